@@ -1,5 +1,7 @@
+import json
 import shutil
 import os
+import subprocess
 Import("env", "projenv")
 
 
@@ -26,6 +28,41 @@ def prefix(env):
     return out
 
 
+# Размеры прошивок всех собранных окружений копятся в .pio/sizes.json,
+# вариант с зафиксированными типами входов (COUNTERn_TYPE) сравнивается
+# с окружением из custom_size_base, если оно уже собрано.
+
+
+def report_size(source, target, env):
+    elf = target[0].get_abspath()
+    out = subprocess.run(["avr-size", "-A", elf], capture_output=True, text=True).stdout
+    sections = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith('.') and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    flash = sections.get('.text', 0) + sections.get('.data', 0)
+    ram = sections.get('.data', 0) + sections.get('.bss', 0)
+
+    sizes_path = os.path.join(env.subst("$PROJECT_DIR"), ".pio", "sizes.json")
+    try:
+        with open(sizes_path) as f:
+            sizes = json.load(f)
+    except (OSError, ValueError):
+        sizes = {}
+    env_name = env["PIOENV"]
+    sizes[env_name] = {"flash": flash, "ram": ram}
+    with open(sizes_path, 'w') as f:
+        json.dump(sizes, f, indent=1)
+
+    line = f"SIZE: {env_name} flash {flash} B, RAM {ram} B"
+    base = env.GetProjectOption("custom_size_base", "")
+    if base and base in sizes:
+        line += (f", vs {base}: flash {flash - sizes[base]['flash']:+d} B,"
+                 f" RAM {ram - sizes[base]['ram']:+d} B")
+    print(line)
+
+
 def copy_file(source, target, env, postfix=''):
     
     file_path = target[0].get_abspath()
@@ -39,6 +76,8 @@ def copy_file(source, target, env, postfix=''):
 
 env.AddPostAction("$BUILD_DIR/${PROGNAME}.hex", lambda source, target, env: copy_file(source, target, env))
 
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_size)
+
 env.AddPostAction(
 	"$BUILD_DIR/${PROGNAME}.elf",
 	env.VerboseAction("avr-objdump -d $BUILD_DIR/${PROGNAME}.elf > $BUILD_DIR/${PROGNAME}.lss", "Creating $BUILD_DIR/${PROGNAME}.lss")
@@ -49,6 +49,51 @@ void ESPPowerPin::extend_wake_up()
     wake_up_timestamp = millis();
 }
 
+EMPTY_INTERRUPT(ADC_vect);
+
+// Запускает преобразование и ждет результата.
+// В режиме IDLE (включена ESP) USI обслуживает i2c и без clkIO не работает,
+// поэтому ждем без сна. Иначе спим в ADC Noise Reduction: вход в сон сам запускает
+// преобразование, а будить может и watchdog, и фронт входа - спим, пока не готово.
+static void adc_convert()
+{
+    uint8_t mode = MCUCR & (_BV(SM1) | _BV(SM0));
+    if (mode == SLEEP_MODE_IDLE)
+    {
+        ADCSRA |= _BV(ADSC);
+        while (bit_is_set(ADCSRA, ADSC));
+        return;
+    }
+
+    set_sleep_mode(SLEEP_MODE_ADC);
+    ADCSRA |= _BV(ADIE);
+    cli();
+    sleep_enable();
+    sei();
+    sleep_cpu(); // без гонки: после sei следующая инструкция выполняется до прерывания
+    for (;;)
+    {
+        cli();
+        if (bit_is_clear(ADCSRA, ADSC))
+            break;
+        sei();
+        sleep_cpu();
+    }
+    sleep_disable();
+    sei();
+    ADCSRA &= ~_BV(ADIE);
+    MCUCR = (MCUCR & ~(_BV(SM1) | _BV(SM0))) | mode;
+}
+
+uint16_t adc_read(const uint8_t channel)
+{
+    power_adc_enable();
+    ADMUX = _BV(ADLAR) | (channel & 0x0F); // опорное - Vcc, как у analogRead
+    ADCSRA = _BV(ADEN) | ADC_FAST_PRESCALER;
+    adc_convert();
+    return (uint16_t)ADCH << 2;
+}
+
 /*
     стандартная константа калибровки вольтметра в attiny
 */
@@ -64,13 +109,12 @@ uint16_t readVcc()
 
     // Включаем ADC
     power_adc_enable();
-    adc_enable();
+    ADCSRA = _BV(ADEN) | _BV(ADPS1) | _BV(ADPS0); // деление на 8: 10 бит, adc_read мог поставить 4
 
     ADMUX = _BV(MUX3) | _BV(MUX2);   // attiny85
 
     delay(2); // Wait for Vref to settle. See Table 17-4. Input Channel Selections
-    ADCSRA |= _BV(ADSC); // Start conversion
-    while (bit_is_set(ADCSRA,ADSC)); // measuring
+    adc_convert();
 
     uint8_t low  = ADCL; // must read ADCL first - it then locks ADCH
     uint8_t high = ADCH; // unlocks both
@@ -35,4 +35,16 @@ struct ESPPowerPin
 // Измеряем напряжение питания Attiny85
 uint16_t readVcc();
 
+/*
+    Быстрое чтение входа для счетчиков: 8 старших бит (ADLAR), делитель
+    частоты ADC 4 (250кГц при 1МГц) - для 8 бит точности хватает, преобразование
+    вдвое короче, чем у analogRead. Пороги LIMIT_* десятибитные, поэтому
+    результат возвращается в шкале 0..1020 с шагом 4.
+    Вне сеанса связи с ESP на время преобразования процессор спит
+    в режиме ADC Noise Reduction. После чтений ADC выключает вызывающий.
+*/
+#define ADC_FAST_PRESCALER _BV(ADPS1) // деление на 4
+
+uint16_t adc_read(const uint8_t channel);
+
 #endif
@@ -54,6 +54,52 @@
 */
 #define WAKEUP_PERIOD_DEFAULT 15L * ONE_MINUTE
 
+/*
+    Период снимков показаний для интервальных данных (тиков watchdog).
+    ESP забирает историю снимков по i2c за одно пробуждение.
+*/
+#define SNAPSHOT_PERIOD 60L * ONE_MINUTE
+#define SNAPSHOT_PERIOD_MIN 60
+
+/*
+    Количество снимков в памяти: сутки при периоде 60 мин
+*/
+#define SNAPSHOT_COUNT 24
+
+/*
+    Снимков в одной странице ответа по i2c (по 4 байта)
+*/
+#define SNAPSHOT_PAGE_COUNT 5
+#define SNAPSHOT_PAGE_SIZE 20
+
+
+/*
+    Протокол i2c: версия и возможности прошивки (команда 'I')
+*/
+#define I2C_PROTO_VERSION 1
+#define CAP_BULK 0x01      // заголовок одной транзакцией ('D')
+#define CAP_SNAPSHOTS 0x02 // история снимков ('H', 'h')
+#define CAP_FIELDS 0x04    // чтение отдельных полей по тегам ('R')
+#define CAP_WDT_RATES 0x08 // статистика периодов watchdog (TAG_WDT_RATES)
+#define CAP_STORAGE 0x10   // износ EEPROM (TAG_STORAGE)
+#define CAP_FLOW_ALARM 0x20 // детектор протечки и прорыва (TAG_FLOW_ALARM, ALARM_TRANSMIT_MODE)
+#define CAP_FLOW_STATS 0x40 // статистика расхода по входам ('F', 'f')
+#define CAP_PULSE_LOG 0x80  // интервалы между последними импульсами ('L')
+
+/*
+    Теги полей для команды 'R'. Ответ: длина, затем [тег, размер, значение]..., crc.
+    Неизвестные теги пропускаются, новые поля добавляются новыми тегами.
+*/
+#define TAG_SERVICE 1  // uint8_t причина перезагрузки и флаги импульсов
+#define TAG_VOLTAGE 2  // uint16_t напряжение, мВ
+#define TAG_CONFIG 3   // Config
+#define TAG_COUNTERS 4 // Data
+#define TAG_ADC 5      // ADCLevel
+#define WDT_RATES 4     // периоды watchdog: 250мс << rate
+#define TAG_WDT_RATES 6 // uint16_t[4] минут на периодах watchdog 250мс, 500мс, 1с, 2с за прошлый сон
+#define TAG_STORAGE 7   // uint32_t записей показаний в EEPROM, uint32_t оставшийся ресурс записей
+#define TAG_FLOW_ALARM 8 // uint8_t тревоги: биты 0-1 вход 1, биты 2-3 вход 2 (FLOW_ALARM_LEAK, FLOW_ALARM_BURST)
+#define TAG_EEPROM_SKIPPED 9 // uint32_t байт, не записанных в EEPROM с включения: в ячейке то же значение
 
 /*
     Аварийное отключение, если ESP зависнет и не пришлет команду "сон".
@@ -66,6 +112,12 @@
 */
 #define SETUP_TIME_MSEC 600000UL
 
+/*
+    После команды "сон" ESP еще столько милисекунд завершает работу,
+    затем питание ESP выключается.
+*/
+#define ESP_SLEEP_DELAY_MSEC 20
+
 /*
     время долгого нажатия кнопки, милисекунд
 */
@@ -153,6 +205,18 @@ struct Header
     uint8_t reserved3;
 }; // 24 байт
 
+/*
+    История приростов показаний
+*/
+struct Snapshots
+{
+    uint8_t count;                      // количество снимков
+    uint8_t head;                       // индекс следующего снимка
+    Data base;                          // показания на момент последнего снимка
+    uint16_t delta0[SNAPSHOT_COUNT];    // прирост импульсов за период, вход 0
+    uint16_t delta1[SNAPSHOT_COUNT];    //                              вход 1
+};
+
 #define HEADER_DATA_SIZE 22
 
 #define TX_BUFFER_SIZE HEADER_DATA_SIZE + 2
@@ -162,5 +226,6 @@ struct Header
 #define ct_assert(e) enum { ASSERT_CONCAT(assert_line_, __LINE__) = 1/(!!(e)) }
 
 ct_assert(sizeof(Header)==24);
+ct_assert(SNAPSHOT_PAGE_SIZE + 1 <= TX_BUFFER_SIZE);
 
 #endif
\ No newline at end of file
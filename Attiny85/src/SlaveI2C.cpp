@@ -4,18 +4,28 @@
 #include <Arduino.h>
 #include "Storage.h"
 #include "Power.h"
+#include "flow.h"
 #include <Wire.h>
 
 extern struct Header info;
 extern void saveConfig();
 extern uint32_t wakeup_period;
 extern void extendWakeUpPeriod();
+extern struct Snapshots history;
+extern volatile uint16_t snapshot_ticks;
+extern uint32_t rate_ticks[];
+extern SeqStorage<Data> storage;
+extern uint8_t flowAlarms();
+extern const FlowStats &flowStats(uint8_t channel);
+extern void clearFlowStats();
+extern void writePulseLog(uint8_t *buf);
 
 /* Static declaration */
 uint8_t SlaveI2C::txBufferPos = 0;
 uint8_t SlaveI2C::txBuffer[TX_BUFFER_SIZE];
 uint8_t SlaveI2C::setup_mode = TRANSMIT_MODE;
 bool SlaveI2C::masterSentSleep = false;
+uint8_t SlaveI2C::bulkLength = 0;
 
 void SlaveI2C::begin(const uint8_t mode)
 {
@@ -35,6 +45,14 @@ void SlaveI2C::end()
 
 void SlaveI2C::requestEvent()
 {
+    if (bulkLength)
+    {
+        // Отдаем сразу весь ответ (сколько поместится в буфер Wire): мастер читает его одной транзакцией.
+        // Ровно bulkLength байт, чтобы в буфере Wire не остались хвосты для следующей команды
+        if (txBufferPos < bulkLength)
+            txBufferPos += Wire.write(&txBuffer[txBufferPos], bulkLength - txBufferPos);
+        return;
+    }
     Wire.write(txBuffer[txBufferPos]);
     if (txBufferPos + 1 < TX_BUFFER_SIZE)
         txBufferPos++; // Avoid buffer overrun if master misbehaves
@@ -44,6 +62,7 @@ void SlaveI2C::newCommand()
 {
     memset(txBuffer, 0xAA, TX_BUFFER_SIZE); // Zero the tx buffer (with 0xAA so master has a chance to see he is stupid)
     txBufferPos = 0;                        // The next read from master starts from begining of buffer
+    bulkLength = 0;
 }
 
 /* Depending on the received command from master, set up the content of the txbuffer so he can get his data */
@@ -61,6 +80,11 @@ void SlaveI2C::receiveEvent(int howMany)
         info.crc = crc_8((unsigned char *)&info, HEADER_DATA_SIZE);
         memcpy(txBuffer, &info, TX_BUFFER_SIZE);
         break;
+    case 'D': // данные одной транзакцией (с версии 39)
+        info.crc = crc_8((unsigned char *)&info, HEADER_DATA_SIZE);
+        memcpy(txBuffer, &info, TX_BUFFER_SIZE);
+        bulkLength = HEADER_DATA_SIZE + 1;
+        break;
     case 'Z': // Готовы ко сну
         masterSentSleep = true;
         break;
@@ -87,6 +111,35 @@ void SlaveI2C::receiveEvent(int howMany)
     case 'V': // обновить напряжение
         info.voltage = readVcc();
         break;
+    case 'I': // ESP спрашивает версию протокола и возможности (с версии 40)
+        txBuffer[0] = I2C_PROTO_VERSION;
+        txBuffer[1] = CAP_BULK | CAP_SNAPSHOTS | CAP_FIELDS | CAP_WDT_RATES | CAP_STORAGE | CAP_FLOW_ALARM | CAP_FLOW_STATS | CAP_PULSE_LOG;
+        txBuffer[2] = TX_BUFFER_SIZE;
+        txBuffer[3] = crc_8(txBuffer, 3);
+        bulkLength = 4;
+        break;
+    case 'R': // ESP забирает только нужные поля
+        getFields();
+        break;
+    case 'H': // ESP забирает страницу истории снимков
+        getSnapshotsPage();
+        break;
+    case 'G': // то же одной транзакцией (с версии 40)
+        getSnapshotsPage();
+        bulkLength = SNAPSHOT_PAGE_SIZE + 1;
+        break;
+    case 'h': // ESP отправил историю на сервер
+        history.count = 0;
+        break;
+    case 'F': // ESP забирает статистику расхода одной транзакцией (с версии 45)
+        getFlowStats();
+        break;
+    case 'f': // ESP отправил статистику на сервер
+        clearFlowStats();
+        break;
+    case 'L': // ESP забирает интервалы между импульсами одной транзакцией (с версии 47)
+        getPulseLog();
+        break;
     }
 }
 
@@ -123,6 +176,140 @@ void SlaveI2C::getCounterTypes()
     }
 }
 
+/*
+    Страница 0: кол-во снимков, период в мин, возраст последнего снимка в мин, показания на момент снимка.
+    Страницы 1..: приросты по SNAPSHOT_PAGE_COUNT снимков от старых к новым.
+*/
+void SlaveI2C::getSnapshotsPage()
+{
+    uint8_t page = Wire.read();
+
+    if (page == 0)
+    {
+        uint16_t age = snapshot_ticks / ONE_MINUTE;
+        txBuffer[0] = history.count;
+        txBuffer[1] = SNAPSHOT_PERIOD_MIN;
+        memcpy(&txBuffer[2], &age, sizeof(age));
+        memcpy(&txBuffer[4], &history.base, sizeof(Data));
+    }
+    else
+    {
+        uint8_t first = (page - 1) * SNAPSHOT_PAGE_COUNT;
+        for (uint8_t i = 0; (i < SNAPSHOT_PAGE_COUNT) && (first + i < history.count); i++)
+        {
+            uint8_t index = (history.head + SNAPSHOT_COUNT - history.count + first + i) % SNAPSHOT_COUNT;
+            memcpy(&txBuffer[i * 4], &history.delta0[index], sizeof(uint16_t));
+            memcpy(&txBuffer[i * 4 + 2], &history.delta1[index], sizeof(uint16_t));
+        }
+    }
+    txBuffer[SNAPSHOT_PAGE_SIZE] = crc_8(txBuffer, SNAPSHOT_PAGE_SIZE);
+}
+
+/*
+    После команды 'R' идут теги полей. Поля, которые не поместились в буфер
+    или неизвестны, в ответ не попадают.
+*/
+void SlaveI2C::getFields()
+{
+    uint8_t len = 0;
+    while (Wire.available())
+    {
+        uint8_t tag = Wire.read();
+        const uint8_t *field;
+        uint8_t size;
+        switch (tag)
+        {
+        case TAG_SERVICE:
+            field = (const uint8_t *)&info + 1; // битовые поля service, on_pulse0, on_pulse1
+            size = 1;
+            break;
+        case TAG_VOLTAGE:
+            field = (const uint8_t *)&info.voltage;
+            size = sizeof(info.voltage);
+            break;
+        case TAG_CONFIG:
+            field = (const uint8_t *)&info.config;
+            size = sizeof(Config);
+            break;
+        case TAG_COUNTERS:
+            field = (const uint8_t *)&info.data;
+            size = sizeof(Data);
+            break;
+        case TAG_ADC:
+            field = (const uint8_t *)&info.adc;
+            size = sizeof(ADCLevel);
+            break;
+        case TAG_WDT_RATES:
+        case TAG_STORAGE:
+            field = nullptr; // вычисляемое поле
+            size = 2 * sizeof(uint32_t);
+            break;
+        case TAG_FLOW_ALARM:
+            field = nullptr;
+            size = 1;
+            break;
+        case TAG_EEPROM_SKIPPED:
+            field = (const uint8_t *)&eeprom_skipped;
+            size = sizeof(eeprom_skipped);
+            break;
+        default:
+            continue;
+        }
+        if (len + size + 4 > TX_BUFFER_SIZE) // длина, тег, размер, crc
+            break;
+        txBuffer[1 + len] = tag;
+        txBuffer[2 + len] = size;
+        if (field)
+        {
+            memcpy(&txBuffer[3 + len], field, size);
+        }
+        else if (tag == TAG_WDT_RATES)
+        {
+            for (uint8_t i = 0; i < WDT_RATES; i++)
+            {
+                uint16_t minutes = rate_ticks[i] / ONE_MINUTE;
+                memcpy(&txBuffer[3 + len + i * sizeof(uint16_t)], &minutes, sizeof(uint16_t));
+            }
+        }
+        else if (tag == TAG_FLOW_ALARM)
+        {
+            txBuffer[3 + len] = flowAlarms();
+        }
+        else
+        {
+            uint32_t value[2] = {storage.writes(), storage.endurance_left()};
+            memcpy(&txBuffer[3 + len], value, sizeof(value));
+        }
+        len += size + 2;
+    }
+    txBuffer[0] = len;
+    txBuffer[1 + len] = crc_8(txBuffer, len + 1);
+    bulkLength = TX_BUFFER_SIZE; // мастер не знает длину заранее и читает весь буфер
+}
+
+/*
+    Статистика расхода: FlowStats входа 1, затем входа 2, crc
+*/
+void SlaveI2C::getFlowStats()
+{
+    memcpy(txBuffer, &flowStats(0), sizeof(FlowStats));
+    memcpy(txBuffer + sizeof(FlowStats), &flowStats(1), sizeof(FlowStats));
+    txBuffer[2 * sizeof(FlowStats)] = crc_8(txBuffer, 2 * sizeof(FlowStats));
+    bulkLength = 2 * sizeof(FlowStats) + 1;
+}
+
+/*
+    Интервалы между импульсами: PulseLog входа 1, затем входа 2, crc
+*/
+ct_assert(2 * PULSE_LOG_CHANNEL_SIZE + 1 <= TX_BUFFER_SIZE);
+
+void SlaveI2C::getPulseLog()
+{
+    writePulseLog(txBuffer);
+    txBuffer[2 * PULSE_LOG_CHANNEL_SIZE] = crc_8(txBuffer, 2 * PULSE_LOG_CHANNEL_SIZE);
+    bulkLength = 2 * PULSE_LOG_CHANNEL_SIZE + 1;
+}
+
 bool SlaveI2C::masterGoingToSleep()
 {
     return masterSentSleep;
@@ -8,6 +8,7 @@
 #define SETUP_MODE 1
 #define TRANSMIT_MODE 2
 #define MANUAL_TRANSMIT_MODE 3
+#define ALARM_TRANSMIT_MODE 4 // внеочередное пробуждение: протечка или прорыв
 
 class SlaveI2C
 {
@@ -17,6 +18,7 @@ protected:
     static uint8_t setup_mode;
 
     static bool masterSentSleep;
+    static uint8_t bulkLength; // длина ответа, отдаваемого одной транзакцией, 0 - побайтно
 
     static void requestEvent();
     static void newCommand();
@@ -24,6 +26,10 @@ protected:
     static void getWakeUpPeriod();
     static void getCounterTypes();
     static void extendWakeUp();
+    static void getSnapshotsPage();
+    static void getFields();
+    static void getFlowStats();
+    static void getPulseLog();
 
 public:
     void begin(const uint8_t);
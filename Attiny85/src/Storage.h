@@ -8,6 +8,9 @@
 
 uint8_t crc_8(unsigned char *input_str, size_t num_bytes);
 
+// Байт, которые не пришлось записывать в EEPROM: значение в ячейке уже то же
+extern uint32_t eeprom_skipped;
+
 template <class T>
 class EEPROMStorage
 {
@@ -45,4 +48,44 @@ private:
     int8_t compare(const uint8_t block1, const uint8_t block2);
 };
 
+#define EEPROM_ENDURANCE 100000UL // Гарантированное число перезаписей ячейки EEPROM
+
+template <class T>
+class SeqStorage
+{
+    /*
+    Журнал показаний с выравниванием износа, занимает всю свободную EEPROM после
+    EEPROMStorage. Блок: |T|seq|crc|, seq - номер записи с начала работы,
+    crc считается по T и seq.
+
+    Блоки пишутся по кругу, поэтому до головы seq[i] == seq[0] + i, а после - меньше
+    на blocks. Голова находится двоичным поиском за log2(blocks) чтений блоков; если
+    попался испорченный блок или круг еще не пройден, читаются все блоки.
+
+    |T|seq|crc|T|seq|crc|...|
+
+    seq головы - общее число записей, по нему оценивается оставшийся ресурс.
+    */
+
+public:
+    explicit SeqStorage(const uint16_t _start_addr, const uint16_t _end_addr);
+    bool init();
+    bool add(const T &element);
+    void get(T &element);
+
+    uint32_t writes() { return seq; }
+    uint32_t endurance_left();
+    uint16_t size();
+
+private:
+    uint16_t start_addr;
+    uint8_t blocks;
+    uint8_t head;
+    uint32_t seq;
+
+    uint16_t addr(const uint8_t block);
+    bool read_seq(const uint8_t block, uint32_t &block_seq);
+    bool scan();
+};
+
 #endif
@@ -95,6 +95,12 @@ struct ButtonB
 
         return press != ButtonPressType::NONE;
     }
+
+    // Нажатие не идет: длительность нажатия считается тактами 250мс
+    inline bool idle()
+    {
+        return on_time == 0;
+    }
 };
 #endif
 
@@ -129,6 +135,11 @@ struct ButtonB2
 
         return false;
     }
+
+    inline bool idle()
+    {
+        return true;
+    }
 };
 #endif
 
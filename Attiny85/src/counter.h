@@ -42,6 +42,21 @@
 #endif
 
 
+/*
+    Простой DISCRETE: без замыканий DISCRETE_IDLE_TICKS тактов по 250мс разомкнутый
+    вход не опрашивается совсем: включаем подтяжку (ток через разомкнутый контакт
+    не идет) и ждем замыкания по прерыванию.
+    NAMUR читается через АЦП, прерывания по замыканию у него нет, поэтому он
+    опрашивается каждые 250мс всегда: реже - и короткий импульс можно пропустить.
+
+    Период watchdog, который нужен входу, см. rate(): 250мс, 500мс, 1с, 2с.
+    DISCRETE опрашивается только по 250мс, пока не ждет прерывания: при редком
+    опросе замыкание 250мс попадает не больше чем в один такт, а начало импульса
+    требует двух подряд (11). Так импульс (250мс замыкание + 750мс размыкание)
+    не теряется. Первое замыкание снимает ожидание и возвращает опрос 250мс.
+*/
+#define DISCRETE_IDLE_TICKS (10 * 4) // 10 сек
+
 enum CounterState
 {
     CLOSE,
@@ -59,6 +74,14 @@ enum CounterType
     NONE = 0xFF
 };
 
+/*
+    Тип входа можно зафиксировать при сборке: -DCOUNTER0_TYPE=DISCRETE
+    (имя из CounterType). Тогда switch по типу сворачивается компилятором,
+    обработчики других типов не попадают в прошивку, а тип из настроек ESP
+    игнорируется. COUNTER_TYPE_ANY - тип задается настройками (обычная прошивка).
+*/
+#define COUNTER_TYPE_ANY 0xFE
+
 enum class CounterEvent
 {
     NONE,
@@ -67,7 +90,8 @@ enum class CounterEvent
 };
 
 
-struct CounterB
+template <uint8_t FIXED_TYPE>
+struct CounterT
 {
     uint8_t         _pin;       // дискретный вход
     uint8_t         _power;     // питание датчика
@@ -83,29 +107,49 @@ struct CounterB
     CounterState    state;      // состояние входа
     CounterType     type;       // тип выхода счетчика
 
-    explicit CounterB(uint8_t pin, uint8_t apin = 0, uint8_t power = (uint8_t)-1)
-        : _pin(pin), _power(power), _apin(apin), on_time(0), off_time(0), adc(0), state(CounterState::CLOSE), type(CounterType::NAMUR)
+    uint16_t        idle;       // тактов без замыкания (до DISCRETE_IDLE_TICKS)
+    bool            armed;      // в простое ждем замыкания по прерыванию
+
+    explicit CounterT(uint8_t pin, uint8_t apin = 0, uint8_t power = (uint8_t)-1)
+        : _pin(pin), _power(power), _apin(apin), on_time(0), off_time(0), adc(0), state(CounterState::CLOSE), type(CounterType::NAMUR),
+          idle(0), armed(false)
     {
         set_type(type);
     }
 
+    // Тип, по которому работает вход: константа, если зафиксирован при сборке
+    inline CounterType kind() const
+    {
+        return FIXED_TYPE == COUNTER_TYPE_ANY ? type : (CounterType)FIXED_TYPE;
+    }
+
     void set_type(CounterType new_type)
     {
-        if ((type == CounterType::HALL) && (_power != (uint8_t)-1)) {
+        if (FIXED_TYPE != COUNTER_TYPE_ANY)
+        {
+            new_type = (CounterType)FIXED_TYPE;
+        }
+        if ((kind() == CounterType::HALL) && (_power != (uint8_t)-1)) {
             DDRB &= ~_BV(_power);       // Пин питания датчика возвращаем на вход
         }
         type = new_type;
-        if ((type == CounterType::HALL) && (_power == (uint8_t)-1))
+        if ((kind() == CounterType::HALL) && (_power == (uint8_t)-1))
         {
             type = CounterType::NONE;
         }
+        idle = 0;
+        armed = false;
         switch (type)
         {
             case CounterType::ELECTRONIC:
                 PORTB |= _BV(_pin);                 // Включить pull-up
 		        PCMSK |= _BV(_pin);                 // Включем прерывание по фронту
+                DDRB &= ~_BV(_pin);                 // Вход
+                break;
             case CounterType::DISCRETE:
             case CounterType::NAMUR:
+                PCMSK &= ~_BV(_pin);                // Прерывание только в простое
+                PORTB &= ~_BV(_pin);                // Отключить pull-up
                 DDRB &= ~_BV(_pin);                 // Вход
                 break;
             case CounterType::HALL:
@@ -124,17 +168,15 @@ struct CounterB
 
     inline uint16_t aRead()
     {
-	    power_adc_enable();
-	    adc_enable();
-        return analogRead(_apin);
+        return adc_read(_apin);
     }
 
-    bool electronic(CounterEvent event)
+    bool electronic(uint8_t pins)
     {
         if (on_time)
             on_time -= 1;
 
-        state = bit_is_set(PINB, _pin) ? CounterState::OPEN : CounterState::CLOSE;
+        state = bit_is_set(pins, _pin) ? CounterState::OPEN : CounterState::CLOSE;
         if (state == CounterState::CLOSE)
         {
             // Замкнут
@@ -219,20 +261,40 @@ struct CounterB
         return false;
     }
 
-    bool discrete(CounterEvent event)
+    /*
+    Начало опроса DISCRETE/NAMUR: нужно ли опрашивать вход в этот такт.
+    Если да - включает pull-up. Пауза на зарядку входа и чтение PINB общие
+    для всех входов, см. counting().
+    DISCRETE в простое ждет замыкания по прерыванию, см. DISCRETE_IDLE_TICKS.
+    */
+    bool scan_begin(CounterEvent event)
+    {
+        if (kind() != CounterType::NAMUR && kind() != CounterType::DISCRETE)
+            return false;
+        if (armed)
+        {
+            // Ждем замыкания: ложные фронты (кнопка, другой вход) и такты пропускаем
+            if (event != CounterEvent::FRONT || bit_is_set(PINB, _pin))
+                return false;
+            PCMSK &= ~_BV(_pin);
+            armed = false;
+        }
+        else if (event == CounterEvent::FRONT) 
+            return false;
+
+        PORTB |= _BV(_pin);                 // Включить pull-up
+        return true;
+    }
+
+    bool discrete(uint8_t ticks, uint8_t pins)
     {   
         /*
-        Вызывается раз в 250мс
+        Вызывается раз в 250мс после scan_begin(), pins - PINB после паузы
         Заполняем байт levels битами со смещением влево. 1 - если замкнут вход.
         Если 11, то начало импульса.
         Если было начало импульса и теперь 11000, то детектируем конец импульса и возвращаем true.
         */
-        if (event == CounterEvent::FRONT) 
-            return false;
-
-        PORTB |= _BV(_pin);                 // Включить pull-up
-        delayMicroseconds(30);
-        if (type == CounterType::NAMUR)
+        if (kind() == CounterType::NAMUR)
         {
             uint16_t a = aRead();
             state = value2state(a);
@@ -243,7 +305,7 @@ struct CounterB
         }
         else
         {
-            state = bit_is_set(PINB, _pin) ? CounterState::OPEN : CounterState::CLOSE;
+            state = bit_is_set(pins, _pin) ? CounterState::OPEN : CounterState::CLOSE;
             if ((state == CounterState::CLOSE) && !on_pulse)
             {
                 adc = aRead();
@@ -251,8 +313,24 @@ struct CounterB
         }
         PORTB &= ~_BV(_pin);                // Отключить pull-up
         
+        bool closed = (state == CounterState::CLOSE || state == CounterState::NAMUR_CLOSE);
         levels = levels << 1;
-        levels |= ((state == CounterState::CLOSE || state == CounterState::NAMUR_CLOSE) & 1);
+        levels |= closed & 1;
+
+        if (closed || on_pulse)
+        {
+            idle = 0;
+        }
+        else if (idle < DISCRETE_IDLE_TICKS)
+        {
+            idle += ticks;
+        }
+        else if (kind() == CounterType::DISCRETE)
+        {
+            PORTB |= _BV(_pin);             // pull-up до замыкания, ток не идет
+            PCMSK |= _BV(_pin);             // Разбудит замыкание
+            armed = true;
+        }
 
         if (on_time)
             on_time -= 1;
@@ -274,23 +352,45 @@ struct CounterB
         return false;
     }
 
-    bool is_impuls(CounterEvent event = CounterEvent::NONE)
+    // ticks - сколько тактов по 250мс прошло с прошлого опроса по времени,
+    // polled - результат scan_begin(), pins - общее чтение PINB
+    bool is_impuls(CounterEvent event, uint8_t ticks, bool polled, uint8_t pins)
     {
-        switch (type) 
+        switch (kind()) 
         {
             case CounterType::ELECTRONIC:
-                return electronic(event);
+                return electronic(pins);
             case CounterType::HALL:
                 return hall(event);
             case CounterType::NAMUR:
             case CounterType::DISCRETE:
-                return discrete(event);
+                return polled && discrete(ticks, pins);
             case CounterType::NONE:
             default:
                 return false;
         }
     }
 
+    // Нужный входу период watchdog: 0 - 250мс, 1 - 500мс, 2 - 1с, 3 - 2с
+    uint8_t rate()
+    {
+        switch (kind())
+        {
+            case CounterType::NAMUR:
+                // Без прерывания: только частый опрос ловит короткое замыкание
+                return 0;
+            case CounterType::DISCRETE:
+                // Замыкание разбудит прерывание, иначе только частый опрос
+                return armed ? 3 : 0;
+            case CounterType::HALL:
+                // Пока идет потребление, фронты ловит прерывание, но время считается тактами
+                return active ? 0 : 2;
+            default:
+                // ELECTRONIC по прерыванию, такты нужны только светодиоду
+                return 3;
+        }
+    }
+
     // Возвращаем текущее состояние входа
     inline CounterState value2state(uint16_t value)
     {
@@ -313,4 +413,6 @@ struct CounterB
     }
 };
 
+typedef CounterT<COUNTER_TYPE_ANY> CounterB;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,185 @@
+#ifndef _FLOW_h
+#define _FLOW_h
+
+#include <Arduino.h>
+
+/*
+    Статистика расхода за период между передачами (команда i2c 'F'):
+    использование - расход после FLOW_EVENT_GAP_MIN минут без импульсов.
+*/
+#define FLOW_EVENT_GAP_MIN 2
+
+struct FlowStats
+{
+    uint8_t max_ppm;      // максимум импульсов в минуту
+    uint8_t events;       // количество использований
+    uint16_t longest_min; // самый долгий непрерывный расход, мин
+    uint16_t zero_min;    // минут без расхода
+}; // 6 байт
+
+/*
+    Детектор протечки и прорыва и статистика по импульсам одного входа. Считает поминутно:
+    - протечка: расход без перерыва (окна FLOW_QUIET_MIN минут без импульсов)
+      дольше FLOW_LEAK_MIN минут;
+    - прорыв: FLOW_BURST_MIN минут подряд не меньше FLOW_BURST_PULSES импульсов в минуту.
+    Тревога сообщается ESP один раз, следующая - после того, как расход прекратился.
+*/
+#define FLOW_QUIET_MIN 15       // окно без расхода, мин
+#define FLOW_LEAK_MIN (4 * 60)  // расход без окна простоя, мин
+#define FLOW_BURST_PULSES 5     // импульсов в минуту (50 л/мин при 10 л/имп)
+#define FLOW_BURST_MIN 5        // минут подряд
+
+// Флаги тревоги (TAG_FLOW_ALARM): вход 1 - младшие биты, вход 2 - сдвиг на 2
+#define FLOW_ALARM_LEAK 0x01
+#define FLOW_ALARM_BURST 0x02
+
+struct FlowDetector
+{
+    uint8_t pulses;     // импульсов за текущую минуту
+    uint8_t quiet_min;  // минут подряд без импульсов
+    uint16_t flow_min;  // минут расхода после последнего окна простоя
+    uint8_t burst_min;  // минут подряд с большим расходом
+    uint8_t reported;   // тревоги, уже переданные ESP
+    uint16_t run_min;   // минут подряд с импульсами
+    FlowStats stats;
+
+    FlowDetector()
+        : pulses(0), quiet_min(FLOW_QUIET_MIN), flow_min(0), burst_min(0), reported(0), run_min(0), stats()
+    {}
+
+    inline void pulse()
+    {
+        if (pulses < 0xFF)
+            pulses++;
+    }
+
+    // Вызывается раз в минуту
+    void minute()
+    {
+        if (pulses)
+        {
+            if (quiet_min >= FLOW_EVENT_GAP_MIN && stats.events < 0xFF)
+                stats.events++;
+            if (pulses > stats.max_ppm)
+                stats.max_ppm = pulses;
+            if (run_min < 0xFFFF)
+                run_min++;
+            if (run_min > stats.longest_min)
+                stats.longest_min = run_min;
+            quiet_min = 0;
+        }
+        else
+        {
+            run_min = 0;
+            if (stats.zero_min < 0xFFFF)
+                stats.zero_min++;
+            if (quiet_min < FLOW_QUIET_MIN)
+                quiet_min++;
+        }
+
+        if (quiet_min >= FLOW_QUIET_MIN)
+        {
+            flow_min = 0;
+            reported &= ~FLOW_ALARM_LEAK;
+        }
+        else if (flow_min < 0xFFFF)
+        {
+            flow_min++;
+        }
+
+        if (pulses >= FLOW_BURST_PULSES)
+        {
+            if (burst_min < 0xFF)
+                burst_min++;
+        }
+        else
+        {
+            burst_min = 0;
+            reported &= ~FLOW_ALARM_BURST;
+        }
+        pulses = 0;
+    }
+
+    inline uint8_t alarm() const
+    {
+        return (flow_min >= FLOW_LEAK_MIN ? FLOW_ALARM_LEAK : 0) | (burst_min >= FLOW_BURST_MIN ? FLOW_ALARM_BURST : 0);
+    }
+
+    // Тревоги, о которых ESP еще не знает
+    inline uint8_t pending() const
+    {
+        return alarm() & ~reported;
+    }
+
+    inline void report()
+    {
+        reported |= alarm();
+    }
+
+    // ESP отправила статистику на сервер. Непрерывный расход продолжается
+    inline void clear_stats()
+    {
+        stats = FlowStats();
+        stats.longest_min = run_min;
+    }
+};
+
+/*
+    Интервалы между последними PULSE_LOG_SIZE импульсами входа (команда i2c 'L'):
+    по ним ESP считает текущий и пиковый расход точнее периода передачи.
+    Интервал в тактах watchdog 250мс сжат в байт: 3 бита порядка и 5 бит
+    мантиссы, точность ~3%, до 4032 тактов (16,8 мин). Больше - PULSE_LOG_MAX.
+    Время такта - не точнее текущего периода watchdog (до 2с во сне).
+*/
+#define PULSE_LOG_SIZE 8
+#define PULSE_LOG_MAX 0xFF
+#define PULSE_LOG_CHANNEL_SIZE (2 + PULSE_LOG_SIZE) // количество, возраст, интервалы
+
+static inline uint8_t pulse_log_encode(uint32_t ticks)
+{
+    if (ticks < 32)
+        return ticks;
+    uint8_t order = 1;
+    while (ticks >= 64)
+    {
+        ticks >>= 1;
+        if (++order > 7)
+            return PULSE_LOG_MAX;
+    }
+    return (order << 5) | (ticks - 32);
+}
+
+struct PulseLog
+{
+    uint8_t interval[PULSE_LOG_SIZE]; // кольцо сжатых интервалов
+    uint8_t head;                     // индекс следующего интервала
+    uint8_t count;                    // интервалов в кольце
+    bool started;                     // был импульс после включения
+    uint32_t last;                    // такт последнего импульса
+
+    PulseLog() : interval(), head(0), count(0), started(false), last(0) {}
+
+    inline void pulse(uint32_t now)
+    {
+        if (started)
+        {
+            interval[head] = pulse_log_encode(now - last);
+            head = (head + 1) % PULSE_LOG_SIZE;
+            if (count < PULSE_LOG_SIZE)
+                count++;
+        }
+        started = true;
+        last = now;
+    }
+
+    // Количество, возраст последнего импульса, интервалы от старых к новым
+    void write(uint8_t *buf, uint32_t now) const
+    {
+        buf[0] = count;
+        buf[1] = started ? pulse_log_encode(now - last) : PULSE_LOG_MAX;
+        for (uint8_t i = 0; i < PULSE_LOG_SIZE; i++)
+            buf[2 + i] = i < count ? interval[(head + PULSE_LOG_SIZE - count + i) % PULSE_LOG_SIZE] : 0;
+    }
+};
+
+#endif
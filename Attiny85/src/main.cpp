@@ -8,6 +8,7 @@
 #include "Storage.h"
 #include "counter.h"
 #include "button.h"
+#include "flow.h"
 #include <avr/wdt.h>
 #include <avr/sleep.h>
 #include <avr/power.h>
@@ -21,6 +22,38 @@ TinyDebugSerial mySerial;
 /*
 Версии прошивок
 
+47 - 2026.10.15
+	1. Журнал интервалов между последними 8 импульсами каждого входа (байт на интервал, такты 250мс), команда i2c 'L', возможность CAP_PULSE_LOG
+
+46 - 2026.10.15
+	1. Запись в EEPROM только изменившихся байт (и конфигурации, и показаний), счетчик сэкономленных записей - тег i2c 9
+
+45 - 2026.10.14
+	1. Статистика расхода по входам за период (макс. импульсов в минуту, использования, самый долгий расход, минуты без расхода), команды i2c 'F' и 'f'
+
+44 - 2026.10.14
+	1. Детектор протечки и прорыва: внеочередное пробуждение ESP в режиме ALARM_TRANSMIT_MODE, тег i2c 8
+
+43 - 2026.10.14
+	1. Показания в журнале с номерами записей во всей свободной EEPROM (24 блока), поиск головы двоичным поиском
+	2. Запись только изменившихся показаний, ресурс EEPROM - тег i2c 7
+	3. Старое кольцо показаний обновляется при каждом включении ESP, чтобы можно было вернуть прошивку до 43
+
+42 - 2026.10.14
+	1. Адаптивный период watchdog 250мс/500мс/1с/2с по активности входов, время на каждом периоде - тег i2c 6
+
+41 - 2026.10.14
+	1. Адаптивный опрос входов DISCRETE/NAMUR: в простое реже, разомкнутый DISCRETE ждет прерывания
+
+40 - 2026.10.14
+	1. Команды i2c 'I' (версия протокола и возможности), 'R' (поля по тегам), 'G' (страница снимков одной транзакцией)
+
+39 - 2026.10.14
+	1. Команда i2c 'D': заголовок одной транзакцией
+
+38 - 2026.10.14
+	1. Снимки прироста показаний раз в час (24 шт), команды i2c 'H' и 'h'
+
 33 - 2025.09.29 - dontsov
     1. 250мс замыкание + 750мс размыкание = импульс
 	2. ADC замыкания теперь 150 ~2кОм. Был 170 ~3.5кОм 
@@ -138,8 +171,17 @@ TinyDebugSerial mySerial;
 //
 // https://github.com/SpenceKonde/ATTinyCore/blob/master/avr/extras/ATtiny_x5.md
 
-static CounterB counter0(4, 2, 3); 	// Вход 1, Blynk: V0, горячая вода PB4 ADC2
-static CounterB counter1(3, 3); 	// Вход 2, Blynk: V1, холодная вода (или лог) PB3 ADC3
+// Тип входа, зафиксированный при сборке (см. COUNTER_TYPE_ANY). HALL - только для входа 1:
+// у входа 2 нет пина питания датчика
+#ifndef COUNTER0_TYPE
+#define COUNTER0_TYPE COUNTER_TYPE_ANY
+#endif
+#ifndef COUNTER1_TYPE
+#define COUNTER1_TYPE COUNTER_TYPE_ANY
+#endif
+
+static CounterT<COUNTER0_TYPE> counter0(4, 2, 3); 	// Вход 1, Blynk: V0, горячая вода PB4 ADC2
+static CounterT<COUNTER1_TYPE> counter1(3, 3); 	// Вход 2, Blynk: V1, холодная вода (или лог) PB3 ADC3
 
 static ESPPowerPin esp(1); // Питание на ESP
 
@@ -175,8 +217,13 @@ uint32_t wakeup_period;
 //Кольцовой нужен для того, чтобы превысить лимит записи памяти в 100 000 раз
 //Записывается каждый импульс, поэтому для 10л/импульс срок службы памяти 10 000м3
 // 100к * 20 = 2 млн * 10 л / 2 счетчика = 10 000 000 л или 10 000 м3
-static EEPROMStorage<Data> storage(20); // 8 byte * 20 + crc * 20
-static EEPROMStorage<Config> config(2, storage.size()); // 5 byte * 2 + crc * 2
+// Прошивки до 43 хранили показания здесь. При первом запуске показания переносятся
+// в журнал, а дальше кольцо обновляется при каждом включении ESP (см. syncLegacyStorage),
+// чтобы возвращенная старая прошивка не начала счет с устаревших показаний
+static EEPROMStorage<Data> legacy_storage(20); // 8 byte * 20 + crc * 20
+static EEPROMStorage<Config> config(2, legacy_storage.size()); // 5 byte * 2 + crc * 2
+// Журнал с номерами записей во всей оставшейся EEPROM: 24 блока по 13 байт
+SeqStorage<Data> storage(config.size(), E2END + 1);
 
 SlaveI2C slaveI2C;
 
@@ -184,15 +231,46 @@ volatile uint32_t 		wdt_count;
 volatile CounterEvent 	event;
 volatile uint8_t		storage_write_limit = 0; 
 
+// История приростов показаний для интервальных данных
+struct Snapshots 		history;
+volatile uint16_t 		snapshot_ticks = 0;
+
+// Детекторы протечки и прорыва, считают поминутно
+static FlowDetector		flow0;
+static FlowDetector		flow1;
+volatile uint16_t		flow_ticks = 0;
+
+// Интервалы между импульсами по тактам, которые не сбрасываются
+static PulseLog			pulse_log0;
+static PulseLog			pulse_log1;
+volatile uint32_t		pulse_clock = 0;
+
+// Адаптивный период watchdog: такт 250мс << wdt_rate
+volatile uint8_t		wdt_rate = 0;
+uint32_t				rate_ticks[WDT_RATES];	// тактов 250мс на каждом периоде с прошлой передачи
+
+static const uint8_t wdt_periods[WDT_RATES] = {WDTO_250MS, WDTO_500MS, WDTO_1S, WDTO_2S};
+
 /* Вектор прерываний сторожевого таймера watchdog */
 ISR(WDT_vect)
 {
-	++wdt_count;
+	uint8_t ticks = 1 << wdt_rate;
+	wdt_count += ticks;
+	snapshot_ticks += ticks;
+	flow_ticks += ticks;
+	pulse_clock += ticks;
+	rate_ticks[wdt_rate] += ticks;
 	event = CounterEvent::TIME;
-	if (storage_write_limit > 0)
-	{
-		storage_write_limit--;
-	}
+	storage_write_limit = storage_write_limit > ticks ? storage_write_limit - ticks : 0;
+}
+
+// Меняет период watchdog, отсчет нового периода начинается сразу
+void setWatchdogRate(uint8_t rate)
+{
+	noInterrupts();
+	wdt_enable(wdt_periods[rate]);
+	wdt_rate = rate;
+	interrupts();
 }
 
 /* Вектор прерываний Pin Change */
@@ -201,37 +279,61 @@ ISR(PCINT0_vect)
 	event = CounterEvent::FRONT;
 }
 
+// Часы интервалов импульсов. Вызывается и из прерывания i2c (команда 'L'),
+// поэтому флаг прерываний восстанавливаем, а не включаем
+static inline uint32_t pulseClock()
+{
+	uint8_t sreg = SREG;
+	noInterrupts();
+	uint32_t now = pulse_clock;
+	SREG = sreg;
+	return now;
+}
+
+// Импульс на входе: счет, статистика расхода, уровень ADC, запись в EEPROM
+static inline void add_pulse(uint32_t &value, FlowDetector &flow, PulseLog &log, uint16_t &adc, const uint16_t level)
+{
+	value++; 				//нужен т.к. при пробуждении запрашиваем данные
+	flow.pulse();
+	log.pulse(pulseClock());
+	adc = level;
+	if (storage_write_limit == 0)
+	{
+		storage.add(info.data);
+		storage_write_limit = 60*4;		// пишем в память не чаще раза в минуту
+	}
+}
+
 // Проверяем входы на замыкание.
 // Замыкание засчитывается только при повторной проверке.
-inline void counting(CounterEvent ev)
+// Опрос общий: pull-up всех опрашиваемых входов, одна пауза на зарядку и одно чтение PINB.
+inline void counting(CounterEvent ev, uint8_t ticks = 1)
 {
-	if (counter0.is_impuls(ev))
+	bool poll0 = counter0.scan_begin(ev);
+#ifndef LOG_ON
+	bool poll1 = counter1.scan_begin(ev);
+#else
+	bool poll1 = false;
+#endif
+	if (poll0 || poll1)
+		delayMicroseconds(30);
+	uint8_t pins = PINB;
+
+	if (counter0.is_impuls(ev, ticks, poll0, pins))
 	{
-		info.data.value0++; 				//нужен т.к. при пробуждении запрашиваем данные
-		info.adc.adc0 = counter0.adc;
+		add_pulse(info.data.value0, flow0, pulse_log0, info.adc.adc0, counter0.adc);
 #ifdef LOG_ON
 		LOG(F("Input0:"));
 		LOG(info.data.value0);
 		LOG(F("ADC0:"));
 		LOG(info.adc.adc0);
 #endif
-		if (storage_write_limit == 0)
-		{
-			storage.add(info.data);
-			storage_write_limit = 60*4;		// пишем в память не чаще раза в минуту
-		}
 	}
 	info.on_pulse0 = counter0.on_time > 0;
 #ifndef LOG_ON
-	if (counter1.is_impuls(ev))
+	if (counter1.is_impuls(ev, ticks, poll1, pins))
 	{
-		info.data.value1++;
-		info.adc.adc1 = counter1.adc;
-		if (storage_write_limit == 0)
-		{
-			storage.add(info.data);
-			storage_write_limit = 60*4;		// пишем в память не чаще раза в минуту
-		}
+		add_pulse(info.data.value1, flow1, pulse_log1, info.adc.adc1, counter1.adc);
 	}
 	info.on_pulse1 = counter1.on_time > 0;
 #endif
@@ -249,6 +351,83 @@ inline void counting(CounterEvent ev)
 	power_adc_disable();
 }
 
+static inline uint16_t snapshotDelta(uint32_t value, uint32_t base)
+{
+	uint32_t delta = value - base;
+	return delta > 0xFFFF ? 0xFFFF : (uint16_t)delta;
+}
+
+// Снимок прироста показаний за прошедший период
+void takeSnapshot()
+{
+	history.delta0[history.head] = snapshotDelta(info.data.value0, history.base.value0);
+	history.delta1[history.head] = snapshotDelta(info.data.value1, history.base.value1);
+	history.base = info.data;
+	history.head = (history.head + 1) % SNAPSHOT_COUNT;
+	if (history.count < SNAPSHOT_COUNT)
+	{
+		history.count++;
+	}
+	noInterrupts();
+	snapshot_ticks = 0;
+	interrupts();
+}
+
+// Минута детекторов расхода. Возвращает тревоги, о которых ESP еще не знает
+uint8_t checkFlow()
+{
+	noInterrupts();
+	bool minute = flow_ticks >= ONE_MINUTE;
+	if (minute)
+	{
+		flow_ticks -= ONE_MINUTE;
+	}
+	interrupts();
+	if (minute)
+	{
+		flow0.minute();
+		flow1.minute();
+	}
+	return flow0.pending() | flow1.pending();
+}
+
+// Текущие тревоги для ESP (TAG_FLOW_ALARM)
+uint8_t flowAlarms()
+{
+	return flow0.alarm() | (flow1.alarm() << 2);
+}
+
+// Статистика расхода для ESP (команда 'F')
+const FlowStats &flowStats(uint8_t channel)
+{
+	return channel ? flow1.stats : flow0.stats;
+}
+
+void clearFlowStats()
+{
+	flow0.clear_stats();
+	flow1.clear_stats();
+}
+
+// Интервалы между импульсами для ESP (команда 'L')
+void writePulseLog(uint8_t *buf)
+{
+	uint32_t now = pulseClock();
+	pulse_log0.write(buf, now);
+	pulse_log1.write(buf + PULSE_LOG_CHANNEL_SIZE, now);
+}
+
+// Копия показаний в кольцо прошивок до 43. Пишется раз за пробуждение ESP, а не
+// на каждый импульс: ресурса 20 блоков хватит на десятки лет при периоде 15 мин
+static void syncLegacyStorage()
+{
+	Data legacy;
+	if (!legacy_storage.get(legacy) || memcmp(&legacy, &info.data, sizeof(Data)) != 0)
+	{
+		legacy_storage.add(info.data);
+	}
+}
+
 void saveConfig()
 {
 	// записываем 2 раза чтобы полностью переписать хранилище
@@ -292,10 +471,18 @@ void setup()
 	}
 	saveConfig();
 
+	// Голова старого кольца нужна и для его обновления
+	bool legacy_found = legacy_storage.init();
 	if (storage.init())
 	{
 		storage.get(info.data);
 	}
+	else if (legacy_found)
+	{
+		legacy_storage.get(info.data);
+		storage.add(info.data);
+	}
+	history.base = info.data;
 
 	wakeup_period = WAKEUP_PERIOD_DEFAULT;
 	LOG_BEGIN(9600);
@@ -305,35 +492,38 @@ void setup()
 	LOG(F("RESET"));
 	LOG(info.config.resets);
 	LOG(F("EEPROM used:"));
-	LOG(storage.size() + config.size());
+	LOG(config.size() + storage.size());
 	LOG(F("Data:"));
 	LOG(info.data.value0);
 	LOG(info.data.value1);
 }
 
-void counting_1ms(uint8_t &delay_loop_count)
+// Ожидание с включенной ESP. Ядро спит в SLEEP_MODE_IDLE, будят фронт входа (PCINT),
+// watchdog раз в 250мс (опрос входов, как во сне), i2c (USI) и таймер millis.
+// wdt_reset() здесь нельзя: таймер millis будит ядро каждые ~2мс, сброс не дал бы
+// watchdog досчитать до 250мс и события TIME не было бы. От зависания защищает
+// сам watchdog: без повторного WDIE следующий период перезагрузит attiny
+void idle_wait()
 {
-	wdt_reset();
-	if (delay_loop_count < 250)
-	{
-		delay_loop_count++;
-	}
-	else
+	noInterrupts();
+	CounterEvent ev = event;
+	event = CounterEvent::NONE;
+	interrupts();
+	if (ev != CounterEvent::NONE)
 	{
-		// Получаем период опроса входов 250мс, как и от ватчдога
-		delay_loop_count = 0;
-		event = CounterEvent::TIME;
+		counting(ev);
 	}
-	if (event != CounterEvent::NONE)
+
+	noInterrupts();
+	if (event == CounterEvent::NONE)
 	{
-		// Если получили фронт изменения сигнала или набежало время - проверяем входы
-		noInterrupts();
-		CounterEvent ev = event;
-		event = CounterEvent::NONE;
+		WDTCR |= _BV(WDIE);
+		sleep_enable();
 		interrupts();
-		counting(ev);
+		sleep_cpu(); // без гонки: после sei следующая инструкция выполняется до прерывания
+		sleep_disable();
 	}
-	delayMicroseconds(1000);
+	interrupts();
 }
 
 // Главный цикл, повторящийся раз в сутки или при настройке вотериуса
@@ -346,16 +536,48 @@ void loop()
 
 	counter0.set_type((CounterType)info.config.types.type0);
 	counter1.set_type((CounterType)info.config.types.type1);
+#if COUNTER0_TYPE != COUNTER_TYPE_ANY || COUNTER1_TYPE != COUNTER_TYPE_ANY
+	info.config.types.type0 = counter0.type; // ESP видит фактический тип входа
+	info.config.types.type1 = counter1.type;
+#endif
 
-	wdt_count = 0;
-	while ((wdt_count < wakeup_period) && !button.pressed(event))
+	// После пробуждения по тревоге продолжаем отсчет обычного периода
+	static bool alarm = false;
+	if (!alarm)
+	{
+		wdt_count = 0;
+	}
+	alarm = false;
+	memset(rate_ticks, 0, sizeof(rate_ticks));
+	while ((wdt_count < wakeup_period) && !button.pressed(event) && !alarm)
 	{
 		noInterrupts();
 		CounterEvent ev = event;
 		event = CounterEvent::NONE;
+		uint8_t ticks = 1 << wdt_rate;
 		interrupts();
 
-		counting(ev);
+		counting(ev, ticks);
+
+		noInterrupts();
+		bool snapshot_time = snapshot_ticks >= SNAPSHOT_PERIOD;
+		interrupts();
+		if (snapshot_time)
+		{
+			takeSnapshot();
+		}
+
+		alarm = checkFlow() != 0;
+
+		// Самый быстрый период из нужных входам и кнопке
+		uint8_t rate = button.idle() ? counter0.rate() : 0;
+#ifndef LOG_ON
+		rate = min(rate, counter1.rate());
+#endif
+		if (rate != wdt_rate)
+		{
+			setWatchdogRate(rate);
+		}
 
 		if (event == CounterEvent::NONE)
 		{
@@ -366,7 +588,11 @@ void loop()
 		LOG_BEGIN(9600);
 	}
 
-	storage.add(info.data);
+	// С ESP входы опрашиваются по watchdog 250мс и фронтам, между ними - idle
+	setWatchdogRate(0);
+
+	storage.add(info.data); // без новых импульсов ничего не пишет
+	syncLegacyStorage();
 	power_all_enable();
 
 	LOG_BEGIN(9600);
@@ -394,6 +620,14 @@ void loop()
 			LOG(F("Manual transmit wake up"));
 			slaveI2C.begin(MANUAL_TRANSMIT_MODE);
 		}
+		else if (alarm)
+		{
+			wake_up_limit = WAIT_ESP_MSEC;
+			LOG(F("Flow alarm wake up"));
+			slaveI2C.begin(ALARM_TRANSMIT_MODE);
+			flow0.report();
+			flow1.report();
+		}
 		else
 		{
 			wake_up_limit = WAIT_ESP_MSEC; // 15 секунд при передаче данных
@@ -410,15 +644,18 @@ void loop()
 
 	LOG(F("ESP turn on"));
 
-	uint8_t delay_loop_count = 0;		
+	// millis нужен таймер 0, он работает в SLEEP_MODE_IDLE
+	set_sleep_mode(SLEEP_MODE_IDLE);
 	while (!slaveI2C.masterGoingToSleep() && !esp.elapsed(wake_up_limit))
 	{
-		counting_1ms(delay_loop_count);
+		idle_wait();
 	}
-	uint8_t sleep_delay_ms = 20;
-	while (sleep_delay_ms--) {
-		counting_1ms(delay_loop_count);
+	unsigned long sleep_received = millis();
+	while (millis() - sleep_received < ESP_SLEEP_DELAY_MSEC)
+	{
+		idle_wait();
 	}
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
 
 	slaveI2C.end(); // выключаем i2c slave.
 
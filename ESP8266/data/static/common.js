@@ -336,33 +336,42 @@ function getWiFiStatus() {
         }, false);
     }, 2000);
 }
+// Изменения входа от /api/events без опроса. false - браузер не умеет EventSource
+function watchStatus(i, callback) {
+    if (!window.EventSource) return false;
+    const events = new EventSource('/api/events');
+    events.addEventListener('status' + i, e => callback(JSON.parse(e.data)));
+    return true;
+}
 function getStatus(i, next) {
+    const onStatus = data => {
+        if(data.state == 1)
+            return window.location = (queryParams.wizard ? next + '?wizard=true': next);
+        formError(data.error);
+        return false;
+    };
+    if (watchStatus(i, onStatus)) return;
     setTimeout(() => {
         ajax('/api/status/' + i, {}, data => {
-            if(data.state == 1)
-                return window.location = (queryParams.wizard ? next + '?wizard=true': next);
-            formError(data.error);
-            getStatus(i, next);
+            if (onStatus(data) === false) getStatus(i, next);
         }, false);
     }, 2000);
 }
 function getImpulses(i) {
+    const onStatus = data => {
+        document.getElementById('impulses').textContent = data.impulses;
+        formError(data.error);
+    };
+    if (watchStatus(i, onStatus)) return;
     setTimeout(() => {
         ajax('/api/status/' + i, {}, data => {
-            document.getElementById('impulses').textContent = data.impulses;
-            formError(data.error);
+            onStatus(data);
             getImpulses(i);
         }, false);
     }, 2000);
 }
 function getImpulsesHall(i) {
-    setTimeout(() => {
-        ajax('/api/status/' + i, {}, data => {
-            document.getElementById('impulses').textContent = data.impulses;
-            formError(data.error);
-            getImpulsesHall(i);
-        }, false);
-    }, 2000);
+    getImpulses(i);
 }
 function finish(btn){
     ajax('/api/turnoff', {}, () => {
@@ -377,8 +386,25 @@ function finishTimer(btn, sec){
     btn.innerText = sec;
     setTimeout(() => finishTimer(btn, sec), 1000);
 }
+// Порядок полей как в wake_log_fill_json
+const WAKE_REASONS = ['power', 'hw_wdt', 'exception', 'soft_wdt', 'restart', 'deep_sleep', 'reset'];
+const WAKE_EXITS = ['ok', 'no_attiny', 'no_config', 'setup', 'no_wifi', 'not_sent'];
+const WAKE_PHASES = ['i2c', 'wifi', 'mqtt', 'ntp', 'send', 'ota', 'off'];
+function formatWake(w){
+    const time = w[1] ? new Date(w[1] * 1000).toISOString().replace('T', ' ').substring(0, 19) : '-';
+    let line = `#${w[0]} ${time} ${WAKE_REASONS[w[2]] || w[2]}`;
+    if (w[2] == 2 || w[2] == 3) line += ` exc=${w[3]} epc1=0x${w[4].toString(16)}`;
+    line += ` mode=${w[5]} ${WAKE_EXITS[w[6]] || w[6]} rssi=${w[7]} heap=${w[8]} flash=${w[9]} total=${w[10]}ms`;
+    WAKE_PHASES.forEach((name, i) => { if (w[11 + i]) line += ` ${name}=${w[11 + i]}`; });
+    return line;
+}
 function getLogs(){
-    ajax('/waterius_logs.txt', {}, data => document.getElementById('logs').value = data);
+    ajax('/api/logs', {}, data => {
+        const wakes = (data.wakes || []).map(formatWake).join('\n');
+        ajax('/waterius_logs.txt', {}, text => {
+            document.getElementById('logs').value = `reset: ${data.reset_reason}\n${wakes}\n\n${text}`;
+        });
+    });
 }
 function _goto(next = false){
     if(!next) 
@@ -0,0 +1,31 @@
+import os
+Import("env")
+
+# Подпись OTA образов. Если в проекте лежит ota_public.key (RSA, PEM),
+# ключ встраивается в прошивку (OTA_SIGNED), и она принимает
+# только образы, подписанные парным ota_private.key
+# (подписывает scripts/build_and_deploy.sh). Тогда образы можно отдавать
+# и по http: целостность проверяет подпись, а не TLS.
+KEY_FILE = "ota_public.key"
+HEADER = "ota_public_key.h"
+
+
+def write_if_changed(path, content):
+    if os.path.isfile(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+    with open(path, 'w') as f:
+        f.write(content)
+
+
+key_path = os.path.join(env.subst("$PROJECT_DIR"), KEY_FILE)
+if os.path.isfile(key_path):
+    with open(key_path) as f:
+        key = f.read().strip()
+    header_dir = os.path.join(env.subst("$BUILD_DIR"), "ota_signing")
+    os.makedirs(header_dir, exist_ok=True)
+    write_if_changed(os.path.join(header_dir, HEADER),
+                     'static const char ota_public_key[] PROGMEM = R"(' + key + '\n)";\n')
+    env.Append(CPPDEFINES=["OTA_SIGNED"], CPPPATH=[header_dir])
+    print(f'OTA: signed images, key {key_path}')
@@ -0,0 +1,63 @@
+import gzip
+import hashlib
+import os
+import shutil
+from SCons.Script import COMMAND_LINE_TARGETS
+Import("env")
+
+# Образ LittleFS собирается не из data, а из копии в $BUILD_DIR/data:
+# статика без шаблонов сжимается, рядом кладется общий ETag.
+# html страницы остаются как есть: они отдаются через processor,
+# а сжатые файлы AsyncWebServer шаблонами не обрабатывает.
+GZIP_DIRS = ("static",)
+GZIP_EXT = (".js", ".css", ".svg")
+ETAG_FILE = os.path.join("static", "etag")
+
+FS_TARGETS = ("buildfs", "uploadfs", "uploadfsota")
+
+
+def gzip_content(content: bytes) -> bytes:
+    # mtime=0: одинаковые файлы дают одинаковый образ
+    return gzip.compress(content, compresslevel=9, mtime=0)
+
+
+def prepare_data(env):
+    source = env.subst("$PROJECT_DATA_DIR")
+    dest = os.path.join(env.subst("$BUILD_DIR"), "data")
+    shutil.rmtree(dest, ignore_errors=True)
+
+    etag = hashlib.md5()
+    plain_size = 0
+    image_size = 0
+    for root, dirs, files in os.walk(source):
+        dirs.sort()
+        rel = os.path.relpath(root, source)
+        os.makedirs(os.path.join(dest, rel), exist_ok=True)
+        top = rel.split(os.sep)[0]
+        for name in sorted(files):
+            with open(os.path.join(root, name), 'rb') as f:
+                content = f.read()
+            etag.update(os.path.join(rel, name).encode())
+            etag.update(content)
+            plain_size += len(content)
+
+            target = os.path.join(dest, rel, name)
+            if top in GZIP_DIRS and name.endswith(GZIP_EXT):
+                packed = gzip_content(content)
+                if len(packed) < len(content):
+                    target += '.gz'
+                    content = packed
+            with open(target, 'wb') as f:
+                f.write(content)
+            image_size += len(content)
+
+    os.makedirs(os.path.dirname(os.path.join(dest, ETAG_FILE)), exist_ok=True)
+    with open(os.path.join(dest, ETAG_FILE), 'w') as f:
+        f.write(etag.hexdigest()[:16])
+
+    print(f'DATA: {source} -> {dest}, {plain_size} -> {image_size} bytes, etag {etag.hexdigest()[:16]}')
+    env.Replace(PROJECT_DATA_DIR=dest)
+
+
+if any(t in COMMAND_LINE_TARGETS for t in FS_TARGETS):
+    prepare_data(env)
@@ -83,23 +83,87 @@ if [ ! -f "$FS_FILE" ]; then
     exit 1
 fi
 
+# Прошивка сжимается: eboot распаковывает gzip при копировании из области загрузки.
+FW_GZ_FILE="${FW_FILE}.gz"
+gzip -9 -n -c "$FW_FILE" > "$FW_GZ_FILE"
+
+# Образ LittleFS пишется прямо в раздел, и сжать его нельзя. Но хвост образа -
+# свободное место (0xFF): его можно не передавать, littlefs не читает блоки вне своего дерева.
+FS_TRIM_FILE="${FS_FILE%.bin}-trim.bin"
+python3 - "$FS_FILE" "$FS_TRIM_FILE" << 'PYEOF'
+import sys
+SECTOR = 4096
+data = open(sys.argv[1], 'rb').read()
+end = len(data)
+while end >= SECTOR and data[end - SECTOR:end] == b'\xff' * SECTOR:
+    end -= SECTOR
+open(sys.argv[2], 'wb').write(data[:end])
+PYEOF
+
+# Подпись образов: прошивка, собранная с ota_public.key, принимает только подписанные.
+# Подпись считается от передаваемого файла (сжатого) и дописывается в конец
+# вместе с ее длиной, как ожидает Updater.
+OTA_PRIVATE_KEY="${PROJECT_DIR}/ota_private.key"
+sign_image() {
+    openssl dgst -sha256 -sign "$OTA_PRIVATE_KEY" -out "$1.sig" "$1"
+    python3 - "$1" "$1.sig" << 'PYEOF'
+import struct, sys
+sig = open(sys.argv[2], 'rb').read()
+with open(sys.argv[1], 'ab') as f:
+    f.write(sig + struct.pack('<L', len(sig)))
+PYEOF
+    rm "$1.sig"
+}
+# Дельта OTA: патч собирает несжатый образ, Updater проверяет его так же,
+# поэтому подписывается несжатая копия.
+DELTA_TARGET="${FW_FILE%.bin}-delta-target.bin"
+cp "$FW_FILE" "$DELTA_TARGET"
+if [ -f "$OTA_PRIVATE_KEY" ]; then
+    echo ""
+    echo "--- Подпись образов ---"
+    sign_image "$FW_GZ_FILE"
+    sign_image "$FS_TRIM_FILE"
+    sign_image "$DELTA_TARGET"
+fi
+
 # MD5
-FW_MD5=$(md5 -q "$FW_FILE")
-FS_MD5=$(md5 -q "$FS_FILE")
+FW_MD5=$(md5 -q "$FW_GZ_FILE")
+FS_MD5=$(md5 -q "$FS_TRIM_FILE")
 
 # Размеры
-FW_SIZE=$(stat -f%z "$FW_FILE")
-FS_SIZE=$(stat -f%z "$FS_FILE")
+FW_PLAIN_SIZE=$(stat -f%z "$FW_FILE")
+FS_PLAIN_SIZE=$(stat -f%z "$FS_FILE")
+FW_SIZE=$(stat -f%z "$FW_GZ_FILE")
+FS_SIZE=$(stat -f%z "$FS_TRIM_FILE")
 
 echo ""
 echo "--- Файлы ---"
-echo "Firmware: ${FW_FILE} (${FW_SIZE} bytes, md5: ${FW_MD5})"
-echo "Filesystem: ${FS_FILE} (${FS_SIZE} bytes, md5: ${FS_MD5})"
+echo "Firmware: ${FW_GZ_FILE} (${FW_PLAIN_SIZE} -> ${FW_SIZE} bytes, md5: ${FW_MD5})"
+echo "Filesystem: ${FS_TRIM_FILE} (${FS_PLAIN_SIZE} -> ${FS_SIZE} bytes, md5: ${FS_MD5})"
 
 # Создаём папку ota/ и копируем туда
 mkdir -p "$OTA_DIR"
-cp "$FW_FILE" "$OTA_DIR/"
-cp "$FS_FILE" "$OTA_DIR/"
+
+# Патчи от прошлых версий: их несжатые образы - то, что работает на устройствах
+echo ""
+echo "--- Патчи от прошлых версий ---"
+DELTA_JSON=""
+for BASE_FILE in "$OTA_DIR"/${BOARD}-*.bin; do
+    [ -f "$BASE_FILE" ] || continue
+    BASE_VERSION=$(basename "$BASE_FILE" .bin | sed "s/^${BOARD}-//")
+    case "$BASE_VERSION" in
+        *[!0-9.]*|"$VERSION") continue ;;
+    esac
+    DELTA_FILE="${BOARD}-${BASE_VERSION}-to-${VERSION}.delta"
+    python3 "$SCRIPT_DIR/ota_delta.py" "$BASE_FILE" "$DELTA_TARGET" "$OTA_DIR/$DELTA_FILE"
+    DELTA_JSON="${DELTA_JSON}  ${BASE_VERSION}: {\"url\": \"${OTA_BASE_URL}/${DELTA_FILE}\", \"size\": $(stat -f%z "$OTA_DIR/$DELTA_FILE"), \"md5\": \"$(md5 -q "$DELTA_TARGET")\"}
+"
+done
+
+cp "$FW_FILE" "$OTA_DIR/" # база для патчей следующей версии
+cp "$FW_GZ_FILE" "$OTA_DIR/"
+cp "$FS_TRIM_FILE" "$OTA_DIR/"
+rm "$DELTA_TARGET"
 
 echo ""
 echo "--- Результат в ota/ ---"
@@ -111,18 +175,24 @@ cat << EOF
 {
   "ota": {
     "firmware": {
-      "url": "${OTA_BASE_URL}/${FW_FILE}",
+      "url": "${OTA_BASE_URL}/${FW_GZ_FILE}",
       "size": ${FW_SIZE},
-      "md5": "${FW_MD5}"
+      "md5": "${FW_MD5}",
+      "compression": "gzip"
     },
     "filesystem": {
-      "url": "${OTA_BASE_URL}/${FS_FILE}",
+      "url": "${OTA_BASE_URL}/${FS_TRIM_FILE}",
       "size": ${FS_SIZE},
       "md5": "${FS_MD5}"
     }
   }
 }
 EOF
+if [ -n "$DELTA_JSON" ]; then
+    echo ""
+    echo "--- firmware.delta по версии устройства ---"
+    printf "%s" "$DELTA_JSON"
+fi
 
 echo ""
 echo "=== Готово ==="
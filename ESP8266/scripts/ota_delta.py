@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Патч прошивки для дельта OTA (формат - в src/ota_delta.h).
+
+Использование:
+    ota_delta.py <base.bin> <target.bin> <patch.delta>
+
+base.bin - образ, который работает на устройстве (несжатый, без подписи),
+target.bin - новый образ в том виде, в каком его примет Updater (с подписью,
+если прошивка собрана с ota_public.key). Патч проверяется применением.
+"""
+import struct
+import sys
+
+MAGIC = b'WDL1'
+HEADER_SKIP = 16   # заголовок образа: Updater правит в нем режим flash
+MIN_MATCH = 8      # короче выгоднее вставить
+MAX_CANDIDATES = 16
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        crc = i << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+        table.append(crc & 0xFFFFFFFF)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc32(data, crc=0xFFFFFFFF):
+    """crc32 ядра ESP8266: старшим битом вперед, без финального xor"""
+    for b in data:
+        crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[((crc >> 24) ^ b) & 0xFF]
+    return crc
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        out.append(b | 0x80 if value else b)
+        if not value:
+            return out
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value - 1) << 1) | 1
+
+
+def match_len(base, src, target, pos):
+    """Длина совпадения base[src:] и target[pos:]"""
+    limit = min(len(base) - src, len(target) - pos)
+    n = 0
+    step = 256
+    while n < limit:
+        step = min(step, limit - n)
+        if base[src + n:src + n + step] == target[pos + n:pos + n + step]:
+            n += step
+        elif step > 1:
+            step //= 2
+        else:
+            break
+    return n
+
+
+def build_index(base):
+    index = {}
+    for i in range(HEADER_SKIP, len(base) - MIN_MATCH + 1):
+        positions = index.setdefault(base[i:i + MIN_MATCH], [])
+        if len(positions) < MAX_CANDIDATES:
+            positions.append(i)
+    return index
+
+
+def make_patch(base, target):
+    out = bytearray(MAGIC)
+    out += struct.pack('<LLL', len(base), crc32(base[HEADER_SKIP:]), len(target))
+    index = build_index(base)
+
+    pending = bytearray(target[:HEADER_SKIP])
+    cursor = HEADER_SKIP
+    pos = HEADER_SKIP
+
+    def flush():
+        nonlocal pending
+        if pending:
+            out.append(OP_INSERT)
+            out.extend(varint(len(pending)))
+            out.extend(pending)
+            pending = bytearray()
+
+    while pos < len(target):
+        # Между версиями код в основном сдвигается целиком: сначала продолжаем с курсора
+        src, length = cursor, 0
+        if cursor < len(base):
+            length = match_len(base, cursor, target, pos)
+        if length < MIN_MATCH:
+            for candidate in index.get(target[pos:pos + MIN_MATCH], ()):
+                n = match_len(base, candidate, target, pos)
+                if n > length or (n == length and abs(candidate - cursor) < abs(src - cursor)):
+                    src, length = candidate, n
+        if length >= MIN_MATCH:
+            flush()
+            out.append(OP_COPY)
+            out.extend(varint(zigzag(src - cursor)))
+            out.extend(varint(length))
+            cursor = src + length
+            pos += length
+        else:
+            # Замена байта: курсор идет вровень, следующее копирование от него же
+            pending.append(target[pos])
+            pos += 1
+            cursor += 1
+    flush()
+    return bytes(out)
+
+
+def apply_patch(base, patch):
+    magic, base_size, base_crc, target_size = struct.unpack('<4sLLL', patch[:16])
+    assert magic == MAGIC and base_size == len(base) and base_crc == crc32(base[HEADER_SKIP:])
+    out = bytearray()
+    cursor, i = 0, 16
+
+    def read_varint():
+        nonlocal i
+        value, shift = 0, 0
+        while True:
+            b = patch[i]
+            i += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    while i < len(patch):
+        op = patch[i]
+        i += 1
+        if op == OP_COPY:
+            delta = read_varint()
+            delta = -(delta >> 1) - 1 if delta & 1 else delta >> 1
+            length = read_varint()
+            src = cursor + delta
+            assert HEADER_SKIP <= src and src + length <= base_size
+            out += base[src:src + length]
+            cursor = src + length
+        elif op == OP_INSERT:
+            length = read_varint()
+            out += patch[i:i + length]
+            i += length
+            cursor += length
+        else:
+            raise ValueError('bad op')
+    assert len(out) == target_size
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 4:
+        print(__doc__)
+        sys.exit(1)
+    base = open(sys.argv[1], 'rb').read()
+    target = open(sys.argv[2], 'rb').read()
+    patch = make_patch(base, target)
+    if apply_patch(base, patch) != target:
+        print('Ошибка: патч не воспроизводит образ')
+        sys.exit(1)
+    with open(sys.argv[3], 'wb') as f:
+        f.write(patch)
+    print(f'{sys.argv[3]}: {len(target)} -> {len(patch)} bytes')
+
+
+if __name__ == '__main__':
+    main()
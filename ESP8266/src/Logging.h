@@ -4,6 +4,7 @@
 #include "setup.h"
 
 #include <Arduino.h>
+#include "log_buffer.h"
 
 template <class T>
 inline Print &operator<<(Print &obj, T arg)
@@ -12,49 +13,80 @@ inline Print &operator<<(Print &obj, T arg)
 	return obj;
 }
 
-#define MS_IN_DAY 86400000
+/*
+Уровни лога. Общий уровень задается флагами LOG_LEVEL_INFO / LOG_LEVEL_DEBUG.
+Модуль может понизить (или повысить) свой уровень, определив LOG_MODULE_LEVEL
+до первого #include:
+	#define LOG_MODULE_LEVEL LOG_LVL_ERROR
+	#include "Logging.h"
+Строки ниже уровня выбрасываются компилятором вместе с вычислением аргументов.
+*/
+#define LOG_LVL_NONE 0
+#define LOG_LVL_ERROR 1
+#define LOG_LVL_INFO 2
+#define LOG_LVL_DEBUG 3
+
+#if defined(LOG_LEVEL_DEBUG)
+#define LOG_LEVEL LOG_LVL_DEBUG
+#elif defined(LOG_LEVEL_INFO)
+#define LOG_LEVEL LOG_LVL_INFO
+#else
+#define LOG_LEVEL LOG_LVL_NONE
+#endif
+
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL
+#endif
+
 #define MS_IN_HOUR 3600000
-#define MS_IN_MINUTE 60000
 #define MS_IN_SECOND 1000
-#define LOG_FORMAT_TIME                                                                               \
-	do                                                                                                \
-	{                                                                                                 \
-		unsigned long logTime = millis();                                                             \
-		unsigned char minutes = ((logTime % MS_IN_DAY) % MS_IN_HOUR) / MS_IN_MINUTE;                  \
-		unsigned char seconds = (((logTime % MS_IN_DAY) % MS_IN_HOUR) % MS_IN_MINUTE) / MS_IN_SECOND; \
-		unsigned short ms = ((((logTime % MS_IN_DAY) % MS_IN_HOUR) % MS_IN_MINUTE) % MS_IN_SECOND);   \
-		char logFormattedTime[17];                                                                    \
-		snprintf_P(logFormattedTime, sizeof(logFormattedTime),                                        \
-				   PSTR("%02u:%02u:%03u"), minutes, seconds, ms);                                     \
-		Serial.print(logFormattedTime);                                                                \
+#define LOG_FORMAT_TIME(out)                                                   \
+	do                                                                         \
+	{                                                                          \
+		unsigned long logTime = millis() % MS_IN_HOUR;                         \
+		unsigned short seconds = logTime / MS_IN_SECOND;                       \
+		unsigned short ms = logTime - seconds * MS_IN_SECOND;                  \
+		char logFormattedTime[10];                                             \
+		logFormattedTime[0] = '0' + seconds / 600;                             \
+		logFormattedTime[1] = '0' + (seconds / 60) % 10;                       \
+		logFormattedTime[2] = ':';                                             \
+		logFormattedTime[3] = '0' + (seconds % 60) / 10;                       \
+		logFormattedTime[4] = '0' + seconds % 10;                              \
+		logFormattedTime[5] = ':';                                             \
+		logFormattedTime[6] = '0' + ms / 100;                                  \
+		logFormattedTime[7] = '0' + (ms / 10) % 10;                            \
+		logFormattedTime[8] = '0' + ms % 10;                                   \
+		logFormattedTime[9] = 0;                                               \
+		out.print(logFormattedTime);                                           \
 	} while (0)
 
 #ifdef LOG_FREE_HEAP
 #undef LOG_FREE_HEAP
 #ifdef ESP8266
-#define LOG_FREE_HEAP                                                                       \
+#define LOG_FREE_HEAP(out)                                                                  \
 	do                                                                                      \
 	{                                                                                       \
 		char logHeap[18];                                                                   \
 		snprintf_P(logHeap, sizeof(logHeap), PSTR("-%03d/%02d%%"), int(ESP.getFreeHeap() / 1024), ESP.getHeapFragmentation()); \
-		Serial.print(logHeap);                                                              \
+		out.print(logHeap);                                                                 \
 	} while (0)
 #else
-#define LOG_FREE_HEAP                                                  \
+#define LOG_FREE_HEAP(out)                                             \
 	do                                                                 \
 	{                                                                  \
 		char logHeap[15];                                              \
 		snprintf_P(logHeap, sizeof(logHeap), PSTR("-%03d/%02d"),       \
 				   ESP_getFreeHeap1024(), ESP_getHeapFragmentation()); \
-		Serial.print(logHeap);                                         \
+		out.print(logHeap);                                            \
 	} while (0)
 #endif
 #else
-#undef LOG_FREE_HEAP
-#define LOG_FREE_HEAP ;
+#define LOG_FREE_HEAP(out) \
+	do                     \
+	{                      \
+	} while (0)
 #endif
 
-// Default do no logging...
 #define LOG_BEGIN(baud)                 \
 	do                                  \
 	{                                   \
@@ -66,51 +98,39 @@ inline Print &operator<<(Print &obj, T arg)
 		Serial.flush(); \
 		Serial.end();   \
 	} while (0)
-#define LOG_INFO(content) \
-	do                    \
-	{                     \
-	} while (0)
 
-#define LOG_ERROR(content) \
-	do                     \
-	{                      \
+// Вывести накопленный лог в Serial и дальше писать напрямую
+#define LOG_FLUSH()           \
+	do                        \
+	{                         \
+		log_buffer.direct(); \
 	} while (0)
 
-#define LOG_DEBUG(content) \
-	do                     \
-	{                      \
+#define LOG_AT(level, title, content)               \
+	do                                              \
+	{                                               \
+		if ((level) <= LOG_MODULE_LEVEL)            \
+		{                                           \
+			LogBuffer &logOut = log_buffer.line();  \
+			LOG_FORMAT_TIME(logOut);                \
+			LOG_FREE_HEAP(logOut);                  \
+			logOut << title << content << "\r\n";   \
+		}                                           \
 	} while (0)
 
-#if defined(LOG_LEVEL_INFO) || defined(LOG_LEVEL_DEBUG)
-// Depending on log level, add code for logging
-#undef LOG_ERROR
-#define LOG_ERROR(content)                           \
-	do                                               \
-	{                                                \
-		LOG_FORMAT_TIME;                             \
-		LOG_FREE_HEAP;                               \
-		Serial << "  ERROR : " << content << "\r\n"; \
+// Ошибка выводит в Serial весь накопленный лог
+#define LOG_ERROR(content)                          \
+	do                                              \
+	{                                               \
+		if (LOG_LVL_ERROR <= LOG_MODULE_LEVEL)      \
+		{                                           \
+			LOG_AT(LOG_LVL_ERROR, F("  ERROR : "), content); \
+			log_buffer.error();                     \
+		}                                           \
 	} while (0)
 
-#undef LOG_INFO
-#define LOG_INFO(content)                            \
-	do                                               \
-	{                                                \
-		LOG_FORMAT_TIME;                             \
-		LOG_FREE_HEAP;                               \
-		Serial << "  INFO  : " << content << "\r\n"; \
-	} while (0)
+#define LOG_INFO(content) LOG_AT(LOG_LVL_INFO, F("  INFO  : "), content)
 
-#ifdef LOG_LEVEL_DEBUG
-#undef LOG_DEBUG
-#define LOG_DEBUG(content)                           \
-	do                                               \
-	{                                                \
-		LOG_FORMAT_TIME;                             \
-		LOG_FREE_HEAP;                               \
-		Serial << "  DEBUG : " << content << "\r\n"; \
-	} while (0)
-#endif
-#endif
+#define LOG_DEBUG(content) LOG_AT(LOG_LVL_DEBUG, F("  DEBUG : "), content)
 
 #endif
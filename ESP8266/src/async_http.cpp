@@ -0,0 +1,150 @@
+#include "async_http.h"
+#include "Logging.h"
+#include "utils.h"
+#include "https_helpers.h"
+
+AsyncHttpPost::AsyncHttpPost()
+    : _sent(0), _code(0), _finished(true), _start(0), _elapsed(0)
+{
+    _client.onConnect([](void *arg, AsyncClient *client)
+                      { ((AsyncHttpPost *)arg)->sendMore(); },
+                      this);
+    _client.onAck([](void *arg, AsyncClient *client, size_t len, uint32_t time)
+                  { ((AsyncHttpPost *)arg)->sendMore(); },
+                  this);
+    _client.onData([](void *arg, AsyncClient *client, void *data, size_t len)
+                   { ((AsyncHttpPost *)arg)->_response.concat((const char *)data, len); },
+                   this);
+    _client.onDisconnect([](void *arg, AsyncClient *client)
+                         {
+                             AsyncHttpPost *self = (AsyncHttpPost *)arg;
+                             // HTTP/1.0 200 OK
+                             int space = self->_response.indexOf(' ');
+                             self->finish(space > 0 ? self->_response.substring(space + 1, space + 4).toInt() : 0); },
+                         this);
+    _client.onError([](void *arg, AsyncClient *client, int8_t error)
+                    { ((AsyncHttpPost *)arg)->finish(error < 0 ? error : -1); },
+                    this);
+}
+
+AsyncHttpPost::~AsyncHttpPost()
+{
+    _client.onDisconnect(nullptr, nullptr);
+    _client.onError(nullptr, nullptr);
+    _client.close(true);
+}
+
+void AsyncHttpPost::finish(int code)
+{
+    if (!_finished)
+    {
+        _code = code;
+        _elapsed = millis() - _start;
+        _finished = true;
+    }
+}
+
+void AsyncHttpPost::sendMore()
+{
+    size_t left = _request.length() - _sent;
+    if (!left)
+    {
+        return;
+    }
+    size_t len = _min(left, _client.space());
+    if (len)
+    {
+        len = _client.add(_request.c_str() + _sent, len);
+        _client.send();
+        _sent += len;
+    }
+}
+
+bool AsyncHttpPost::begin(const String &url, const char *key, const char *email, const String &payload)
+{
+    if (get_proto(url) != PROTO_HTTP)
+    {
+        return false;
+    }
+
+    String host, path;
+    uint16_t port;
+    parse_url(url, host, port, path);
+
+    // HTTP/1.0: сервер закроет соединение после ответа и не будет использовать chunked
+    _request.reserve(payload.length() + 256);
+    _request = F("POST ");
+    _request += path;
+    _request += F(" HTTP/1.0\r\nHost: ");
+    _request += host;
+    _request += F("\r\nContent-Type: application/json\r\n");
+    if (key)
+    {
+        _request += F("Waterius-Token: ");
+        _request += key;
+        _request += F("\r\n");
+    }
+    if (email)
+    {
+        _request += F("Waterius-Email: ");
+        _request += email;
+        _request += F("\r\n");
+    }
+    _request += F("Content-Length: ");
+    _request += payload.length();
+    _request += F("\r\nConnection: close\r\n\r\n");
+    _request += payload;
+
+    _response = "";
+    _sent = 0;
+    _code = 0;
+    _elapsed = 0;
+    _start = millis();
+    _finished = false;
+
+    LOG_INFO(F("AHTTP: Connect ") << host << F(":") << port << path);
+    if (!_client.connect(host.c_str(), port))
+    {
+        LOG_ERROR(F("AHTTP: Connect failed"));
+        finish(-1);
+        return false;
+    }
+    return true;
+}
+
+bool AsyncHttpPost::wait(uint32_t timeout_ms)
+{
+    while (!_finished && (millis() - _start < timeout_ms))
+    {
+        delay(1);
+    }
+    if (!_finished)
+    {
+        LOG_ERROR(F("AHTTP: Timeout"));
+        finish(-1);
+        _client.close(true);
+    }
+    LOG_INFO(F("AHTTP: Response code: ") << _code << F(" time: ") << _elapsed << F(" ms"));
+    return http_accepted(_code);
+}
+
+String AsyncHttpPost::body() const
+{
+    int index = _response.indexOf(F("\r\n\r\n"));
+    return index >= 0 ? _response.substring(index + 4) : String();
+}
+
+uint32_t AsyncHttpPost::retry_after() const
+{
+    int end = _response.indexOf(F("\r\n\r\n"));
+    String headers = _response.substring(0, end >= 0 ? end + 2 : _response.length());
+    headers.toLowerCase();
+    String value;
+    int index = headers.indexOf(F("\r\nretry-after:"));
+    if (index >= 0)
+    {
+        index += 14;
+        value = headers.substring(index, headers.indexOf('\r', index));
+    }
+    return parse_retry_after(_code, value);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file async_http.h
+ * @brief Неблокирующая отправка JSON POST запроса по http
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * DNS, подключение и обмен идут в колбеках ESPAsyncTCP, поэтому пока
+ * выполняются блокирующие отправки (https, mqtt), запрос продвигается в фоне.
+ * Для https используется обычный post_data: TLS в ESPAsyncTCP не поддерживается.
+ */
+#ifndef ASYNC_HTTP_H_
+#define ASYNC_HTTP_H_
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+class AsyncHttpPost
+{
+    AsyncClient _client;
+    String _request;
+    String _response;
+    size_t _sent;
+    int _code;
+    bool _finished;
+    uint32_t _start;
+    uint32_t _elapsed;
+
+    void sendMore();
+    void finish(int code);
+
+public:
+    AsyncHttpPost();
+    ~AsyncHttpPost();
+    AsyncHttpPost(const AsyncHttpPost &) = delete;
+    AsyncHttpPost &operator=(const AsyncHttpPost &) = delete;
+
+    /**
+     * @brief Начинает отправку. Возвращает управление сразу.
+     *
+     * @param url ссылка вида http://host[:port][/path]
+     * @param key токен Waterius-Token
+     * @param email Waterius-Email
+     * @param payload тело запроса
+     * @return true подключение начато
+     */
+    bool begin(const String &url, const char *key, const char *email, const String &payload);
+
+    /**
+     * @brief Ждет завершения запроса не дольше timeout_ms от начала
+     *
+     * @return true получен ответ 200 или 204
+     */
+    bool wait(uint32_t timeout_ms);
+
+    bool finished() const { return _finished; }
+
+    /**
+     * @brief Запрос начали передавать. Сервер мог его получить и принять,
+     * даже если ответа не дождались, поэтому повторять такой запрос нельзя.
+     */
+    bool request_started() const { return _sent > 0; }
+    int code() const { return _code; }
+    uint32_t elapsed() const { return _elapsed; }
+
+    /**
+     * @brief Тело ответа (без заголовков)
+     */
+    String body() const;
+
+    /**
+     * @brief Секунды из Retry-After ответа 429/503 (https_helpers.h), 0 - не просил ждать
+     */
+    uint32_t retry_after() const;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "coap_client.h"
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <memory>
+#include "Logging.h"
+#include "setup.h"
+#include "coap_message.h"
+#include "https_helpers.h"
+#include "dns_cache.h"
+#include "sync_time.h"
+
+static void add_query(CoapWriter &writer, const __FlashStringHelper *name, const char *value)
+{
+    if (!value || !value[0])
+    {
+        return;
+    }
+    String query = name;
+    query += value;
+    writer.option(COAP_OPTION_URI_QUERY, query.c_str(), query.length());
+}
+
+static size_t build_request(uint8_t *buf, const String &path, const char *key, const char *email,
+                            const JsonDocument &json, const bool msgpack, const uint16_t message_id, const uint8_t *token)
+{
+    CoapWriter writer(buf, COAP_MAX_MESSAGE);
+    writer.header(COAP_TYPE_CON, COAP_CODE_POST, message_id, token, COAP_TOKEN_SIZE);
+    writer.uri_path(path.c_str());
+    writer.option_uint(COAP_OPTION_CONTENT_FORMAT, msgpack ? COAP_FORMAT_MSGPACK : COAP_FORMAT_JSON);
+    add_query(writer, F("key="), key);
+    add_query(writer, F("email="), email);
+
+    size_t body_len = msgpack ? measureMsgPack(json) : measureJson(json);
+    uint8_t *body = writer.payload();
+    if (!body || body_len > writer.available())
+    {
+        LOG_ERROR(F("COAP: Body ") << body_len << F(" bytes does not fit, max ") << COAP_MAX_MESSAGE);
+        return 0;
+    }
+    if (msgpack)
+    {
+        serializeMsgPack(json, body, body_len);
+    }
+    else
+    {
+        serializeJson(json, (char *)body, body_len); // без завершающего нуля
+    }
+    return writer.finish(body_len);
+}
+
+static void send_empty_ack(WiFiUDP &udp, const uint16_t message_id)
+{
+    uint8_t ack[COAP_HEADER_SIZE];
+    CoapWriter writer(ack, sizeof(ack));
+    writer.header(COAP_TYPE_ACK, COAP_CODE_EMPTY, message_id, nullptr, 0);
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write(ack, writer.length());
+    udp.endPacket();
+}
+
+bool coap_post(const String &url, const char *key, const char *email, const JsonDocument &json, JsonDocument &json_settings, bool msgpack)
+{
+    String host, path;
+    uint16_t port;
+    IPAddress ip;
+    if (!parse_url(url, host, port, path))
+    {
+        LOG_ERROR(F("COAP: Wrong URL:") << url);
+        return false;
+    }
+    if (!dns_resolve(host, ip))
+    {
+        LOG_ERROR(F("COAP: Can't resolve ") << host);
+        return false;
+    }
+
+    std::unique_ptr<uint8_t[]> request(new uint8_t[COAP_MAX_MESSAGE]);
+    std::unique_ptr<uint8_t[]> response(new uint8_t[COAP_MAX_RESPONSE]);
+    uint16_t message_id = ESP.random();
+    uint32_t token_value = ESP.random();
+    uint8_t token[COAP_TOKEN_SIZE];
+    memcpy(token, &token_value, COAP_TOKEN_SIZE);
+
+    size_t request_len = build_request(request.get(), path, key, email, json, msgpack, message_id, token);
+    if (!request_len)
+    {
+        return false;
+    }
+    LOG_INFO(F("COAP: POST ") << url << F(" ") << (msgpack ? F("MessagePack") : F("JSON")) << F(" ") << request_len << F(" bytes"));
+
+    WiFiUDP udp;
+    if (!begin_udp_random_port(udp))
+    {
+        LOG_ERROR(F("COAP: Can't open UDP port"));
+        return false;
+    }
+
+    uint32_t start = millis();
+    uint32_t timeout = COAP_ACK_TIMEOUT_MS;
+    uint8_t transmissions = 0;
+    bool acked = false; // пустое подтверждение: ответ придет отдельным сообщением
+    bool answered = false;
+    uint8_t code = COAP_CODE_EMPTY;
+    uint32_t sent = 0;
+
+    while (!answered)
+    {
+        if (!acked && (transmissions == 0 || millis() - sent >= timeout))
+        {
+            if (transmissions > COAP_MAX_RETRANSMIT)
+            {
+                break;
+            }
+            if (transmissions)
+            {
+                timeout *= 2;
+                LOG_INFO(F("COAP: Retransmit #") << transmissions);
+            }
+            udp.beginPacket(ip, port);
+            udp.write(request.get(), request_len);
+            udp.endPacket();
+            sent = millis();
+            transmissions++;
+        }
+        if (acked && millis() - start >= SERVER_TIMEOUT)
+        {
+            break;
+        }
+
+        int size = udp.parsePacket();
+        if (size <= 0)
+        {
+            delay(1);
+            continue;
+        }
+        if (udp.remoteIP() != ip || udp.remotePort() != port)
+        {
+            udp.flush();
+            continue;
+        }
+        size_t len = udp.read(response.get(), COAP_MAX_RESPONSE - 1);
+        response[len] = 0; // нагрузка заканчивается в конце датаграммы, так она становится строкой
+        CoapMessage msg;
+        if (!coap_parse(response.get(), len, msg))
+        {
+            continue;
+        }
+        if ((msg.type == COAP_TYPE_ACK || msg.type == COAP_TYPE_RST) && msg.message_id == message_id)
+        {
+            if (msg.type == COAP_TYPE_RST)
+            {
+                LOG_ERROR(F("COAP: Reset by server"));
+                break;
+            }
+            if (msg.code == COAP_CODE_EMPTY)
+            {
+                acked = true;
+                continue;
+            }
+            answered = coap_token_match(msg, token, COAP_TOKEN_SIZE);
+        }
+        else if (msg.type != COAP_TYPE_ACK && msg.type != COAP_TYPE_RST && coap_token_match(msg, token, COAP_TOKEN_SIZE))
+        {
+            if (msg.type == COAP_TYPE_CON)
+            {
+                send_empty_ack(udp, msg.message_id);
+            }
+            answered = true;
+        }
+        if (answered)
+        {
+            code = msg.code;
+            if (COAP_CODE_CLASS(code) == 2 && msg.payload_len)
+            {
+                parse_settings_response(String((const char *)msg.payload), json_settings);
+            }
+        }
+    }
+    udp.stop();
+
+    bool result = answered && COAP_CODE_CLASS(code) == 2;
+    if (answered)
+    {
+        LOG_INFO(F("COAP: Response code: ") << COAP_CODE_CLASS(code) << F(".") << (code & 0x1F) / 10 << (code & 0x1F) % 10
+                                            << F(" in ") << millis() - start << F(" ms"));
+    }
+    else
+    {
+        LOG_ERROR(F("COAP: No response, transmissions ") << transmissions);
+    }
+    return result;
+}
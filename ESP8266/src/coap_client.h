@@ -0,0 +1,48 @@
+/**
+ * @file coap_client.h
+ * @brief Отправка показаний запросом CoAP POST по UDP
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Для своего сервера в локальной сети: без TCP рукопожатия и TLS запрос
+ * и подтверждение занимают один обмен датаграммами. Запрос подтверждаемый
+ * (CON): без ответа он повторяется с удвоением паузы, начиная с
+ * COAP_ACK_TIMEOUT_MS. Сервер может ответить сразу в подтверждении или
+ * подтвердить пустым сообщением и прислать ответ отдельно. Токен и почта
+ * уходят опциями Uri-Query вместо заголовков Waterius-Token и Waterius-Email.
+ *
+ * Блочная передача (RFC 7959) не поддерживается: тело должно поместиться
+ * в одну датаграмму, для этого есть компактный формат (http_compact).
+ */
+#ifndef COAP_CLIENT_H_
+#define COAP_CLIENT_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#ifndef COAP_MAX_MESSAGE
+#define COAP_MAX_MESSAGE 1152 // рекомендованный RFC 7252 предел без фрагментации IP
+#endif
+#ifndef COAP_MAX_RESPONSE
+#define COAP_MAX_RESPONSE 512
+#endif
+#define COAP_ACK_TIMEOUT_MS 300UL // в локальной сети ответ приходит за единицы мс
+#define COAP_MAX_RETRANSMIT 3
+#define COAP_TOKEN_SIZE 4
+
+/**
+ * @brief Отправляет документ запросом POST и ждет ответа 2.xx
+ *
+ * @param url ссылка coap://host[:port][/path]
+ * @param key токен (Uri-Query key=)
+ * @param email почта (Uri-Query email=)
+ * @param json данные
+ * @param json_settings настройки из json ответа сервера
+ * @param msgpack отправить тело в MessagePack вместо JSON
+ * @return true сервер ответил кодом 2.xx
+ */
+extern bool coap_post(const String &url, const char *key, const char *email, const JsonDocument &json, JsonDocument &json_settings, bool msgpack = false);
+
+#endif
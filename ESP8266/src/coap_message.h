@@ -0,0 +1,290 @@
+/**
+ * @file coap_message.h
+ * @brief Сборка и разбор сообщений CoAP (RFC 7252)
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Только то, что нужно для одного запроса POST: заголовок, токен, опции
+ * по возрастанию номера и полезная нагрузка после маркера 0xFF. Здесь нет
+ * сети, сообщения проверяются тестами на компьютере; отправка и повторы -
+ * в coap_client.cpp.
+ */
+#ifndef COAP_MESSAGE_H_
+#define COAP_MESSAGE_H_
+
+#include <Arduino.h>
+
+#define COAP_VERSION 1
+
+#define COAP_TYPE_CON 0 // подтверждаемое
+#define COAP_TYPE_NON 1
+#define COAP_TYPE_ACK 2
+#define COAP_TYPE_RST 3
+
+#define COAP_CODE(c, d) (uint8_t)(((c) << 5) | (d))
+#define COAP_CODE_EMPTY COAP_CODE(0, 0)
+#define COAP_CODE_POST COAP_CODE(0, 2)
+#define COAP_CODE_CLASS(code) ((code) >> 5)
+
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY 15
+
+#define COAP_FORMAT_JSON 50
+#define COAP_FORMAT_MSGPACK 65000 // у MessagePack нет номера, берем из экспериментальных
+
+#define COAP_HEADER_SIZE 4
+#define COAP_TOKEN_MAX 8
+#define COAP_PAYLOAD_MARKER 0xFF
+
+struct CoapMessage
+{
+    uint8_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_len;
+    uint8_t token[COAP_TOKEN_MAX];
+    const uint8_t *payload;
+    size_t payload_len;
+};
+
+/**
+ * @brief Пишет сообщение в буфер. Опции добавляются по возрастанию номера.
+ * При нехватке места ok() становится false, дальнейшие вызовы ничего не пишут.
+ */
+class CoapWriter
+{
+public:
+    CoapWriter(uint8_t *buf, const size_t size) : _buf(buf), _size(size) {}
+
+    void header(const uint8_t type, const uint8_t code, const uint16_t message_id, const uint8_t *token, const uint8_t token_len)
+    {
+        _len = 0;
+        _last_option = 0;
+        _ok = token_len <= COAP_TOKEN_MAX;
+        if (!reserve(COAP_HEADER_SIZE + token_len))
+        {
+            return;
+        }
+        _buf[0] = (COAP_VERSION << 6) | (type << 4) | token_len;
+        _buf[1] = code;
+        _buf[2] = message_id >> 8;
+        _buf[3] = message_id & 0xFF;
+        memcpy(_buf + COAP_HEADER_SIZE, token, token_len);
+        _len = COAP_HEADER_SIZE + token_len;
+    }
+
+    void option(const uint16_t number, const void *value, const uint16_t len)
+    {
+        if (!_ok || number < _last_option)
+        {
+            _ok = false;
+            return;
+        }
+        uint16_t delta = number - _last_option;
+        if (!reserve(1 + ext_size(delta) + ext_size(len) + len))
+        {
+            return;
+        }
+        uint8_t *first = _buf + _len++;
+        *first = (nibble(delta) << 4) | nibble(len);
+        put_ext(delta);
+        put_ext(len);
+        memcpy(_buf + _len, value, len);
+        _len += len;
+        _last_option = number;
+    }
+
+    // Беззнаковое значение без ведущих нулевых байт (0 - пустая опция)
+    void option_uint(const uint16_t number, const uint32_t value)
+    {
+        uint8_t bytes[4];
+        uint8_t len = 0;
+        for (int8_t shift = 24; shift >= 0; shift -= 8)
+        {
+            uint8_t b = value >> shift;
+            if (b || len)
+            {
+                bytes[len++] = b;
+            }
+        }
+        option(number, bytes, len);
+    }
+
+    // Uri-Path: по опции на каждый сегмент пути "/a/b"
+    void uri_path(const char *path)
+    {
+        while (*path)
+        {
+            while (*path == '/')
+            {
+                path++;
+            }
+            const char *end = path;
+            while (*end && *end != '/' && *end != '?')
+            {
+                end++;
+            }
+            if (end != path)
+            {
+                option(COAP_OPTION_URI_PATH, path, end - path);
+            }
+            if (*end == '?')
+            {
+                break;
+            }
+            path = end;
+        }
+    }
+
+    /**
+     * @brief Маркер нагрузки. Нагрузку вызывающий пишет сам по
+     * возвращенному указателю, не больше available() байт.
+     */
+    uint8_t *payload()
+    {
+        if (!reserve(1))
+        {
+            return nullptr;
+        }
+        _buf[_len++] = COAP_PAYLOAD_MARKER;
+        return _buf + _len;
+    }
+
+    size_t available() const { return _ok ? _size - _len : 0; }
+
+    // Длина вместе с записанными после payload() len байтами
+    size_t finish(const size_t payload_len)
+    {
+        if (!_ok || payload_len > _size - _len)
+        {
+            _ok = false;
+            return 0;
+        }
+        _len += payload_len;
+        return _len;
+    }
+
+    size_t length() const { return _len; }
+
+    bool ok() const { return _ok; }
+
+private:
+    static uint8_t nibble(const uint16_t v) { return v < 13 ? v : (v < 269 ? 13 : 14); }
+
+    static uint8_t ext_size(const uint16_t v) { return v < 13 ? 0 : (v < 269 ? 1 : 2); }
+
+    void put_ext(const uint16_t v)
+    {
+        if (v >= 269)
+        {
+            _buf[_len++] = (v - 269) >> 8;
+            _buf[_len++] = (v - 269) & 0xFF;
+        }
+        else if (v >= 13)
+        {
+            _buf[_len++] = v - 13;
+        }
+    }
+
+    bool reserve(const size_t n)
+    {
+        if (_ok && _len + n > _size)
+        {
+            _ok = false;
+        }
+        return _ok;
+    }
+
+    uint8_t *_buf;
+    size_t _size;
+    size_t _len = 0;
+    uint16_t _last_option = 0;
+    bool _ok = true;
+};
+
+// Расширенное значение дельты или длины опции
+inline bool coap_read_ext(const uint8_t nib, const uint8_t *&p, const uint8_t *end, uint16_t &value)
+{
+    if (nib < 13)
+    {
+        value = nib;
+    }
+    else if (nib == 13 && p < end)
+    {
+        value = 13 + *p++;
+    }
+    else if (nib == 14 && end - p >= 2)
+    {
+        value = 269 + ((p[0] << 8) | p[1]);
+        p += 2;
+    }
+    else
+    {
+        return false; // 15 зарезервировано под маркер
+    }
+    return true;
+}
+
+/**
+ * @brief Разбирает сообщение. Опции пропускаются, payload указывает в buf.
+ *
+ * @return true сообщение корректно
+ */
+inline bool coap_parse(const uint8_t *buf, const size_t len, CoapMessage &msg)
+{
+    if (len < COAP_HEADER_SIZE || (buf[0] >> 6) != COAP_VERSION)
+    {
+        return false;
+    }
+    msg.type = (buf[0] >> 4) & 0x03;
+    msg.token_len = buf[0] & 0x0F;
+    msg.code = buf[1];
+    msg.message_id = (buf[2] << 8) | buf[3];
+    msg.payload = nullptr;
+    msg.payload_len = 0;
+    if (msg.token_len > COAP_TOKEN_MAX || len < (size_t)COAP_HEADER_SIZE + msg.token_len)
+    {
+        return false;
+    }
+    memcpy(msg.token, buf + COAP_HEADER_SIZE, msg.token_len);
+
+    const uint8_t *p = buf + COAP_HEADER_SIZE + msg.token_len;
+    const uint8_t *end = buf + len;
+    while (p < end)
+    {
+        if (*p == COAP_PAYLOAD_MARKER)
+        {
+            p++;
+            if (p == end)
+            {
+                return false; // маркер без нагрузки запрещен
+            }
+            msg.payload = p;
+            msg.payload_len = end - p;
+            return true;
+        }
+        uint8_t first = *p++;
+        uint16_t delta, opt_len;
+        if (!coap_read_ext(first >> 4, p, end, delta) || !coap_read_ext(first & 0x0F, p, end, opt_len))
+        {
+            return false;
+        }
+        if ((size_t)(end - p) < opt_len)
+        {
+            return false;
+        }
+        p += opt_len;
+    }
+    return true;
+}
+
+// Сообщение - ответ на запрос с этим токеном
+inline bool coap_token_match(const CoapMessage &msg, const uint8_t *token, const uint8_t token_len)
+{
+    return msg.token_len == token_len && memcmp(msg.token, token, token_len) == 0;
+}
+
+#endif
@@ -4,12 +4,14 @@
 
 #include <ESP8266WiFi.h>
 #include <IPAddress.h>
-#include <EEPROM.h>
 #include "utils.h"
 #include "porting.h"
 #include "sync_time.h"
 #include "wifi_helpers.h"
 #include "flash_hal.h"
+#include "hot_state.h"
+#include "crc.h"
+#include <coredecls.h>
 
 
 // Конвертируем значение переменных компиляции в строк
@@ -17,23 +19,128 @@
 #define VALUE(x) VALUE_TO_STRING(x)
 #define VAR_NAME_VALUE(var) #var "=" VALUE(var)
 
-// Сохраняем конфигурацию в EEPROM
-void store_config(const Settings &sett)
+// Контрольная сумма холодной части настроек, записанной в EEPROM
+static uint16_t stored_cold_crc = 0;
+static bool stored_cold_valid = false;
+
+/*
+Настройки лежат в секторе EEPROM (A) и, где раскладка flash оставляет
+свободный сектор перед ним (4 МБ: между LittleFS и EEPROM), в запасном (B).
+Запись идет в сектор со старой копией, поэтому при пропадании питания во
+время стирания или записи остается предыдущая целая копия. Номер записи
+пишется последним и выбирает свежую копию. Прежний формат EEPROM (номер
+не записан, 0xFFFFFFFF) читается как запись с номером 0.
+*/
+#define CONFIG_SECTOR_A ((EEPROM_start - 0x40200000) / SPI_FLASH_SEC_SIZE)
+#define CONFIG_SECTOR_B (CONFIG_SECTOR_A - 1)
+#define CONFIG_READ_CHUNK 240 // чтение с подсчетом crc по частям, кратно 4
+
+struct ConfigTrailer
 {
-    uint16_t crc = get_checksum(sett);
-    EEPROM.begin(sizeof(sett) + sizeof(crc));
-    EEPROM.put(0, sett);
-    EEPROM.put(sizeof(sett), crc);
+    uint16_t crc;
+    uint16_t reserved; // 0xFFFF как в прежнем формате
+    uint32_t seq;      // номер записи, пишется последним
+};
+static_assert(sizeof(Settings) % 4 == 0, "Settings must be aligned to flash word");
+
+static uint32_t active_sector = 0; // сектор с последней целой копией, 0 - нет
+static uint32_t active_seq = 0;
 
-    if (!EEPROM.commit())
+static bool config_b_available()
+{
+    return FS_PHYS_ADDR + FS_PHYS_SIZE <= CONFIG_SECTOR_B * SPI_FLASH_SEC_SIZE;
+}
+
+static uint32_t trailer_seq(const ConfigTrailer &trailer)
+{
+    return trailer.seq == 0xFFFFFFFF ? 0 : trailer.seq;
+}
+
+// Читаем копию прямо в настройки, crc считаем по ходу чтения
+static bool read_config(const uint32_t sector, Settings &sett, const ConfigTrailer &trailer)
+{
+    const uint32_t address = sector * SPI_FLASH_SEC_SIZE;
+    const size_t covered = sizeof(Settings) - 2; // как в get_checksum
+    uint8_t *dst = (uint8_t *)&sett;
+    uint16_t crc = 0xFFFF;
+    for (size_t offset = 0; offset < sizeof(Settings); offset += CONFIG_READ_CHUNK)
+    {
+        size_t len = _min((size_t)CONFIG_READ_CHUNK, sizeof(Settings) - offset);
+        if (!ESP.flashRead(address + offset, (uint32_t *)(dst + offset), len))
+        {
+            return false;
+        }
+        if (offset < covered)
+        {
+            crc = crc16_modbus(dst + offset, _min(len, covered - offset), crc);
+        }
+    }
+    return crc == trailer.crc;
+}
+
+static uint16_t cold_checksum(const Settings &sett)
+{
+    Settings cold = sett;
+    hot_state_mask(cold);
+    return get_checksum(cold);
+}
+
+// Сохраняем конфигурацию на место старой копии
+static bool commit_config(const Settings &sett)
+{
+    ConfigTrailer trailer = {get_checksum(sett), 0xFFFF, active_seq + 1};
+    uint32_t sector = (config_b_available() && active_sector == CONFIG_SECTOR_A) ? CONFIG_SECTOR_B : CONFIG_SECTOR_A;
+    uint32_t address = sector * SPI_FLASH_SEC_SIZE;
+
+    bool result = ESP.flashEraseSector(sector) &&
+                  ESP.flashWrite(address, (const uint32_t *)&sett, sizeof(sett)) &&
+                  ESP.flashWrite(address + sizeof(sett), (const uint32_t *)&trailer, sizeof(trailer));
+    if (!result)
     {
         LOG_ERROR(F("Config stored FAILED"));
+        if (sector == active_sector)
+        {
+            active_sector = 0; // единственная копия испорчена
+        }
     }
     else
     {
-        LOG_INFO(F("Config stored OK crc=") << crc);
+        LOG_INFO(F("Config stored OK crc=") << trailer.crc << F(" sector=") << sector << F(" seq=") << trailer.seq);
+        active_sector = sector;
+        active_seq = trailer.seq;
+        stored_cold_crc = cold_checksum(sett);
+        stored_cold_valid = true;
+    }
+    return result;
+}
+
+// Горячие поля дописываем в журнал, сектор EEPROM стираем только при изменении остальных
+bool config_changed(const Settings &sett)
+{
+    return !stored_cold_valid || cold_checksum(sett) != stored_cold_crc;
+}
+
+void store_config(Settings &sett)
+{
+    bool cold_changed = config_changed(sett);
+    if (!cold_changed && !hot_state_changed(sett))
+    {
+        LOG_INFO(F("Config not changed"));
+        return;
+    }
+
+    sett.flash_writes++;
+    if (!cold_changed && hot_state_store(sett))
+    {
+        return;
+    }
+
+    sett.config_commits++;
+    sett.hot_seq = hot_state_commit(sett);
+    if (commit_config(sett))
+    {
+        hot_state_clear(sett);
     }
-    EEPROM.end();
 }
 
 // Инициализация параметров по умолчанию
@@ -55,9 +162,12 @@ bool init_config(Settings &sett)
 
     sett.waterius_on = (uint8_t)true;
     sett.http_on = (uint8_t)false;
+    sett.http_compact = (uint8_t)false;
+    sett.log_upload = (uint8_t)false;
     sett.mqtt_on = (uint8_t)false;
     sett.dhcp_off = (uint8_t)false;
     sett.mqtt_retain = (uint8_t)true;
+    sett.mqtt_changed_only = (uint8_t)false;
 
     //можно оптимизировать и загружать из PROGMEM, но ради 2х полей смысла не вижу
     //static const char WATERIUS_DEFAULT_DOMAIN[] PROGMEM =  "https://cloud.waterius.ru"
@@ -133,19 +243,43 @@ bool init_config(Settings &sett)
     return false;
 }
 
-/* Загружаем конфигурацию в EEPROM. true - успех. */
+/* Загружаем конфигурацию из свежей целой копии. true - успех. */
 bool load_config(Settings &sett)
 {
     LOG_INFO(F("Loading Config..."));
-    uint16_t crc = 0;
     Settings tmp_sett = {};
-    EEPROM.begin(sizeof(tmp_sett) + sizeof(crc)); //  4 до 4096 байт. с адреса 0x7b000.
-    EEPROM.get(0, tmp_sett);
-    EEPROM.get(sizeof(tmp_sett), crc);
-    EEPROM.end();
 
-    uint16_t calculated_crc = get_checksum(tmp_sett);
-    if (crc == calculated_crc)
+    // Сначала свежая копия, при ошибке crc - предыдущая
+    uint32_t sectors[2] = {CONFIG_SECTOR_A, CONFIG_SECTOR_B};
+    ConfigTrailer trailers[2] = {};
+    uint8_t count = config_b_available() ? 2 : 1;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!ESP.flashRead(sectors[i] * SPI_FLASH_SEC_SIZE + sizeof(Settings), (uint32_t *)&trailers[i], sizeof(ConfigTrailer)))
+        {
+            memset(&trailers[i], 0xFF, sizeof(ConfigTrailer));
+        }
+    }
+    if (count == 2 && trailer_seq(trailers[1]) > trailer_seq(trailers[0]))
+    {
+        std::swap(sectors[0], sectors[1]);
+        std::swap(trailers[0], trailers[1]);
+    }
+
+    active_sector = 0;
+    active_seq = 0;
+    stored_cold_valid = false;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (read_config(sectors[i], tmp_sett, trailers[i]))
+        {
+            active_sector = sectors[i];
+            active_seq = trailer_seq(trailers[i]);
+            break;
+        }
+        LOG_INFO(F("Config sector ") << sectors[i] << F(" is empty or damaged"));
+    }
+    if (active_sector)
     {
         if (tmp_sett.version != sett.version)
         {
@@ -164,6 +298,10 @@ bool load_config(Settings &sett)
             sett = tmp_sett;
             LOG_INFO(F("Configuration CRC ok"));
 
+            stored_cold_crc = cold_checksum(sett);
+            stored_cold_valid = true;
+            hot_state_load(sett);
+
             // Для безопасной работы с буферами,  в библиотеках может не быть проверок
             sett.waterius_host[HOST_LEN - 1] = 0;
             sett.waterius_key[WATERIUS_KEY_LEN - 1] = 0;
@@ -246,7 +384,6 @@ bool load_config(Settings &sett)
     else
     {
         LOG_INFO(F("ESP config CRC failed. Maybe first run. Init configuration."));
-        LOG_INFO(F("Saved crc=") << crc << F(" calculated=") << calculated_crc);
         return init_config(sett);
     }
 }
@@ -369,14 +506,162 @@ uint16_t tune_wakeup(const time_t &now, const time_t &base_time, const time_t &l
     return new_period_min_tuned;
 }
 
+uint32_t wakeup_slot_sec(const Settings &sett, const uint16_t period_min)
+{
+    uint32_t period_sec = (uint32_t)period_min * 60;
+    if (!period_sec)
+    {
+        return 0;
+    }
+    if (sett.wakeup_slot)
+    {
+        return (uint32_t)(sett.wakeup_slot - 1) * 60 % period_sec;
+    }
+    // chip id идут почти подряд, crc32 разносит соседние по всему периоду
+    uint32_t chip_id = getChipId();
+    return crc32(&chip_id, sizeof(chip_id)) % period_sec;
+}
+
+time_t wakeup_base_time(const Settings &sett, const uint16_t period_min)
+{
+#ifndef WAKEUP_SLOT_DISABLED
+    return sett.base_time + wakeup_slot_sec(sett, period_min);
+#else
+    return sett.base_time;
+#endif
+}
+
+void wakeup_defer(Settings &sett, const uint32_t seconds)
+{
+    if (!seconds)
+    {
+        return;
+    }
+    // минуты attiny идут в clock_ratio раз медленнее настоящих
+    double minutes = ceil(seconds / 60.0);
+    if (sett.clock_ratio)
+    {
+        minutes = ceil(minutes * CLOCK_RATIO_SCALE / sett.clock_ratio);
+    }
+    uint16_t period = minutes >= UINT16_MAX ? UINT16_MAX : (uint16_t)minutes;
+    if (period > sett.period_min_tuned)
+    {
+        LOG_INFO(F("Defer: server busy for ") << seconds << F(" s, period_min_tuned=") << period);
+        sett.period_min_tuned = period;
+    }
+}
+
 /* Сбрасываем скорректированный период после изменения периода пользователем */
 void reset_period_min_tuned(Settings &sett)
 {
     sett.period_min_tuned = sett.wakeup_per_min * 0.9;   
+    sett.period_policy_min = 0;
+    sett.idle_min = 0;
     LOG_INFO(F("RESET: period_min_tuned=") << sett.period_min_tuned);
 
 }
 
+uint16_t wakeup_period_min(const Settings &sett)
+{
+    return sett.period_policy_min ? sett.period_policy_min : sett.wakeup_per_min;
+}
+
+/* Расход во всех последних WAKEUP_POLICY_LEAK_PERIODS интервалах attiny */
+static bool leak_suspected(const uint16_t *delta, const AttinySnapshots &snapshots)
+{
+    if (snapshots.count < WAKEUP_POLICY_LEAK_PERIODS)
+    {
+        return false;
+    }
+    for (uint8_t i = snapshots.count - WAKEUP_POLICY_LEAK_PERIODS; i < snapshots.count; i++)
+    {
+        if (!delta[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Расход за прошлый период, л/ч, больше порога. Электричество не учитываем */
+static bool high_flow(uint8_t counter_name, uint32_t delta, uint16_t period_min)
+{
+    return counter_name != CounterName::ELECTRO && (uint32_t)delta * 60 > (uint32_t)WAKEUP_POLICY_HIGH_FLOW_LPH * period_min;
+}
+
+bool wifi_backoff(Settings &sett, const uint8_t mode)
+{
+    if (mode != TRANSMIT_MODE || !sett.wifi_backoff_skip)
+    {
+        return false;
+    }
+    sett.wifi_backoff_skip--;
+    LOG_INFO(F("WIFI: backoff after ") << sett.wifi_fail_streak << F(" failures, ") << sett.wifi_backoff_skip << F(" wakes left"));
+    return true;
+}
+
+void wifi_backoff_result(Settings &sett, const bool connected)
+{
+    if (connected)
+    {
+        sett.wifi_fail_streak = 0;
+        sett.wifi_backoff_skip = 0;
+        return;
+    }
+    if (sett.wifi_fail_streak < UINT8_MAX)
+    {
+        sett.wifi_fail_streak++;
+    }
+    if (sett.wifi_fail_streak >= WIFI_BACKOFF_FAILURES)
+    {
+        uint8_t shift = _min(sett.wifi_fail_streak - WIFI_BACKOFF_FAILURES, 7);
+        sett.wifi_backoff_skip = _min(1 << shift, WIFI_BACKOFF_MAX_SKIP);
+    }
+}
+
+uint16_t wakeup_policy(Settings &sett, const CalculatedData &cdata, const AttinySnapshots &snapshots, const bool low_battery)
+{
+    uint16_t period = wakeup_period_min(sett);
+    uint16_t lo = sett.wakeup_per_min_lo ? _min(sett.wakeup_per_min_lo, sett.wakeup_per_min) : sett.wakeup_per_min;
+    uint16_t hi = sett.wakeup_per_min_hi ? _max(sett.wakeup_per_min_hi, sett.wakeup_per_min) : sett.wakeup_per_min;
+
+    bool flow = cdata.delta0 || cdata.delta1;
+    sett.idle_min = flow ? 0 : _min((uint32_t)sett.idle_min + period, (uint32_t)UINT16_MAX);
+
+    if (lo == hi)
+    {
+        sett.period_policy_min = 0;
+        return sett.wakeup_per_min;
+    }
+
+    uint16_t next = sett.wakeup_per_min;
+    if (low_battery)
+    {
+        next = hi;
+        LOG_INFO(F("Policy: low battery"));
+    }
+    else if ((sett.counter0_name != CounterName::ELECTRO && leak_suspected(snapshots.delta0, snapshots)) ||
+             (sett.counter1_name != CounterName::ELECTRO && leak_suspected(snapshots.delta1, snapshots)))
+    {
+        next = lo;
+        LOG_INFO(F("Policy: leak suspected"));
+    }
+    else if (high_flow(sett.counter0_name, cdata.delta0, period) || high_flow(sett.counter1_name, cdata.delta1, period))
+    {
+        next = _max(lo, period / 2);
+        LOG_INFO(F("Policy: high flow"));
+    }
+    else if (sett.idle_min >= WAKEUP_POLICY_IDLE_MIN)
+    {
+        next = _min((uint32_t)hi, (uint32_t)period * 2);
+        LOG_INFO(F("Policy: idle_min=") << sett.idle_min);
+    }
+
+    sett.period_policy_min = next == sett.wakeup_per_min ? 0 : next;
+    LOG_INFO(F("Policy: period=") << next << F(" lo=") << lo << F(" hi=") << hi);
+    return next;
+}
+
 /* Обновляем значения в конфиге */
 void update_config(Settings &sett, const AttinyData &data, const CalculatedData &cdata)
 {
@@ -409,12 +694,20 @@ void update_config(Settings &sett, const AttinyData &data, const CalculatedData
         LOG_INFO(F("Manual/first wakeup: base_time reset"));
     }
 
-    LOG_INFO(F("Wakeup period, min:") << sett.wakeup_per_min);
+    LOG_INFO(F("Wakeup period, min:") << sett.wakeup_per_min << F(" policy:") << wakeup_period_min(sett));
 
     // Корректируем период пробуждения только для автоматического режима
     if (sett.mode == TRANSMIT_MODE)
     {    
-        sett.period_min_tuned = tune_wakeup(now, sett.base_time, sett.last_send, sett.wakeup_per_min, sett.period_min_tuned);
+        uint16_t period_min = wakeup_period_min(sett);
+        sett.period_min_tuned = tune_wakeup(now, wakeup_base_time(sett, period_min), sett.last_send, period_min, sett.period_min_tuned);
+    }
+
+    // Внеочередное пробуждение по тревоге attiny не сдвигает расписание:
+    // коррекция периода считает сон от прошлого обычного пробуждения
+    if (sett.mode == ALARM_TRANSMIT_MODE)
+    {
+        return;
     }
 
     // Обновляем метку последней активности
@@ -432,11 +725,18 @@ void factory_reset(Settings &sett)
     LOG_INFO(F("EEPROM erased"));
 
     // The flash cache maps the physical flash into the address space at offset  \ FS_PHYS_ADDR - ?
-    ESP.flashEraseSector(((EEPROM_start - 0x40200000) / SPI_FLASH_SEC_SIZE));
-    LOG_INFO(F("0x40200000 erased"));
+    ESP.flashEraseSector(CONFIG_SECTOR_A);
+    if (config_b_available())
+    {
+        ESP.flashEraseSector(CONFIG_SECTOR_B);
+    }
+    active_sector = 0;
+    active_seq = 0;
+    LOG_INFO(F("Config sectors erased"));
 
     delay(500);
 
+    stored_cold_valid = false;
     init_config(sett);
     strncpy0(sett.waterius_key, waterius_key.c_str(), WATERIUS_KEY_LEN);
     LOG_INFO(F("Restore waterius_key=") << sett.waterius_key);
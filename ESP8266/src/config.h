@@ -7,8 +7,11 @@
 
 #include "setup.h"
 
-/* Сохраняем конфигурацию в EEPROM */
-extern void store_config(const Settings &sett);
+/* Сохраняем конфигурацию в EEPROM, если она изменилась. Считает записи во flash */
+extern void store_config(Settings &sett);
+
+/* Изменились ли настройки, кроме часто меняющихся полей (hot_state.h), с последней записи */
+extern bool config_changed(const Settings &sett);
 
 /* Читаем конфигурацию из EEPROM */
 extern bool load_config(Settings &sett);
@@ -17,11 +20,54 @@ extern bool load_config(Settings &sett);
 extern bool init_config(Settings &sett);
 
 /* Корректируем период пробуждения только для автоматического режима */
-uint16_t tune_wakeup(const time_t &now, const time_t &base_time, const uint16_t &wakeup_per_min);
+uint16_t tune_wakeup(const time_t &now, const time_t &base_time, const time_t &last_send,
+                     const uint16_t &wakeup_per_min, const uint16_t &period_min_tuned);
+
+/*
+Место пробуждений в периоде: сдвиг от base_time, с. Без назначенного сервером
+wakeup_slot - по crc32 chip id: устройства, настроенные в одно время,
+просыпаются равномерно в течение периода, а не пачкой.
+*/
+extern uint32_t wakeup_slot_sec(const Settings &sett, const uint16_t period_min);
+
+/* Опорная точка расписания для tune_wakeup: base_time со сдвигом на место устройства в периоде */
+extern time_t wakeup_base_time(const Settings &sett, const uint16_t period_min);
 
 /* Сбрасываем скорректированный период после изменения периода пользователем */
 extern void reset_period_min_tuned(Settings &sett);
 
+/* Период пробуждения с учетом политики, мин */
+extern uint16_t wakeup_period_min(const Settings &sett);
+
+/*
+Политика периода пробуждения в границах wakeup_per_min_lo..wakeup_per_min_hi:
+минимальный при подозрении на протечку, вдвое короче при большом расходе,
+вдвое длиннее после WAKEUP_POLICY_IDLE_MIN минут без расхода, максимальный
+при разряженной батарее. Сохраняет выбранный период в period_policy_min,
+его использует update_config для коррекции по времени.
+*/
+extern uint16_t wakeup_policy(Settings &sett, const CalculatedData &cdata, const AttinySnapshots &snapshots, const bool low_battery);
+
+/*
+Отсрочка подключения к Wi-Fi. После WIFI_BACKOFF_FAILURES неудач подряд
+обычные пробуждения (TRANSMIT_MODE) пропускаются без подключения: 1, 2, 4...
+до WIFI_BACKOFF_MAX_SKIP пробуждений между попытками. Пробуждение кнопкой
+и по тревоге подключаются всегда.
+Возвращает true, если в это пробуждение не подключаемся.
+*/
+extern bool wifi_backoff(Settings &sett, const uint8_t mode);
+
+/* Учитывает результат подключения для отсрочки */
+extern void wifi_backoff_result(Settings &sett, const bool connected);
+
+/*
+Откладывает следующее пробуждение не раньше чем через seconds (сервер перегружен:
+429/503 с Retry-After или retry_after в ответе). Вызывается после update_config,
+период attiny пересчитывается по коэффициенту хода ее часов. Следующая коррекция
+вернет пробуждения на расписание.
+*/
+extern void wakeup_defer(Settings &sett, const uint32_t seconds);
+
 /* Обновляем данные в конфиге*/
 extern void update_config(Settings &sett, const AttinyData &data, const CalculatedData &cdata);
 
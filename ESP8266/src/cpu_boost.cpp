@@ -0,0 +1,49 @@
+#include "cpu_boost.h"
+#include <user_interface.h>
+
+static uint8_t depth = 0;
+static uint8_t base_mhz = 0;
+static uint32_t boost_start_us = 0;
+static uint32_t boost_total_us = 0;
+
+CpuBoost::CpuBoost(const bool active)
+    : _active(active)
+{
+#ifndef CPU_BOOST_DISABLED
+    if (!_active || depth++)
+    {
+        return;
+    }
+    base_mhz = system_get_cpu_freq();
+    if (base_mhz < CPU_BOOST_MHZ)
+    {
+        system_update_cpu_freq(CPU_BOOST_MHZ);
+    }
+    boost_start_us = micros();
+#endif
+}
+
+CpuBoost::~CpuBoost()
+{
+#ifndef CPU_BOOST_DISABLED
+    if (!_active || --depth)
+    {
+        return;
+    }
+    if (base_mhz < CPU_BOOST_MHZ)
+    {
+        system_update_cpu_freq(base_mhz);
+        boost_total_us += micros() - boost_start_us;
+    }
+#endif
+}
+
+uint32_t cpu_boost_ms()
+{
+    uint32_t total_us = boost_total_us;
+    if (depth && base_mhz < CPU_BOOST_MHZ)
+    {
+        total_us += micros() - boost_start_us;
+    }
+    return total_us / 1000;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file cpu_boost.h
+ * @brief Повышенная частота CPU на время вычислительных фаз
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Прошивка собрана на 80 МГц. Рукопожатие TLS, шифрование тела запроса и
+ * формирование json упираются в процессор, а радио все это время включено:
+ * на 160 МГц фаза короче, и за цикл батарея отдает меньше, хотя ток выше.
+ * CpuBoost переключает частоту на время своей жизни, вложенные - по
+ * внешнему. Время на повышенной частоте уходит в "timing" json и в модель
+ * energy, а выигрыш виден по времени фаз профайлера.
+ */
+#ifndef CPU_BOOST_H_
+#define CPU_BOOST_H_
+
+#include <Arduino.h>
+
+#ifndef CPU_BOOST_MHZ
+#define CPU_BOOST_MHZ 160
+#endif
+
+class CpuBoost
+{
+public:
+    /**
+     * @param active false - частота не меняется (например, http без TLS)
+     */
+    explicit CpuBoost(const bool active = true);
+    ~CpuBoost();
+
+private:
+    bool _active;
+};
+
+/**
+ * @brief Время на повышенной частоте за текущее пробуждение, мс
+ */
+extern uint32_t cpu_boost_ms();
+
+#endif
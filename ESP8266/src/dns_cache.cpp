@@ -0,0 +1,302 @@
+#include "dns_cache.h"
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+#include <coredecls.h>
+#include "Logging.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include "sync_time.h"
+#include "utils.h"
+
+struct DnsLookup
+{
+    String host;
+    uint32_t host_crc;
+    uint32_t start;
+    IPAddress ip;
+    volatile bool done;
+    bool cache; // сохранять адрес в кэш
+};
+
+static DnsLookup lookups[DNS_LOOKUP_SIZE];
+static uint8_t lookup_count = 0;
+static DnsCacheFile cache;
+static bool cache_loaded = false;
+
+static uint32_t cache_crc(const DnsCacheFile &file_cache)
+{
+    return crc32(&file_cache, offsetof(DnsCacheFile, crc));
+}
+
+static uint32_t host_crc(const String &host)
+{
+    return crc32(host.c_str(), host.length());
+}
+
+static void load_cache()
+{
+    if (cache_loaded)
+    {
+        return;
+    }
+    cache_loaded = true;
+
+    bool valid = false;
+    if (fs_begin())
+    {
+        File file = LittleFS.open(DNS_CACHE_FILE, "r");
+        if (file)
+        {
+            valid = file.read((uint8_t *)&cache, sizeof(cache)) == sizeof(cache) &&
+                    cache.crc == cache_crc(cache);
+            file.close();
+        }
+    }
+    if (!valid)
+    {
+        memset(&cache, 0, sizeof(cache));
+    }
+}
+
+// Адрес получен от DNS не раньше DNS_CACHE_MAX_AGE назад
+static bool is_fresh(const DnsCacheEntry &entry)
+{
+    time_t now = time(nullptr);
+    return is_valid_time(now) && entry.resolved && now >= entry.resolved && now - entry.resolved < (time_t)DNS_CACHE_MAX_AGE;
+}
+
+static int find_entry(uint32_t crc)
+{
+    for (uint8_t i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        if (cache.entries[i].ip && cache.entries[i].host_crc == crc)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static DnsLookup *find_lookup(uint32_t crc)
+{
+    for (uint8_t i = 0; i < lookup_count; i++)
+    {
+        if (lookups[i].host_crc == crc)
+        {
+            return &lookups[i];
+        }
+    }
+    return nullptr;
+}
+
+static void dns_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    DnsLookup *lookup = (DnsLookup *)arg;
+    if (ipaddr)
+    {
+        lookup->ip = IPAddress(ipaddr);
+    }
+    lookup->done = true;
+}
+
+static DnsLookup *dns_start(const String &host, const bool cache = true)
+{
+    IPAddress ip;
+    if (!host.length() || ip.fromString(host))
+    {
+        return nullptr;
+    }
+
+    uint32_t crc = host_crc(host);
+    DnsLookup *lookup = find_lookup(crc);
+    if (lookup)
+    {
+        lookup->cache |= cache;
+        return lookup;
+    }
+    if (lookup_count == DNS_LOOKUP_SIZE)
+    {
+        return nullptr;
+    }
+
+    lookup = &lookups[lookup_count++];
+    lookup->host = host;
+    lookup->host_crc = crc;
+    lookup->start = millis();
+    lookup->ip = IPAddress();
+    lookup->done = false;
+    lookup->cache = cache;
+
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(lookup->host.c_str(), &addr, dns_found, lookup);
+    if (err == ERR_OK)
+    {
+        lookup->ip = IPAddress(&addr);
+        lookup->done = true;
+    }
+    else if (err != ERR_INPROGRESS)
+    {
+        LOG_ERROR(F("DNS: Lookup failed ") << host);
+        lookup->done = true;
+    }
+    return lookup;
+}
+
+void dns_prefetch(const Settings &sett)
+{
+    load_cache();
+
+    if (is_mqtt(sett))
+    {
+        dns_start(sett.mqtt_host);
+    }
+    if (is_mqtt(sett) || is_https(sett.waterius_host) || is_https(sett.http_url))
+    {
+        dns_start(get_ntp_server_name(sett));
+    }
+    if (is_waterius_site(sett))
+    {
+        dns_start(get_host(sett.waterius_host));
+    }
+    if (is_http(sett))
+    {
+        dns_start(get_host(sett.http_url));
+    }
+    LOG_INFO(F("DNS: ") << lookup_count << F(" lookups started"));
+}
+
+bool dns_resolve(const String &host, IPAddress &ip)
+{
+    if (ip.fromString(host))
+    {
+        return true;
+    }
+
+    load_cache();
+    uint32_t crc = host_crc(host);
+    int index = find_entry(crc);
+    if (index >= 0 && is_fresh(cache.entries[index]))
+    {
+        ip = cache.entries[index].ip;
+        LOG_INFO(F("DNS: ") << host << F(" cached ") << ip.toString());
+        return true;
+    }
+
+    DnsLookup *lookup = dns_start(host);
+    if (!lookup)
+    {
+        // таблица запросов заполнена, разрешаем обычным способом
+        return WiFi.hostByName(host.c_str(), ip, DNS_TIMEOUT) == 1;
+    }
+
+    bool has_last = DNS_LAST_IP_FALLBACK && index >= 0;
+    uint32_t timeout = has_last ? DNS_SLOW_TIMEOUT : DNS_TIMEOUT;
+    while (!lookup->done && millis() - lookup->start < timeout)
+    {
+        delay(1);
+    }
+
+    if (lookup->done && lookup->ip.isSet())
+    {
+        ip = lookup->ip;
+        LOG_INFO(F("DNS: ") << host << F(" resolved ") << ip.toString() << F(" in ") << millis() - lookup->start << F(" ms"));
+        return true;
+    }
+    if (has_last)
+    {
+        ip = cache.entries[index].ip;
+        LOG_INFO(F("DNS: ") << host << F(" is slow, use last ") << ip.toString());
+        return true;
+    }
+
+    LOG_ERROR(F("DNS: Unable to resolve ") << host);
+    return false;
+}
+
+bool dns_poll(const String &host, IPAddress &ip)
+{
+    if (ip.fromString(host))
+    {
+        return true;
+    }
+
+    load_cache();
+    int index = find_entry(host_crc(host));
+    if (index >= 0 && is_fresh(cache.entries[index]))
+    {
+        ip = cache.entries[index].ip;
+        return true;
+    }
+
+    DnsLookup *lookup = dns_start(host, false);
+    if (!lookup)
+    {
+        return true; // таблица запросов заполнена
+    }
+    if (lookup->done && lookup->ip.isSet())
+    {
+        ip = lookup->ip;
+    }
+    return lookup->done || millis() - lookup->start >= DNS_TIMEOUT;
+}
+
+void dns_cache_store()
+{
+    if (!cache_loaded)
+    {
+        return;
+    }
+
+    time_t now = time(nullptr);
+    bool changed = false;
+    for (uint8_t i = 0; i < lookup_count; i++)
+    {
+        DnsLookup &lookup = lookups[i];
+        if (!lookup.cache || !lookup.done || !lookup.ip.isSet())
+        {
+            continue;
+        }
+
+        int index = find_entry(lookup.host_crc);
+        if (index >= 0 && cache.entries[index].ip == (uint32_t)lookup.ip && is_fresh(cache.entries[index]))
+        {
+            continue;
+        }
+        if (index < 0)
+        {
+            // занимаем свободную или самую старую запись
+            index = 0;
+            for (uint8_t j = 0; j < DNS_CACHE_SIZE; j++)
+            {
+                if (!cache.entries[j].ip)
+                {
+                    index = j;
+                    break;
+                }
+                if (cache.entries[j].resolved < cache.entries[index].resolved)
+                {
+                    index = j;
+                }
+            }
+        }
+        cache.entries[index].host_crc = lookup.host_crc;
+        cache.entries[index].ip = (uint32_t)lookup.ip;
+        cache.entries[index].resolved = is_valid_time(now) ? now : 0;
+        changed = true;
+    }
+
+    if (!changed || !fs_begin())
+    {
+        return;
+    }
+    cache.crc = cache_crc(cache);
+    File file = LittleFS.open(DNS_CACHE_FILE, "w");
+    if (!file || file.write((const uint8_t *)&cache, sizeof(cache)) != sizeof(cache))
+    {
+        LOG_ERROR(F("DNS: Failed to store cache"));
+    }
+    if (file)
+    {
+        file.close();
+    }
+}
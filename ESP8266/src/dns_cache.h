@@ -0,0 +1,77 @@
+/**
+ * @file dns_cache.h
+ * @brief Параллельное разрешение имен серверов и кэш адресов на LittleFS
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Сразу после подключения к wifi запросы DNS для всех нужных в этом цикле
+ * серверов (NTP, MQTT, сайт Ватериуса, http_url) уходят одновременно,
+ * ответы приходят в колбеке lwIP, пока идут другие фазы.
+ * Последние адреса хранятся в файле на LittleFS (RTC память не переживает
+ * снятие питания attiny): свежий адрес (младше DNS_CACHE_MAX_AGE секунд)
+ * используется без ожидания ответа, а устаревший - если DNS не ответил
+ * за DNS_SLOW_TIMEOUT. Файл перезаписывается, только когда адрес сменился
+ * или устаревший адрес подтвержден новым ответом.
+ *
+ * Для https соединение все равно устанавливается по имени (нужен SNI),
+ * но имя к этому моменту уже лежит в таблице lwIP после параллельного запроса.
+ */
+#ifndef DNS_CACHE_H_
+#define DNS_CACHE_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include "setup.h"
+
+#define DNS_CACHE_FILE "/dns.bin"
+#define DNS_CACHE_SIZE 4
+#define DNS_LOOKUP_SIZE (DNS_CACHE_SIZE + 2) // и запасные серверы NTP, их адреса не кэшируются
+
+struct DnsCacheEntry
+{
+    uint32_t host_crc;
+    uint32_t ip;
+    time_t resolved; // время последнего ответа DNS, 0 - неизвестно
+};
+
+struct DnsCacheFile
+{
+    DnsCacheEntry entries[DNS_CACHE_SIZE];
+    uint32_t crc;
+};
+
+/**
+ * @brief Запускает запросы DNS для всех серверов из настроек
+ *
+ * @param sett настройки
+ */
+extern void dns_prefetch(const Settings &sett);
+
+/**
+ * @brief Возвращает адрес сервера: из кэша, из ответа на запрос
+ * или после ожидания ответа
+ *
+ * @param host имя сервера или ip адрес строкой
+ * @param ip адрес
+ * @return true адрес получен
+ */
+extern bool dns_resolve(const String &host, IPAddress &ip);
+
+/**
+ * @brief Адрес сервера без ожидания: из кэша или из завершенного запроса.
+ * Если запроса еще нет, запускает его. Такой адрес в кэш не сохраняется.
+ *
+ * @param host имя сервера или ip адрес строкой
+ * @param ip адрес, если запрос завершился успешно
+ * @return true запрос завершен (успешно или нет), false - ответа еще нет
+ */
+extern bool dns_poll(const String &host, IPAddress &ip);
+
+/**
+ * @brief Сохраняет изменившиеся адреса на LittleFS
+ */
+extern void dns_cache_store();
+
+#endif
@@ -0,0 +1,102 @@
+#include "energy.h"
+#include "Logging.h"
+#include "profiler.h"
+#include "config.h"
+#include "voltage.h"
+#include "cpu_boost.h"
+
+extern Voltage voltage;
+
+// Ток ESP в каждой фазе профайлера, мА
+static const uint8_t PHASE_MA[PHASE_COUNT] = {
+    ENERGY_IDLE_MA, // i2c
+    ENERGY_RX_MA,   // wifi
+    ENERGY_RX_MA,   // mqtt
+    ENERGY_RX_MA,   // ntp
+    ENERGY_TX_MA,   // send
+    ENERGY_RX_MA,   // ota
+    ENERGY_IDLE_MA  // shutdown
+};
+
+uint16_t energy_account(Settings &sett)
+{
+    ProfilerCycle cycle;
+    profiler_cycle(cycle);
+
+    // мА * мс = мкА * с
+    uint32_t wake_uas = 0;
+    uint32_t phases_ms = 0;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++)
+    {
+        wake_uas += (uint32_t)cycle.phase_ms[i] * PHASE_MA[i];
+        phases_ms += cycle.phase_ms[i];
+    }
+    // Загрузка, чтение настроек, json и все, что вне фаз
+    if (cycle.total_ms > phases_ms)
+    {
+        wake_uas += (cycle.total_ms - phases_ms) * ENERGY_IDLE_MA;
+    }
+    // Фазы на повышенной частоте короче, но ток в них выше
+    wake_uas += cpu_boost_ms() * ENERGY_BOOST_MA;
+
+    uint32_t sleep_uas = (uint32_t)wakeup_period_min(sett) * 60 * ENERGY_SLEEP_UA;
+    uint32_t cycle_uah = (wake_uas + sleep_uas + 1800) / 3600;
+
+    sett.energy_cycle_uah = _min(cycle_uah, (uint32_t)UINT16_MAX);
+    sett.energy_uah += cycle_uah;
+
+    LOG_INFO(F("ENERGY: wake=") << (wake_uas + 1800) / 3600 << F(" sleep=") << (sleep_uas + 1800) / 3600
+                                << F(" uAh total=") << sett.energy_uah / 1000 << F(" mAh days=") << energy_battery_days(sett));
+    return sett.energy_cycle_uah;
+}
+
+void energy_reset(Settings &sett)
+{
+    sett.energy_uah = 0;
+    sett.energy_cycle_uah = 0;
+}
+
+uint16_t energy_battery_days(const Settings &sett)
+{
+    uint32_t capacity_uah = (uint32_t)ENERGY_BATTERY_MAH * 1000;
+    uint16_t period = wakeup_period_min(sett);
+    if (!sett.energy_cycle_uah || !period || sett.energy_uah >= capacity_uah)
+    {
+        return 0;
+    }
+    // Расход в сутки: циклов в сутках * расход цикла
+    uint32_t day_uah = (uint32_t)sett.energy_cycle_uah * 1440 / period;
+    if (!day_uah)
+    {
+        day_uah = 1;
+    }
+    return _min((capacity_uah - sett.energy_uah) / day_uah, (uint32_t)UINT16_MAX);
+}
+
+bool energy_battery_low(const Settings &sett)
+{
+    if (voltage.low_voltage())
+    {
+        return true;
+    }
+    if (!sett.energy_cycle_uah || !sett.wakeup_per_min)
+    {
+        return false;
+    }
+    // Прогноз при периоде пользователя: с удлиненным политикой периодом
+    // он растет, и иначе период переключался бы туда и обратно
+    uint32_t capacity_uah = (uint32_t)ENERGY_BATTERY_MAH * 1000;
+    uint32_t need_uah = (uint32_t)sett.energy_cycle_uah * 1440 / sett.wakeup_per_min * WAKEUP_POLICY_LOW_BATTERY_DAYS;
+    return sett.energy_uah + need_uah >= capacity_uah;
+}
+
+void energy_fill_json(const Settings &sett, JsonObject &root)
+{
+    if (!sett.energy_cycle_uah)
+    {
+        return;
+    }
+    root[F("cycle_uah")] = sett.energy_cycle_uah;
+    root[F("energy_mah")] = sett.energy_uah / 1000;
+    root[F("battery_days")] = energy_battery_days(sett);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file energy.h
+ * @brief Оценка расхода батареи за цикл пробуждения
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Амперметра на плате нет, поэтому расход считается по модели: время фаз
+ * из профайлера умножается на типовой ток ESP в этой фазе, к нему добавляется
+ * ток сна attiny со стабилизатором за период пробуждения. Расход цикла и
+ * накопленный с настройки расход хранятся в горячих полях настроек, в json
+ * уходят вместе с оценкой оставшихся дней работы батареи.
+ */
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "setup.h"
+
+/*
+Типовые токи, мА. Радио ESP включено с момента старта, поэтому
+и без передачи (загрузка, i2c) ток близок к приему.
+*/
+#ifndef ENERGY_IDLE_MA
+#define ENERGY_IDLE_MA 70 // процессор, радио без передачи
+#endif
+#ifndef ENERGY_RX_MA
+#define ENERGY_RX_MA 75 // подключение к wifi, ntp, mqtt, ota: прием и короткие пакеты
+#endif
+#ifndef ENERGY_TX_MA
+#define ENERGY_TX_MA 120 // отправка показаний: в среднем с пиками передачи 170 мА
+#endif
+#ifndef ENERGY_BOOST_MA
+#define ENERGY_BOOST_MA 10 // добавка к току фазы на CPU_BOOST_MHZ (cpu_boost.h)
+#endif
+#ifndef ENERGY_SLEEP_UA
+#define ENERGY_SLEEP_UA 10 // сон: attiny и стабилизатор, ESP обесточена (7-15 мкА)
+#endif
+#ifndef ENERGY_BATTERY_MAH
+#define ENERGY_BATTERY_MAH 2500 // 3 последовательные батарейки АА
+#endif
+
+/**
+ * @brief Добавляет расход текущего пробуждения и следующего сна
+ * к накопленному. Вызывается перед сохранением настроек.
+ *
+ * @param sett настройки
+ * @return расход цикла, мкА*ч
+ */
+extern uint16_t energy_account(Settings &sett);
+
+/**
+ * @brief Обнуляет накопленный расход (после настройки, замены батареек)
+ *
+ * @param sett настройки
+ */
+extern void energy_reset(Settings &sett);
+
+/**
+ * @brief Прогноз работы от батареи по расходу прошлого цикла
+ *
+ * @param sett настройки
+ * @return дней, 0 - расход еще не известен или емкость исчерпана
+ */
+extern uint16_t energy_battery_days(const Settings &sett);
+
+/**
+ * @brief Батарея разряжена: по напряжению или прогноз energy меньше
+ * WAKEUP_POLICY_LOW_BATTERY_DAYS дней
+ *
+ * @param sett настройки
+ */
+extern bool energy_battery_low(const Settings &sett);
+
+/**
+ * @brief Добавляет расход прошлого цикла, накопленный расход
+ * и прогноз дней работы батареи
+ *
+ * @param sett настройки
+ * @param root корневой объект json
+ */
+extern void energy_fill_json(const Settings &sett, JsonObject &root);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * @file espnow_frame.h
+ * @brief Кадр показаний ESP-NOW и таблица устройств шлюза
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Кадр - 40 байт: показания и напряжение одного пробуждения, номер кадра
+ * и первые ESPNOW_TAG_SIZE байт HMAC-SHA256 общим ключом (подпись считает
+ * espnow_link.cpp). Шлюз хранит последний кадр каждого устройства и отбрасывает
+ * кадры с номером не больше принятого: записанный в эфире кадр не повторить.
+ * Здесь только логика без радио, она проверяется тестами на компьютере.
+ */
+#ifndef ESPNOW_FRAME_H_
+#define ESPNOW_FRAME_H_
+
+#include <Arduino.h>
+#include "setup.h"
+
+#define ESPNOW_FRAME_MAGIC 0x5745 // "WE"
+#define ESPNOW_FRAME_VERSION 1
+#define ESPNOW_TAG_SIZE 8
+
+#ifndef ESPNOW_GATEWAY_DEVICES
+#define ESPNOW_GATEWAY_DEVICES 32 // устройств на шлюз
+#endif
+
+struct __attribute__((packed)) EspNowFrame
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t mode;       // режим пробуждения
+    uint32_t chip_id;
+    uint32_t seq;       // растет с каждым кадром устройства
+    uint32_t impulses0;
+    uint32_t impulses1;
+    float channel0;     // показания, м3 (или по типу счетчика)
+    float channel1;
+    uint16_t voltage;   // мВ
+    uint8_t flow_alarm; // тревоги детектора расхода attiny
+    uint8_t reserved;
+    uint8_t tag[ESPNOW_TAG_SIZE];
+}; // 40 байт
+static_assert(sizeof(EspNowFrame) == 40, "sizeof EspNowFrame != 40");
+
+#define ESPNOW_SIGNED_SIZE offsetof(EspNowFrame, tag)
+
+// Заголовок кадра подходит этой прошивке (подпись проверяется отдельно)
+inline bool espnow_frame_valid(const uint8_t *raw, const size_t len)
+{
+    if (len != sizeof(EspNowFrame))
+    {
+        return false;
+    }
+    const EspNowFrame *frame = (const EspNowFrame *)raw;
+    return frame->magic == ESPNOW_FRAME_MAGIC && frame->version == ESPNOW_FRAME_VERSION;
+}
+
+// MAC вида "AA:BB:CC:DD:EE:FF" (или через '-')
+inline bool espnow_mac_parse(const char *text, uint8_t *mac)
+{
+    if (!text || strlen(text) != 17)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        uint8_t v = 0;
+        for (uint8_t j = 0; j < 2; j++)
+        {
+            char c = text[i * 3 + j];
+            v <<= 4;
+            if (c >= '0' && c <= '9')
+                v |= c - '0';
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                v |= (c | 0x20) - 'a' + 10;
+            else
+                return false;
+        }
+        if (i < 5 && text[i * 3 + 2] != ':' && text[i * 3 + 2] != '-')
+        {
+            return false;
+        }
+        mac[i] = v;
+    }
+    return true;
+}
+
+// MAC в 17 символов; false, если MAC не задан (нули)
+inline bool espnow_mac_format(const uint8_t *mac, char *text)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    uint8_t any = 0;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        any |= mac[i];
+        text[i * 3] = digits[mac[i] >> 4];
+        text[i * 3 + 1] = digits[mac[i] & 0x0F];
+        text[i * 3 + 2] = i < 5 ? ':' : 0;
+    }
+    return any != 0;
+}
+
+// Ключ подписи - ESPNOW_KEY_SIZE байт в hex
+inline bool espnow_key_parse(const char *hex, uint8_t *key)
+{
+    if (!hex || strlen(hex) != 2 * ESPNOW_KEY_SIZE)
+    {
+        return false;
+    }
+    uint8_t parsed[ESPNOW_KEY_SIZE];
+    for (uint8_t i = 0; i < 2 * ESPNOW_KEY_SIZE; i++)
+    {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9')
+            v = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            v = (c | 0x20) - 'a' + 10;
+        else
+            return false;
+        parsed[i / 2] = (i & 1) ? (parsed[i / 2] | v) : (v << 4);
+    }
+    memcpy(key, parsed, ESPNOW_KEY_SIZE);
+    return true;
+}
+
+enum EspNowAccept : uint8_t
+{
+    ESPNOW_ACCEPTED = 0,
+    ESPNOW_REPLAY, // номер не больше принятого
+    ESPNOW_FULL,   // нет места: все устройства ждут отправки
+};
+
+struct EspNowDevice
+{
+    EspNowFrame frame;
+    uint32_t received_ms;
+    bool pending; // еще не переслан на сервер
+};
+
+/**
+ * @brief Последние кадры устройств шлюза. Новое устройство при заполненной
+ * таблице вытесняет давно молчащее из уже пересланных.
+ */
+class EspNowTable
+{
+public:
+    EspNowAccept accept(const EspNowFrame &frame, const uint32_t now_ms)
+    {
+        EspNowDevice *device = find(frame.chip_id);
+        if (device)
+        {
+            if (frame.seq <= device->frame.seq)
+            {
+                return ESPNOW_REPLAY;
+            }
+        }
+        else if (_count < ESPNOW_GATEWAY_DEVICES)
+        {
+            device = &_devices[_count++];
+        }
+        else
+        {
+            for (uint8_t i = 0; i < _count; i++)
+            {
+                EspNowDevice &d = _devices[i];
+                if (!d.pending && (!device || now_ms - d.received_ms > now_ms - device->received_ms))
+                {
+                    device = &d;
+                }
+            }
+            if (!device)
+            {
+                return ESPNOW_FULL;
+            }
+        }
+        device->frame = frame;
+        device->received_ms = now_ms;
+        device->pending = true;
+        return ESPNOW_ACCEPTED;
+    }
+
+    uint8_t count() const { return _count; }
+
+    const EspNowDevice &device(const uint8_t index) const { return _devices[index]; }
+
+    uint8_t pending() const
+    {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            n += _devices[i].pending;
+        }
+        return n;
+    }
+
+    // Кадры, принятые до sent_ms, переданы на сервер
+    void mark_sent(const uint32_t sent_ms)
+    {
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if ((int32_t)(sent_ms - _devices[i].received_ms) >= 0)
+            {
+                _devices[i].pending = false;
+            }
+        }
+    }
+
+private:
+    EspNowDevice *find(const uint32_t chip_id)
+    {
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (_devices[i].frame.chip_id == chip_id)
+            {
+                return &_devices[i];
+            }
+        }
+        return nullptr;
+    }
+
+    EspNowDevice _devices[ESPNOW_GATEWAY_DEVICES];
+    uint8_t _count = 0;
+};
+
+#endif
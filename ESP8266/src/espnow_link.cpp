@@ -0,0 +1,236 @@
+#ifndef ESPNOW_DISABLED
+#include "espnow_link.h"
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#include <bearssl/bearssl_hmac.h>
+#include <ArduinoJson.h>
+#include "Logging.h"
+#include "espnow_frame.h"
+#include "wifi_helpers.h"
+#include "senders/send_data.h"
+#include "json_arena.h"
+#include "porting.h"
+
+uint8_t espnow_role(const Settings &sett)
+{
+    return sett.espnow.magic == ESPNOW_CONFIG_MAGIC ? sett.espnow.role : ESPNOW_ROLE_OFF;
+}
+
+static void espnow_sign(const uint8_t *key, const EspNowFrame &frame, uint8_t *tag)
+{
+    br_hmac_key_context kc;
+    br_hmac_key_init(&kc, &br_sha256_vtable, key, ESPNOW_KEY_SIZE);
+    br_hmac_context ctx;
+    br_hmac_init(&ctx, &kc, ESPNOW_TAG_SIZE);
+    br_hmac_update(&ctx, &frame, ESPNOW_SIGNED_SIZE);
+    br_hmac_out(&ctx, tag);
+}
+
+static bool espnow_verify(const uint8_t *key, const EspNowFrame &frame)
+{
+    uint8_t tag[ESPNOW_TAG_SIZE];
+    espnow_sign(key, frame, tag);
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < ESPNOW_TAG_SIZE; i++)
+    {
+        diff |= tag[i] ^ frame.tag[i];
+    }
+    return diff == 0;
+}
+
+// Отправитель
+
+static volatile int8_t send_status = -1;
+
+static void on_sent(uint8_t *mac, uint8_t status)
+{
+    send_status = status;
+}
+
+bool espnow_send(Settings &sett, const AttinyData &data, const CalculatedData &cdata, const uint16_t voltage)
+{
+    if (espnow_role(sett) != ESPNOW_ROLE_SENDER)
+    {
+        return false;
+    }
+    uint8_t channel = sett.espnow.channel ? sett.espnow.channel : sett.wifi_channel;
+    if (!channel)
+    {
+        LOG_ERROR(F("ESPNOW: gateway channel unknown"));
+        return false;
+    }
+
+    EspNowFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.magic = ESPNOW_FRAME_MAGIC;
+    frame.version = ESPNOW_FRAME_VERSION;
+    frame.mode = sett.mode;
+    frame.chip_id = getChipId();
+    frame.seq = ++sett.espnow_seq;
+    frame.impulses0 = data.impulses0;
+    frame.impulses1 = data.impulses1;
+    frame.channel0 = cdata.channel0;
+    frame.channel1 = cdata.channel1;
+    frame.voltage = voltage;
+    frame.flow_alarm = data.flow_alarm;
+    espnow_sign(sett.espnow.key, frame, frame.tag);
+
+    uint32_t start = millis();
+    wifi_set_mode(WIFI_STA);
+    wifi_set_channel(channel);
+    if (esp_now_init() != 0)
+    {
+        LOG_ERROR(F("ESPNOW: init failed"));
+        return false;
+    }
+    esp_now_set_self_role(ESP_NOW_ROLE_CONTROLLER);
+    esp_now_register_send_cb(on_sent);
+    esp_now_add_peer(sett.espnow.gateway, ESP_NOW_ROLE_SLAVE, channel, nullptr, 0);
+
+    bool acked = false;
+    for (uint8_t attempt = 0; attempt < ESPNOW_SEND_ATTEMPTS && !acked; attempt++)
+    {
+        send_status = -1;
+        esp_now_send(sett.espnow.gateway, (uint8_t *)&frame, sizeof(frame));
+        uint32_t sent = millis();
+        while (send_status < 0 && millis() - sent < ESPNOW_ACK_TIMEOUT_MS)
+        {
+            delay(1);
+        }
+        acked = send_status == 0;
+    }
+    esp_now_deinit();
+
+    LOG_INFO(F("ESPNOW: seq=") << frame.seq << F(" channel=") << channel << (acked ? F(" acked in ") : F(" no ack, ")) << millis() - start << F(" ms"));
+    return acked;
+}
+
+// Шлюз
+
+struct GatewayQueue
+{
+    EspNowFrame frames[ESPNOW_GATEWAY_QUEUE];
+    volatile uint8_t head = 0; // пишет обработчик приема
+    volatile uint8_t tail = 0; // читает цикл шлюза
+};
+
+static GatewayQueue *gateway_queue = nullptr;
+
+// Вызывается в контексте системы: только копируем кадр
+static void on_received(uint8_t *mac, uint8_t *raw, uint8_t len)
+{
+    if (!espnow_frame_valid(raw, len))
+    {
+        return;
+    }
+    uint8_t next = (gateway_queue->head + 1) % ESPNOW_GATEWAY_QUEUE;
+    if (next == gateway_queue->tail)
+    {
+        return; // очередь полна, устройство повторит в следующее пробуждение
+    }
+    memcpy(&gateway_queue->frames[gateway_queue->head], raw, sizeof(EspNowFrame));
+    gateway_queue->head = next;
+}
+
+static bool gateway_start(Settings &sett)
+{
+    if (!wifi_connect(sett))
+    {
+        return false;
+    }
+    WiFi.setSleepMode(WIFI_NONE_SLEEP); // в modem sleep кадры теряются
+    if (esp_now_init() != 0)
+    {
+        LOG_ERROR(F("ESPNOW: init failed"));
+        return false;
+    }
+    esp_now_set_self_role(ESP_NOW_ROLE_SLAVE);
+    esp_now_register_recv_cb(on_received);
+    LOG_INFO(F("ESPNOW: gateway ") << WiFi.macAddress() << F(" channel ") << WiFi.channel());
+    return true;
+}
+
+static void gateway_fill_json(const EspNowTable &table, JsonDocument &doc, const uint32_t now_ms)
+{
+    doc[F("gateway")] = WiFi.macAddress();
+    doc[F("channel")] = WiFi.channel();
+    doc[F("esp_id")] = getChipId();
+    doc[F("version_esp")] = FIRMWARE_VERSION;
+    JsonArray devices = doc[F("devices")].to<JsonArray>();
+    for (uint8_t i = 0; i < table.count(); i++)
+    {
+        const EspNowDevice &device = table.device(i);
+        if (!device.pending)
+        {
+            continue;
+        }
+        const EspNowFrame &frame = device.frame;
+        JsonObject item = devices.add<JsonObject>();
+        item[F("esp_id")] = frame.chip_id;
+        item[F("seq")] = frame.seq;
+        item[F("mode")] = frame.mode;
+        item[F("imp0")] = frame.impulses0;
+        item[F("imp1")] = frame.impulses1;
+        item[F("ch0")] = frame.channel0;
+        item[F("ch1")] = frame.channel1;
+        item[F("voltage")] = frame.voltage / 1000.0;
+        item[F("flow_alarm")] = frame.flow_alarm;
+        item[F("age")] = (now_ms - device.received_ms) / 1000; // секунд до пересылки
+    }
+}
+
+void espnow_gateway_run(Settings &sett)
+{
+    LOG_INFO(F("ESPNOW: gateway mode"));
+    gateway_queue = new GatewayQueue();
+    EspNowTable *table = new EspNowTable();
+    bool started = false;
+    uint32_t flush_ms = millis();
+
+    for (;;)
+    {
+        if (!started || WiFi.status() != WL_CONNECTED)
+        {
+            if (started)
+            {
+                esp_now_deinit();
+            }
+            started = gateway_start(sett);
+            if (!started)
+            {
+                delay(ESPNOW_GATEWAY_FLUSH_SEC * 1000UL);
+                continue;
+            }
+        }
+
+        while (gateway_queue->tail != gateway_queue->head)
+        {
+            const EspNowFrame &frame = gateway_queue->frames[gateway_queue->tail];
+            if (!espnow_verify(sett.espnow.key, frame))
+            {
+                LOG_ERROR(F("ESPNOW: bad signature from ") << frame.chip_id);
+            }
+            else
+            {
+                EspNowAccept result = table->accept(frame, millis());
+                LOG_INFO(F("ESPNOW: ") << frame.chip_id << F(" seq=") << frame.seq << F(" result=") << result);
+            }
+            gateway_queue->tail = (gateway_queue->tail + 1) % ESPNOW_GATEWAY_QUEUE;
+        }
+
+        uint32_t now = millis();
+        if (table->pending() && now - flush_ms >= ESPNOW_GATEWAY_FLUSH_SEC * 1000UL)
+        {
+            JsonDocument doc(&json_arena);
+            gateway_fill_json(*table, doc, now);
+            if (send_batch(sett, doc))
+            {
+                table->mark_sent(now);
+            }
+            flush_ms = now;
+        }
+        delay(10);
+    }
+}
+
+#endif
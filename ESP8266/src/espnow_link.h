@@ -0,0 +1,56 @@
+/**
+ * @file espnow_link.h
+ * @brief Передача показаний шлюзу по ESP-NOW и режим шлюза
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * В многоквартирном доме каждому устройству не нужно подключаться к роутеру,
+ * получать адрес по DHCP и открывать TLS ради двух десятков байт показаний.
+ * Устройство с ролью ESPNOW_ROLE_SENDER в обычное пробуждение отправляет
+ * подписанный кадр (espnow_frame.h) на MAC шлюза прямо на его канале и ждет
+ * подтверждения на уровне MAC - это десятки миллисекунд. Без подтверждения
+ * пробуждение продолжается как обычно, через Wi-Fi. Пробуждения кнопкой
+ * всегда идут через Wi-Fi: с ними приходят настройки и OTA с сервера.
+ *
+ * Шлюз - ESP8266 с этой же прошивкой и ролью ESPNOW_ROLE_GATEWAY на
+ * постоянном питании без attiny (он не отвечает по i2c). Шлюз остается
+ * подключенным к роутеру, принимает кадры, проверяет подпись и номер и
+ * раз в ESPNOW_GATEWAY_FLUSH_SEC пересылает накопленное одним запросом на
+ * http_url и в топик <mqtt_topic>/espnow (send_batch). Канал и MAC шлюза,
+ * которые нужно ввести на устройствах, он пишет в лог и в пересылаемый json.
+ */
+#ifndef ESPNOW_LINK_H_
+#define ESPNOW_LINK_H_
+
+#ifndef ESPNOW_DISABLED
+
+#include <Arduino.h>
+#include "setup.h"
+#include "master_i2c.h"
+
+#define ESPNOW_SEND_ATTEMPTS 3
+#define ESPNOW_ACK_TIMEOUT_MS 30      // подтверждение MAC приходит за единицы мс
+#define ESPNOW_GATEWAY_FLUSH_SEC 60   // период пересылки накопленных кадров
+#define ESPNOW_GATEWAY_QUEUE 8        // кадров между приемом и обработкой в цикле
+
+/**
+ * @brief Настроена ли роль ESP-NOW (с учетом старых данных Blynk на ее месте)
+ */
+extern uint8_t espnow_role(const Settings &sett);
+
+/**
+ * @brief Отправляет показания шлюзу. Увеличивает sett.espnow_seq.
+ *
+ * @return true шлюз подтвердил прием
+ */
+extern bool espnow_send(Settings &sett, const AttinyData &data, const CalculatedData &cdata, const uint16_t voltage);
+
+/**
+ * @brief Работа шлюза: прием кадров и пересылка на серверы. Не возвращается.
+ */
+extern void espnow_gateway_run(Settings &sett);
+
+#endif
+#endif
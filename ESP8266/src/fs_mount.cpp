@@ -0,0 +1,25 @@
+#include "fs_mount.h"
+#include <LittleFS.h>
+#include "Logging.h"
+
+static bool mounted = false;
+
+bool fs_begin()
+{
+    if (!mounted)
+    {
+        uint32_t start = micros();
+        mounted = LittleFS.begin();
+        LOG_INFO(F("FS: mount ") << (mounted ? F("OK ") : F("FAILED ")) << (micros() - start) << F(" us"));
+    }
+    return mounted;
+}
+
+void fs_end()
+{
+    if (mounted)
+    {
+        LittleFS.end();
+        mounted = false;
+    }
+}
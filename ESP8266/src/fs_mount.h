@@ -0,0 +1,34 @@
+/**
+ * @file fs_mount.h
+ * @brief Монтирование LittleFS один раз за пробуждение
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Журналы (горячие поля, пробуждения, очередь показаний, кэши MQTT)
+ * монтировали LittleFS на каждое чтение и запись: begin() заново читает
+ * суперблок и метаданные, end() отмонтирует. За обычное пробуждение
+ * набиралось 5-8 монтирований. Теперь первое обращение монтирует, и
+ * до него на пути передачи flash не трогается. Закрытые файлы LittleFS
+ * переживают снятие питания, поэтому перед сном отмонтировать не нужно.
+ * fs_end() нужен только перед записью образа файловой системы (OTA).
+ */
+#ifndef FS_MOUNT_H_
+#define FS_MOUNT_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Монтирует LittleFS при первом вызове
+ *
+ * @return true файловая система доступна
+ */
+extern bool fs_begin();
+
+/**
+ * @brief Отмонтирует LittleFS, следующий fs_begin смонтирует заново
+ */
+extern void fs_end();
+
+#endif
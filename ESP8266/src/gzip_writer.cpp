@@ -0,0 +1,194 @@
+#include "gzip_writer.h"
+#include <new>
+
+// RFC 1951 3.2.5: основания длин (коды 257..285) и расстояний (коды 0..29)
+static const uint16_t LENGTH_BASE[29] PROGMEM = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] PROGMEM = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] PROGMEM = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] PROGMEM = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_WINDOW 32768
+#define GZIP_END_OF_BLOCK 256
+
+// crc32 gzip (отраженный полином 0xEDB88320), не crc32 ядра из coredecls.h
+static uint32_t gzip_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static inline uint16_t hash3(const uint8_t *p)
+{
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & ((1 << GZIP_HASH_BITS) - 1);
+}
+
+GzipWriter::GzipWriter(Print &out) : _out(out), _bits(0), _nbits(0), _crc(0), _size(0)
+{
+}
+
+void GzipWriter::writeBits(uint32_t value, uint8_t count)
+{
+    _bits |= value << _nbits;
+    _nbits += count;
+    while (_nbits >= 8)
+    {
+        _out.write((uint8_t)_bits);
+        _bits >>= 8;
+        _nbits -= 8;
+    }
+}
+
+// Коды Хаффмана пишутся старшим битом вперед
+void GzipWriter::writeCode(uint16_t code, uint8_t length)
+{
+    uint16_t reversed = 0;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    writeBits(reversed, length);
+}
+
+// Фиксированные коды: RFC 1951 3.2.6
+void GzipWriter::literal(uint16_t symbol)
+{
+    if (symbol < 144)
+    {
+        writeCode(0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        writeCode(0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        writeCode(symbol - 256, 7);
+    }
+    else
+    {
+        writeCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+void GzipWriter::match(uint16_t length, uint16_t distance)
+{
+    uint8_t i = 28;
+    while (pgm_read_word(&LENGTH_BASE[i]) > length)
+    {
+        i--;
+    }
+    literal(257 + i);
+    writeBits(length - pgm_read_word(&LENGTH_BASE[i]), pgm_read_byte(&LENGTH_EXTRA[i]));
+
+    i = 29;
+    while (pgm_read_word(&DIST_BASE[i]) > distance)
+    {
+        i--;
+    }
+    writeCode(i, 5);
+    writeBits(distance - pgm_read_word(&DIST_BASE[i]), pgm_read_byte(&DIST_EXTRA[i]));
+}
+
+void GzipWriter::begin()
+{
+    // ID1 ID2, deflate, без флагов, время 0, XFL 0, ОС неизвестна
+    static const uint8_t header[10] PROGMEM = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for (uint8_t i = 0; i < sizeof(header); i++)
+    {
+        _out.write(pgm_read_byte(&header[i]));
+    }
+    _bits = 0;
+    _nbits = 0;
+    _crc = 0;
+    _size = 0;
+}
+
+bool GzipWriter::block(const uint8_t *data, size_t len)
+{
+    len = _min(len, (size_t)GZIP_MAX_BLOCK);
+    _crc = gzip_crc32(_crc, data, len);
+    _size += len;
+
+    writeBits(1 << 1, 3); // не последний блок, фиксированные коды
+
+    // позиция + 1, 0 - пусто
+    uint16_t *head = new (std::nothrow) uint16_t[1 << GZIP_HASH_BITS];
+    if (head)
+    {
+        memset(head, 0, sizeof(uint16_t) << GZIP_HASH_BITS);
+    }
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        uint16_t best = 0;
+        size_t candidate = 0;
+        if (head && pos + GZIP_MIN_MATCH <= len)
+        {
+            uint16_t h = hash3(data + pos);
+            if (head[h] && pos - (head[h] - 1) <= GZIP_WINDOW)
+            {
+                candidate = head[h] - 1;
+                size_t limit = _min((size_t)GZIP_MAX_MATCH, len - pos);
+                while (best < limit && data[candidate + best] == data[pos + best])
+                {
+                    best++;
+                }
+            }
+            head[h] = pos + 1;
+        }
+
+        if (best >= GZIP_MIN_MATCH)
+        {
+            match(best, pos - candidate);
+            // позиции внутри повтора тоже в таблицу: следующие повторы длиннее
+            for (size_t i = pos + 1; i < pos + best && i + GZIP_MIN_MATCH <= len; i++)
+            {
+                head[hash3(data + i)] = i + 1;
+            }
+            pos += best;
+        }
+        else
+        {
+            literal(data[pos]);
+            pos++;
+        }
+    }
+    literal(GZIP_END_OF_BLOCK);
+
+    bool hashed = head != nullptr;
+    delete[] head;
+    return hashed;
+}
+
+void GzipWriter::end()
+{
+    writeBits(1 | (1 << 1), 3); // последний блок без данных
+    literal(GZIP_END_OF_BLOCK);
+    if (_nbits)
+    {
+        writeBits(0, 8 - _nbits);
+    }
+    writeBits(_crc & 0xFFFF, 16);
+    writeBits(_crc >> 16, 16);
+    writeBits(_size & 0xFFFF, 16);
+    writeBits(_size >> 16, 16);
+}
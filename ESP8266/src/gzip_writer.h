@@ -0,0 +1,62 @@
+/**
+ * @file gzip_writer.h
+ * @brief Сжатие gzip (deflate с фиксированными кодами Хаффмана) в Print
+ * @version 0.1
+ * @date 2026-10-15
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Для отправки текстовых логов: zlib на ESP8266 нет, а фиксированные коды
+ * deflate не требуют таблиц частот и второго прохода по данным. Повторы
+ * ищутся только внутри одного блока (LZ77, одна позиция на хэш), поэтому
+ * память - хэш таблица на время block(). Лог сжимается в 2-3 раза, результат
+ * распаковывает любой gzip (Content-Encoding: gzip).
+ *
+ * Выход детерминирован: длину для Content-Length можно получить первым
+ * проходом в Crc32Print (json_stream.h), а вторым писать в сокет.
+ */
+#ifndef GZIP_WRITER_H_
+#define GZIP_WRITER_H_
+
+#include <Arduino.h>
+
+#define GZIP_HASH_BITS 10     // 2 Кб хэш таблицы на время block()
+#define GZIP_MAX_BLOCK 0xFFFF // позиции в хэш таблице 16 бит
+
+class GzipWriter
+{
+    Print &_out;
+    uint32_t _bits;
+    uint8_t _nbits;
+    uint32_t _crc;
+    uint32_t _size;
+
+    void writeBits(uint32_t value, uint8_t count);
+    void writeCode(uint16_t code, uint8_t length);
+    void literal(uint16_t symbol);
+    void match(uint16_t length, uint16_t distance);
+
+public:
+    explicit GzipWriter(Print &out);
+
+    /**
+     * @brief Заголовок gzip
+     */
+    void begin();
+
+    /**
+     * @brief Сжимает данные отдельным блоком deflate
+     *
+     * @param data данные, не длиннее GZIP_MAX_BLOCK
+     * @param len длина
+     * @return false не хватило памяти на хэш таблицу, блок записан без повторов
+     */
+    bool block(const uint8_t *data, size_t len);
+
+    /**
+     * @brief Последний пустой блок, crc32 и длина исходных данных
+     */
+    void end();
+};
+
+#endif
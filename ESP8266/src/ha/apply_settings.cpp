@@ -3,6 +3,7 @@
 #include "Logging.h"
 #include "portal/active_point_api.h"
 #include "config.h"
+#include "json_arena.h"
 #include "setup.h"
 
 void apply_settings(const JsonDocument &json_settings_received, 
@@ -10,7 +11,7 @@ void apply_settings(const JsonDocument &json_settings_received,
                     const AttinyData &data, 
                     CalculatedData &cdata)
 {
-    JsonDocument errors_doc;
+    JsonDocument errors_doc(&json_arena);
     JsonObject errorsObj = errors_doc.to<JsonObject>();
 
     JsonObjectConst root = json_settings_received.as<JsonObjectConst>();
@@ -21,7 +22,12 @@ void apply_settings(const JsonDocument &json_settings_received,
 
         LOG_INFO(F("Apply setting: ") << name << F("=") << payload);
 
-        if (name.endsWith(F("0")))
+        if (name == F("config_rev"))
+        {
+            // не параметр портала: ревизия, с которой сервер сравнивает настройки устройства
+            sett.config_rev = kv.value().as<uint32_t>();
+        }
+        else if (name.endsWith(F("0")))
         {
             name.remove(name.length() - 1, 1);
             AsyncWebParameter p(name, payload);
@@ -41,6 +47,14 @@ void apply_settings(const JsonDocument &json_settings_received,
         }
     }
     
-    store_config(sett);
+    // Те же значения, что уже стоят: запись во flash отложится до конца пробуждения
+    if (config_changed(sett))
+    {
+        store_config(sett);
+    }
+    else
+    {
+        LOG_INFO(F("Settings not changed"));
+    }
     calculate_values(sett, data, cdata);
 }
@@ -0,0 +1,105 @@
+#include "discovery_cache.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include <coredecls.h>
+#include "Logging.h"
+
+DiscoveryCache::DiscoveryCache()
+    : _dirty(false), _failed(false)
+{
+    memset(&_data, 0, sizeof(_data));
+}
+
+void DiscoveryCache::load()
+{
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    File file = LittleFS.open(DISCOVERY_CACHE_FILE, "r");
+    if (file)
+    {
+        if (file.read((uint8_t *)&_data, sizeof(_data)) != sizeof(_data) || _data.count > DISCOVERY_CACHE_SIZE)
+        {
+            LOG_ERROR(F("MQTT: DISCOVERY: Cache is corrupted"));
+            memset(&_data, 0, sizeof(_data));
+        }
+        file.close();
+    }
+}
+
+void DiscoveryCache::store()
+{
+    if (!_dirty)
+    {
+        return;
+    }
+
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    File file = LittleFS.open(DISCOVERY_CACHE_FILE, "w");
+    if (file)
+    {
+        file.write((const uint8_t *)&_data, sizeof(_data));
+        file.close();
+        _dirty = false;
+        LOG_INFO(F("MQTT: DISCOVERY: Cache saved, entries: ") << _data.count);
+    }
+    else
+    {
+        LOG_ERROR(F("MQTT: DISCOVERY: Failed to open ") << DISCOVERY_CACHE_FILE);
+    }
+}
+
+int DiscoveryCache::find(uint32_t topic_crc) const
+{
+    for (uint8_t i = 0; i < _data.count; i++)
+    {
+        if (_data.entries[i].topic_crc == topic_crc)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool DiscoveryCache::changed(const String &topic, uint32_t payload_crc) const
+{
+    int index = find(crc32(topic.c_str(), topic.length()));
+    return index < 0 || _data.entries[index].payload_crc != payload_crc;
+}
+
+void DiscoveryCache::update(const String &topic, uint32_t payload_crc)
+{
+    uint32_t topic_crc = crc32(topic.c_str(), topic.length());
+    int index = find(topic_crc);
+    if (index < 0)
+    {
+        if (_data.count == DISCOVERY_CACHE_SIZE)
+        {
+            // Не поместился: в следующий раз опубликуем еще раз
+            _failed = true;
+            return;
+        }
+        index = _data.count++;
+        _data.entries[index].topic_crc = topic_crc;
+    }
+    _data.entries[index].payload_crc = payload_crc;
+    _dirty = true;
+}
+
+void DiscoveryCache::complete(uint32_t set_crc)
+{
+    uint32_t crc = _failed ? 0 : set_crc;
+    if (_data.set_crc != crc)
+    {
+        _data.set_crc = crc;
+        _dirty = true;
+    }
+}
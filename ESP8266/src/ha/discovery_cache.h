@@ -0,0 +1,76 @@
+/**
+ * @file discovery_cache.h
+ * @brief Контрольные суммы опубликованных discovery топиков Home Assistant
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Discovery публикуется с retain, поэтому брокер хранит конфигурацию сенсоров сам.
+ * В файле на LittleFS храним crc всего набора (версии, модель, типы каналов, топики)
+ * и crc каждого топика с его содержимым. Если набор не изменился, discovery
+ * не формируется вовсе, иначе публикуются только изменившиеся сенсоры.
+ */
+#ifndef HA_DISCOVERY_CACHE_H_
+#define HA_DISCOVERY_CACHE_H_
+
+#include <Arduino.h>
+
+#define DISCOVERY_CACHE_FILE "/discovery.bin"
+#define DISCOVERY_CACHE_SIZE 40 // Сенсоров: общие + по 8 на канал с запасом
+
+struct DiscoveryCacheEntry
+{
+    uint32_t topic_crc;
+    uint32_t payload_crc;
+};
+
+struct DiscoveryCacheData
+{
+    uint32_t set_crc; // crc набора, с которым опубликованы все сенсоры
+    uint8_t count;
+    uint8_t reserved[3];
+    DiscoveryCacheEntry entries[DISCOVERY_CACHE_SIZE];
+};
+
+class DiscoveryCache
+{
+    DiscoveryCacheData _data;
+    bool _dirty;
+    bool _failed;
+
+    int find(uint32_t topic_crc) const;
+
+public:
+    DiscoveryCache();
+
+    void load();
+    void store();
+
+    /**
+     * @brief Набор сенсоров опубликован полностью и не менялся
+     */
+    bool actual(uint32_t set_crc) const { return _data.set_crc == set_crc; }
+
+    /**
+     * @brief Содержимое топика отличается от опубликованного
+     */
+    bool changed(const String &topic, uint32_t payload_crc) const;
+
+    /**
+     * @brief Запоминает опубликованное содержимое топика
+     */
+    void update(const String &topic, uint32_t payload_crc);
+
+    /**
+     * @brief Публикация не удалась, набор нельзя считать опубликованным
+     */
+    void fail() { _failed = true; }
+
+    /**
+     * @brief Запоминает набор, если все публикации прошли
+     */
+    void complete(uint32_t set_crc);
+};
+
+#endif
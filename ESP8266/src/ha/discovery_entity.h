@@ -1,6 +1,6 @@
 /**
  * @file discovery_entity.h
- * @brief Создание строки для публикации автодискавери 
+ * @brief Генерация json для публикации автодискавери
  * @version 0.1
  * @date 2023-02-06
  * 
@@ -10,11 +10,12 @@
 #ifndef HA_DISCOVERY_ENTITY_H_
 #define HA_DISCOVERY_ENTITY_H_
 
-#include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include <Arduino.h>
+#include "json_writer.h"
 #include "resources.h"
 
-extern String build_entity_discovery(const char *mqtt_topic,
+extern void write_entity_discovery(Print &out,
+                                   const char *mqtt_topic,
                                    const char *sensor_type,
                                    const char *sensor_name,
                                    const char *sensor_id,
@@ -32,11 +33,12 @@ extern String build_entity_discovery(const char *mqtt_topic,
                                    const char *sw_version = "",
                                    const char *hw_version = "",
                                    const char *json_attributes_topic = "",
-                                   const char *json_attributes_template = "",
+                                   int attributes_channel = HA_NONE,
+                                   int attributes_channel_name = HA_NONE,
                                    const char *advanced_conf = "");
 
 extern void update_channel_names(int channel, int channel_name, String &entity_id, String &entity_name);
 
-extern String get_attributes_template(const char *const attrs[][MQTT_PARAM_COUNT], int index, int count, int channel, int channel_name);
+extern void write_channel_attributes(JsonWriter &attributes, const int channel, const int channel_name);
 
 #endif
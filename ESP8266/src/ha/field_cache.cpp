@@ -0,0 +1,104 @@
+#include "field_cache.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include <coredecls.h>
+#include "Logging.h"
+
+FieldCache::FieldCache()
+    : _dirty(false)
+{
+    memset(&_data, 0, sizeof(_data));
+}
+
+void FieldCache::load(const String &topic)
+{
+    uint32_t topic_crc = crc32(topic.c_str(), topic.length());
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    File file = LittleFS.open(FIELD_CACHE_FILE, "r");
+    if (file)
+    {
+        if (file.read((uint8_t *)&_data, sizeof(_data)) != sizeof(_data) || _data.count > FIELD_CACHE_SIZE)
+        {
+            LOG_ERROR(F("MQTT: FIELDS: Cache is corrupted"));
+            memset(&_data, 0, sizeof(_data));
+        }
+        file.close();
+    }
+
+    if (_data.topic_crc != topic_crc)
+    {
+        memset(&_data, 0, sizeof(_data));
+        _data.topic_crc = topic_crc;
+        _dirty = true;
+    }
+}
+
+void FieldCache::store()
+{
+    if (!_dirty)
+    {
+        return;
+    }
+
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    File file = LittleFS.open(FIELD_CACHE_FILE, "w");
+    if (file)
+    {
+        file.write((const uint8_t *)&_data, sizeof(_data));
+        file.close();
+        _dirty = false;
+    }
+    else
+    {
+        LOG_ERROR(F("MQTT: FIELDS: Failed to open ") << FIELD_CACHE_FILE);
+    }
+}
+
+int FieldCache::find(uint32_t key_crc) const
+{
+    for (uint8_t i = 0; i < _data.count; i++)
+    {
+        if (_data.entries[i].key_crc == key_crc)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool FieldCache::changed(const char *key, uint32_t value_crc) const
+{
+    int index = find(crc32(key, strlen(key)));
+    return index < 0 || _data.entries[index].value_crc != value_crc;
+}
+
+void FieldCache::update(const char *key, uint32_t value_crc)
+{
+    uint32_t key_crc = crc32(key, strlen(key));
+    int index = find(key_crc);
+    if (index < 0)
+    {
+        if (_data.count == FIELD_CACHE_SIZE)
+        {
+            return; // не поместилось: поле будет публиковаться каждый раз
+        }
+        index = _data.count++;
+        _data.entries[index].key_crc = key_crc;
+    }
+    else if (_data.entries[index].value_crc == value_crc)
+    {
+        return;
+    }
+    _data.entries[index].value_crc = value_crc;
+    _dirty = true;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file field_cache.h
+ * @brief Контрольные суммы опубликованных полей показаний MQTT
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * С настройкой mqtt_changed_only поля публикуются в отдельные топики, только
+ * если их значение изменилось с прошлого пробуждения. С retain брокер хранит
+ * прошлые значения сам. Для каждого поля храним crc имени и crc значения в
+ * файле на LittleFS, как discovery_cache: RTC память занята и не переживает
+ * снятие питания attiny. Вместе с полями хранится crc базового топика,
+ * после его смены публикуется все.
+ */
+#ifndef HA_FIELD_CACHE_H_
+#define HA_FIELD_CACHE_H_
+
+#include <Arduino.h>
+
+#define FIELD_CACHE_FILE "/fields.bin"
+#define FIELD_CACHE_SIZE 80 // Полей показаний с запасом
+
+struct FieldCacheEntry
+{
+    uint32_t key_crc;
+    uint32_t value_crc;
+};
+
+struct FieldCacheData
+{
+    uint32_t topic_crc;
+    uint8_t count;
+    uint8_t reserved[3];
+    FieldCacheEntry entries[FIELD_CACHE_SIZE];
+};
+
+class FieldCache
+{
+    FieldCacheData _data;
+    bool _dirty;
+
+    int find(uint32_t key_crc) const;
+
+public:
+    FieldCache();
+
+    /**
+     * @brief Загружает суммы, опубликованные в базовый топик
+     */
+    void load(const String &topic);
+    void store();
+
+    /**
+     * @brief Значение поля отличается от опубликованного
+     */
+    bool changed(const char *key, uint32_t value_crc) const;
+
+    /**
+     * @brief Запоминает опубликованное значение поля
+     */
+    void update(const char *key, uint32_t value_crc);
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file mqtt_pipeline.h
+ * @brief Пакетная публикация нескольких топиков одним потоком
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Без Home Assistant каждое поле показаний публикуется в свой топик, и
+ * PubSubClient отправлял каждое сообщение отдельными записями в сокет:
+ * заголовок, топик и содержимое - около 60 сообщений по 2-3 маленьких
+ * TCP сегмента. MqttPipeline сам собирает пакеты PUBLISH с QoS 0 (у них нет
+ * идентификатора, брокеру все равно, кто их сформировал) в буфер размером
+ * с TCP сегмент и отдает его в клиент целиком. Пишем через PubSubClient,
+ * чтобы он учитывал исходящую активность для keep-alive.
+ */
+#ifndef HA_MQTT_PIPELINE_H_
+#define HA_MQTT_PIPELINE_H_
+
+#include <Arduino.h>
+#include "json_stream.h"
+
+#ifndef MQTT_PIPELINE_BUFFER
+#define MQTT_PIPELINE_BUFFER 536 // TCP_MSS lwIP в варианте с экономией памяти
+#endif
+
+#define MQTT_PACKET_PUBLISH 0x30
+#define MQTT_MAX_REMAINING 268435455UL // 4 байта длины переменной части
+
+class MqttPipeline
+{
+    BufferedPrint<MQTT_PIPELINE_BUFFER> _out;
+    const bool _retain;
+    size_t _expected = 0;
+    uint16_t _count = 0;
+
+public:
+    MqttPipeline(Print &out, const bool retain) : _out(out), _retain(retain) {}
+
+    /**
+     * @brief Добавляет пакет PUBLISH (QoS 0). Буфер уходит в клиент по заполнении.
+     *
+     * @return false топик или сообщение не помещаются в пакет MQTT
+     */
+    bool publish(const char *topic, const size_t topic_len, const char *payload, const size_t len)
+    {
+        unsigned long remaining = 2 + topic_len + len;
+        if (topic_len > 0xFFFF || remaining > MQTT_MAX_REMAINING)
+        {
+            return false;
+        }
+
+        uint8_t header[7];
+        size_t n = 0;
+        header[n++] = MQTT_PACKET_PUBLISH | (_retain ? 1 : 0);
+        do
+        {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            header[n++] = remaining ? (digit | 0x80) : digit;
+        } while (remaining);
+        header[n++] = topic_len >> 8;
+        header[n++] = topic_len & 0xFF;
+
+        _out.write(header, n);
+        _out.write((const uint8_t *)topic, topic_len);
+        _out.write((const uint8_t *)payload, len);
+        _expected += n + topic_len + len;
+        _count++;
+        return true;
+    }
+
+    /**
+     * @brief Отдает остаток буфера
+     *
+     * @return true клиент принял все пакеты
+     */
+    bool flush()
+    {
+        _out.flush();
+        return _out.written() == _expected;
+    }
+
+    uint16_t count() const { return _count; }
+    size_t written() const { return _out.written(); }
+};
+
+#endif
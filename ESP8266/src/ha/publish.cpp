@@ -3,6 +3,7 @@
 #include "setup.h"
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include "json_stream.h"
 
 extern Settings sett;
 
@@ -13,20 +14,19 @@ extern Settings sett;
  * @param topic строка с топиком
  * @param payload содержимое топика
  * @param mode режим публикации, режим по умолчанию PUBLISH_MODE_BIG
+ * @return true сообщение отправлено
  */
-void publish(PubSubClient &mqtt_client, const String &topic, const String &payload, const int mode)
+bool publish(PubSubClient &mqtt_client, const String &topic, const String &payload, const int mode)
 {
     switch (mode)
     {
     case PUBLISH_MODE_SIMPLE:
-        publish_simple(mqtt_client, topic, payload);
-        break;
+        return publish_simple(mqtt_client, topic, payload);
     case PUBLISH_MODE_CHUNKED:
-        publish_chunked(mqtt_client, topic, payload);
-        break;
+        return publish_chunked(mqtt_client, topic, payload);
     case PUBLISH_MODE_BIG:
     default:
-        publish_big(mqtt_client, topic, payload);
+        return publish_big(mqtt_client, topic, payload);
     }
 }
 
@@ -38,7 +38,7 @@ void publish(PubSubClient &mqtt_client, const String &topic, const String &paylo
  * @param topic строка с топиком
  * @param payload содержимое топика
  */
-void publish_chunked(PubSubClient &mqtt_client, 
+bool publish_chunked(PubSubClient &mqtt_client, 
                      const String &topic, 
                      const String &payload, 
                      const unsigned int chunk_size)
@@ -72,16 +72,15 @@ void publish_chunked(PubSubClient &mqtt_client,
         if (mqtt_client.endPublish())
         {
             LOG_INFO(F("MQTT: Published succesfully"));
+            return true;
         }
-        else
-        {
-            LOG_ERROR(F("MQTT: Publish failed"));
-        }
+        LOG_ERROR(F("MQTT: Publish failed"));
     }
     else
     {
         LOG_ERROR(F("MQTT: Client not connected."));
     }
+    return false;
 }
 
 /**
@@ -93,7 +92,7 @@ void publish_chunked(PubSubClient &mqtt_client,
  * @param topic строка с топиком
  * @param payload содержимое топика
  */
-void publish_big(PubSubClient &mqtt_client, 
+bool publish_big(PubSubClient &mqtt_client, 
                  const String &topic, 
                  const String &payload)
 {
@@ -106,7 +105,8 @@ void publish_big(PubSubClient &mqtt_client,
     LOG_INFO(F("MQTT: Retain: ") << sett.mqtt_retain);
     if (mqtt_client.beginPublish(topic.c_str(), len, (bool)sett.mqtt_retain))
     {
-        if (mqtt_client.print(payload.c_str()) == len)
+        bool result = mqtt_client.print(payload.c_str()) == len;
+        if (result)
         {
             LOG_INFO(F("MQTT: Published succesfully"));
         }
@@ -116,11 +116,10 @@ void publish_big(PubSubClient &mqtt_client,
         }
 
         mqtt_client.endPublish();
+        return result;
     }
-    else
-    {
-        LOG_ERROR(F("MQTT: Client not connected."));
-    }
+    LOG_ERROR(F("MQTT: Client not connected."));
+    return false;
 }
 /**
  * @brief Публикация топика в MQTT если сообщение меньше 250 символов
@@ -129,7 +128,7 @@ void publish_big(PubSubClient &mqtt_client,
  * @param topic строка с топиком
  * @param payload содержимое топика
  */
-void publish_simple(PubSubClient &mqtt_client, const String &topic, const String &payload)
+bool publish_simple(PubSubClient &mqtt_client, const String &topic, const String &payload)
 {
     LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
     LOG_INFO(F("MQTT: Publish Topic: ") << topic);
@@ -139,6 +138,37 @@ void publish_simple(PubSubClient &mqtt_client, const String &topic, const String
     if (mqtt_client.connected())
     {
         if (mqtt_client.publish(topic.c_str(), payload.c_str(), (bool)sett.mqtt_retain))
+        {
+            LOG_INFO(F("MQTT: Published succesfully"));
+            return true;
+        }
+        LOG_ERROR(F("MQTT: Publish failed"));
+    }
+    else
+    {
+        LOG_ERROR(F("MQTT: Client not connected."));
+    }
+    return false;
+}
+
+/**
+ * @brief Публикация JSON документа потоково, без промежуточной строки.
+ * Длина известна заранее через measureJson.
+ *
+ * @param mqtt_client клиент MQTT
+ * @param topic строка с топиком
+ * @param json документ
+ */
+void publish_json(PubSubClient &mqtt_client, const String &topic, const JsonDocument &json)
+{
+    size_t len = measureJson(json);
+    LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
+    LOG_INFO(F("MQTT: Publish Topic: ") << topic);
+    LOG_INFO(F("MQTT: Payload Size: ") << len);
+
+    if (mqtt_client.beginPublish(topic.c_str(), len, (bool)sett.mqtt_retain))
+    {
+        if (stream_json(json, mqtt_client) == len)
         {
             LOG_INFO(F("MQTT: Published succesfully"));
         }
@@ -146,9 +176,48 @@ void publish_simple(PubSubClient &mqtt_client, const String &topic, const String
         {
             LOG_ERROR(F("MQTT: Publish failed"));
         }
+        mqtt_client.endPublish();
     }
     else
     {
         LOG_ERROR(F("MQTT: Client not connected."));
     }
 }
+
+/**
+ * @brief Публикация сообщения, которое генерируется прямо в клиент MQTT.
+ * Длину нужно посчитать заранее, прогнав генератор вхолостую (Crc32Print).
+ *
+ * @param mqtt_client клиент MQTT
+ * @param topic строка с топиком
+ * @param len длина сообщения
+ * @param write генератор сообщения
+ * @return true сообщение отправлено целиком
+ */
+bool publish_stream(PubSubClient &mqtt_client, const String &topic, size_t len, const std::function<void(Print &)> &write)
+{
+    LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
+    LOG_INFO(F("MQTT: Publish Topic: ") << topic);
+    LOG_INFO(F("MQTT: Payload Size: ") << len);
+
+    if (!mqtt_client.beginPublish(topic.c_str(), len, (bool)sett.mqtt_retain))
+    {
+        LOG_ERROR(F("MQTT: Client not connected."));
+        return false;
+    }
+
+    BufferedPrint<JSON_STREAM_BUFFER_SIZE> out(mqtt_client);
+    write(out);
+    out.flush();
+    bool result = out.written() == len;
+    if (result)
+    {
+        LOG_INFO(F("MQTT: Published succesfully"));
+    }
+    else
+    {
+        LOG_ERROR(F("MQTT: Publish failed"));
+    }
+    mqtt_client.endPublish();
+    return result;
+}
@@ -12,6 +12,7 @@
 
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <functional>
 
 #define MQTT_CHUNK_SIZE 128
 #define PUBLISH_MODE_BIG 0
@@ -19,9 +20,11 @@
 #define PUBLISH_MODE_SIMPLE 2
 #define DEFAULT_PUBLISH_MODE PUBLISH_MODE_BIG
 
-extern void publish(PubSubClient &mqtt_client, const String &topic, const String &payload, const int mode = DEFAULT_PUBLISH_MODE);
-extern void publish_big(PubSubClient &mqtt_client, const String &topic, const String &payload);
-extern void publish_simple(PubSubClient &mqtt_client, const String &topic, const String &payload);
-extern void publish_chunked(PubSubClient &mqtt_client, const String &topic, const String &payload, const unsigned int chunk_size=MQTT_CHUNK_SIZE);
+extern bool publish(PubSubClient &mqtt_client, const String &topic, const String &payload, const int mode = DEFAULT_PUBLISH_MODE);
+extern bool publish_big(PubSubClient &mqtt_client, const String &topic, const String &payload);
+extern bool publish_simple(PubSubClient &mqtt_client, const String &topic, const String &payload);
+extern void publish_json(PubSubClient &mqtt_client, const String &topic, const JsonDocument &json);
+extern bool publish_stream(PubSubClient &mqtt_client, const String &topic, size_t len, const std::function<void(Print &)> &write);
+extern bool publish_chunked(PubSubClient &mqtt_client, const String &topic, const String &payload, const unsigned int chunk_size=MQTT_CHUNK_SIZE);
 
 #endif
\ No newline at end of file
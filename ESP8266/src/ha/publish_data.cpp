@@ -1,6 +1,13 @@
 #include "publish_data.h"
 #include "Logging.h"
 #include "publish.h"
+#include "mqtt_pipeline.h"
+#include "field_cache.h"
+#include "setup.h"
+#include <coredecls.h>
+#include <memory>
+
+extern Settings sett;
 
 /**
  * @brief Пубикует показания в один топик в формате json
@@ -11,27 +18,71 @@
  */
 void publish_data_to_single_topic(PubSubClient &mqtt_client, String &topic, JsonDocument &json_data)
 {
-    String payload = "";
-    serializeJson(json_data, payload);
-    LOG_INFO(F("MQTT: Publish src data: ") << payload);
-    publish(mqtt_client, topic, payload);
+    publish_json(mqtt_client, topic, json_data);
 }
 
 /**
- * @brief Публикация показаний в отдельные топики
+ * @brief Публикация показаний в отдельные топики.
+ * Пакеты собираются в буфер размером с TCP сегмент и уходят вместе.
  *
  * @param mqtt_client клиент MQTT
  * @param topic имя топика
  * @param json_data данные в JSON
+ * @param changed_only публиковать только поля, изменившиеся с прошлой публикации
  */
-void publish_data_to_multiple_topics(PubSubClient &mqtt_client, String &topic, JsonDocument &json_data)
+void publish_data_to_multiple_topics(PubSubClient &mqtt_client, String &topic, JsonDocument &json_data, const bool changed_only)
 {
+    if (!mqtt_client.connected())
+    {
+        LOG_ERROR(F("MQTT: Client not connected."));
+        return;
+    }
+
+    std::unique_ptr<FieldCache> cache;
+    if (changed_only)
+    {
+        cache.reset(new FieldCache());
+        cache->load(topic);
+    }
+
+    MqttPipeline pipeline(mqtt_client, (bool)sett.mqtt_retain);
+    String sensor_topic = topic + '/';
+    const unsigned int base = sensor_topic.length();
+    uint8_t skipped = 0;
+
     JsonObject root = json_data.as<JsonObject>();
     for (JsonPair p : root)
     {
-        String sensor_topic = topic + "/" + p.key().c_str();
         String sensor_value = p.value().as<String>();
-        publish(mqtt_client, sensor_topic, sensor_value);
+        uint32_t value_crc = crc32(sensor_value.c_str(), sensor_value.length());
+        if (cache && !cache->changed(p.key().c_str(), value_crc))
+        {
+            skipped++;
+            continue;
+        }
+        sensor_topic.remove(base);
+        sensor_topic += p.key().c_str();
+        LOG_DEBUG(F("MQTT: ") << sensor_topic << F(" = ") << sensor_value);
+        if (!pipeline.publish(sensor_topic.c_str(), sensor_topic.length(), sensor_value.c_str(), sensor_value.length()))
+        {
+            LOG_ERROR(F("MQTT: Too big ") << sensor_topic);
+            continue;
+        }
+        if (cache)
+        {
+            cache->update(p.key().c_str(), value_crc);
+        }
+    }
+
+    if (!pipeline.flush())
+    {
+        LOG_ERROR(F("MQTT: Publish failed, sent ") << pipeline.written() << F(" bytes"));
+        return; // кэш не сохраняем: в следующий раз опубликуем еще раз
+    }
+    LOG_INFO(F("MQTT: Published ") << pipeline.count() << F(" topics, ") << pipeline.written() << F(" bytes, unchanged ") << skipped);
+    if (cache)
+    {
+        cache->store();
     }
 }
 
@@ -56,8 +107,9 @@ void publish_data(PubSubClient &mqtt_client, String &topic, JsonDocument &json_d
     else
     {
         LOG_INFO(F("MQTT: Publish data to multiple topics"));
-        // в оотдельные топики
-        publish_data_to_multiple_topics(mqtt_client, topic, json_data);
+        // в оотдельные топики, после настройки и по кнопке - все поля
+        bool changed_only = sett.mqtt_changed_only && sett.mode == TRANSMIT_MODE;
+        publish_data_to_multiple_topics(mqtt_client, topic, json_data, changed_only);
     }
 
     LOG_INFO(F("MQTT: Publish data finished. ") << millis() - start << F(" milliseconds elapsed"));
@@ -7,6 +7,44 @@
 #include "utils.h"
 #include "discovery_entity.h"
 #include "publish.h"
+#include "discovery_cache.h"
+#include "json_stream.h"
+
+// Кэш текущей публикации discovery (nullptr - публикуем все)
+static DiscoveryCache *active_cache = nullptr;
+
+/**
+ * @brief Публикует конфигурацию сенсора, если она изменилась с прошлой публикации.
+ * Генератор вызывается дважды: для длины и crc, затем прямо в клиент MQTT.
+ *
+ * @param mqtt_client клиент MQTT
+ * @param config_topic топик конфигурации сенсора
+ * @param write генератор конфигурации
+ */
+static void publish_entity_config(PubSubClient &mqtt_client, const String &config_topic, const std::function<void(Print &)> &write)
+{
+    Crc32Print measure;
+    write(measure);
+    LOG_INFO(F("MQTT: DISCOVERY SENSOR: JSON size: ") << measure.length);
+
+    if (active_cache && !active_cache->changed(config_topic, measure.crc))
+    {
+        LOG_INFO(F("MQTT: DISCOVERY: Unchanged, skip"));
+        return;
+    }
+
+    if (publish_stream(mqtt_client, config_topic, measure.length, write))
+    {
+        if (active_cache)
+        {
+            active_cache->update(config_topic, measure.crc);
+        }
+    }
+    else if (active_cache)
+    {
+        active_cache->fail();
+    }
+}
 
 /**
  * @brief Формирование данных для публикации автодискавери топиков
@@ -49,18 +87,17 @@ void publish_discovery_entity(PubSubClient &mqtt_client,
 
     LOG_INFO(F("MQTT: DISCOVERY:  Sensor: ") << entity_name);
 
-    String payload = build_entity_discovery(topic.c_str(),
-                                            entity_type.c_str(), entity_name.c_str(), entity_id.c_str(),
-                                            state_class.c_str(), device_class.c_str(), unit_of_meas.c_str(),
-                                            entity_category.c_str(), icon.c_str(),
-                                            device_id.c_str(), device_mac.c_str(),
-                                            true, device_name, device_manufacturer,
-                                            device_model, sw_version, hw_version,
-                                            topic.c_str(), nullptr,
-                                            advanced_conf.c_str());
-
     String entity_discovery_topic = String(discovery_topic) + "/" + entity_type + "/" + uniqueId_prefix + "/" + entity_id + "/config";
-    publish(mqtt_client, entity_discovery_topic, payload);
+    publish_entity_config(mqtt_client, entity_discovery_topic, [&](Print &out)
+                          { write_entity_discovery(out, topic.c_str(),
+                                                   entity_type.c_str(), entity_name.c_str(), entity_id.c_str(),
+                                                   state_class.c_str(), device_class.c_str(), unit_of_meas.c_str(),
+                                                   entity_category.c_str(), icon.c_str(),
+                                                   device_id.c_str(), device_mac.c_str(),
+                                                   true, device_name, device_manufacturer,
+                                                   device_model, sw_version, hw_version,
+                                                   topic.c_str(), HA_NONE, HA_NONE,
+                                                   advanced_conf.c_str()); });
 }
 
 /**
@@ -102,7 +139,7 @@ void publish_discovery_entity_extended(PubSubClient &mqtt_client,
  * @param device_id
  * @param device_mac
  * @param entity свойства сенсора
- * @param json_attributes_template аттрибуты сенсора
+ * @param with_attributes добавить атрибуты канала (импульсы, ADC, серийный номер и т.п.)
  * @param channel индекс канала при наличии
  * @param channel_name enum типа канала из интерфейса настройки
  */
@@ -112,7 +149,7 @@ void publish_discovery_entity_channel(PubSubClient &mqtt_client,
                                       const String &device_id, 
                                       const String &device_mac,
                                       const char *const entity[MQTT_PARAM_COUNT],
-                                      const String &json_attributes_template,
+                                      const bool with_attributes,
                                       const int channel = HA_NONE,
                                       const int channel_name = HA_NONE)
 {
@@ -132,18 +169,17 @@ void publish_discovery_entity_channel(PubSubClient &mqtt_client,
 
     LOG_INFO(F("MQTT: DISCOVERY:  Sensor: ") << entity_name);
 
-    String payload = build_entity_discovery(topic.c_str(),
-                                            entity_type.c_str(), entity_name.c_str(), entity_id.c_str(),
-                                            state_class.c_str(), device_class.c_str(), unit_of_meas.c_str(),
-                                            entity_category.c_str(), icon.c_str(),
-                                            device_id.c_str(), device_mac.c_str(),
-                                            true, nullptr, nullptr,
-                                            nullptr, nullptr, nullptr,
-                                            topic.c_str(), json_attributes_template.length() > 0 ? json_attributes_template.c_str() : nullptr,
-                                            advanced_conf.c_str());
-
     String entity_discovery_topic = String(discovery_topic) + "/" + entity_type + "/" + uniqueId_prefix + "/" + entity_id + "/config";
-    publish(mqtt_client, entity_discovery_topic, payload);
+    publish_entity_config(mqtt_client, entity_discovery_topic, [&](Print &out)
+                          { write_entity_discovery(out, topic.c_str(),
+                                                   entity_type.c_str(), entity_name.c_str(), entity_id.c_str(),
+                                                   state_class.c_str(), device_class.c_str(), unit_of_meas.c_str(),
+                                                   entity_category.c_str(), icon.c_str(),
+                                                   device_id.c_str(), device_mac.c_str(),
+                                                   true, nullptr, nullptr,
+                                                   nullptr, nullptr, nullptr,
+                                                   topic.c_str(), with_attributes ? channel : HA_NONE, channel_name,
+                                                   advanced_conf.c_str()); });
 }
 
 /**
@@ -184,43 +220,6 @@ void publish_discovery_general_entities(PubSubClient &mqtt_client,
     publish_discovery_entity(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_MODEL);
 }
 
-/**
- * @brief Добавление аттрибута сенсора в json
- *
- * @param json_attributes json с аттрибутами
- * @param entity свойства сенсора
- * @param channel номер канала 0 или 1
- * @param channel_name название канала (вода, электричество, газ, тепло)
- */
-void add_entity_attribute(JsonObject &json_attributes, 
-                          const char *const entity[MQTT_PARAM_COUNT], 
-                          const int channel, 
-                          const int channel_name)
-{
-    String entity_id = FPSTR(entity[2]);
-    String entity_name = FPSTR(entity[1]);
-    update_channel_names(channel, channel_name, entity_id, entity_name);
-    json_attributes[entity_name] = String(F("{{ value_json.")) + entity_id + F(" | is_defined }}");
-}
-
-String channel_entity_attributes(const int channel, const int channel_name)
-{
-    String json_attributes_template;
-    JsonDocument json_doc;
-    JsonObject json_attributes = json_doc.to<JsonObject>();
-
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_IMP, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_DELTA, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_ADC, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_SERIAL, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_FACTOR, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_CNAME, channel, channel_name);
-    add_entity_attribute(json_attributes, ENTITY_CHANNEL_CTYPE, channel, channel_name);
-    
-    serializeJson(json_attributes, json_attributes_template);
-    return json_attributes_template;
-}
-
 /**
  * @brief Публикация сведений устройства по каналам
  *
@@ -243,7 +242,7 @@ void publish_discovery_channel_entities(PubSubClient &mqtt_client,
                                         const int channel_name)
 {
     // Публикуем настройку типа входа, даже если он отключён
-    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_CTYPE, "", channel, channel_name);
+    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_CTYPE, false, channel, channel_name);
     
     if (!channel_is_work)
     {
@@ -251,38 +250,36 @@ void publish_discovery_channel_entities(PubSubClient &mqtt_client,
         return;
     }
 
-    String json_attributes_template = channel_entity_attributes(channel, channel_name);
-
     switch (channel_name) 
     {
         case CounterName::WATER_COLD:
         case CounterName::WATER_HOT:
         case CounterName::PORTABLE_WATER:
         case CounterName::OTHER:
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_WATER_TOTAL, json_attributes_template, channel, channel_name);
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_WATER_TOTAL_CFG, "", channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_WATER_TOTAL, true, channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_WATER_TOTAL_CFG, false, channel, channel_name);
             break;
         case CounterName::GAS:
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_GAS_TOTAL, json_attributes_template, channel, channel_name);
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_GAS_TOTAL_CFG, "", channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_GAS_TOTAL, true, channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_GAS_TOTAL_CFG, false, channel, channel_name);
             break;
         case CounterName::ELECTRO:
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_ELECTRO_TOTAL, json_attributes_template, channel, channel_name);
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_ELECTRO_TOTAL_CFG, "", channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_ELECTRO_TOTAL, true, channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_ELECTRO_TOTAL_CFG, false, channel, channel_name);
             break;
         case CounterName::HEAT_GCAL:
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_GCAL_TOTAL, json_attributes_template, channel, channel_name);
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_GCAL_TOTAL_CFG, "", channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_GCAL_TOTAL, true, channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_GCAL_TOTAL_CFG, false, channel, channel_name);
             break;
         case CounterName::HEAT_KWT:
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_KWT_TOTAL, json_attributes_template, channel, channel_name);
-            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_KWT_TOTAL_CFG, "", channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_KWT_TOTAL, true, channel, channel_name);
+            publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_HEAT_KWT_TOTAL_CFG, false, channel, channel_name);
             break;
     }
 
-    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_SERIAL, "", channel, channel_name);
-    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_FACTOR, "", channel, channel_name);
-    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_CNAME, "", channel, channel_name);
+    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_SERIAL, false, channel, channel_name);
+    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_FACTOR, false, channel, channel_name);
+    publish_discovery_entity_channel(mqtt_client, topic, discovery_topic, device_id, device_mac, ENTITY_CHANNEL_CNAME, false, channel, channel_name);
 
 }
 
@@ -303,6 +300,25 @@ void publish_discovery(PubSubClient &mqtt_client,
     LOG_INFO(F("MQTT: Publishing discovery topic"));
     unsigned long start_time = millis();
 
+    // Все, от чего зависит содержимое discovery
+    Crc32Print set_crc;
+    set_crc << F(FIRMWARE_VERSION) << data.version << data.model
+            << data.counter_type0 << data.counter_type1 << sett.counter0_name << sett.counter1_name
+            << topic << discovery_topic << sett.mqtt_host << sett.mqtt_port;
+
+    // Без retain брокер не хранит конфигурацию, пропускать нельзя
+    DiscoveryCache cache;
+    if (sett.mqtt_retain)
+    {
+        cache.load();
+        if (cache.actual(set_crc.crc))
+        {
+            LOG_INFO(F("MQTT: Discovery unchanged, skip"));
+            return;
+        }
+        active_cache = &cache;
+    }
+
     String device_id = String(getChipId());
     String device_mac = get_mac_address_hex();
 
@@ -315,5 +331,12 @@ void publish_discovery(PubSubClient &mqtt_client,
     publish_discovery_channel_entities(mqtt_client, topic, discovery_topic, device_id, device_mac, 
                                        channel_is_work(data.counter_type1), 1, sett.counter1_name);
 
+    if (active_cache)
+    {
+        active_cache->complete(set_crc.crc);
+        active_cache->store();
+        active_cache = nullptr;
+    }
+
     LOG_INFO(F("MQTT: Discovery topic published: ") << millis() - start_time << F(" milliseconds elapsed"));
 }
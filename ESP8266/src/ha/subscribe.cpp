@@ -5,6 +5,7 @@
 #include "publish_data.h"
 #include "config.h"
 #include "json.h"
+#include "json_arena.h"
 #include "utils.h"
 #include "portal/active_point_api.h"
 
@@ -12,46 +13,202 @@
 #define MQTT_MAX_TRIES 5
 #define MQTT_CONNECT_DELAY 100
 #define MQTT_SUBSCRIPTION_TOPIC "/#"
+#define MQTT_SYNC_TOPIC "/sync"
 
 extern MasterI2C masterI2C;
 extern AttinyData data;
 extern AttinyData runtime_data;
 extern CalculatedData cdata;
 
+// Метка, после эха которой все накопленные сообщения получены
+static String sync_token;
+static bool sync_received = false;
+
+// Последняя команда монитора: минут наблюдения, 0 - остановить
+static uint8_t monitor_min = 0;
+static bool monitor_received = false;
+
+#define MQTT_CMD_TEXT 0  // строка как есть, разбирает applyInputParameter
+#define MQTT_CMD_UINT 1
+#define MQTT_CMD_FLOAT 2
+#define MQTT_CMD_JSON 3
+#define MQTT_CMD_MONITOR 4 // целое, в настройки не попадает
+
+#define MQTT_CMD_NAME_LEN 24          // имя параметра в топике
+#define MQTT_CMD_TEXT_LEN (HOST_LEN + 16) // значение без таблицы: до адреса сервера
+
+struct MqttCommand
+{
+    const char *name;
+    uint8_t type;
+};
+
+static const char c_period_min[] PROGMEM = "period_min";
+static const char c_ntp_skip[] PROGMEM = "ntp_skip";
+static const char c_ch0[] PROGMEM = "ch0";
+static const char c_ch1[] PROGMEM = "ch1";
+static const char c_f0[] PROGMEM = "f0";
+static const char c_f1[] PROGMEM = "f1";
+static const char c_cname0[] PROGMEM = "cname0";
+static const char c_cname1[] PROGMEM = "cname1";
+static const char c_ctype0[] PROGMEM = "ctype0";
+static const char c_ctype1[] PROGMEM = "ctype1";
+static const char c_ota[] PROGMEM = "ota";
+static const char c_monitor[] PROGMEM = "monitor";
+
+// Команды из discovery (cmd_t): имя - хвост топика <topic>/<имя>/set
+static const MqttCommand MQTT_COMMANDS[] PROGMEM = {
+    {c_period_min, MQTT_CMD_UINT},
+    {c_ntp_skip, MQTT_CMD_UINT},
+    {c_ch0, MQTT_CMD_FLOAT},
+    {c_ch1, MQTT_CMD_FLOAT},
+    {c_f0, MQTT_CMD_UINT},
+    {c_f1, MQTT_CMD_UINT},
+    {c_cname0, MQTT_CMD_UINT},
+    {c_cname1, MQTT_CMD_UINT},
+    {c_ctype0, MQTT_CMD_UINT},
+    {c_ctype1, MQTT_CMD_UINT},
+    {c_ota, MQTT_CMD_JSON},
+    {c_monitor, MQTT_CMD_MONITOR},
+};
+
 /**
- * @brief Обновление настроек по сообщению MQTT
+ * @brief Тип команды по имени параметра. Неизвестные имена передаются
+ * строкой, как раньше: их разбирает общий код настроек.
+ */
+static uint8_t mqtt_command_type(const char *name)
+{
+    for (const MqttCommand &entry : MQTT_COMMANDS)
+    {
+        MqttCommand cmd;
+        memcpy_P(&cmd, &entry, sizeof(cmd));
+        if (strcmp_P(name, cmd.name) == 0)
+        {
+            return cmd.type;
+        }
+    }
+    return MQTT_CMD_TEXT;
+}
+
+/**
+ * @brief Копирует сообщение в буфер на стеке с завершающим нулем
+ */
+static bool mqtt_copy_payload(const byte *raw_payload, unsigned int length, char *buf, size_t size)
+{
+    if (length >= size)
+    {
+        return false;
+    }
+    memcpy(buf, raw_payload, length);
+    buf[length] = 0;
+    return true;
+}
+
+/**
+ * @brief Разбирает команду прямо из буферов PubSubClient, без String.
+ * Значение записывается в json_settings_received с типом из таблицы:
+ * повторная команда (retain и накопленная в сессии) заменяет прошлую.
  *
- * @param topic топик вида /period_min/set
- * @param payload данные из топика
+ * @param topic топик вида <topic>/period_min/set
+ * @param raw_payload данные из топика
+ * @param length длина данных
+ * @param json_settings_received полученные настройки
+ * @return true команда принята
  */
-void ha_fill_json_settings_data(const String &topic, const String &payload, JsonDocument &json_settings_received)
+static bool mqtt_parse_command(const char *topic, const byte *raw_payload, unsigned int length, JsonDocument &json_settings_received)
 {
-    bool updated = false;
-    if (topic.endsWith(F("/set"))) // пришла команда на изменение
+    size_t topic_len = strlen(topic);
+    if (topic_len < 5 || strcmp_P(topic + topic_len - 4, PSTR("/set")) != 0) // пришла команда на изменение
     {
-        // извлекаем имя параметра
-        int endslash = topic.lastIndexOf('/');
-        int prevslash = topic.lastIndexOf('/', endslash - 1);
-        String name = topic.substring(prevslash + 1, endslash);
-        LOG_INFO(F("MQTT: CALLBACK: Parameter ") << name);
+        return false;
+    }
+
+    // извлекаем имя параметра
+    const char *end = topic + topic_len - 4;
+    const char *begin = end;
+    while (begin > topic && begin[-1] != '/')
+    {
+        begin--;
+    }
+    char name[MQTT_CMD_NAME_LEN];
+    if (begin == end || (size_t)(end - begin) >= sizeof(name))
+    {
+        return false;
+    }
+    memcpy(name, begin, end - begin);
+    name[end - begin] = 0;
+    LOG_INFO(F("MQTT: CALLBACK: Parameter ") << name << F(", ") << length << F(" bytes"));
 
-        if (name == F("ota"))
+    char value[MQTT_CMD_TEXT_LEN];
+    char *value_end = nullptr;
+    const uint8_t type = mqtt_command_type(name);
+    switch (type)
+    {
+    case MQTT_CMD_JSON:
+    {
+        JsonDocument doc(&json_arena);
+        if (deserializeJson(doc, (const char *)raw_payload, length) != DeserializationError::Ok)
+        {
+            LOG_ERROR(F("MQTT: Failed to parse JSON of ") << name);
+            return false;
+        }
+        json_settings_received[name] = doc.as<JsonObject>();
+        return true;
+    }
+    case MQTT_CMD_UINT:
+    case MQTT_CMD_MONITOR:
+    case MQTT_CMD_FLOAT:
+    {
+        if (!mqtt_copy_payload(raw_payload, length, value, sizeof(value)))
         {
-            JsonDocument ota_doc;
-            if (deserializeJson(ota_doc, payload) == DeserializationError::Ok)
+            break;
+        }
+        // шаблоны команд HA могут добавить пробелы вокруг числа
+        if (type != MQTT_CMD_FLOAT)
+        {
+            unsigned long number = strtoul(value, &value_end, 10);
+            while (value_end && *value_end == ' ')
+            {
+                value_end++;
+            }
+            if (value_end == value || *value_end)
             {
-                json_settings_received[name] = ota_doc.as<JsonObject>();
+                break;
             }
-            else
+            if (type == MQTT_CMD_MONITOR)
             {
-                LOG_ERROR(F("MQTT: Failed to parse OTA JSON"));
+                // Команда сессии, а не настройка: ее выполняет monitor_mqtt
+                monitor_min = _min(number, (unsigned long)MQTT_MONITOR_MAX_MIN);
+                monitor_received = true;
+                return true;
             }
+            json_settings_received[name] = (uint32_t)number;
         }
         else
         {
-            json_settings_received[name] = payload;
+            double number = strtod(value, &value_end);
+            while (value_end && *value_end == ' ')
+            {
+                value_end++;
+            }
+            if (value_end == value || *value_end)
+            {
+                break;
+            }
+            json_settings_received[name] = number;
+        }
+        return true;
+    }
+    default:
+        if (!mqtt_copy_payload(raw_payload, length, value, sizeof(value)))
+        {
+            break;
         }
+        json_settings_received[name] = value;
+        return true;
     }
+    LOG_ERROR(F("MQTT: Bad value of ") << name);
+    return false;
 }
 
 /**
@@ -67,25 +224,50 @@ void ha_fill_json_settings_data(const String &topic, const String &payload, Json
  */
 void mqtt_callback(Settings &sett, JsonDocument &json_settings_received, PubSubClient &mqtt_client, String &mqtt_topic, char *raw_topic, byte *raw_payload, unsigned int length)
 {
-    String topic = raw_topic;
-    String payload;
-    String zero_payload("");
-    payload.reserve(length);
-
-    LOG_INFO(F("MQTT: CALLBACK: Message arrived to: ") << topic);
-    LOG_INFO(F("MQTT: CALLBACK: Message length: ") << length);
-
-    for (unsigned int i = 0; i < length; i++)
+    size_t topic_len = strlen(raw_topic);
+    if (sync_token.length() && topic_len == mqtt_topic.length() + strlen(MQTT_SYNC_TOPIC) &&
+        strncmp(raw_topic, mqtt_topic.c_str(), mqtt_topic.length()) == 0 &&
+        strcmp(raw_topic + mqtt_topic.length(), MQTT_SYNC_TOPIC) == 0)
     {
-        payload += (char)raw_payload[i];
+        // Метка без retain: удалять нечего, чужую (прошлых пробуждений) пропускаем
+        sync_received |= length == sync_token.length() && memcmp(raw_payload, sync_token.c_str(), length) == 0;
+        return;
     }
-    LOG_INFO(F("MQTT: CALLBACK: Message payload: ") << payload);
 
-    ha_fill_json_settings_data(topic, payload, json_settings_received);
+    if (length == 0)
+    {
+        return; // эхо удаления retain: применять и удалять нечего
+    }
 
+    LOG_INFO(F("MQTT: CALLBACK: Message arrived to: ") << raw_topic);
+    mqtt_parse_command(raw_topic, raw_payload, length, json_settings_received);
 
+    // Топик лежит в буфере PubSubClient, publish перезапишет его: копия на стеке
+    char topic[MQTT_TOPIC_LEN + MQTT_CMD_NAME_LEN + 8];
+    if (topic_len >= sizeof(topic))
+    {
+        LOG_ERROR(F("MQTT: Topic too long"));
+        return;
+    }
+    memcpy(topic, raw_topic, topic_len + 1);
     LOG_INFO(F("MQTT: Remove retain message: ") << topic);
-    publish(mqtt_client, topic, zero_payload, PUBLISH_MODE_SIMPLE);
+    mqtt_client.publish(topic, (const uint8_t *)"", 0, true);
+}
+
+bool mqtt_monitor_pending()
+{
+    return monitor_received && monitor_min;
+}
+
+bool mqtt_monitor_take(uint8_t &minutes)
+{
+    if (!monitor_received)
+    {
+        return false;
+    }
+    minutes = monitor_min;
+    monitor_received = false;
+    return true;
 }
 
 /**
@@ -107,7 +289,9 @@ bool mqtt_connect(Settings &sett, PubSubClient &mqtt_client)
     do
     {
         LOG_INFO(F("MQTT: Attempt #") << MQTT_MAX_TRIES - attempts + 1 << F(" from ") << MQTT_MAX_TRIES);
-        if (mqtt_client.connect(client_id.c_str(), login, pass))
+        // Постоянная сессия: брокер хранит подписку и копит команды HA (QoS1), пока устройство спит.
+        // client_id постоянный, поэтому после пробуждения сессия продолжается.
+        if (mqtt_client.connect(client_id.c_str(), login, pass, nullptr, 0, false, nullptr, !sett.mqtt_auto_discovery))
         {
             LOG_INFO(F("MQTT: Connected."));
             return true;
@@ -160,4 +344,83 @@ bool mqtt_unsubscribe(PubSubClient &mqtt_client, String &mqtt_topic)
     LOG_INFO(F("MQTT: Unsubscribed from ") << subscribe_topic);
 
     return true;
-}
\ No newline at end of file
+}
+/**
+ * @brief Принимает сообщения, которые брокер отдает сразу после подключения
+ * (накопленные в постоянной сессии и retain). Ждем, пока данные идут,
+ * и выходим после паузы idle_ms вместо фиксированной задержки.
+ *
+ * @param mqtt_client клиент MQTT
+ * @param client сокет клиента
+ * @param idle_ms пауза без входящих данных, после которой прием завершен
+ * @param timeout_ms максимальное время приема
+ */
+void mqtt_drain(PubSubClient &mqtt_client, WiFiClient &client, uint32_t idle_ms, uint32_t timeout_ms)
+{
+    uint32_t start = millis();
+    uint32_t last_data = start;
+    while (mqtt_client.connected() && millis() - start < timeout_ms)
+    {
+        if (client.available())
+        {
+            mqtt_client.loop();
+            last_data = millis();
+        }
+        else if (millis() - last_data >= idle_ms)
+        {
+            break;
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+    LOG_INFO(F("MQTT: Drain ") << millis() - start << F(" ms"));
+}
+
+/**
+ * @brief Принимает сообщения, которые брокер отдает сразу после подписки
+ * (накопленные в постоянной сессии и retain), до эха своей метки.
+ * Брокер отдает подписчику сообщения по порядку, поэтому метка,
+ * опубликованная после подписки, приходит после всех накопленных.
+ * Ожидание - один обмен с брокером вместо паузы наугад.
+ *
+ * @param mqtt_client клиент MQTT
+ * @param client сокет клиента
+ * @param mqtt_topic строка с топиком
+ * @param timeout_ms максимальное время ожидания метки
+ * @return true метка вернулась
+ */
+bool mqtt_sync(PubSubClient &mqtt_client, WiFiClient &client, String &mqtt_topic, uint32_t timeout_ms)
+{
+    uint32_t start = millis();
+    String sync_topic = mqtt_topic + F(MQTT_SYNC_TOPIC);
+    sync_token = String(ESP.getChipId(), HEX) + '-' + String(ESP.random(), HEX);
+    sync_received = false;
+    if (!mqtt_client.publish(sync_topic.c_str(), sync_token.c_str(), false))
+    {
+        LOG_ERROR(F("MQTT: Sync publish failed"));
+        sync_token = String();
+        return false;
+    }
+
+    while (mqtt_client.connected() && !sync_received && millis() - start < timeout_ms)
+    {
+        if (client.available())
+        {
+            mqtt_client.loop();
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+    sync_token = String();
+    if (!sync_received)
+    {
+        LOG_ERROR(F("MQTT: Sync timeout ") << millis() - start << F(" ms"));
+        return false;
+    }
+    LOG_INFO(F("MQTT: Sync ") << millis() - start << F(" ms"));
+    return true;
+}
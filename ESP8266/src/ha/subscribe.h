@@ -12,14 +12,33 @@
 
 #include <Arduino.h>
 #include <PubSubClient.h>
+#include <ESP8266WiFi.h>
 #include <ArduinoJson.h>
 #include "master_i2c.h"
 #include "setup.h"
 
+#define MQTT_MONITOR_MAX_MIN 10 // предел сессии монитора: все это время wifi включен
+
 extern void mqtt_callback(Settings &sett, JsonDocument &json_data, PubSubClient &mqtt_client, String &mqtt_topic, char *raw_topic, byte *raw_payload, unsigned int length);
 extern bool mqtt_connect(Settings &sett, PubSubClient &mqtt_client);
 extern bool mqtt_subscribe(PubSubClient &mqtt_client, String &mqtt_topic);
 extern bool mqtt_unsubscribe(PubSubClient &mqtt_client, String &mqtt_topic);
+extern void mqtt_drain(PubSubClient &mqtt_client, WiFiClient &client, uint32_t idle_ms, uint32_t timeout_ms);
+extern bool mqtt_sync(PubSubClient &mqtt_client, WiFiClient &client, String &mqtt_topic, uint32_t timeout_ms);
+
+/**
+ * @brief Команда монитора из топика <topic>/monitor/set, если пришла
+ * после прошлого вызова. Сама команда в настройки не попадает.
+ *
+ * @param minutes минут наблюдения (не больше MQTT_MONITOR_MAX_MIN), 0 - остановить
+ * @return true пришла новая команда
+ */
+extern bool mqtt_monitor_take(uint8_t &minutes);
+
+/**
+ * @brief Пришла команда начать монитор, еще не выполненная
+ */
+extern bool mqtt_monitor_pending();
 
 
 #endif
\ No newline at end of file
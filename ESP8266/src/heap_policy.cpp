@@ -0,0 +1,26 @@
+#include "heap_policy.h"
+#include "Logging.h"
+
+size_t heap_large_id(const size_t size)
+{
+#ifdef MMU_IRAM_HEAP
+    if (!size)
+    {
+        return umm_get_current_heap_id(); // без TLS переключать нечего
+    }
+    size_t iram_free;
+    {
+        HeapSelectIram iram;
+        iram_free = ESP.getMaxFreeBlockSize();
+    }
+    if (iram_free >= size + HEAP_IRAM_RESERVE)
+    {
+        return UMM_HEAP_IRAM;
+    }
+    LOG_INFO(F("HEAP: ") << size << F(" bytes do not fit IRAM block ") << iram_free << F(", use DRAM"));
+    return UMM_HEAP_DRAM;
+#else
+    (void)size;
+    return 0;
+#endif
+}
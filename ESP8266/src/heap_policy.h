@@ -0,0 +1,55 @@
+/**
+ * @file heap_policy.h
+ * @brief Крупные короткоживущие буферы - во вторую кучу IRAM
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Самые большие выделения пробуждения - буферы BearSSL (прием до 16 КБ,
+ * контекст и передача) и внутренности HTTPClient при OTA. Они живут одно
+ * соединение, но дробят DRAM, где лежат долгоживущие объекты, стек lwIP и
+ * AsyncWebServer портала. В сборке со второй кучей (MMU_IRAM_HEAP, см.
+ * platformio.ini) HeapSelectLarge на время подключения переключает
+ * выделения в IRAM, если там хватает места под оценку размера; иначе
+ * остается DRAM - неудачное выделение в IRAM не переходит в DRAM само.
+ * Выделения SDK и lwIP ядро всегда делает в DRAM.
+ *
+ * IRAM доступна только словами: побайтовый доступ BearSSL к буферам
+ * эмулирует обработчик исключений, рукопожатие становится медленнее
+ * (время видно в фазах профайлера). Без MMU_IRAM_HEAP класс ничего не делает.
+ */
+#ifndef HEAP_POLICY_H_
+#define HEAP_POLICY_H_
+
+#include <Arduino.h>
+#include <umm_malloc/umm_heap_select.h>
+
+#define HEAP_TLS_CONTEXT 6000 // br_ssl_client_context, x509 и клиент, байт
+#define HEAP_TLS_DEFAULT (16709 + 837 + HEAP_TLS_CONTEXT) // буферы WiFiClientSecure по умолчанию
+
+#ifndef HEAP_IRAM_RESERVE
+#define HEAP_IRAM_RESERVE 1024 // остается в IRAM после крупного выделения
+#endif
+
+/**
+ * @brief Куча для выделения size байт: IRAM, если хватает, иначе DRAM.
+ * При size == 0 - текущая куча (соединение без TLS).
+ */
+extern size_t heap_large_id(const size_t size);
+
+#ifdef MMU_IRAM_HEAP
+class HeapSelectLarge : public HeapSelect
+{
+public:
+    explicit HeapSelectLarge(const size_t size) : HeapSelect(heap_large_id(size)) {}
+};
+#else
+class HeapSelectLarge
+{
+public:
+    explicit HeapSelectLarge(const size_t) {}
+};
+#endif
+
+#endif
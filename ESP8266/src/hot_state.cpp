@@ -0,0 +1,258 @@
+#include "hot_state.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include <coredecls.h>
+#include "Logging.h"
+
+static uint32_t next_seq = 0;
+static uint8_t records = 0;
+static bool scanned = false;
+static HotState stored;
+static bool stored_valid = false;
+
+static uint32_t record_crc(const HotState &state)
+{
+    return crc32(&state, offsetof(HotState, crc));
+}
+
+static void capture(const Settings &sett, HotState &state)
+{
+    memset(&state, 0, sizeof(state));
+    state.impulses0_previous = sett.impulses0_previous;
+    state.impulses1_previous = sett.impulses1_previous;
+    state.wake_time = sett.wake_time;
+    state.http_static_crc = sett.http_static_crc;
+    state.clock_ratio = sett.clock_ratio;
+    state.last_send = sett.last_send;
+    state.base_time = sett.base_time;
+    state.period_min_tuned = sett.period_min_tuned;
+    state.ntp_drift_ms = sett.ntp_drift_ms;
+    state.mode = sett.mode;
+    state.wifi_connect_errors = sett.wifi_connect_errors;
+    state.wifi_connect_attempt = sett.wifi_connect_attempt;
+    state.ntp_error_counter = sett.ntp_error_counter;
+    state.ntp_skip_count = sett.ntp_skip_count;
+    state.offline_queue_file = sett.offline_queue_file;
+    state.energy_cycle_uah = sett.energy_cycle_uah;
+    state.energy_uah = sett.energy_uah;
+    state.period_policy_min = sett.period_policy_min;
+    state.idle_min = sett.idle_min;
+    state.wifi_fail_streak = sett.wifi_fail_streak;
+    state.wifi_backoff_skip = sett.wifi_backoff_skip;
+    state.wifi_fast_uses = sett.wifi_fast_uses;
+    state.ntp_fast_server = sett.ntp_fast_server;
+    state.espnow_seq = sett.espnow_seq;
+    state.flash_writes = sett.flash_writes;
+    state.config_commits = sett.config_commits;
+}
+
+// Совпадают ли поля записей без номера и счетчиков
+static bool same_fields(const HotState &a, const HotState &b)
+{
+    size_t from = offsetof(HotState, impulses0_previous);
+    return memcmp((const uint8_t *)&a + from, (const uint8_t *)&b + from, offsetof(HotState, flash_writes) - from) == 0;
+}
+
+// Ищет последнюю целую запись, заодно считает записи и следующий номер
+static bool scan(const Settings &sett, HotState &last)
+{
+    bool found = false;
+    uint32_t max_seq = 0;
+    records = 0;
+
+    File file = LittleFS.open(HOT_STATE_FILE, "r");
+    if (file)
+    {
+        HotState state;
+        while (file.read((uint8_t *)&state, sizeof(state)) == sizeof(state))
+        {
+            records++;
+            if (state.crc != record_crc(state))
+            {
+                continue;
+            }
+            if (state.seq >= max_seq)
+            {
+                max_seq = state.seq;
+                last = state;
+                found = true;
+            }
+        }
+        if (file.size() % sizeof(state))
+        {
+            // Записи другого размера (прошлая версия прошивки): новые
+            // дописывать нельзя, иначе они не совпадут с границей записи
+            records = HOT_STATE_RECORDS;
+        }
+        file.close();
+    }
+
+    next_seq = found ? _max(max_seq + 1, sett.hot_seq) : sett.hot_seq;
+    scanned = true;
+    return found && last.seq >= sett.hot_seq;
+}
+
+bool hot_state_load(Settings &sett)
+{
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return false;
+    }
+
+    HotState state;
+    bool found = scan(sett, state);
+
+    if (!found)
+    {
+        // Актуальны настройки из EEPROM, с ними и сравниваем
+        capture(sett, stored);
+        stored_valid = true;
+        return false;
+    }
+
+    sett.impulses0_previous = state.impulses0_previous;
+    sett.impulses1_previous = state.impulses1_previous;
+    sett.wake_time = state.wake_time;
+    sett.http_static_crc = state.http_static_crc;
+    sett.clock_ratio = state.clock_ratio;
+    sett.last_send = state.last_send;
+    sett.base_time = state.base_time;
+    sett.period_min_tuned = state.period_min_tuned;
+    sett.ntp_drift_ms = state.ntp_drift_ms;
+    sett.mode = state.mode;
+    sett.wifi_connect_errors = state.wifi_connect_errors;
+    sett.wifi_connect_attempt = state.wifi_connect_attempt;
+    sett.ntp_error_counter = state.ntp_error_counter;
+    sett.ntp_skip_count = state.ntp_skip_count;
+    sett.offline_queue_file = state.offline_queue_file;
+    sett.energy_cycle_uah = state.energy_cycle_uah;
+    sett.energy_uah = state.energy_uah;
+    sett.period_policy_min = state.period_policy_min;
+    sett.idle_min = state.idle_min;
+    sett.wifi_fail_streak = state.wifi_fail_streak;
+    sett.wifi_backoff_skip = state.wifi_backoff_skip;
+    sett.wifi_fast_uses = state.wifi_fast_uses;
+    sett.ntp_fast_server = state.ntp_fast_server;
+    sett.espnow_seq = state.espnow_seq;
+    sett.flash_writes = state.flash_writes;
+    sett.config_commits = state.config_commits;
+
+    stored = state;
+    stored_valid = true;
+
+    LOG_INFO(F("HOT: Loaded seq=") << state.seq << F(" records=") << records);
+    return true;
+}
+
+bool hot_state_changed(const Settings &sett)
+{
+    if (!stored_valid)
+    {
+        return true;
+    }
+    HotState state;
+    capture(sett, state);
+    return !same_fields(state, stored);
+}
+
+bool hot_state_store(const Settings &sett)
+{
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return false;
+    }
+
+    if (!scanned)
+    {
+        HotState last;
+        scan(sett, last);
+    }
+
+    HotState state;
+    capture(sett, state);
+    state.seq = next_seq;
+    state.crc = record_crc(state);
+
+    // Сжатие: начинаем файл заново с текущей записи
+    bool compact = records >= HOT_STATE_RECORDS;
+    bool result = false;
+    File file = LittleFS.open(HOT_STATE_FILE, compact ? "w" : "a");
+    if (!file)
+    {
+        LOG_ERROR(F("HOT: Failed to open ") << HOT_STATE_FILE);
+    }
+    else
+    {
+        result = file.write((const uint8_t *)&state, sizeof(state)) == sizeof(state);
+        file.close();
+    }
+
+    if (result)
+    {
+        stored = state;
+        stored_valid = true;
+        next_seq++;
+        records = compact ? 1 : records + 1;
+        LOG_INFO(F("HOT: Stored seq=") << state.seq << F(" records=") << records);
+    }
+    else
+    {
+        LOG_ERROR(F("HOT: Store failed"));
+    }
+    return result;
+}
+
+uint32_t hot_state_commit(const Settings &sett)
+{
+    if (!scanned && fs_begin())
+    {
+        HotState last;
+        scan(sett, last);
+    }
+    return _max(next_seq, sett.hot_seq);
+}
+
+void hot_state_clear(const Settings &sett)
+{
+    capture(sett, stored);
+    stored_valid = true;
+
+    if (records && fs_begin())
+    {
+        LittleFS.remove(HOT_STATE_FILE);
+        records = 0;
+    }
+}
+
+void hot_state_mask(Settings &sett)
+{
+    sett.impulses0_previous = 0;
+    sett.impulses1_previous = 0;
+    sett.wake_time = 0;
+    sett.http_static_crc = 0;
+    sett.clock_ratio = 0;
+    sett.last_send = 0;
+    sett.base_time = 0;
+    sett.period_min_tuned = 0;
+    sett.ntp_drift_ms = 0;
+    sett.mode = 0;
+    sett.wifi_connect_errors = 0;
+    sett.wifi_connect_attempt = 0;
+    sett.ntp_error_counter = 0;
+    sett.ntp_skip_count = 0;
+    sett.offline_queue_file = 0;
+    sett.energy_cycle_uah = 0;
+    sett.energy_uah = 0;
+    sett.period_policy_min = 0;
+    sett.idle_min = 0;
+    sett.wifi_fail_streak = 0;
+    sett.wifi_backoff_skip = 0;
+    sett.wifi_fast_uses = 0;
+    sett.ntp_fast_server = 0;
+    sett.espnow_seq = 0;
+    sett.flash_writes = 0;
+    sett.config_commits = 0;
+    sett.hot_seq = 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file hot_state.h
+ * @brief Журнал часто меняющихся полей настроек на LittleFS
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Счетчики ошибок, прошлые показания и время последней отправки меняются
+ * каждое пробуждение, а вместе с ними раньше перезаписывались все 960 байт
+ * настроек со стиранием сектора flash. Теперь эти поля дописываются маленькой
+ * записью в конец файла, а сектор с настройками перезаписывается только
+ * при изменении остальных (холодных) полей.
+ *
+ * RTC память для этого не подходит: attiny снимает питание ESP после сна.
+ *
+ * Запись с номером меньше Settings::hot_seq старше настроек в EEPROM и
+ * не применяется. При переполнении файл перезаписывается последней записью.
+ */
+#ifndef HOT_STATE_H_
+#define HOT_STATE_H_
+
+#include <Arduino.h>
+#include "setup.h"
+
+#define HOT_STATE_FILE "/hot.bin"
+#define HOT_STATE_RECORDS 64 // Записей в файле до сжатия
+
+struct HotState
+{
+    uint32_t seq;
+    uint32_t impulses0_previous;
+    uint32_t impulses1_previous;
+    uint32_t wake_time;
+    uint32_t http_static_crc;
+    uint32_t clock_ratio;
+    time_t last_send;
+    time_t base_time;
+    uint16_t period_min_tuned;
+    uint16_t ntp_drift_ms;
+    uint8_t mode;
+    uint8_t wifi_connect_errors;
+    uint8_t wifi_connect_attempt;
+    uint8_t ntp_error_counter;
+    uint8_t ntp_skip_count;
+    uint8_t offline_queue_file;
+    uint16_t energy_cycle_uah;
+    uint32_t energy_uah;
+    uint16_t period_policy_min;
+    uint16_t idle_min;
+    uint8_t wifi_fail_streak;
+    uint8_t wifi_backoff_skip;
+    uint8_t wifi_fast_uses;
+    uint8_t ntp_fast_server;
+    uint32_t espnow_seq;
+    // Счетчики записей не участвуют в сравнении: сами меняются при каждой записи
+    uint32_t flash_writes;
+    uint32_t config_commits;
+    uint32_t crc;
+};
+
+/**
+ * @brief Применяет к настройкам последнюю целую запись журнала
+ *
+ * @param sett настройки, загруженные из EEPROM
+ * @return true запись применена
+ */
+extern bool hot_state_load(Settings &sett);
+
+/**
+ * @brief Проверяет, отличаются ли горячие поля от последней записи
+ * (загруженной или сохраненной в этом пробуждении)
+ *
+ * @param sett настройки
+ * @return true нужна запись
+ */
+extern bool hot_state_changed(const Settings &sett);
+
+/**
+ * @brief Дописывает горячие поля настроек в журнал
+ *
+ * @param sett настройки
+ * @return true запись сохранена
+ */
+extern bool hot_state_store(const Settings &sett);
+
+/**
+ * @brief Номер для Settings::hot_seq при полной записи настроек в EEPROM:
+ * записи журнала до нее перестают применяться
+ *
+ * @param sett настройки
+ * @return значение hot_seq
+ */
+extern uint32_t hot_state_commit(const Settings &sett);
+
+/**
+ * @brief Удаляет устаревший журнал после полной записи настроек
+ *
+ * @param sett записанные настройки, с ними сравниваются следующие изменения
+ */
+extern void hot_state_clear(const Settings &sett);
+
+/**
+ * @brief Обнуляет горячие поля, чтобы сравнивать только холодную часть настроек
+ */
+extern void hot_state_mask(Settings &sett);
+
+#endif
@@ -0,0 +1,157 @@
+#include "http_pool.h"
+#include <ESP8266WiFi.h>
+#include "Logging.h"
+#include "setup.h"
+#include "tls_session.h"
+#include "dns_cache.h"
+#include "heap_policy.h"
+
+struct HttpPoolEntry
+{
+    String host;
+    uint16_t port = 0;
+    bool secure = false;
+    bool busy = false;
+    WiFiClient *client = nullptr;
+    BearSSL::Session *session = nullptr; // должна жить дольше клиента
+};
+
+static HttpPoolEntry pool[HTTP_POOL_SIZE];
+
+static void entry_close(HttpPoolEntry &entry)
+{
+    if (entry.client)
+    {
+        entry.client->stop();
+        delete entry.client;
+    }
+    delete entry.session;
+    entry.client = nullptr;
+    entry.session = nullptr;
+    entry.host = String();
+    entry.busy = false;
+}
+
+static HttpPoolEntry *entry_find(const String &host, const uint16_t port, const bool secure)
+{
+    for (HttpPoolEntry &entry : pool)
+    {
+        if (entry.client && !entry.busy && entry.port == port && entry.secure == secure && entry.host == host)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+static HttpPoolEntry &entry_free()
+{
+    for (HttpPoolEntry &entry : pool)
+    {
+        if (!entry.client)
+        {
+            return entry;
+        }
+    }
+    for (HttpPoolEntry &entry : pool)
+    {
+        if (!entry.busy)
+        {
+            entry_close(entry); // вытесняем простаивающее
+            return entry;
+        }
+    }
+    entry_close(pool[0]);
+    return pool[0];
+}
+
+static bool entry_connect(HttpPoolEntry &entry, const String &url)
+{
+    if (!entry.secure)
+    {
+        entry.client = new WiFiClient();
+        entry.client->setTimeout(SERVER_TIMEOUT);
+        IPAddress ip;
+        return dns_resolve(entry.host, ip) ? entry.client->connect(ip, entry.port)
+                                           : entry.client->connect(entry.host.c_str(), entry.port);
+    }
+
+    // Контекст и буферы BearSSL выделяются в конструкторе и при подключении
+    HeapSelectLarge large(HEAP_TLS_DEFAULT);
+    BearSSL::WiFiClientSecure *tls_client = new BearSSL::WiFiClientSecure();
+    entry.session = new BearSSL::Session();
+    LOG_INFO(F("HTTP: Create secure client"));
+    tls_client->setInsecure(); // доверяем всем сертификатам
+    if (tls_session_load(url, *entry.session))
+    {
+        LOG_INFO(F("HTTP: Resume TLS session"));
+    }
+    tls_client->setSession(entry.session);
+    tls_client->setTimeout(SERVER_TIMEOUT);
+    entry.client = tls_client;
+
+    // https подключаем по имени (SNI), адрес уже в таблице lwIP после dns_prefetch
+    return entry.client->connect(entry.host.c_str(), entry.port);
+}
+
+bool http_pool_acquire(const String &url, const String &host, const uint16_t port, const bool secure, HttpConnection &conn)
+{
+    HttpPoolEntry *entry = entry_find(host, port, secure);
+    if (entry)
+    {
+        // Сервер мог закрыть соединение по таймауту или прислать лишнее
+        if (entry->client->connected() && !entry->client->available())
+        {
+            LOG_INFO(F("HTTP: Reuse connection to ") << host);
+            entry->busy = true;
+            conn.client = entry->client;
+            conn.session = entry->session;
+            conn.reused = true;
+            return true;
+        }
+        entry_close(*entry);
+    }
+
+    entry = &entry_free();
+    entry->host = host;
+    entry->port = port;
+    entry->secure = secure;
+    if (!entry_connect(*entry, url))
+    {
+        entry_close(*entry);
+        return false;
+    }
+    entry->busy = true;
+    conn.client = entry->client;
+    conn.session = entry->session;
+    conn.reused = false;
+    return true;
+}
+
+void http_pool_release(HttpConnection &conn, const bool keep)
+{
+    for (HttpPoolEntry &entry : pool)
+    {
+        if (entry.client && entry.client == conn.client)
+        {
+            if (keep && entry.client->connected())
+            {
+                entry.busy = false;
+            }
+            else
+            {
+                entry_close(entry);
+            }
+            break;
+        }
+    }
+    conn = HttpConnection();
+}
+
+void http_pool_close()
+{
+    for (HttpPoolEntry &entry : pool)
+    {
+        entry_close(entry);
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * @file http_pool.h
+ * @brief Соединения http/https, переиспользуемые в пределах пробуждения
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * post_data держит соединение открытым (keep-alive), если сервер не
+ * попросил его закрыть и ответ прочитан до конца. Следующий запрос на тот
+ * же хост и порт - на сайт Ватериуса и на http_url одного сервера, повторная
+ * отправка после применения настроек - идет по живому сокету без TCP и
+ * TLS рукопожатий. Соединений не больше HTTP_POOL_SIZE, все закрываются
+ * http_pool_close() до OTA (открытый TLS клиент держит буферы в куче)
+ * и выключения wifi.
+ */
+#ifndef HTTP_POOL_H_
+#define HTTP_POOL_H_
+
+#include <Arduino.h>
+#include <WiFiClientSecureBearSSL.h>
+
+#ifndef HTTP_POOL_SIZE
+#define HTTP_POOL_SIZE 2 // сайт Ватериуса и http_url
+#endif
+
+struct HttpConnection
+{
+    WiFiClient *client = nullptr;         // WiFiClient или BearSSL::WiFiClientSecure
+    BearSSL::Session *session = nullptr;  // только для https
+    bool reused = false;                  // соединение осталось от прошлого запроса
+};
+
+/**
+ * @brief Возвращает открытое соединение с хостом или подключается заново.
+ * Для нового https соединения загружается сохраненная сессия TLS (tls_session.h).
+ *
+ * @param url ссылка (для кэша сессии TLS)
+ * @param host имя хоста
+ * @param port порт
+ * @param secure https
+ * @param conn соединение
+ * @return true подключено
+ */
+extern bool http_pool_acquire(const String &url, const String &host, const uint16_t port, const bool secure, HttpConnection &conn);
+
+/**
+ * @brief Возвращает соединение после запроса
+ *
+ * @param keep ответ прочитан полностью и сервер не закрывает соединение
+ */
+extern void http_pool_release(HttpConnection &conn, const bool keep);
+
+/**
+ * @brief Закрывает все соединения
+ */
+extern void http_pool_close();
+
+#endif
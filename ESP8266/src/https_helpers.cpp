@@ -1,83 +1,357 @@
+#include "https_helpers.h"
 #include <ESP8266WiFi.h>
-#include "ESP8266HTTPClient.h"
 #include <ArduinoJson.h>
 #include "Logging.h"
 #include "utils.h"
+#include "tls_session.h"
+#include "json_stream.h"
+#include "cpu_boost.h"
+#include "http_pool.h"
+#include "json_arena.h"
 
-bool post_data(const String &url, const char *key, const char *email, const String &payload, JsonDocument &json_settings)
-{
-    void *pClient = nullptr;
-    HTTPClient httpClient;
-    bool result = false;
-    LOG_INFO(F("HTTP: Send JSON POST request"));
-    LOG_INFO(F("HTTP: URL:") << url);
-    LOG_INFO(F("HTTP: Body:") << payload);
+#define HTTP_DEFAULT_PORT 80
+#define HTTPS_DEFAULT_PORT 443
+#define COAP_DEFAULT_PORT 5683
+#define HTTP_MAX_CHUNKED_BODY 2048
 
+bool parse_url(const String &url, String &host, uint16_t &port, String &path)
+{
     String proto = get_proto(url);
-    LOG_INFO(F("HTTP: Protocol: ") << proto);
+    if (proto != PROTO_HTTP && proto != PROTO_HTTPS && proto != PROTO_COAP)
+    {
+        return false;
+    }
+
+    // proto://host[:port][/path]
+    int host_start = url.indexOf(F("://")) + 3;
+    int path_start = url.indexOf('/', host_start);
+    host = path_start > 0 ? url.substring(host_start, path_start) : url.substring(host_start);
+    path = path_start > 0 ? url.substring(path_start) : String('/');
+    port = proto == PROTO_HTTPS ? HTTPS_DEFAULT_PORT : (proto == PROTO_COAP ? COAP_DEFAULT_PORT : HTTP_DEFAULT_PORT);
+
+    int port_start = host.indexOf(':');
+    if (port_start > 0)
+    {
+        port = host.substring(port_start + 1).toInt();
+        host.remove(port_start);
+    }
+    return host.length() > 0;
+}
+
+static void merge_settings(const JsonDocument &temp, JsonDocument &json_settings)
+{
+    if (temp.is<JsonObjectConst>())
+    {
+        for (JsonPairConst kv : temp.as<JsonObjectConst>())
+        {
+            json_settings[kv.key()] = kv.value();
+        }
+        LOG_INFO(F("HTTP: Settings received from server"));
+    }
+}
+
+void parse_settings_response(const String &response_body, JsonDocument &json_settings)
+{
+    if (response_body.length() <= 2)
+    {
+        return;
+    }
+
+    JsonDocument temp(&json_arena);
+    if (!deserializeJson(temp, response_body))
+    {
+        merge_settings(temp, json_settings);
+    }
+}
+
+// Читает из сокета не больше длины тела: за ним в том же соединении следующий ответ
+class BoundedReader
+{
+    Stream &_stream;
+    size_t _left;
+
+public:
+    BoundedReader(Stream &stream, const size_t length) : _stream(stream), _left(length) {}
+
+    int read()
+    {
+        uint8_t c;
+        if (!_left || _stream.readBytes(&c, 1) != 1) // с ожиданием, данные могут быть еще в пути
+        {
+            return -1;
+        }
+        _left--;
+        return c;
+    }
 
-    // Set wc client
-    if (proto == PROTO_HTTP)
+    size_t readBytes(char *buffer, size_t length)
     {
-        LOG_INFO(F("HTTP: Create insecure client"));
-        pClient = new WiFiClient;
+        length = _stream.readBytes(buffer, _min(length, _left));
+        _left -= length;
+        return length;
     }
-    else if (proto == PROTO_HTTPS)
+
+    // Дочитывает остаток тела
+    bool skip()
     {
-        LOG_INFO(F("HTTP: Create secure client"));
-        pClient = new WiFiClientSecure;
-        (*(WiFiClientSecure *)pClient).setInsecure(); // доверяем всем сертификатам
+        char buffer[64];
+        while (_left)
+        {
+            if (!readBytes(buffer, sizeof(buffer)))
+            {
+                return false;
+            }
+        }
+        return true;
     }
+};
 
-    // HTTP settings
-    httpClient.setTimeout(SERVER_TIMEOUT);
-    httpClient.setReuse(false); // будет сразу закрывать подключение после отправки
+// Тело в chunked (HTTP/1.1) целиком. Ответы с настройками небольшие
+static bool read_chunked(Stream &stream, String &body)
+{
+    for (;;)
+    {
+        String line = stream.readStringUntil('\n');
+        if (!line.length())
+        {
+            return false;
+        }
+        size_t size = strtoul(line.c_str(), nullptr, 16);
+        if (!size)
+        {
+            stream.readStringUntil('\n'); // пустая строка после последнего блока
+            return true;
+        }
+        if (body.length() + size > HTTP_MAX_CHUNKED_BODY)
+        {
+            return false;
+        }
+        while (size--)
+        {
+            char c;
+            if (stream.readBytes(&c, 1) != 1)
+            {
+                return false;
+            }
+            body += c;
+        }
+        stream.readStringUntil('\n');
+    }
+}
 
-    if (httpClient.begin(*(WiFiClient *)pClient, url))
+/**
+ * @brief Отправляет запрос по соединению и разбирает ответ
+ *
+ * @param keep соединение можно оставить открытым для следующего запроса
+ * @return код ответа или -1, если ответа нет
+ */
+static int post_request(WiFiClient &client, const bool secure, const String &host, const String &path, const char *key, const char *email,
+                        const JsonDocument &json, const bool msgpack, const size_t body_len, JsonDocument &json_settings, bool &keep)
+{
+    keep = false;
     {
-        httpClient.addHeader(F("Content-Type"), F("application/json"));
+        // Рукопожатие уже прошло, здесь шифрование тела
+        CpuBoost boost(secure);
+
+        BufferedPrint<JSON_STREAM_BUFFER_SIZE> out(client);
+        out << F("POST ") << path << F(" HTTP/1.1\r\nHost: ") << host
+            << F("\r\nUser-Agent: ESP8266HTTPClient\r\nContent-Type: ")
+            << (msgpack ? F("application/msgpack") : F("application/json")) << F("\r\n");
         if (key)
         {
-            httpClient.addHeader(F("Waterius-Token"), key);
+            out << F("Waterius-Token: ") << key << F("\r\n");
         }
         if (email)
         {
-            httpClient.addHeader(F("Waterius-Email"), email);
+            out << F("Waterius-Email: ") << email << F("\r\n");
+        }
+        out << F("Content-Length: ") << body_len << F("\r\nConnection: keep-alive\r\n\r\n");
+        if (msgpack)
+        {
+            serializeMsgPack(json, out);
         }
-        LOG_INFO(F("HTTP: Post request"));
+        else
+        {
+            serializeJson(json, out);
+        }
+    }
+#ifdef LOG_LEVEL_DEBUG
+    serializeJson(json, log_buffer);
+    log_buffer.println();
+#endif
 
-        int response_code = httpClient.POST(payload);
-        LOG_INFO(F("HTTP: Response code: ") << response_code);
-        result = response_code == 200;
-        String response_body = httpClient.getString();
-        LOG_INFO(F("HTTP: Response body: ") << response_body);
+    // HTTP/1.1 200 OK
+    String status = client.readStringUntil('\n');
+    int space = status.indexOf(' ');
+    int response_code = space > 0 ? status.substring(space + 1).toInt() : -1;
+    if (response_code <= 0)
+    {
+        LOG_ERROR(F("HTTP: No response"));
+        return -1;
+    }
+    LOG_INFO(F("HTTP: Response code: ") << response_code);
+
+    bool close = !status.startsWith(F("HTTP/1.1"));
+    bool chunked = false;
+    long content_length = -1;
+    String retry_after;
+    for (;;)
+    {
+        String header = client.readStringUntil('\n');
+        header.trim();
+        if (!header.length())
+        {
+            break;
+        }
+        header.toLowerCase();
+        if (header.startsWith(F("content-length:")))
+        {
+            content_length = header.substring(15).toInt();
+        }
+        else if (header.startsWith(F("transfer-encoding:")))
+        {
+            chunked = header.indexOf(F("chunked")) > 0;
+        }
+        else if (header.startsWith(F("connection:")))
+        {
+            close = header.indexOf(F("close")) > 0;
+        }
+        else if (header.startsWith(F("retry-after:")))
+        {
+            retry_after = header.substring(12);
+        }
+    }
 
-        if (result && response_body.length() > 2)
+    http_retry_after = parse_retry_after(response_code, retry_after);
+    if (http_retry_after)
+    {
+        LOG_ERROR(F("HTTP: Server busy, retry after ") << http_retry_after << F(" s"));
+    }
+
+    if (response_code == 204)
+    {
+        // Настройки не изменились: тела нет и читать нечего
+        keep = !close;
+        return response_code;
+    }
+
+    bool ok = response_code == 200;
+    if (chunked)
+    {
+        String body;
+        keep = read_chunked(client, body) && !close;
+        if (ok)
         {
-            JsonDocument temp;
-            DeserializationError error = deserializeJson(temp, response_body);
-            if (!error && temp.is<JsonObject>())
+            parse_settings_response(body, json_settings);
+        }
+    }
+    else if (content_length >= 0)
+    {
+        BoundedReader reader(client, content_length);
+        if (ok && content_length)
+        {
+            // Разбираем настройки прямо из сокета
+            JsonDocument temp(&json_arena);
+            DeserializationError error = deserializeJson(temp, reader);
+            if (!error)
             {
-                for (JsonPairConst kv : temp.as<JsonObjectConst>())
-                {
-                    json_settings[kv.key()] = kv.value();
-                }
-                LOG_INFO(F("HTTP: Settings received from server"));
+                merge_settings(temp, json_settings);
+            }
+            else
+            {
+                LOG_ERROR(F("HTTP: Response parse error: ") << error.c_str());
             }
         }
-
-        httpClient.end();
-        (*(WiFiClient *)pClient).stop();
+        keep = reader.skip() && !close;
     }
+    else if (ok)
+    {
+        // Без длины тело заканчивается закрытием соединения
+        JsonDocument temp(&json_arena);
+        DeserializationError error = deserializeJson(temp, client);
+        if (!error)
+        {
+            merge_settings(temp, json_settings);
+        }
+        else if (error != DeserializationError::EmptyInput)
+        {
+            LOG_ERROR(F("HTTP: Response parse error: ") << error.c_str());
+        }
+    }
+    return response_code;
+}
+
+uint32_t http_retry_after = 0;
 
-    if (proto == PROTO_HTTP)
+uint32_t parse_retry_after(const int response_code, const String &value)
+{
+    if (response_code != 429 && response_code != 503)
+    {
+        return 0;
+    }
+    String seconds = value;
+    seconds.trim();
+    bool digits = seconds.length() > 0;
+    for (size_t i = 0; i < seconds.length() && digits; i++)
     {
-        delete (WiFiClient *)pClient;
+        digits = isdigit(seconds[i]);
     }
-    else if (proto == PROTO_HTTPS)
+    if (!digits)
+    {
+        return HTTP_RETRY_AFTER_DEFAULT;
+    }
+    uint32_t retry_after = seconds.toInt();
+    return _min(_max(retry_after, 1UL), HTTP_RETRY_AFTER_MAX);
+}
+
+bool post_data(const String &url, const char *key, const char *email, const JsonDocument &json, JsonDocument &json_settings, bool msgpack)
+{
+    String host, path;
+    uint16_t port;
+    if (!parse_url(url, host, port, path) || get_proto(url) == PROTO_COAP)
     {
-        delete (WiFiClientSecure *)pClient;
+        LOG_ERROR(F("HTTP: Wrong URL:") << url);
+        return false;
     }
 
-    return result;
-}
\ No newline at end of file
+    size_t body_len = msgpack ? measureMsgPack(json) : measureJson(json);
+    LOG_INFO(F("HTTP: Send ") << (msgpack ? F("MessagePack") : F("JSON")) << F(" POST request"));
+    LOG_INFO(F("HTTP: URL:") << url);
+    LOG_INFO(F("HTTP: Body size:") << body_len);
+
+    bool secure = get_proto(url) == PROTO_HTTPS;
+    int response_code = -1;
+    http_retry_after = 0;
+    HttpConnection conn;
+    bool retry;
+    do
+    {
+        bool connected;
+        {
+            // Рукопожатие - на повышенной частоте, ожидание ответа - нет
+            CpuBoost boost(secure);
+            connected = http_pool_acquire(url, host, port, secure, conn);
+        }
+        if (!connected)
+        {
+            LOG_ERROR(F("HTTP: Connect failed"));
+            return false;
+        }
+
+        bool keep = false;
+        response_code = post_request(*conn.client, secure, host, path, key, email, json, msgpack, body_len, json_settings, keep);
+        if (response_code > 0 && secure && !conn.reused)
+        {
+            // рукопожатие прошло, сохраняем сессию для следующего пробуждения
+            tls_session_store(url, *conn.session);
+        }
+        retry = response_code <= 0 && conn.reused; // сервер успел закрыть простаивавшее соединение
+        http_pool_release(conn, keep);
+        if (retry)
+        {
+            LOG_INFO(F("HTTP: Kept connection is dead, reconnect"));
+        }
+    } while (retry);
+
+    return http_accepted(response_code);
+}
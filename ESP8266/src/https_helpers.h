@@ -4,6 +4,62 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
-extern bool post_data(const String &url, const char *key, const char *email, const String &payload, JsonDocument &json_settings);
+/**
+ * @brief Копирует настройки из json ответа сервера
+ *
+ * @param response_body тело ответа
+ * @param json_settings документ для полученных настроек
+ */
+extern void parse_settings_response(const String &response_body, JsonDocument &json_settings);
+
+/**
+ * @brief Сервер принял данные: 200 (в теле могут быть настройки)
+ * или 204 - ревизия настроек config_rev совпала, тела нет
+ */
+inline bool http_accepted(const int response_code)
+{
+    return response_code == 200 || response_code == 204;
+}
+
+#define HTTP_RETRY_AFTER_DEFAULT 3600UL      // с, если 429/503 без Retry-After в секундах
+#define HTTP_RETRY_AFTER_MAX (7 * 86400UL)   // дольше не откладываем
+
+/**
+ * @brief Сколько секунд сервер просил не повторять запрос в последнем ответе
+ * (429 или 503 с Retry-After), 0 - не просил. Повторные попытки в это
+ * пробуждение бессмысленны, показания остаются в очереди до следующего.
+ */
+extern uint32_t http_retry_after;
+
+/**
+ * @brief Разбирает Retry-After ответа 429 или 503
+ *
+ * @param response_code код ответа
+ * @param value значение заголовка: секунды (HTTP-дату не разбираем)
+ * @return секунды ожидания, 0 для других кодов
+ */
+extern uint32_t parse_retry_after(const int response_code, const String &value);
+
+/**
+ * @brief Разбирает ссылку вида proto://host[:port][/path]
+ *
+ * @return true ссылка http, https или coap
+ */
+extern bool parse_url(const String &url, String &host, uint16_t &port, String &path);
+
+/**
+ * @brief Отправляет JSON POST запрос. Тело пишется в сокет потоково,
+ * без промежуточной строки, ответ разбирается прямо из сокета.
+ * Соединение остается открытым для следующего запроса на тот же хост (http_pool.h).
+ *
+ * @param url ссылка http или https
+ * @param key токен Waterius-Token
+ * @param email Waterius-Email
+ * @param json данные
+ * @param json_settings настройки из ответа сервера
+ * @param msgpack отправить тело в MessagePack вместо JSON (ответ всегда JSON)
+ * @return true сервер ответил 200 или 204. При 429/503 задает http_retry_after
+ */
+extern bool post_data(const String &url, const char *key, const char *email, const JsonDocument &json, JsonDocument &json_settings, bool msgpack = false);
 
 #endif
\ No newline at end of file
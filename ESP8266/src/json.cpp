@@ -7,8 +7,34 @@
 #include "voltage.h"
 #include "sync_time.h"
 #include "wifi_helpers.h"
+#include "profiler.h"
+#include "energy.h"
+#include "config.h"
+#include "json_stream.h"
+#include "ota_parse.h"
 
 extern Voltage voltage;
+extern AttinySnapshots snapshots;
+extern AttinyFlowStats flow_stats;
+extern AttinyPulseLog pulse_log;
+
+/**
+ * @brief Расход по интервалам между импульсами, единиц показаний в час
+ * (м3/ч, для электричества кВт)
+ *
+ * @param name тип счетчика CounterName
+ * @param factor вес импульса (для электричества - импульсов на кВт*ч)
+ * @param ticks интервал в тактах attiny
+ */
+static float pulse_rate(const uint8_t name, const uint16_t factor, const uint16_t ticks)
+{
+    if (!factor || ticks >= ATTINY_PULSE_LOG_MAX)
+    {
+        return 0.0; // импульсов давно не было
+    }
+    float per_pulse = name == CounterName::ELECTRO ? 1.0 / factor : factor / 1000.0;
+    return per_pulse * 3600000.0 / (_max(ticks, (uint16_t)1) * ATTINY_PULSE_TICK_MS);
+}
 
 void get_json_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data)
 {
@@ -39,6 +65,8 @@ void get_json_data(const Settings &sett, const AttinyData &data, const Calculate
     root[F("voltage")] = voltage.average() / 1000.0;
     root[F("voltage_low")] = voltage.low_voltage();
     root[F("voltage_diff")] = (float)voltage.diff() / 1000.0;
+    root[F("voltage_min")] = voltage.min_value() / 1000.0;
+    root[F("voltage_min_phase")] = profiler_phase_name(voltage.min_phase()); // где просадка: wifi, send...
     root[F("battery")] = voltage.get_battery_level();
 
     // Wifi и сеть
@@ -47,6 +75,8 @@ void get_json_data(const Settings &sett, const AttinyData &data, const Calculate
     root[F("wifi_phy_mode_s")] = wifi_phy_mode_title((WiFiPhyMode_t)sett.wifi_phy_mode);
     root[F("wifi_connect_errors")] = sett.wifi_connect_errors;
     root[F("wifi_connect_attempt")] = sett.wifi_connect_attempt;
+    root[F("wifi_on_ms")] = wifi_transitions.wake_ms + wifi_transitions.mode_ms;
+    root[F("wifi_connect_ms")] = wifi_transitions.connect_ms;
 
     uint8_t *bssid = WiFi.BSSID();
     char router_mac[18] = {0};
@@ -66,19 +96,33 @@ void get_json_data(const Settings &sett, const AttinyData &data, const Calculate
     root[F("flash_id")] = ESP.getFlashChipId();
 
     root[F("freemem")] = ESP.getFreeHeap();
+    root[F("freemem_min")] = profiler_heap_min();
+#ifdef MMU_IRAM_HEAP
+    root[F("iram_min")] = profiler_iram_min();
+#endif
     root[F("timestamp")] = get_current_time();
 
     // настройки и события
     root[F("waketime")] = sett.wake_time;
     root[F("period_min_tuned")] = sett.period_min_tuned;
     root[F("period_min")] = sett.wakeup_per_min;
+    root[F("period_lo")] = sett.wakeup_per_min_lo;
+    root[F("period_hi")] = sett.wakeup_per_min_hi;
+    root[F("period_policy")] = wakeup_period_min(sett);
+    root[F("wake_slot")] = sett.wakeup_slot ? (int32_t)sett.wakeup_slot - 1 : -1;
+    root[F("wake_offset")] = wakeup_slot_sec(sett, wakeup_period_min(sett)) / 60;
+    root[F("config_rev")] = sett.config_rev;
     root[F("setuptime")] = sett.setup_time;
     root[F("boot")] = data.service;
     root[F("resets")] = data.resets;
+    root[F("reset_reason")] = ESP.getResetInfoPtr()->reason;
     root[F("mode")] = sett.mode;
     root[F("setup_finished")] = sett.setup_finished_counter;
     root[F("setup_started")] = data.setup_started_counter;
     root[F("ntp_errors")] = sett.ntp_error_counter;
+    root[F("ntp_skip")] = sett.ntp_skip_period;
+    root[F("flash_writes")] = sett.flash_writes;
+    root[F("config_commits")] = sett.config_commits;
     root[F("mqtt_retain")] = (bool)sett.mqtt_retain;
 #if WATERIUS_MODEL == WATERIUS_MODEL_2
     root[F("voltage_cal")] = sett.voltage_cal;
@@ -100,6 +144,105 @@ void get_json_data(const Settings &sett, const AttinyData &data, const Calculate
     // OTA error
     root[F("ota_error")] = (int)sett.ota_error;
 
+    // Образ файловой системы: сервер не присылает тот же
+    char fs_md5[2 * OTA_MD5_SIZE + 1];
+    if (ota_md5_format(sett.fs_md5, fs_md5))
+    {
+        root[F("fs_md5")] = fs_md5;
+    }
+
+    // Время фаз цикла пробуждения
+    profiler_fill_json(root);
+
+    // Расход батареи по модели и прогноз дней работы
+    energy_fill_json(sett, root);
+
+    // Сколько attiny проспала на каждом периоде watchdog, мин
+    if (data.wdt_minutes[0] || data.wdt_minutes[1] || data.wdt_minutes[2] || data.wdt_minutes[3])
+    {
+        JsonArray rates = root[F("wdt_rates")].to<JsonArray>();
+        for (uint8_t i = 0; i < ATTINY_WDT_RATES; i++)
+        {
+            rates.add(data.wdt_minutes[i]);
+        }
+    }
+
+    // Тревоги детектора расхода attiny (пробуждение в ALARM_TRANSMIT_MODE)
+    if (data.flow_alarm)
+    {
+        root[F("flow_alarm")] = data.flow_alarm;
+    }
+
+    // Износ EEPROM attiny
+    if (data.eeprom_writes)
+    {
+        root[F("eeprom_writes")] = data.eeprom_writes;
+        root[F("eeprom_left")] = data.eeprom_left;
+    }
+    if (data.eeprom_skipped)
+    {
+        root[F("eeprom_skipped")] = data.eeprom_skipped;
+    }
+
+    // Интервальные данные: приросты импульсов по периодам от старых к новым
+    if (snapshots.count)
+    {
+        JsonObject intervals = root[F("intervals")].to<JsonObject>();
+        intervals[F("period")] = snapshots.period_min;
+        intervals[F("age")] = snapshots.age_min;
+        intervals[F("imp0")] = snapshots.base0;
+        intervals[F("imp1")] = snapshots.base1;
+        JsonArray d0 = intervals[F("d0")].to<JsonArray>();
+        JsonArray d1 = intervals[F("d1")].to<JsonArray>();
+        for (uint8_t i = 0; i < snapshots.count; i++)
+        {
+            d0.add(snapshots.delta0[i]);
+            d1.add(snapshots.delta1[i]);
+        }
+    }
+
+    // Статистика расхода по входам за период
+    if (flow_stats.valid)
+    {
+        JsonArray flow = root[F("flow")].to<JsonArray>();
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            const AttinyFlowChannel &channel = flow_stats.channel[i];
+            JsonObject item = flow.add<JsonObject>();
+            item[F("max_ppm")] = channel.max_ppm;
+            item[F("events")] = channel.events;
+            item[F("longest")] = channel.longest_min;
+            item[F("zero")] = channel.zero_min;
+        }
+    }
+
+    // Текущий и пиковый расход по последним импульсам.
+    // Текущий не больше, чем по времени после последнего импульса: расход мог прекратиться
+    if (pulse_log.valid)
+    {
+        JsonArray rates = root[F("rate")].to<JsonArray>();
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            const AttinyPulseChannel &channel = pulse_log.channel[i];
+            const uint8_t name = i ? sett.counter1_name : sett.counter0_name;
+            const uint16_t factor = i ? sett.factor1 : sett.factor0;
+            JsonObject item = rates.add<JsonObject>();
+            item[F("n")] = channel.count;
+            if (!channel.count)
+            {
+                continue;
+            }
+            uint16_t shortest = channel.interval[0];
+            for (uint8_t j = 1; j < channel.count; j++)
+            {
+                shortest = _min(shortest, channel.interval[j]);
+            }
+            uint16_t last = _max(channel.interval[channel.count - 1], channel.age);
+            item[F("now")] = pulse_rate(name, factor, last);
+            item[F("peak")] = pulse_rate(name, factor, shortest);
+        }
+    }
+
     LOG_INFO(F("JSON: Size: ") << measureJson(json_data));
 
     // JSON size 1.1.16 929 //no mqtt
@@ -110,3 +253,54 @@ void get_json_data(const Settings &sett, const AttinyData &data, const Calculate
     // JSON size 0.10.6: 439
     // JSON size 0.10.3: 355
 }
+
+// Поля, которые меняются только при настройке или обновлении прошивки
+static const char STATIC_KEYS[] PROGMEM = ",version,version_esp,model,esp_id,flash_id,mac,key,email,company,place,"
+                                          "serial0,serial1,cname0,cname1,data_type0,data_type1,ctype0,ctype1,f0,f1,"
+                                          "ch0_start,ch1_start,wifi_phy_mode_s,dhcp,mqtt,ha,http,mqtt_retain,"
+                                          "voltage_cal,setuptime,setup_finished,period_min,period_lo,period_hi,config_rev,ntp_skip,wake_slot,";
+
+static bool is_static_key(const String &keys, const char *key)
+{
+    char needle[24];
+    size_t len = strlen(key);
+    if (len + 3 > sizeof(needle))
+    {
+        return false;
+    }
+    needle[0] = ',';
+    memcpy(needle + 1, key, len);
+    needle[len + 1] = ',';
+    needle[len + 2] = 0;
+    return strstr(keys.c_str(), needle) != nullptr;
+}
+
+uint32_t get_compact_json(const JsonDocument &json_data, uint32_t static_crc, JsonDocument &compact)
+{
+    JsonObjectConst root = json_data.as<JsonObjectConst>();
+    String keys = FPSTR(STATIC_KEYS); // strstr_P ищет строку из flash в RAM, а нам нужно наоборот
+
+    Crc32Print crc;
+    for (JsonPairConst kv : root)
+    {
+        if (is_static_key(keys, kv.key().c_str()))
+        {
+            crc.write((const uint8_t *)kv.key().c_str(), kv.key().size());
+            serializeMsgPack(kv.value(), crc);
+        }
+    }
+
+    bool send_static = crc.crc != static_crc;
+    for (JsonPairConst kv : root)
+    {
+        if (send_static || !is_static_key(keys, kv.key().c_str()))
+        {
+            compact[kv.key()] = kv.value();
+        }
+    }
+    compact[F("sv")] = JSON_SCHEMA_VERSION;
+    compact[F("sc")] = crc.crc;
+
+    LOG_INFO(F("JSON: Compact size: ") << measureMsgPack(compact) << F(" static: ") << send_static);
+    return crc.crc;
+}
@@ -15,6 +15,8 @@
 #include "voltage.h"
 #include "master_i2c.h"
 
+#define JSON_SCHEMA_VERSION 1 // Версия набора полей в компактном формате
+
 /**
     Конвертирует настройки и показания в json
 
@@ -26,4 +28,16 @@
 */
 extern void get_json_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data);
 
+/**
+    Готовит документ для компактной отправки (MessagePack).
+    Статические поля (версии, id, компания, место и т.п.) копируются,
+    только если их crc32 отличается от static_crc.
+
+    @param json_data полный json с показаниями.
+    @param static_crc crc32 статических полей, уже принятых сервером (0 - отправить все).
+    @param compact документ, в который будут записаны данные.
+    @return crc32 статических полей текущего json_data
+*/
+extern uint32_t get_compact_json(const JsonDocument &json_data, uint32_t static_crc, JsonDocument &compact);
+
 #endif
@@ -0,0 +1,128 @@
+#include "json_arena.h"
+#include <stdlib.h>
+#ifdef JSON_ARENA_IRAM
+#include <umm_malloc/umm_heap_select.h>
+#endif
+
+#define ARENA_ALIGN sizeof(void *)
+#define ARENA_FREED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+// Перед каждым выделением: размер (для reallocate) и предыдущее выделение
+struct ArenaHeader
+{
+    size_t size; // со старшим битом ARENA_FREED после освобождения
+    size_t prev; // смещение предыдущего выделения, 0 - нет
+};
+#define ARENA_HEADER sizeof(ArenaHeader)
+
+JsonArena json_arena;
+
+static ArenaHeader *header_of(const uint8_t *ptr)
+{
+    return (ArenaHeader *)(ptr - ARENA_HEADER);
+}
+
+static size_t align_up(const size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+bool JsonArena::begin(const size_t size)
+{
+    void *block;
+    {
+#ifdef JSON_ARENA_IRAM
+        HeapSelectIram iram;
+#endif
+        block = malloc(size);
+    }
+    begin(block, block ? size : 0);
+    return block != nullptr;
+}
+
+void JsonArena::begin(void *block, const size_t size)
+{
+    _block = (uint8_t *)block;
+    _size = size;
+    _top = 0;
+    _last = 0;
+    _peak = 0;
+    _live = 0;
+    _fallbacks = 0;
+}
+
+void *JsonArena::allocate(size_t size)
+{
+    size_t need = ARENA_HEADER + align_up(size);
+    if (!_block || _size - _top < need)
+    {
+        _fallbacks++;
+        return malloc(size);
+    }
+    ArenaHeader *header = (ArenaHeader *)(_block + _top);
+    header->size = size;
+    header->prev = _last;
+    _last = _top + ARENA_HEADER;
+    _top += need;
+    _live++;
+    if (_top > _peak)
+    {
+        _peak = _top;
+    }
+    return _block + _last;
+}
+
+void JsonArena::deallocate(void *ptr)
+{
+    if (!owns(ptr))
+    {
+        free(ptr);
+        return;
+    }
+    if (--_live == 0)
+    {
+        _top = 0; // все документы закрыты: блок пуст
+        _last = 0;
+        return;
+    }
+    header_of((uint8_t *)ptr)->size |= ARENA_FREED;
+    // С вершины снимаем все освобожденные подряд, остальное вернется позже
+    while (_last && (header_of(_block + _last)->size & ARENA_FREED))
+    {
+        _top = _last - ARENA_HEADER;
+        _last = header_of(_block + _last)->prev;
+    }
+}
+
+void *JsonArena::reallocate(void *ptr, size_t new_size)
+{
+    if (!ptr)
+    {
+        return allocate(new_size);
+    }
+    if (!owns(ptr))
+    {
+        return realloc(ptr, new_size);
+    }
+
+    size_t old_size = header_of((uint8_t *)ptr)->size;
+    if ((uint8_t *)ptr == _block + _last && _size - _last >= align_up(new_size))
+    {
+        // последнее выделение растет или сжимается на месте
+        header_of((uint8_t *)ptr)->size = new_size;
+        _top = _last + align_up(new_size);
+        if (_top > _peak)
+        {
+            _peak = _top;
+        }
+        return ptr;
+    }
+
+    void *moved = allocate(new_size);
+    if (moved)
+    {
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+        deallocate(ptr);
+    }
+    return moved;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file json_arena.h
+ * @brief Распределитель памяти для JsonDocument из одного блока на пробуждение
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Документы пробуждения (показания, настройки из ответов, временные для
+ * разбора ответа и компактного формата) выделяли пулы и строки в общей куче
+ * вперемешку с буферами TLS и lwIP. После их освобождения в куче оставались
+ * дыры, и на сборке с 1 МБ flash рукопожатию иногда не хватало непрерывного
+ * блока. JsonArena берет один блок в setup(), пока куча еще не раздроблена,
+ * и раздает память подряд, как стек. Последнее выделение растет на месте
+ * (так растут строки и пулы ArduinoJson), а освобожденное с вершины
+ * возвращается вместе с освобожденными под ним. Когда закрыт последний
+ * документ, блок снова пуст к следующей фазе.
+ * Если блока не хватило, память берется из кучи как обычно.
+ *
+ * С JSON_ARENA_IRAM блок берется из кучи IRAM (сборка с MMU_IRAM_HEAP):
+ * DRAM остается под TLS, но побайтовый доступ к IRAM эмулируется
+ * обработчиком исключений и заметно медленнее.
+ */
+#ifndef JSON_ARENA_H_
+#define JSON_ARENA_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#ifndef JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE 6144 // показания с очередью, настройки и временные документы
+#endif
+
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    /**
+     * @brief Выделяет блок. Без блока все выделения идут в кучу.
+     */
+    bool begin(const size_t size = JSON_ARENA_SIZE);
+
+    /**
+     * @brief Использует готовый блок (для тестов)
+     */
+    void begin(void *block, const size_t size);
+
+    void *allocate(size_t size) override;
+    void deallocate(void *ptr) override;
+    void *reallocate(void *ptr, size_t new_size) override;
+
+    size_t used() const { return _top; }
+    size_t peak() const { return _peak; }
+    size_t capacity() const { return _size; }
+    uint16_t fallbacks() const { return _fallbacks; } // выделений из кучи при нехватке блока
+
+private:
+    bool owns(const void *ptr) const { return ptr >= _block && ptr < _block + _size; }
+
+    uint8_t *_block = nullptr;
+    size_t _size = 0;
+    size_t _top = 0;
+    size_t _last = 0;   // смещение последнего выделения (за заголовком), 0 - нет
+    size_t _peak = 0;
+    uint16_t _live = 0; // выделений в блоке
+    uint16_t _fallbacks = 0;
+};
+
+extern JsonArena json_arena;
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file json_stream.h
+ * @brief Потоковая сериализация JSON без промежуточной строки
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * ArduinoJson пишет в Print по одному символу. Если писать так прямо в сокет,
+ * то каждый символ уйдет отдельным TCP пакетом (или TLS записью). BufferedPrint
+ * собирает данные в небольшой буфер на стеке и отдает их порциями.
+ * Общий интерфейс для отправки по http (WiFiClient) и mqtt (PubSubClient).
+ */
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <coredecls.h>
+
+#define JSON_STREAM_BUFFER_SIZE 256
+
+template <size_t N>
+class BufferedPrint : public Print
+{
+    Print &_out;
+    uint8_t _buffer[N];
+    size_t _len;
+    size_t _written;
+
+public:
+    explicit BufferedPrint(Print &out) : _out(out), _len(0), _written(0) {}
+    ~BufferedPrint() { flush(); }
+
+    size_t write(uint8_t c) override
+    {
+        _buffer[_len++] = c;
+        if (_len == N)
+        {
+            flush();
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            write(buffer[i]);
+        }
+        return size;
+    }
+
+    void flush() override
+    {
+        if (_len)
+        {
+            _written += _out.write(_buffer, _len);
+            _len = 0;
+        }
+    }
+
+    /**
+     * @brief Сколько байт реально принял получатель
+     */
+    size_t written() const { return _written; }
+};
+
+/**
+ * @brief Считает crc32 и длину всего, что в него пишут, без промежуточного буфера
+ */
+class Crc32Print : public Print
+{
+public:
+    uint32_t crc = 0xffffffff;
+    size_t length = 0;
+
+    size_t write(uint8_t c) override
+    {
+        crc = crc32(&c, 1, crc);
+        length++;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        crc = crc32(buffer, size, crc);
+        length += size;
+        return size;
+    }
+};
+
+/**
+ * @brief Сериализует JSON в поток через буфер
+ *
+ * @param json документ
+ * @param out получатель (сокет, клиент mqtt)
+ * @return количество байт, принятых получателем
+ */
+inline size_t stream_json(const JsonDocument &json, Print &out)
+{
+    BufferedPrint<JSON_STREAM_BUFFER_SIZE> buffered(out);
+    serializeJson(json, buffered);
+    buffered.flush();
+    return buffered.written();
+}
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ * @file json_writer.h
+ * @brief Генератор JSON прямо в поток, без документа в памяти
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Используется для больших сообщений (discovery Home Assistant): генератор
+ * запускается дважды - сначала в Crc32Print для длины и crc, затем в сокет.
+ * Памяти нужно только на буфер отправки, сколько бы ни было полей.
+ */
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <Arduino.h>
+
+#define JSON_WRITER_MAX_DEPTH 16
+
+/**
+ * @brief Экранирует все, что в него пишут, для вставки внутрь строки JSON
+ */
+class JsonEscapedPrint : public Print
+{
+    Print &_out;
+
+public:
+    explicit JsonEscapedPrint(Print &out) : _out(out) {}
+
+    size_t write(uint8_t c) override
+    {
+        if (c == '"' || c == '\\')
+        {
+            _out.write('\\');
+            _out.write(c);
+        }
+        else if (c < 0x20)
+        {
+            char buf[7];
+            snprintf_P(buf, sizeof(buf), PSTR("\\u%04x"), c);
+            _out.write((const uint8_t *)buf, 6);
+        }
+        else
+        {
+            _out.write(c);
+        }
+        return 1;
+    }
+    using Print::write;
+};
+
+class JsonWriter
+{
+    Print &_out;
+    JsonEscapedPrint _escaped;
+    uint16_t _first; // бит на уровень вложенности: следующий элемент первый
+    uint8_t _depth;
+    bool _after_key;
+
+    void separator()
+    {
+        if (_after_key)
+        {
+            _after_key = false;
+        }
+        else if (_first & (1U << _depth))
+        {
+            _first &= ~(1U << _depth);
+        }
+        else
+        {
+            _out.write(',');
+        }
+    }
+
+    void open(char c)
+    {
+        separator();
+        _out.write(c);
+        _depth++;
+        _first |= (1U << _depth);
+    }
+
+    void close(char c)
+    {
+        _depth--;
+        _out.write(c);
+    }
+
+public:
+    explicit JsonWriter(Print &out)
+        : _out(out), _escaped(out), _first(1), _depth(0), _after_key(false) {}
+
+    JsonWriter &begin_object()
+    {
+        open('{');
+        return *this;
+    }
+    JsonWriter &end_object()
+    {
+        close('}');
+        return *this;
+    }
+    JsonWriter &begin_array()
+    {
+        open('[');
+        return *this;
+    }
+    JsonWriter &end_array()
+    {
+        close(']');
+        return *this;
+    }
+
+    template <typename K>
+    JsonWriter &key(K name)
+    {
+        separator();
+        _out.write('"');
+        _escaped.print(name);
+        _out.write('"');
+        _out.write(':');
+        _after_key = true;
+        return *this;
+    }
+
+    /**
+     * @brief Начинает строковое значение. Все, что выведено в
+     * возвращаемый поток до end_string(), будет экранировано.
+     */
+    Print &begin_string()
+    {
+        separator();
+        _out.write('"');
+        return _escaped;
+    }
+    JsonWriter &end_string()
+    {
+        _out.write('"');
+        return *this;
+    }
+
+    JsonWriter &value(const char *str)
+    {
+        begin_string().print(str);
+        return end_string();
+    }
+    JsonWriter &value(const __FlashStringHelper *str)
+    {
+        begin_string().print(str);
+        return end_string();
+    }
+    JsonWriter &value(const String &str) { return value(str.c_str()); }
+    JsonWriter &value(bool b)
+    {
+        separator();
+        _out.print(b ? F("true") : F("false"));
+        return *this;
+    }
+    JsonWriter &value(int n)
+    {
+        separator();
+        _out.print(n);
+        return *this;
+    }
+    JsonWriter &value(long n)
+    {
+        separator();
+        _out.print(n);
+        return *this;
+    }
+    JsonWriter &value(double n)
+    {
+        separator();
+        _out.print(n, 2);
+        return *this;
+    }
+
+    template <typename K, typename V>
+    JsonWriter &member(K name, V val)
+    {
+        key(name);
+        return value(val);
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "log_buffer.h"
+
+LogBuffer log_buffer;
+
+LogBuffer::LogBuffer() : _head(0), _size(0), _errors(0)
+{
+#ifdef LOG_DIRECT
+    _direct = true;
+#else
+    _direct = false;
+#endif
+}
+
+size_t LogBuffer::write(uint8_t c)
+{
+    if (_direct)
+    {
+        Serial.write(c);
+    }
+    _buf[_head] = c;
+    _head = (_head + 1) % LOG_BUFFER_SIZE;
+    if (_size < LOG_BUFFER_SIZE)
+    {
+        _size++;
+    }
+    return 1;
+}
+
+size_t LogBuffer::write(const uint8_t *buffer, size_t size)
+{
+    if (_direct)
+    {
+        Serial.write(buffer, size);
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        _buf[_head] = buffer[i];
+        _head = (_head + 1) % LOG_BUFFER_SIZE;
+    }
+    _size = _min(_size + size, (size_t)LOG_BUFFER_SIZE);
+    return size;
+}
+
+LogBuffer &LogBuffer::line()
+{
+    if (!_direct && Serial.available())
+    {
+        // К устройству подключен терминал
+        while (Serial.available())
+        {
+            Serial.read();
+        }
+        direct();
+    }
+    return *this;
+}
+
+void LogBuffer::dump(Print &out) const
+{
+    size_t start = (_head + LOG_BUFFER_SIZE - _size) % LOG_BUFFER_SIZE;
+    size_t first = _min(_size, LOG_BUFFER_SIZE - start);
+    out.write((const uint8_t *)_buf + start, first);
+    out.write((const uint8_t *)_buf, _size - first);
+}
+
+size_t LogBuffer::read(size_t offset, uint8_t *buf, size_t len) const
+{
+    if (offset >= _size)
+    {
+        return 0;
+    }
+    len = _min(len, _size - offset);
+    size_t start = (_head + LOG_BUFFER_SIZE - _size + offset) % LOG_BUFFER_SIZE;
+    size_t first = _min(len, LOG_BUFFER_SIZE - start);
+    memcpy(buf, _buf + start, first);
+    memcpy(buf + first, _buf, len - first);
+    return len;
+}
+
+void LogBuffer::error()
+{
+    if (_errors < UINT8_MAX)
+    {
+        _errors++;
+    }
+    direct();
+}
+
+void LogBuffer::direct()
+{
+    if (_direct)
+    {
+        return;
+    }
+    if (_size == LOG_BUFFER_SIZE)
+    {
+        Serial.print(F("...\r\n"));
+    }
+    dump(Serial);
+    _direct = true;
+}
+
+void LogBuffer::clear()
+{
+    _head = 0;
+    _size = 0;
+}
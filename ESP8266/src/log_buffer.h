@@ -0,0 +1,93 @@
+/**
+ * @file log_buffer.h
+ * @brief Кольцевой буфер лога в RAM с отложенным выводом в Serial
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * При 115200 бод строка лога занимает в UART около 5 мс, и когда FIFO
+ * заполнен, Serial.print ждет. В обычном пробуждении без ошибок лог никто
+ * не читает, поэтому строки складываются в буфер, а в Serial уходят только
+ * если что-то пошло не так или к устройству подключен компьютер:
+ *   - при первой ошибке (LOG_ERROR): буфер выводится целиком и дальше лог идет напрямую;
+ *   - если в Serial пришел любой байт (нажали клавишу в терминале);
+ *   - по LOG_FLUSH(): в режиме настройки и при ручном пробуждении;
+ *   - всегда, если задан флаг LOG_DIRECT.
+ * Буфер хранит последние LOG_BUFFER_SIZE байт лога в любом режиме,
+ * старые строки затираются.
+ */
+#ifndef LOG_BUFFER_H_
+#define LOG_BUFFER_H_
+
+#include <Arduino.h>
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 2048
+#endif
+
+class LogBuffer : public Print
+{
+    char _buf[LOG_BUFFER_SIZE];
+    size_t _head;
+    size_t _size;
+    bool _direct;
+    uint8_t _errors;
+
+public:
+    LogBuffer();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    /**
+     * @brief Начало строки лога: если в Serial что-то пришло, переключается на прямой вывод
+     */
+    LogBuffer &line();
+
+    /**
+     * @brief Выводит накопленное в Serial, дальше лог пишется и в Serial
+     */
+    void direct();
+
+    bool is_direct() const { return _direct; }
+
+    /**
+     * @brief Отмечает ошибку (LOG_ERROR) и переключается на прямой вывод
+     */
+    void error();
+
+    /**
+     * @brief Ошибок в логе этого запуска (насыщение 255)
+     */
+    uint8_t errors() const { return _errors; }
+
+    /**
+     * @brief Байт в буфере
+     */
+    size_t size() const { return _size; }
+
+    /**
+     * @brief Копирует часть содержимого буфера (от старых строк к новым)
+     *
+     * @param offset смещение от самой старой строки
+     * @return количество скопированных байт
+     */
+    size_t read(size_t offset, uint8_t *buf, size_t len) const;
+
+    /**
+     * @brief Копирует содержимое буфера (от старых строк к новым)
+     *
+     * @param out куда выводить
+     */
+    void dump(Print &out) const;
+
+    /**
+     * @brief Отбрасывает накопленное
+     */
+    void clear();
+};
+
+extern LogBuffer log_buffer;
+
+#endif
@@ -0,0 +1,391 @@
+#include "log_store.h"
+#include <new>
+#include <coredecls.h>
+#include "fs_mount.h"
+#include "log_buffer.h"
+#include "Logging.h"
+#include "sync_time.h"
+#include "utils.h"
+#include "https_helpers.h"
+#include "http_pool.h"
+#include "json_stream.h"
+#include "gzip_writer.h"
+
+static const char *const LOG_FILES[2] = {LOG_STORE_FILE0, LOG_STORE_FILE1};
+
+/**
+ * @brief Записи обоих файлов: номера и размеры
+ */
+struct LogStoreState
+{
+    bool found[2];
+    uint32_t first_seq[2];
+    uint32_t last_seq[2];
+    size_t size[2];
+    uint8_t active; // файл с самой новой записью
+};
+
+static uint32_t header_crc(const LogStoreHeader &header)
+{
+    return crc32(&header, offsetof(LogStoreHeader, crc));
+}
+
+/**
+ * @brief Читает заголовок записи с текущей позиции файла.
+ * Целая запись: верный crc и текст полностью в файле.
+ */
+static bool read_header(File &file, LogStoreHeader &header)
+{
+    if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header))
+    {
+        return false;
+    }
+    return header.crc == header_crc(header) && header.length <= LOG_BUFFER_SIZE &&
+           file.size() - file.position() >= header.length;
+}
+
+static void scan(LogStoreState &state)
+{
+    memset(&state, 0, sizeof(state));
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        File file = LittleFS.open(LOG_FILES[i], "r");
+        if (!file)
+        {
+            continue;
+        }
+        state.size[i] = file.size();
+        LogStoreHeader header;
+        while (read_header(file, header))
+        {
+            if (!state.found[i])
+            {
+                state.first_seq[i] = header.seq;
+                state.found[i] = true;
+            }
+            state.last_seq[i] = header.seq;
+            file.seek(header.length, SeekCur);
+        }
+        file.close();
+    }
+    state.active = state.found[1] && (!state.found[0] || state.last_seq[1] > state.last_seq[0]) ? 1 : 0;
+}
+
+static bool is_error_exit(WakeExit wake_exit)
+{
+    switch (wake_exit)
+    {
+    case WAKE_EXIT_NO_ATTINY:
+    case WAKE_EXIT_NO_CONFIG:
+    case WAKE_EXIT_NO_WIFI:
+    case WAKE_EXIT_NOT_SENT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool log_store_wake(const Settings &sett, WakeExit wake_exit)
+{
+    if (!is_error_exit(wake_exit) && !log_buffer.errors())
+    {
+        return false;
+    }
+    if (!fs_begin())
+    {
+        return false;
+    }
+
+    LogStoreState state;
+    scan(state);
+
+    LogStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    header.seq = state.found[state.active] ? state.last_seq[state.active] + 1 : 0;
+    time_t now = time(nullptr);
+    header.timestamp = is_valid_time(now) ? (uint32_t)(now - millis() / 1000) : 0;
+    header.length = log_buffer.size();
+    header.exit = wake_exit;
+    header.errors = log_buffer.errors();
+    header.crc = header_crc(header);
+
+    // Текущий файл заполнен - второй начинаем заново, в нем самые старые записи
+    uint8_t target = state.active;
+    bool restart = state.size[target] + sizeof(header) + header.length > LOG_STORE_FILE_SIZE;
+    if (restart)
+    {
+        target ^= 1;
+    }
+
+    File file = LittleFS.open(LOG_FILES[target], restart ? "w" : "a");
+    if (!file)
+    {
+        LOG_ERROR(F("LOG: Failed to open ") << LOG_FILES[target]);
+        return false;
+    }
+    // Лог пишем до LOG_INFO ниже: иначе его строка не совпадет с длиной в заголовке
+    bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+    if (ok)
+    {
+        BufferedPrint<JSON_STREAM_BUFFER_SIZE> out(file);
+        log_buffer.dump(out);
+        out.flush();
+        ok = out.written() == header.length;
+    }
+    file.close();
+
+    if (ok)
+    {
+        LOG_INFO(F("LOG: Stored seq=") << header.seq << F(" bytes=") << header.length << F(" file=") << target);
+    }
+    else
+    {
+        LOG_ERROR(F("LOG: Store failed"));
+    }
+    return ok;
+}
+
+static size_t record_title(char *buf, size_t size, const LogStoreHeader &header)
+{
+    return snprintf_P(buf, size, PSTR("\r\n=== wake %u, time %u, exit %u, errors %u ===\r\n"),
+                      (unsigned)header.seq, (unsigned)header.timestamp, header.exit, header.errors);
+}
+
+static uint32_t read_uploaded()
+{
+    uint32_t next = 0;
+    File file = LittleFS.open(LOG_STORE_UPLOADED_FILE, "r");
+    if (file)
+    {
+        if (file.read((uint8_t *)&next, sizeof(next)) != sizeof(next))
+        {
+            next = 0;
+        }
+        file.close();
+    }
+    return next;
+}
+
+/**
+ * @brief Сжимает записи с номерами from..to в gzip, каждую отдельным блоком
+ *
+ * @param buf буфер на заголовок и текст одной записи
+ */
+static void gzip_records(Print &out, uint32_t from, uint32_t to, const LogStoreState &state, uint8_t *buf, size_t buf_size)
+{
+    GzipWriter gzip(out);
+    gzip.begin();
+    for (uint8_t n = 0; n < 2; n++)
+    {
+        uint8_t i = n == 0 ? state.active ^ 1 : state.active;
+        if (!state.found[i] || state.last_seq[i] < from || state.first_seq[i] > to)
+        {
+            continue;
+        }
+        File file = LittleFS.open(LOG_FILES[i], "r");
+        LogStoreHeader header;
+        while (file && read_header(file, header))
+        {
+            if (header.seq < from || header.seq > to)
+            {
+                file.seek(header.length, SeekCur);
+                continue;
+            }
+            size_t len = record_title((char *)buf, buf_size, header);
+            len += file.read(buf + len, _min((size_t)header.length, buf_size - len));
+            gzip.block(buf, len);
+        }
+        if (file)
+        {
+            file.close();
+        }
+    }
+    gzip.end();
+}
+
+/**
+ * @brief POST тела gzip. Соединение берется из пула: это тот же http_url,
+ * куда только что ушли показания.
+ *
+ * @return код ответа или -1
+ */
+static int post_gzip(const Settings &sett, uint32_t from, uint32_t to, const LogStoreState &state, uint8_t *buf, size_t buf_size)
+{
+    String url = sett.http_url;
+    String host, path;
+    uint16_t port;
+    if (!parse_url(url, host, port, path))
+    {
+        return -1;
+    }
+
+    // Первый проход - только длина
+    Crc32Print measure;
+    gzip_records(measure, from, to, state, buf, buf_size);
+
+    bool secure = get_proto(url) == PROTO_HTTPS;
+    HttpConnection conn;
+    if (!http_pool_acquire(url, host, port, secure, conn))
+    {
+        return -1;
+    }
+    {
+        BufferedPrint<JSON_STREAM_BUFFER_SIZE> out(*conn.client);
+        out << F("POST ") << path << F(" HTTP/1.1\r\nHost: ") << host
+            << F("\r\nUser-Agent: ESP8266HTTPClient\r\nContent-Type: text/plain\r\nContent-Encoding: gzip\r\n")
+            << F("Waterius-Token: ") << sett.waterius_key << F("\r\n")
+            << F("Content-Length: ") << measure.length << F("\r\nConnection: close\r\n\r\n");
+        gzip_records(out, from, to, state, buf, buf_size);
+    }
+
+    conn.client->setTimeout(LOG_UPLOAD_TIMEOUT);
+    String status = conn.client->readStringUntil('\n');
+    int space = status.indexOf(' ');
+    int response_code = space > 0 ? status.substring(space + 1).toInt() : -1;
+    http_pool_release(conn, false);
+
+    LOG_INFO(F("LOG: Uploaded ") << measure.length << F(" bytes, code ") << response_code);
+    return response_code;
+}
+
+bool log_store_upload(const Settings &sett)
+{
+    if (!sett.log_upload || !is_http(sett) || is_coap(sett.http_url) || !fs_begin())
+    {
+        return true;
+    }
+
+    LogStoreState state;
+    scan(state);
+    if (!state.found[state.active])
+    {
+        return true;
+    }
+    uint32_t to = state.last_seq[state.active];
+    uint32_t from = read_uploaded();
+    if (from > to + 1)
+    {
+        from = 0; // журнал начат заново
+    }
+    if (from > to)
+    {
+        return true;
+    }
+    if (to - from >= LOG_UPLOAD_MAX_RECORDS)
+    {
+        from = to - LOG_UPLOAD_MAX_RECORDS + 1; // самые свежие, остальные устарели
+    }
+
+    size_t buf_size = LOG_BUFFER_SIZE + 80;
+    uint8_t *buf = new (std::nothrow) uint8_t[buf_size];
+    if (!buf)
+    {
+        LOG_ERROR(F("LOG: No memory for upload"));
+        return false;
+    }
+    int code = post_gzip(sett, from, to, state, buf, buf_size);
+    delete[] buf;
+
+    if (!http_accepted(code))
+    {
+        LOG_ERROR(F("LOG: Upload failed"));
+        return false;
+    }
+    uint32_t next = to + 1;
+    File file = LittleFS.open(LOG_STORE_UPLOADED_FILE, "w");
+    if (file)
+    {
+        file.write((const uint8_t *)&next, sizeof(next));
+        file.close();
+    }
+    return true;
+}
+
+LogStoreReader::LogStoreReader() : _file_index(0), _left(0), _title_len(0), _title_pos(0), _buffer_pos(0), _buffer_title(false)
+{
+    _order[0] = 0;
+    _order[1] = 1;
+    if (fs_begin())
+    {
+        LogStoreState state;
+        scan(state);
+        _order[0] = state.active ^ 1;
+        _order[1] = state.active;
+        _file = LittleFS.open(LOG_FILES[_order[0]], "r");
+    }
+    else
+    {
+        _file_index = 2;
+    }
+}
+
+bool LogStoreReader::nextRecord()
+{
+    while (_file_index < 2)
+    {
+        LogStoreHeader header;
+        if (_file && read_header(_file, header))
+        {
+            _left = header.length;
+            _title_len = record_title(_title, sizeof(_title), header);
+            _title_pos = 0;
+            return true;
+        }
+        if (_file)
+        {
+            _file.close();
+        }
+        if (++_file_index < 2)
+        {
+            _file = LittleFS.open(LOG_FILES[_order[_file_index]], "r");
+        }
+    }
+    return false;
+}
+
+size_t LogStoreReader::read(uint8_t *buf, size_t len)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        if (_title_pos < _title_len)
+        {
+            size_t n = _min(len - total, (size_t)(_title_len - _title_pos));
+            memcpy(buf + total, _title + _title_pos, n);
+            _title_pos += n;
+            total += n;
+        }
+        else if (_left)
+        {
+            size_t n = _file.read(buf + total, _min(len - total, (size_t)_left));
+            if (!n)
+            {
+                _left = 0; // файл оборвался
+                continue;
+            }
+            _left -= n;
+            total += n;
+        }
+        else if (nextRecord())
+        {
+            continue;
+        }
+        else if (!_buffer_title)
+        {
+            _title_len = snprintf_P(_title, sizeof(_title), PSTR("\r\n=== current ===\r\n"));
+            _title_pos = 0;
+            _buffer_title = true;
+        }
+        else
+        {
+            size_t n = log_buffer.read(_buffer_pos, buf + total, len - total);
+            if (!n)
+            {
+                break;
+            }
+            _buffer_pos += n;
+            total += n;
+        }
+    }
+    return total;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file log_store.h
+ * @brief Текстовый лог пробуждений с ошибками на LittleFS
+ * @version 0.1
+ * @date 2026-10-15
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Буфер лога (log_buffer.h) живет до сна, и без терминала лог неудачного
+ * пробуждения терялся. Теперь перед сном пробуждения с ошибкой буфер
+ * дописывается одной записью в кольцо из двух файлов: запись идет в конец
+ * текущего файла, а когда он заполнен - второй файл начинается заново.
+ * Построчной перезаписи нет, одна запись во flash за пробуждение с ошибкой.
+ *
+ * Запись: заголовок LogStoreHeader, затем length байт текста лога.
+ *
+ * Лог отдается порталом по /waterius_logs.txt частями (LogStoreReader),
+ * без сборки в памяти. С настройкой log_upload записи, еще не принятые
+ * сервером, уходят на http_url в gzip при следующем подключении к wifi.
+ */
+#ifndef LOG_STORE_H_
+#define LOG_STORE_H_
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "setup.h"
+#include "wake_log.h"
+
+#define LOG_STORE_FILE0 "/log0.bin"
+#define LOG_STORE_FILE1 "/log1.bin"
+#define LOG_STORE_UPLOADED_FILE "/log_up.bin" // номер последней принятой сервером записи
+#define LOG_STORE_FILE_SIZE 8192              // файл заполнен, начинаем второй
+#define LOG_UPLOAD_MAX_RECORDS 4              // записей в одной отправке, остальные - в следующий раз
+#define LOG_UPLOAD_TIMEOUT 5000UL             // ожидание ответа сервера, мс
+
+struct LogStoreHeader
+{
+    uint32_t seq;
+    uint32_t timestamp; // время пробуждения, 0 - неизвестно
+    uint16_t length;    // байт текста после заголовка
+    uint8_t exit;       // WakeExit
+    uint8_t errors;     // ошибок в логе (насыщение 255)
+    uint32_t crc;       // crc32 полей выше
+};
+
+/**
+ * @brief Сохраняет лог пробуждения, если оно закончилось неудачей
+ * или в логе есть ошибки. Вызывается перед сном.
+ *
+ * @param sett настройки
+ * @param wake_exit итог цикла
+ * @return true запись сохранена
+ */
+extern bool log_store_wake(const Settings &sett, WakeExit wake_exit);
+
+/**
+ * @brief Отправляет на http_url записи, которых сервер еще не принял:
+ * POST text/plain с Content-Encoding: gzip. Только при включенной
+ * настройке log_upload, по http или https.
+ *
+ * @param sett настройки
+ * @return true отправлять было нечего или сервер ответил 200
+ */
+extern bool log_store_upload(const Settings &sett);
+
+/**
+ * @brief Текст лога частями: сохраненные записи от старых к новым,
+ * затем буфер текущего запуска. Для ответа AsyncWebServer
+ * beginChunkedResponse: каждый read продолжает с того места, где
+ * закончил предыдущий.
+ */
+class LogStoreReader
+{
+    File _file;
+    uint8_t _order[2]; // файлы от старого к новому
+    uint8_t _file_index;
+    uint16_t _left;    // байт текста текущей записи
+    char _title[64];   // заголовок записи, еще не отданный целиком
+    uint8_t _title_len;
+    uint8_t _title_pos;
+    size_t _buffer_pos; // позиция в буфере текущего запуска
+    bool _buffer_title;
+
+    bool nextRecord();
+
+public:
+    LogStoreReader();
+
+    /**
+     * @brief Следующая часть текста
+     *
+     * @return количество байт, 0 - текст закончился
+     */
+    size_t read(uint8_t *buf, size_t len);
+};
+
+#endif
@@ -5,21 +5,26 @@
 #include "Logging.h"
 #include "config.h"
 #include "master_i2c.h"
-#include "senders/send_data.h"
-#include "ha/apply_settings.h"
+#include "json_arena.h"
 #include "portal/active_point.h"
 #include "voltage.h"
 #include "utils.h"
 #include "porting.h"
-#include "sync_time.h"
 #include "wifi_helpers.h"
 #include "config.h"
 #include "wleds.h"
-#include "ota_update.h"
 #include "flash_reset.h"
+#include "profiler.h"
+#include "wake_log.h"
+#include "log_store.h"
+#include "espnow_link.h"
+#include "wake_transmit.h"
 
 MasterI2C masterI2C;     // Для общения с Attiny85 по i2c
 AttinyData data;         // Данные от Attiny85 при включении
+AttinySnapshots snapshots; // История приростов показаний от Attiny85
+AttinyFlowStats flow_stats; // Статистика расхода по входам от Attiny85
+AttinyPulseLog pulse_log;   // Интервалы между последними импульсами от Attiny85
 AttinyData runtime_data; // Копия данных от Attiny85. Обновляются в webportal на странице детектирования и ввода значений счётчиков.
 Settings sett;           // Настройки соединения и предыдущие показания из EEPROM
 CalculatedData cdata;    // вычисляемые данные
@@ -42,6 +47,15 @@ void setup()
 
     masterI2C.begin(); // Включаем i2c master
 
+    // Блок для json берем первым, пока куча не раздроблена
+    if (!json_arena.begin())
+    {
+        LOG_ERROR(F("JSON: arena not allocated"));
+    }
+
+    // Радио с загрузки в forced sleep (enableWiFiAtBootTime не вызываем): i2c, настройки
+    // и расчет показаний идут без него, включает его только wifi_set_mode при подключении
+
     HeapSelectIram ephemeral;
     LOG_INFO(F("IRAM free: ") << ESP.getFreeHeap() << F(" bytes"));
     {
@@ -57,9 +71,22 @@ void loop()
 {
     uint8_t mode = TRANSMIT_MODE; // TRANSMIT_MODE;
     bool config_loaded = false;
+    WakeExit wake_exit = WAKE_EXIT_NO_ATTINY;
 
     // спрашиваем у Attiny85 повод пробуждения и данные true)
-    if (masterI2C.getMode(mode) && masterI2C.getAttinyData(data))
+    profiler_start(PHASE_I2C);
+    bool attiny_ready = masterI2C.getMode(mode) && masterI2C.getAttinyData(data);
+    profiler_stop(PHASE_I2C);
+
+#ifndef ESPNOW_DISABLED
+    // Шлюз ESP-NOW - плата с постоянным питанием без attiny
+    if (!attiny_ready && load_config(sett) && espnow_role(sett) == ESPNOW_ROLE_GATEWAY)
+    {
+        espnow_gateway_run(sett);
+    }
+#endif
+
+    if (attiny_ready)
     {
         runtime_data = data;
 
@@ -77,6 +104,11 @@ void loop()
         // Загружаем конфигурацию из EEPROM
         config_loaded = load_config(sett);
         sett.mode = mode;
+        if (mode == SETUP_MODE || mode == MANUAL_TRANSMIT_MODE)
+        {
+            // Разбудили кнопкой: рядом человек, возможно с терминалом
+            LOG_FLUSH();
+        }
         LOG_INFO(F("Startup mode: ") << mode);
 
         // Вычисляем текущие показания
@@ -90,6 +122,7 @@ void loop()
             start_active_point(sett, cdata);
 
             store_config(sett);
+            wake_log_store(sett, WAKE_EXIT_SETUP);
 
             wifi_shutdown();
 
@@ -107,77 +140,29 @@ void loop()
 
         if (config_loaded)
         {
-            if (wifi_connect(sett))
-            {
-                voltage.update();
-                log_system_info();
-
-                JsonDocument json_data;
-                JsonDocument json_settings_received;
-
-                // Подключаемся и подписываемся на мктт
-#ifndef MQTT_DISABLED
-                if (is_mqtt(sett))
-                {
-                    connect_and_subscribe_mqtt(sett, json_settings_received);
-                }
-#endif
-
-                // устанавливать время только при использовани хттпс или мктт
-                if (is_mqtt(sett) || is_https(sett.waterius_host) || is_https(sett.http_url))
-                {
-                    if (!sync_ntp_time(sett)) {
-                        sett.ntp_error_counter++;
-                    }
-                }
-
-                LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
-
-                send_data(sett, data, cdata, json_data, json_settings_received);
-
-                if (sett.ota_error != OTA_ERR_NONE)
-                {
-                    sett.ota_error = OTA_ERR_NONE;
-                    store_config(sett);
-                }
-
-                if (settings_received(json_settings_received))
-                {
-                    apply_settings(json_settings_received, sett, data, cdata);
-                    send_data(sett, data, cdata, json_data, json_settings_received);
-                }
-
-#if WATERIUS_MODEL == WATERIUS_MODEL_2
-                if (has_ota(json_settings_received))
-                {
-                    perform_ota_update(json_settings_received[F("ota")].as<JsonObject>(), masterI2C, sett, voltage);
-                }
-#endif
-
-                // Все уже отправили,  wifi не нужен - выключаем
-                wifi_shutdown();
-
-                update_config(sett, data, cdata);
-
-                if (!masterI2C.setWakeUpPeriod(sett.period_min_tuned))
-                {
-                    LOG_ERROR(F("Wakeup period wasn't set"));
-                }
-            }
-            store_config(sett);  // т.к. сохраняем число ошибок подключения
+            wake_exit = wake_transmit(mode, &json_arena);
         }
     }
 
     if (!config_loaded)
     {
         blynk_error(ErrorBlynks::ERROR_CONFIG);
+        if (attiny_ready)
+        {
+            wake_exit = WAKE_EXIT_NO_CONFIG;
+        }
     }
 
+    profiler_log();
+    wake_log_store(sett, wake_exit);
+    log_store_wake(sett, wake_exit);
+
     LOG_INFO(F("Going to sleep"));
     LOG_END();
 
     uint8_t vendor_id = ESP.getFlashChipVendorId();
 
+    voltage.stop_sampling();
     masterI2C.setSleep(); // через 20мс attiny отключит EN
 
     release_leds();
@@ -3,39 +3,41 @@
 #include <Wire.h>
 #include <Arduino.h>
 #include "setup.h"
+#include "crc.h"
 
-// https://github.com/lammertb/libcrc/blob/600316a01924fd5bb9d47d535db5b8f3987db178/src/crc8.c
-
-// https://gist.github.com/brimston3/83cdeda8f7d2cf55717b83f0d32f9b5e
-// https://www.onlinegdb.com/online_c++_compiler
-// Dallas CRC x8+x5+x4+1
-uint8_t crc_8(unsigned char *b, size_t num_bytes, uint8_t crc)
+// Dallas CRC x8+x5+x4+1, байтовая таблица во flash (common/crc.h)
+uint8_t crc_8(const unsigned char *b, size_t num_bytes, uint8_t crc)
 {
-    while (num_bytes--)
-    {
-        uint8_t inbyte = *b++;
-        for (uint8_t i = 8; i; i--)
-        {
-            uint8_t mix = (crc ^ inbyte) & 0x01;
-            crc >>= 1;
-            if (mix)
-                crc ^= 0x8C;
-            inbyte >>= 1;
-        }
-    }
-    return crc;
+    return crc8<Crc8Table<> >(b, num_bytes, crc);
 }
 
-MasterI2C::MasterI2C(): i2c_busy(false)
+MasterI2C::MasterI2C(): i2c_busy(false), bulk_read(true)
 {}
 
 void MasterI2C::begin()
 {
     Wire.begin(SDA_PIN, SCL_PIN);
-    Wire.setClock(100000L);
+    Wire.setClock(I2C_CLOCK);
     Wire.setClockStretchLimit(2500L); // Иначе связь с Attiny не надежная будут FF FF в хвосте посылки
 }
 
+/**
+ * @brief Сравнение контрольной суммы с учетом ошибки в статистике обмена
+ *
+ * @param calculated посчитанная по принятым данным
+ * @param received принятая от attiny
+ * @return true суммы совпали
+ */
+bool MasterI2C::crcMatch(uint8_t calculated, uint8_t received)
+{
+    if (calculated == received)
+    {
+        return true;
+    }
+    link_stats.crc_errors++;
+    return false;
+}
+
 bool MasterI2C::sendCmd(uint8_t cmd)
 {
     return sendData(&cmd, 1);
@@ -44,11 +46,13 @@ bool MasterI2C::sendCmd(uint8_t cmd)
 bool MasterI2C::sendData(uint8_t *buf, size_t size)
 {
     uint8_t i;
+    link_stats.transactions++;
     Wire.beginTransmission(I2C_SLAVE_ADDR);
     for (i = 0; i < size; i++)
     {
         if (Wire.write(buf[i]) != 1)
         {
+            link_stats.bus_errors++;
             LOG_ERROR(F("I2C transmitting fail."));
             return false;
         }
@@ -56,9 +60,11 @@ bool MasterI2C::sendData(uint8_t *buf, size_t size)
     int err = Wire.endTransmission(true);
     if (err != 0)
     {
+        link_stats.bus_errors++;
         LOG_ERROR(F("end error:") << err);
         return false;
     }
+    link_stats.bytes += size;
 
     return true;
 }
@@ -73,16 +79,31 @@ bool MasterI2C::sendData(uint8_t *buf, size_t size)
  */
 bool MasterI2C::getByte(uint8_t &value, uint8_t &crc)
 {
+    link_stats.transactions++;
     if (Wire.requestFrom(I2C_SLAVE_ADDR, 1) != 1)
     {
+        link_stats.bus_errors++;
         LOG_ERROR(F("RequestFrom failed"));
         return false;
     }
+    link_stats.bytes++;
     value = Wire.read();
     crc = crc_8(&value, 1, crc);
     return true;
 }
 
+bool MasterI2C::getBytes(uint8_t *value, uint8_t count, uint8_t &crc)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!getByte(value[i], crc))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool MasterI2C::getUint16(uint16_t &value, uint8_t &crc)
 {
 
@@ -120,6 +141,10 @@ bool MasterI2C::getUint(uint32_t &value, uint8_t &crc)
 bool MasterI2C::getMode(uint8_t &mode)
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
 
     uint8_t crc = INIT_ATTINY_CRC;
 
@@ -134,62 +159,142 @@ bool MasterI2C::getMode(uint8_t &mode)
 }
 
 /**
- * @brief Чтение данных с прибора.
- * 
- * Данные читаются в буффер, до контрольной суммы включительно. 
- * При успешном чтении расчитанная контрольная сумма должна быть равно 0, 
- * в противном случае во время чтения произошла ошибка.
- * 
- * @param data Структура для заполнения данными
- * @return true прочитанно успешно.
- * @return false произошла ошибка
+ * @brief Чтение блока данных одной транзакцией i2c
+ *
+ * @param value приемник
+ * @param count количество байт
+ * @return true прочитано успешно
  */
-bool MasterI2C::getAttinyData(AttinyData &data)
+bool MasterI2C::getBulk(uint8_t *value, uint8_t count)
+{
+    link_stats.transactions++;
+    if (Wire.requestFrom((uint8_t)I2C_SLAVE_ADDR, (size_t)count) != count)
+    {
+        link_stats.bus_errors++;
+        LOG_ERROR(F("RequestFrom failed"));
+        return false;
+    }
+    link_stats.bytes += count;
+    return Wire.readBytes(value, count) == count;
+}
+
+/**
+ * @brief Чтение заголовка с данными прибора: одной транзакцией (attiny >= ATTINY_BULK_MIN_VERSION)
+ * или побайтно для старых прошивок.
+ *
+ * @param buf буфер ATTINY_HEADER_SIZE байт, последний - контрольная сумма
+ * @return true данные прочитаны, контрольная сумма верна
+ */
+bool MasterI2C::getHeader(uint8_t *buf)
 {
-    BusyGuard guard(i2c_busy);
     uint8_t crc = INIT_ATTINY_CRC;
 
+    // Версия неизвестна до первого чтения, пробуем сразу блоком.
+    // Старая прошивка не знает команду и вернет 0xAA, не сойдется контрольная сумма.
+    if (bulk_read)
+    {
+        if (sendCmd('D') && getBulk(buf, ATTINY_HEADER_SIZE) && buf[0] >= ATTINY_BULK_MIN_VERSION &&
+            crcMatch(crc_8(buf, ATTINY_HEADER_SIZE - 1, INIT_ATTINY_CRC), buf[ATTINY_HEADER_SIZE - 1]))
+        {
+            return true;
+        }
+        LOG_INFO(F("I2C: Bulk read failed, read by bytes"));
+        link_stats.bulk_fallbacks++;
+        bulk_read = false;
+    }
+
     if (!sendCmd('B'))
     {
         LOG_ERROR(F("Send CMD failed"));
         return false;
     }
+    if (!getBytes(buf, ATTINY_HEADER_SIZE, crc))
+    {
+        return false;
+    }
 
-    uint8_t dummy = INIT_ATTINY_CRC;
-    bool good = getByte(data.version, crc);
-
-    LOG_INFO(F("attiny firmware ver: ") << data.version);
-
-    if (data.version < 29)
+    if (buf[0] < 29)
     {
         init_crc = 0; // в версиях <29 инициализация идет нулём
-        crc = 0;
-        crc = crc_8(&data.version, 1, crc);
     }
+    if (!crcMatch(crc_8(buf, ATTINY_HEADER_SIZE - 1, buf[0] < 29 ? 0 : INIT_ATTINY_CRC), buf[ATTINY_HEADER_SIZE - 1]))
+    {
+        LOG_ERROR(F("!!! CRC wrong !!!!, go to sleep"));
+        return false;
+    }
+    bulk_read = buf[0] >= ATTINY_BULK_MIN_VERSION;
+    return true;
+}
 
-    good &= getByte(data.service, crc);
-    data.on_pulse0 = (data.service >> 6) & 1;
-    data.on_pulse1 = (data.service >> 7) & 1;
-
-    good &= getUint16(data.voltage, crc);
-    good &= getByte(data.reserved, crc);
-    good &= getByte(data.setup_started_counter, crc);
-
-    good &= getByte(data.resets, crc);
-    good &= getByte(data.model, crc);
-    good &= getByte(data.counter_type0, crc);
-    good &= getByte(data.counter_type1, crc);
+// Поля заголовка, до контрольной суммы включительно
+static void copy_header(const AttinyData &from, AttinyData &to)
+{
+    memcpy(&to, &from, offsetof(AttinyData, reserved2));
+}
 
-    good &= getUint(data.impulses0, crc);
-    good &= getUint(data.impulses1, crc);
+/**
+ * @brief Чтение данных с прибора.
+ * 
+ * Заголовок читается в буффер, до контрольной суммы включительно,
+ * затем раскладывается по полям. Прочитанное запоминается в кэше.
+ * 
+ * @param data Структура для заполнения данными
+ * @return true прочитанно успешно.
+ * @return false произошла ошибка
+ */
+bool MasterI2C::getAttinyData(AttinyData &data)
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        LOG_ERROR(F("I2C: busy"));
+        return false;
+    }
+    return readData(data);
+}
 
-    good &= getUint16(data.adc0, crc);
-    good &= getUint16(data.adc1, crc);
+/**
+ * @brief Данные из кэша, если они прочитаны не раньше max_age_ms назад,
+ * иначе чтение с прибора. Для тех, кому не важен каждый импульс:
+ * портал, повторные запросы страниц.
+ *
+ * @param data Структура для заполнения данными (меняется только заголовок)
+ * @param max_age_ms допустимый возраст кэша
+ * @return true данные есть
+ */
+bool MasterI2C::getCachedData(AttinyData &data, uint32_t max_age_ms)
+{
+    if (cache_valid && millis() - cache_ms <= max_age_ms)
+    {
+        copy_header(cache, data);
+        return true;
+    }
+    return getAttinyData(data);
+}
 
-    good &= getByte(data.crc, dummy);
+bool MasterI2C::readData(AttinyData &data)
+{
+    uint8_t buf[ATTINY_HEADER_SIZE];
 
-    if (good)
+    if (getHeader(buf))
     {
+        data.version = buf[0];
+        data.service = buf[1];
+        data.on_pulse0 = (data.service >> 6) & 1;
+        data.on_pulse1 = (data.service >> 7) & 1;
+        memcpy(&data.voltage, &buf[2], sizeof(data.voltage));
+        data.reserved = buf[4];
+        data.setup_started_counter = buf[5];
+        data.resets = buf[6];
+        data.model = buf[7];
+        data.counter_type0 = buf[8];
+        data.counter_type1 = buf[9];
+        memcpy(&data.impulses0, &buf[10], sizeof(data.impulses0));
+        memcpy(&data.impulses1, &buf[14], sizeof(data.impulses1));
+        memcpy(&data.adc0, &buf[18], sizeof(data.adc0));
+        memcpy(&data.adc1, &buf[20], sizeof(data.adc1));
+        data.crc = buf[22];
+
         LOG_INFO(F("v") << data.version
         << F(" service:") << (data.service & 0x3F)
         << F(" on_pulse0:") << data.on_pulse0
@@ -208,25 +313,184 @@ bool MasterI2C::getAttinyData(AttinyData &data)
         << F(" imp1:") << data.impulses1 
         << F(" adc1:") << data.adc1);
 
-        if (data.crc != crc)
+        if (data.version >= ATTINY_CAPS_MIN_VERSION && !proto_version)
         {
-            LOG_ERROR(F("!!! CRC wrong !!!!, go to sleep"));
+            getCapabilities();
         }
-        else
-        {
-            if (data.version >= 30)
-                return true;
 
-            LOG_ERROR(F("ATTINY: unsupported firmware ver.") << data.version);
+        if (data.version >= 30)
+        {
+            copy_header(data, cache);
+            cache_ms = millis();
+            cache_valid = true;
+            return true;
         }
+
+        LOG_ERROR(F("ATTINY: unsupported firmware ver.") << data.version);
     }
     LOG_ERROR(F("Data failed"));
     return false;
 }
 
+/**
+ * @brief Запрос версии протокола и возможностей прошивки Attiny
+ *
+ * @return true ответ получен
+ */
+bool MasterI2C::getCapabilities()
+{
+    uint8_t buf[4];
+    if (!sendCmd('I') || !getBulk(buf, sizeof(buf)) || !crcMatch(crc_8(buf, 3, INIT_ATTINY_CRC), buf[3]))
+    {
+        LOG_ERROR(F("I2C: Capabilities read failed"));
+        return false;
+    }
+    proto_version = buf[0];
+    caps = buf[1];
+    LOG_INFO(F("I2C: protocol v") << proto_version << F(" caps:") << caps << F(" buffer:") << buf[2]);
+    return true;
+}
+
+void MasterI2C::parseField(uint8_t tag, const uint8_t *value, uint8_t size, AttinyData &data)
+{
+    switch (tag)
+    {
+    case ATTINY_TAG_SERVICE:
+        if (size == 1)
+        {
+            data.service = value[0];
+            data.on_pulse0 = (data.service >> 6) & 1;
+            data.on_pulse1 = (data.service >> 7) & 1;
+        }
+        break;
+    case ATTINY_TAG_VOLTAGE:
+        if (size == sizeof(data.voltage))
+        {
+            memcpy(&data.voltage, value, size);
+        }
+        break;
+    case ATTINY_TAG_CONFIG:
+        if (size == 5)
+        {
+            data.setup_started_counter = value[0];
+            data.resets = value[1];
+            data.model = value[2];
+            data.counter_type0 = value[3];
+            data.counter_type1 = value[4];
+        }
+        break;
+    case ATTINY_TAG_COUNTERS:
+        if (size == 8)
+        {
+            memcpy(&data.impulses0, value, 4);
+            memcpy(&data.impulses1, value + 4, 4);
+        }
+        break;
+    case ATTINY_TAG_ADC:
+        if (size == 4)
+        {
+            memcpy(&data.adc0, value, 2);
+            memcpy(&data.adc1, value + 2, 2);
+        }
+        break;
+    case ATTINY_TAG_WDT_RATES:
+        if (size == sizeof(data.wdt_minutes))
+        {
+            memcpy(data.wdt_minutes, value, size);
+        }
+        break;
+    case ATTINY_TAG_STORAGE:
+        if (size == 8)
+        {
+            memcpy(&data.eeprom_writes, value, 4);
+            memcpy(&data.eeprom_left, value + 4, 4);
+        }
+        break;
+    case ATTINY_TAG_FLOW_ALARM:
+        if (size == 1)
+        {
+            data.flow_alarm = value[0];
+        }
+        break;
+    case ATTINY_TAG_EEPROM_SKIPPED:
+        if (size == sizeof(data.eeprom_skipped))
+        {
+            memcpy(&data.eeprom_skipped, value, size);
+        }
+        break;
+    default:
+        // поле новой версии прошивки, этой версии ESP не нужно
+        break;
+    }
+}
+
+/**
+ * @brief Чтение только нужных полей данных (ATTINY_CAP_FIELDS).
+ * Остальные поля data не меняются.
+ *
+ * @param tags теги ATTINY_TAG_*
+ * @param count количество тегов
+ * @param data структура для заполнения
+ * @return true прочитано успешно
+ */
+bool MasterI2C::getFields(const uint8_t *tags, uint8_t count, AttinyData &data)
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    return readFields(tags, count, data);
+}
+
+bool MasterI2C::readFields(const uint8_t *tags, uint8_t count, AttinyData &data)
+{
+    uint8_t txBuf[8];
+    uint8_t buf[ATTINY_FIELDS_SIZE];
+
+    if (!hasCapability(ATTINY_CAP_FIELDS) || count + 1 > sizeof(txBuf))
+    {
+        return false;
+    }
+    txBuf[0] = 'R';
+    memcpy(&txBuf[1], tags, count);
+
+    if (!sendData(txBuf, count + 1) || !getBulk(buf, sizeof(buf)))
+    {
+        return false;
+    }
+    uint8_t len = buf[0];
+    if (len + 2 > sizeof(buf) || !crcMatch(crc_8(buf, len + 1, INIT_ATTINY_CRC), buf[len + 1]))
+    {
+        LOG_ERROR(F("I2C: Fields CRC wrong"));
+        return false;
+    }
+
+    for (uint8_t pos = 1; pos + 2 <= len + 1;)
+    {
+        uint8_t tag = buf[pos];
+        uint8_t size = buf[pos + 1];
+        if (pos + 2 + size > len + 1)
+        {
+            break;
+        }
+        parseField(tag, &buf[pos + 2], size, data);
+        if (cache_valid)
+        {
+            parseField(tag, &buf[pos + 2], size, cache);
+        }
+        pos += size + 2;
+    }
+    return true;
+}
+
 bool MasterI2C::setWakeUpPeriod(uint16_t period)
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     uint8_t txBuf[4];
 
     txBuf[0] = 'S';
@@ -244,6 +508,10 @@ bool MasterI2C::setWakeUpPeriod(uint16_t period)
 bool MasterI2C::setCountersType(const uint8_t type0, const uint8_t type1)
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     uint8_t txBuf[4];
 
     txBuf[0] = 'C';
@@ -261,29 +529,239 @@ bool MasterI2C::setCountersType(const uint8_t type0, const uint8_t type1)
 bool MasterI2C::extendWakeUp()
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     return sendCmd('E');
 }
 
-bool MasterI2C::updateVoltage()
+/**
+ * @brief Новое измерение напряжения attiny и его чтение под одним захватом шины:
+ * новые прошивки отдают одно поле, старые - весь заголовок.
+ *
+ * @param data структура для заполнения
+ * @return true прочитано успешно
+ */
+bool MasterI2C::readVoltage(AttinyData &data)
 {
     BusyGuard guard(i2c_busy);
-    return sendCmd('V');
+    if (!guard)
+    {
+        return false;
+    }
+    if (!sendCmd('V'))
+    {
+        return false;
+    }
+    // Без yield: хэндлеры портала не вклиниваются между командой и чтением
+    delayMicroseconds(ATTINY_VOLTAGE_MEASURE_US);
+
+    static const uint8_t tags[] = {ATTINY_TAG_VOLTAGE};
+    return hasCapability(ATTINY_CAP_FIELDS) ? readFields(tags, sizeof(tags), data) : readData(data);
 }
 
 bool MasterI2C::setTransmitMode()
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     return sendCmd('T');
 }
 
 bool MasterI2C::setSetupMode()
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     return sendCmd('P');
 }
 
 bool MasterI2C::setSleep()
 {
     BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
     return sendCmd('Z');
 }
+
+bool MasterI2C::getSnapshotsPage(uint8_t page, uint8_t *buf)
+{
+    // 'G' - та же страница одной транзакцией
+    bool bulk = hasCapability(ATTINY_CAP_BULK);
+    uint8_t txBuf[2] = {(uint8_t)(bulk ? 'G' : 'H'), page};
+    uint8_t crc = INIT_ATTINY_CRC;
+    uint8_t dummy = INIT_ATTINY_CRC;
+    uint8_t page_crc = 0;
+
+    if (!sendData(txBuf, 2))
+    {
+        return false;
+    }
+    if (bulk)
+    {
+        uint8_t reply[ATTINY_SNAPSHOT_PAGE_SIZE + 1];
+        if (!getBulk(reply, sizeof(reply)))
+        {
+            return false;
+        }
+        memcpy(buf, reply, ATTINY_SNAPSHOT_PAGE_SIZE);
+        crc = crc_8(reply, ATTINY_SNAPSHOT_PAGE_SIZE, INIT_ATTINY_CRC);
+        page_crc = reply[ATTINY_SNAPSHOT_PAGE_SIZE];
+    }
+    else if (!getBytes(buf, ATTINY_SNAPSHOT_PAGE_SIZE, crc) || !getByte(page_crc, dummy))
+    {
+        return false;
+    }
+    if (!crcMatch(crc, page_crc))
+    {
+        LOG_ERROR(F("Snapshots page ") << page << F(" CRC wrong"));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Чтение истории снимков показаний постранично.
+ * 
+ * @param snapshots структура для заполнения
+ * @return true прочитано успешно
+ */
+bool MasterI2C::getSnapshots(AttinySnapshots &snapshots)
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    uint8_t buf[ATTINY_SNAPSHOT_PAGE_SIZE];
+
+    snapshots.count = 0;
+    if (!getSnapshotsPage(0, buf))
+    {
+        return false;
+    }
+
+    uint8_t count = _min(buf[0], ATTINY_SNAPSHOT_COUNT);
+    snapshots.period_min = buf[1];
+    memcpy(&snapshots.age_min, &buf[2], sizeof(snapshots.age_min));
+    memcpy(&snapshots.base0, &buf[4], sizeof(snapshots.base0));
+    memcpy(&snapshots.base1, &buf[8], sizeof(snapshots.base1));
+
+    for (uint8_t first = 0; first < count; first += ATTINY_SNAPSHOT_PAGE_COUNT)
+    {
+        if (!getSnapshotsPage(first / ATTINY_SNAPSHOT_PAGE_COUNT + 1, buf))
+        {
+            return false;
+        }
+        for (uint8_t i = 0; (i < ATTINY_SNAPSHOT_PAGE_COUNT) && (first + i < count); i++)
+        {
+            memcpy(&snapshots.delta0[first + i], &buf[i * 4], sizeof(uint16_t));
+            memcpy(&snapshots.delta1[first + i], &buf[i * 4 + 2], sizeof(uint16_t));
+        }
+    }
+    snapshots.count = count;
+
+    LOG_INFO(F("Snapshots: ") << count << F(" period:") << snapshots.period_min << F(" age:") << snapshots.age_min);
+    return true;
+}
+
+bool MasterI2C::clearSnapshots()
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    return sendCmd('h');
+}
+
+/**
+ * @brief Чтение статистики расхода по входам одной транзакцией
+ *
+ * @param stats структура для заполнения
+ * @return true прочитано успешно
+ */
+bool MasterI2C::getFlowStats(AttinyFlowStats &stats)
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    uint8_t buf[2 * ATTINY_FLOW_CHANNEL_SIZE + 1];
+
+    stats.valid = false;
+    if (!sendCmd('F') || !getBulk(buf, sizeof(buf)) ||
+        !crcMatch(crc_8(buf, 2 * ATTINY_FLOW_CHANNEL_SIZE, INIT_ATTINY_CRC), buf[2 * ATTINY_FLOW_CHANNEL_SIZE]))
+    {
+        LOG_ERROR(F("I2C: Flow stats read failed"));
+        return false;
+    }
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        const uint8_t *value = buf + i * ATTINY_FLOW_CHANNEL_SIZE;
+        AttinyFlowChannel &channel = stats.channel[i];
+        channel.max_ppm = value[0];
+        channel.events = value[1];
+        memcpy(&channel.longest_min, value + 2, 2);
+        memcpy(&channel.zero_min, value + 4, 2);
+    }
+    stats.valid = true;
+    return true;
+}
+
+bool MasterI2C::clearFlowStats()
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    return sendCmd('f');
+}
+
+// Байт интервала attiny: 3 бита порядка, 5 бит мантиссы
+static uint16_t pulse_log_decode(uint8_t value)
+{
+    uint8_t order = value >> 5;
+    uint8_t mantissa = value & 0x1F;
+    return order ? (32 + mantissa) << (order - 1) : mantissa;
+}
+
+bool MasterI2C::getPulseLog(AttinyPulseLog &log)
+{
+    BusyGuard guard(i2c_busy);
+    if (!guard)
+    {
+        return false;
+    }
+    uint8_t buf[2 * ATTINY_PULSE_LOG_CHANNEL_SIZE + 1];
+
+    log.valid = false;
+    if (!sendCmd('L') || !getBulk(buf, sizeof(buf)) ||
+        !crcMatch(crc_8(buf, 2 * ATTINY_PULSE_LOG_CHANNEL_SIZE, INIT_ATTINY_CRC), buf[2 * ATTINY_PULSE_LOG_CHANNEL_SIZE]))
+    {
+        LOG_ERROR(F("I2C: Pulse log read failed"));
+        return false;
+    }
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        const uint8_t *value = buf + i * ATTINY_PULSE_LOG_CHANNEL_SIZE;
+        AttinyPulseChannel &channel = log.channel[i];
+        channel.count = _min(value[0], (uint8_t)ATTINY_PULSE_LOG_SIZE);
+        channel.age = pulse_log_decode(value[1]);
+        for (uint8_t j = 0; j < ATTINY_PULSE_LOG_SIZE; j++)
+        {
+            channel.interval[j] = pulse_log_decode(value[2 + j]);
+        }
+    }
+    log.valid = true;
+    return true;
+}
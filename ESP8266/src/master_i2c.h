@@ -19,30 +19,34 @@
 
 #define INIT_ATTINY_CRC 0xFF
 
-// Класс для синхронизации запросов к i2c, которые могут быть из разных потоков в AsyncWebServer
-// В ESP отсутствуют мьютексы, поэтому будем считать, что это проще сдела
+// Захват шины i2c. Запросы бывают и из хэндлеров AsyncWebServer (контекст SYS),
+// а там ждать с yield() нельзя. Сам обмен с attiny не уступает процессор,
+// поэтому занятая шина - ошибка вызова, а не повод крутиться в цикле.
+// Повторные чтения данных идут из кэша MasterI2C::getCachedData.
 class BusyGuard {
     volatile bool& busy;
+    bool owner;
 public:
-    BusyGuard(volatile bool& flag) : busy(flag) {
-        while (true) {
-            noInterrupts();
-            if (!busy) {
-                busy = true;
-                interrupts();
-                break;
-            }
-            interrupts();
-            yield();
+    BusyGuard(volatile bool& flag) : busy(flag), owner(false) {
+        noInterrupts();
+        if (!busy) {
+            busy = true;
+            owner = true;
         }
+        interrupts();
     }
     ~BusyGuard() {
-        busy = false;
+        if (owner) {
+            busy = false;
+        }
     }
+    explicit operator bool() const { return owner; }
     BusyGuard(const BusyGuard&) = delete;
     BusyGuard& operator=(const BusyGuard&) = delete;
 };
 
+#define ATTINY_WDT_RATES 4
+
 /*
 Данные принимаемые от Attiny
 */
@@ -71,20 +75,148 @@ struct AttinyData
     uint8_t crc = 0; // Всегда в конце структуры данных
     uint8_t reserved2 = 0;
     // Кратно 16bit https://github.com/esp8266/Arduino/issues/1825
+
+    // Не из заголовка, читаются по тегам
+    uint16_t wdt_minutes[ATTINY_WDT_RATES] = {0}; // Минут сна на периодах watchdog 250мс, 500мс, 1с, 2с
+    uint32_t eeprom_writes = 0; // Записей показаний в EEPROM
+    uint32_t eeprom_left = 0;   // Оценка оставшихся записей до износа EEPROM
+    uint8_t flow_alarm = 0;     // Тревоги детектора расхода
+    uint32_t eeprom_skipped = 0; // Байт, которые attiny не перезаписала: значение совпало
+};
+
+#define ATTINY_SNAPSHOT_COUNT 24
+#define ATTINY_SNAPSHOT_PAGE_COUNT 5
+#define ATTINY_SNAPSHOT_PAGE_SIZE 20
+#define ATTINY_SNAPSHOT_MIN_VERSION 38
+#define ATTINY_BULK_MIN_VERSION 39
+#define ATTINY_HEADER_SIZE 23 // HEADER_DATA_SIZE + crc
+#define ATTINY_CAPS_MIN_VERSION 40
+#define ATTINY_VOLTAGE_MEASURE_US 5000 // attiny измеряет напряжение после команды 'V'
+
+/*
+Возможности прошивки Attiny (команда 'I')
+*/
+#define ATTINY_CAP_BULK 0x01      // заголовок одной транзакцией
+#define ATTINY_CAP_SNAPSHOTS 0x02 // история снимков
+#define ATTINY_CAP_FIELDS 0x04    // чтение отдельных полей по тегам
+#define ATTINY_CAP_WDT_RATES 0x08 // статистика периодов watchdog
+#define ATTINY_CAP_STORAGE 0x10   // износ EEPROM
+#define ATTINY_CAP_FLOW_ALARM 0x20 // детектор протечки и прорыва
+#define ATTINY_CAP_FLOW_STATS 0x40 // статистика расхода по входам ('F', 'f')
+#define ATTINY_CAP_PULSE_LOG 0x80  // интервалы между последними импульсами ('L')
+
+/*
+Теги полей для чтения по команде 'R'
+*/
+#define ATTINY_TAG_SERVICE 1  // uint8_t
+#define ATTINY_TAG_VOLTAGE 2  // uint16_t, мВ
+#define ATTINY_TAG_CONFIG 3   // setup_started_counter, resets, model, counter_type0, counter_type1
+#define ATTINY_TAG_COUNTERS 4 // impulses0, impulses1
+#define ATTINY_TAG_ADC 5      // adc0, adc1
+#define ATTINY_TAG_WDT_RATES 6 // uint16_t[ATTINY_WDT_RATES], минут
+#define ATTINY_TAG_STORAGE 7   // uint32_t записей показаний, uint32_t оставшийся ресурс
+#define ATTINY_TAG_FLOW_ALARM 8 // uint8_t тревоги, биты ATTINY_ALARM_* канала 0, канала 1 - со сдвигом 2
+#define ATTINY_TAG_EEPROM_SKIPPED 9 // uint32_t байт, не записанных в EEPROM с включения attiny
+
+#define ATTINY_ALARM_LEAK 0x01  // расход без перерыва несколько часов
+#define ATTINY_ALARM_BURST 0x02 // большой расход несколько минут подряд
+#define ATTINY_FIELDS_SIZE 24 // ответ на 'R': длина, [тег, размер, значение]..., crc
+
+/*
+История приростов показаний от Attiny (интервальные данные)
+*/
+struct AttinySnapshots
+{
+    uint8_t count = 0;      // Количество снимков
+    uint8_t period_min = 0; // Период снимков, мин
+    uint16_t age_min = 0;   // Сколько минут прошло после последнего снимка
+    uint32_t base0 = 0;     // Показания на момент последнего снимка, канал 0
+    uint32_t base1 = 0;     //                                      канал 1
+    uint16_t delta0[ATTINY_SNAPSHOT_COUNT] = {0}; // Прирост за период, от старых к новым
+    uint16_t delta1[ATTINY_SNAPSHOT_COUNT] = {0};
+};
+
+/*
+Статистика расхода по входу за период между передачами
+*/
+struct AttinyFlowChannel
+{
+    uint8_t max_ppm = 0;      // Максимум импульсов в минуту
+    uint8_t events = 0;       // Количество использований (расход после 2 мин без импульсов)
+    uint16_t longest_min = 0; // Самый долгий непрерывный расход, мин
+    uint16_t zero_min = 0;    // Минут без расхода
+};
+
+#define ATTINY_FLOW_CHANNEL_SIZE 6
+
+struct AttinyFlowStats
+{
+    bool valid = false;
+    AttinyFlowChannel channel[2];
+};
+
+/*
+Интервалы между последними импульсами входа. attiny передает их сжатыми
+в байт (3 бита порядка, 5 бит мантиссы), здесь они уже в тактах
+ATTINY_PULSE_TICK_MS. ATTINY_PULSE_LOG_MAX - дольше, чем помещается в байт.
+*/
+#define ATTINY_PULSE_LOG_SIZE 8
+#define ATTINY_PULSE_LOG_CHANNEL_SIZE (2 + ATTINY_PULSE_LOG_SIZE) // количество, возраст, интервалы
+#define ATTINY_PULSE_LOG_MAX 4032
+#define ATTINY_PULSE_TICK_MS 250
+
+struct AttinyPulseChannel
+{
+    uint8_t count = 0;     // интервалов
+    uint16_t age = 0;      // тактов после последнего импульса
+    uint16_t interval[ATTINY_PULSE_LOG_SIZE] = {0}; // от старых к новым
+};
+
+struct AttinyPulseLog
+{
+    bool valid = false;
+    AttinyPulseChannel channel[2];
 };
 
 uint8_t crc_8(const unsigned char *input_str, size_t num_bytes, uint8_t crc = 0);
 
+/*
+Счетчики обмена с Attiny: для стенда Utils/tests/loadtest_attiny
+*/
+struct MasterI2CStats
+{
+    uint32_t transactions = 0;   // Транзакций i2c (запись команды или чтение)
+    uint32_t bytes = 0;          // Передано и принято байт
+    uint16_t bus_errors = 0;     // Нет ответа, NACK, короткое чтение
+    uint16_t crc_errors = 0;     // Ответ пришел, контрольная сумма не сошлась
+    uint16_t bulk_fallbacks = 0; // Переходов с чтения блоком на побайтное
+};
+
 class MasterI2C
 {
     uint8_t init_crc = 0xFF;
     volatile bool i2c_busy;
+    bool bulk_read; // attiny отдает заголовок одной транзакцией
+    uint8_t proto_version = 0; // версия протокола i2c, 0 - не поддерживается
+    uint8_t caps = 0;
+    AttinyData cache;        // заголовок последнего чтения
+    uint32_t cache_ms = 0;   // millis() чтения
+    bool cache_valid = false;
+    MasterI2CStats link_stats;
 
 protected:
+    bool crcMatch(uint8_t calculated, uint8_t received);
     bool getUint(uint32_t &value, uint8_t &crc);
     bool getUint16(uint16_t &value, uint8_t &crc);
     bool getByte(uint8_t &value, uint8_t &crc);
     bool sendData(uint8_t *buf, size_t size);
+    bool getSnapshotsPage(uint8_t page, uint8_t *buf);
+    bool getBulk(uint8_t *value, uint8_t count);
+    bool getHeader(uint8_t *buf);
+    bool getCapabilities();
+    void parseField(uint8_t tag, const uint8_t *value, uint8_t size, AttinyData &data);
+    bool readData(AttinyData &data);
+    bool readFields(const uint8_t *tags, uint8_t count, AttinyData &data);
 
     bool getByte(uint8_t *value, uint8_t &crc);
     bool getBytes(uint8_t *value, uint8_t count, uint8_t &crc);
@@ -96,13 +228,23 @@ public:
     bool sendCmd(uint8_t cmd);
     bool getMode(uint8_t &mode);
     bool getAttinyData(AttinyData &data);
+    bool getCachedData(AttinyData &data, uint32_t max_age_ms);
+    bool getFields(const uint8_t *tags, uint8_t count, AttinyData &data);
+    bool hasCapability(uint8_t cap) const { return caps & cap; }
     bool setWakeUpPeriod(uint16_t per);
     bool setCountersType(const uint8_t type0, const uint8_t type1);
     bool setTransmitMode();
     bool setSetupMode();
     bool setSleep();
     bool extendWakeUp();
-    bool updateVoltage();
+    bool readVoltage(AttinyData &data);
+    bool getSnapshots(AttinySnapshots &snapshots);
+    bool clearSnapshots();
+    bool getFlowStats(AttinyFlowStats &stats);
+    bool clearFlowStats();
+    bool getPulseLog(AttinyPulseLog &log);
+    const MasterI2CStats &stats() const { return link_stats; }
+    void resetStats() { link_stats = MasterI2CStats(); }
 };
 
 #endif
\ No newline at end of file
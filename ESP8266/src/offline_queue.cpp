@@ -0,0 +1,174 @@
+#include "offline_queue.h"
+#include <LittleFS.h>
+#include <memory>
+#include "fs_mount.h"
+#include "Logging.h"
+#include "sync_time.h"
+#include "utils.h"
+
+// Время последней точки в файле, 0 - файла нет
+static uint32_t queue_last_timestamp(const Settings &sett)
+{
+    QueuedReading point;
+    point.timestamp = 0;
+    if (sett.offline_queue_file)
+    {
+        File file = LittleFS.open(OFFLINE_QUEUE_FILE, "r");
+        if (file)
+        {
+            if (file.size() >= sizeof(point) &&
+                file.seek(file.size() / sizeof(point) * sizeof(point) - sizeof(point)) &&
+                file.read((uint8_t *)&point, sizeof(point)) != sizeof(point))
+            {
+                point.timestamp = 0;
+            }
+            file.close();
+        }
+    }
+    return point.timestamp;
+}
+
+// Дописывает точку в файл, в полном файле сдвигает кольцо на одну точку
+static bool queue_append_file(Settings &sett, const QueuedReading &point)
+{
+    size_t count = 0;
+    File file = LittleFS.open(OFFLINE_QUEUE_FILE, "r");
+    if (file)
+    {
+        count = file.size() / sizeof(QueuedReading);
+        file.close();
+    }
+
+    bool result = false;
+    if (count < OFFLINE_QUEUE_FILE_SIZE)
+    {
+        file = LittleFS.open(OFFLINE_QUEUE_FILE, "a");
+        if (file)
+        {
+            result = file.write((const uint8_t *)&point, sizeof(point)) == sizeof(point);
+            file.close();
+        }
+    }
+    else
+    {
+        // Свежие показания важнее: выбрасываем самые старые
+        std::unique_ptr<QueuedReading[]> points(new QueuedReading[OFFLINE_QUEUE_FILE_SIZE]);
+        const size_t keep = (OFFLINE_QUEUE_FILE_SIZE - 1) * sizeof(QueuedReading);
+        file = LittleFS.open(OFFLINE_QUEUE_FILE, "r");
+        bool read_ok = file &&
+                       file.seek((count - OFFLINE_QUEUE_FILE_SIZE + 1) * sizeof(QueuedReading)) &&
+                       file.read((uint8_t *)points.get(), keep) == keep;
+        if (file)
+        {
+            file.close();
+        }
+        if (read_ok)
+        {
+            points[OFFLINE_QUEUE_FILE_SIZE - 1] = point;
+            file = LittleFS.open(OFFLINE_QUEUE_FILE, "w");
+            if (file)
+            {
+                result = file.write((const uint8_t *)points.get(), keep + sizeof(point)) == keep + sizeof(point);
+                file.close();
+            }
+            LOG_INFO(F("QUEUE: File is full, oldest point dropped"));
+        }
+    }
+
+    if (result)
+    {
+        sett.offline_queue_file = 1;
+    }
+    else
+    {
+        LOG_ERROR(F("QUEUE: Failed to write ") << OFFLINE_QUEUE_FILE);
+    }
+    return result;
+}
+
+void offline_queue_push(Settings &sett, const AttinyData &data, uint16_t voltage_mv)
+{
+    if (!is_waterius_site(sett) && !is_http(sett) && !is_mqtt(sett))
+    {
+        // отправлять некуда
+        return;
+    }
+
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    QueuedReading point;
+    time_t now = time(nullptr);
+    if (is_valid_time(now))
+    {
+        point.timestamp = now;
+    }
+    else
+    {
+        // Без NTP оцениваем время по предыдущей точке и периоду пробуждения
+        uint32_t last = queue_last_timestamp(sett);
+        time_t prev = last ? (time_t)last : sett.last_send;
+        point.timestamp = is_valid_time(prev) ? prev + (time_t)sett.period_min_tuned * 60 : 0;
+    }
+    point.impulses0 = data.impulses0;
+    point.impulses1 = data.impulses1;
+    point.voltage = voltage_mv;
+    point.reserved = 0;
+
+    if (queue_append_file(sett, point))
+    {
+        LOG_INFO(F("QUEUE: Point saved"));
+    }
+}
+
+static void add_point(JsonArray &points, const QueuedReading &point)
+{
+    JsonArray item = points.add<JsonArray>();
+    item.add(point.timestamp);
+    item.add(point.impulses0);
+    item.add(point.impulses1);
+    item.add(point.voltage);
+}
+
+uint16_t offline_queue_fill_json(const Settings &sett, JsonDocument &json_data)
+{
+    if (!sett.offline_queue_file || !fs_begin())
+    {
+        return 0;
+    }
+
+    File file = LittleFS.open(OFFLINE_QUEUE_FILE, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint16_t count = 0;
+    JsonArray points = json_data[F("queue")].to<JsonArray>();
+    QueuedReading point;
+    while (file.read((uint8_t *)&point, sizeof(point)) == sizeof(point))
+    {
+        add_point(points, point);
+        count++;
+    }
+    file.close();
+
+    LOG_INFO(F("QUEUE: ") << count << F(" pending points added"));
+    return count;
+}
+
+void offline_queue_clear(Settings &sett)
+{
+    if (sett.offline_queue_file)
+    {
+        if (fs_begin())
+        {
+            LittleFS.remove(OFFLINE_QUEUE_FILE);
+        }
+        sett.offline_queue_file = 0;
+        LOG_INFO(F("QUEUE: File removed"));
+    }
+}
@@ -0,0 +1,63 @@
+/**
+ * @file offline_queue.h
+ * @brief Очередь показаний, которые не удалось отправить
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Если роутер или сервер недоступны, показания цикла дописываются в файл
+ * на LittleFS (RTC память не переживает снятие питания attiny). Файл -
+ * кольцо: при заполнении самая старая точка уступает место новой.
+ * При следующей удачной отправке вся очередь уходит одним запросом
+ * в массиве "queue" json: [[timestamp, imp0, imp1, voltage_mv], ...]
+ * Очередь одна на все направления и очищается, только когда показания
+ * приняли все включенные. До этого направления, которые уже приняли
+ * точки, получают их повторно и отбрасывают по timestamp.
+ */
+#ifndef OFFLINE_QUEUE_H_
+#define OFFLINE_QUEUE_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "setup.h"
+#include "master_i2c.h"
+
+#define OFFLINE_QUEUE_FILE_SIZE 96  // Точек в файле (сутки при периоде 15 мин)
+#define OFFLINE_QUEUE_FILE "/queue.bin"
+
+struct QueuedReading
+{
+    uint32_t timestamp; // время точки (оценка, если не было NTP)
+    uint32_t impulses0;
+    uint32_t impulses1;
+    uint16_t voltage;   // мВ
+    uint16_t reserved;
+};
+
+/**
+ * @brief Сохраняет показания текущего цикла в очередь
+ *
+ * @param sett настройки (флаг файла очереди)
+ * @param data показания attiny
+ * @param voltage_mv напряжение питания
+ */
+extern void offline_queue_push(Settings &sett, const AttinyData &data, uint16_t voltage_mv);
+
+/**
+ * @brief Добавляет массив "queue" с неотправленными показаниями
+ *
+ * @param sett настройки
+ * @param json_data json с показаниями
+ * @return количество добавленных точек
+ */
+extern uint16_t offline_queue_fill_json(const Settings &sett, JsonDocument &json_data);
+
+/**
+ * @brief Очищает очередь после удачной отправки во все включенные направления
+ *
+ * @param sett настройки
+ */
+extern void offline_queue_clear(Settings &sett);
+
+#endif
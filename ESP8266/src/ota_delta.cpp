@@ -0,0 +1,206 @@
+#include "ota_delta.h"
+#include <coredecls.h>
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool OtaDelta::fail(OtaDeltaError error)
+{
+    if (_error == OTA_DELTA_OK)
+    {
+        _error = error;
+    }
+    return false;
+}
+
+bool OtaDelta::check_base()
+{
+    uint32_t expected = get_le32(_header + 8);
+    uint8_t buf[OTA_DELTA_BUFFER];
+    uint32_t crc = 0xffffffff;
+    for (uint32_t pos = OTA_DELTA_HEADER_SKIP; pos < _base_size;)
+    {
+        size_t n = _min((uint32_t)sizeof(buf), _base_size - pos);
+        if (!_io.read_base(pos, buf, n))
+        {
+            return fail(OTA_DELTA_ERR_IO);
+        }
+        crc = crc32(buf, n, crc);
+        pos += n;
+    }
+    return crc == expected || fail(OTA_DELTA_ERR_BASE);
+}
+
+bool OtaDelta::header()
+{
+    if (get_le32(_header) != OTA_DELTA_MAGIC)
+    {
+        return fail(OTA_DELTA_ERR_FORMAT);
+    }
+    _base_size = get_le32(_header + 4);
+    _target_size = get_le32(_header + 12);
+    if (_base_size <= OTA_DELTA_HEADER_SKIP || !_target_size)
+    {
+        return fail(OTA_DELTA_ERR_FORMAT);
+    }
+    if (!check_base())
+    {
+        return false;
+    }
+    if (!_io.begin(_target_size))
+    {
+        return fail(OTA_DELTA_ERR_IO);
+    }
+    _header_done = true;
+    return true;
+}
+
+// Собирает varint LEB128 в _value
+bool OtaDelta::varint(uint8_t byte, bool &done)
+{
+    if (_shift > 28)
+    {
+        return fail(OTA_DELTA_ERR_FORMAT);
+    }
+    _value |= (uint32_t)(byte & 0x7F) << _shift;
+    _shift += 7;
+    done = !(byte & 0x80);
+    return true;
+}
+
+bool OtaDelta::copy()
+{
+    int64_t from = (int64_t)_cursor + _delta;
+    uint32_t len = _value;
+    if (from < OTA_DELTA_HEADER_SKIP || from + len > _base_size || len > _target_size - _written)
+    {
+        return fail(OTA_DELTA_ERR_FORMAT);
+    }
+    uint8_t buf[OTA_DELTA_BUFFER];
+    uint32_t pos = (uint32_t)from;
+    while (len)
+    {
+        size_t n = _min((uint32_t)sizeof(buf), len);
+        if (!_io.read_base(pos, buf, n) || !_io.write(buf, n))
+        {
+            return fail(OTA_DELTA_ERR_IO);
+        }
+        pos += n;
+        len -= n;
+        _written += n;
+    }
+    _cursor = pos;
+    return true;
+}
+
+bool OtaDelta::feed(const uint8_t *data, size_t len)
+{
+    if (_error != OTA_DELTA_OK)
+    {
+        return false;
+    }
+    size_t i = 0;
+    while (i < len)
+    {
+        bool done = false;
+        switch (_state)
+        {
+        case STATE_HEADER:
+            _header[_header_len++] = data[i++];
+            if (_header_len == OTA_DELTA_HEADER_SIZE)
+            {
+                if (!header())
+                {
+                    return false;
+                }
+                _state = STATE_OP;
+            }
+            break;
+
+        case STATE_OP:
+            _value = 0;
+            _shift = 0;
+            if (data[i] == OTA_DELTA_OP_COPY)
+            {
+                _state = STATE_COPY_DELTA;
+            }
+            else if (data[i] == OTA_DELTA_OP_INSERT)
+            {
+                _state = STATE_INSERT_LEN;
+            }
+            else
+            {
+                return fail(OTA_DELTA_ERR_FORMAT);
+            }
+            i++;
+            break;
+
+        case STATE_COPY_DELTA:
+            if (!varint(data[i++], done))
+            {
+                return false;
+            }
+            if (done)
+            {
+                _delta = (_value & 1) ? -(int64_t)(_value >> 1) - 1 : (int64_t)(_value >> 1); // zigzag
+                _value = 0;
+                _shift = 0;
+                _state = STATE_COPY_LEN;
+            }
+            break;
+
+        case STATE_COPY_LEN:
+            if (!varint(data[i++], done))
+            {
+                return false;
+            }
+            if (done)
+            {
+                if (!copy())
+                {
+                    return false;
+                }
+                _state = STATE_OP;
+            }
+            break;
+
+        case STATE_INSERT_LEN:
+            if (!varint(data[i++], done))
+            {
+                return false;
+            }
+            if (done)
+            {
+                if (!_value || _value > _target_size - _written)
+                {
+                    return fail(OTA_DELTA_ERR_FORMAT);
+                }
+                _insert_left = _value;
+                _state = STATE_INSERT_DATA;
+            }
+            break;
+
+        case STATE_INSERT_DATA:
+        {
+            // Вставки пишем прямо из принятого буфера
+            size_t n = _min((size_t)_insert_left, len - i);
+            if (!_io.write(data + i, n))
+            {
+                return fail(OTA_DELTA_ERR_IO);
+            }
+            i += n;
+            _written += n;
+            _insert_left -= n;
+            if (!_insert_left)
+            {
+                _cursor += _value;
+                _state = STATE_OP;
+            }
+            break;
+        }
+        }
+    }
+    return true;
+}
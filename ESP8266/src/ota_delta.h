@@ -0,0 +1,115 @@
+/**
+ * @file ota_delta.h
+ * @brief Применение патча прошивки к работающему образу (дельта OTA)
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Полный образ прошивки даже сжатым весит сотни КБ. Между соседними
+ * версиями меняются в основном адреса в пулах литералов, поэтому
+ * scripts/ota_delta.py строит из прошлого образа (base) и нового (target)
+ * патч из двух команд: скопировать участок base или вставить байты.
+ * Патч применяется потоком: участки читаются из flash работающей прошивки,
+ * результат идет в Updater, как при полном скачивании.
+ *
+ * Формат (числа little-endian, varint - LEB128):
+ *   "WDL1", base_size, base_crc, target_size - по 4 байта
+ *   0x01 delta len - копировать len байт base с позиции cursor + delta
+ *                    (delta - varint zigzag), cursor = позиция + len
+ *   0x02 len bytes - вставить len байт, cursor += len
+ * base_crc - crc32 ядра ESP8266 (от 0xffffffff) от base без первых
+ * OTA_DELTA_HEADER_SKIP байт: в них Updater при записи меняет режим flash.
+ * Поэтому и патч эти байты всегда вставляет, а не копирует.
+ */
+#ifndef OTA_DELTA_H_
+#define OTA_DELTA_H_
+
+#include <Arduino.h>
+
+#define OTA_DELTA_MAGIC 0x314C4457UL // "WDL1"
+#define OTA_DELTA_HEADER_SIZE 16
+#define OTA_DELTA_HEADER_SKIP 16     // заголовок образа, его правит Updater
+#define OTA_DELTA_BUFFER 512         // чтение base для копирования и crc
+#define OTA_DELTA_OP_COPY 0x01
+#define OTA_DELTA_OP_INSERT 0x02
+
+enum OtaDeltaError : uint8_t
+{
+    OTA_DELTA_OK = 0,
+    OTA_DELTA_ERR_FORMAT, // не патч или команда за пределами образов
+    OTA_DELTA_ERR_BASE,   // патч для другой прошивки
+    OTA_DELTA_ERR_IO      // чтение base или запись результата
+};
+
+/**
+ * @brief Откуда читать base и куда писать результат
+ */
+class OtaDeltaIo
+{
+public:
+    virtual ~OtaDeltaIo() {}
+    virtual bool read_base(uint32_t offset, uint8_t *buf, size_t len) = 0;
+
+    /**
+     * @brief Вызывается после проверки base, до первой записи
+     */
+    virtual bool begin(uint32_t target_size) = 0;
+    virtual bool write(const uint8_t *buf, size_t len) = 0;
+};
+
+class OtaDelta
+{
+public:
+    explicit OtaDelta(OtaDeltaIo &io) : _io(io) {}
+
+    /**
+     * @brief Разбирает очередную порцию патча (любой длины)
+     *
+     * @return false ошибка, см. error()
+     */
+    bool feed(const uint8_t *data, size_t len);
+
+    /**
+     * @brief Патч применен целиком: записано target_size байт и команда не оборвана
+     */
+    bool finished() const { return _state == STATE_OP && _header_done && _written == _target_size; }
+
+    OtaDeltaError error() const { return _error; }
+    uint32_t written() const { return _written; }
+    uint32_t target_size() const { return _target_size; }
+
+private:
+    enum State : uint8_t
+    {
+        STATE_HEADER,
+        STATE_OP,
+        STATE_COPY_DELTA,
+        STATE_COPY_LEN,
+        STATE_INSERT_LEN,
+        STATE_INSERT_DATA
+    };
+
+    bool fail(OtaDeltaError error);
+    bool header();
+    bool check_base();
+    bool copy();
+    bool varint(uint8_t byte, bool &done);
+
+    OtaDeltaIo &_io;
+    State _state = STATE_HEADER;
+    OtaDeltaError _error = OTA_DELTA_OK;
+    bool _header_done = false;
+    uint8_t _header[OTA_DELTA_HEADER_SIZE];
+    uint8_t _header_len = 0;
+    uint32_t _base_size = 0;
+    uint32_t _target_size = 0;
+    uint32_t _cursor = 0;  // позиция в base
+    uint32_t _written = 0;
+    uint32_t _value = 0;   // собираемый varint
+    uint8_t _shift = 0;
+    int64_t _delta = 0;
+    uint32_t _insert_left = 0;
+};
+
+#endif
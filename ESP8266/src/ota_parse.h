@@ -9,6 +9,11 @@ struct OtaParams
     const char *fw_url;
     const char *fw_md5;
     size_t fw_size;
+    bool fw_gzip; // образ сжат gzip, распаковывает eboot при копировании
+    const char *delta_url; // патч от работающей прошивки, см. ota_delta.h
+    const char *delta_md5; // MD5 образа после применения патча
+    size_t delta_size;
+    bool has_delta;
     const char *fs_url;
     const char *fs_md5;
     size_t fs_size;
@@ -17,6 +22,69 @@ struct OtaParams
     uint8_t error;
 };
 
+/*
+Необязательное поле "compression": нет или "none" - образ как есть, "gzip" - сжатый.
+Неизвестное значение - ошибка: такой образ записался бы как есть.
+*/
+inline bool parse_ota_compression(const JsonObject &image, bool &gzip)
+{
+    const char *compression = image["compression"].as<const char *>();
+    gzip = compression && strcmp(compression, "gzip") == 0;
+    return !compression || gzip || strcmp(compression, "none") == 0;
+}
+
+// MD5 из 32 hex-символов (в любом регистре) в байты
+inline bool ota_md5_parse(const char *hex, uint8_t *md5)
+{
+    if (!hex || strlen(hex) != 2 * OTA_MD5_SIZE)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < 2 * OTA_MD5_SIZE; i++)
+    {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9')
+            v = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            v = (c | 0x20) - 'a' + 10;
+        else
+            return false;
+        md5[i / 2] = (i & 1) ? (md5[i / 2] | v) : (v << 4);
+    }
+    return true;
+}
+
+// MD5 в 32 hex-символа; false, если MD5 неизвестен (нули)
+inline bool ota_md5_format(const uint8_t *md5, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    uint8_t any = 0;
+    for (uint8_t i = 0; i < OTA_MD5_SIZE; i++)
+    {
+        any |= md5[i];
+        hex[2 * i] = digits[md5[i] >> 4];
+        hex[2 * i + 1] = digits[md5[i] & 0x0F];
+    }
+    hex[2 * OTA_MD5_SIZE] = 0;
+    return any != 0;
+}
+
+// Образ по http:// без TLS. Принимается только прошивкой с подписью образов (OTA_SIGNED)
+inline bool ota_url_plain(const char *url)
+{
+    return url && strncmp(url, "http://", 7) == 0;
+}
+
+inline bool ota_url_allowed(const char *url)
+{
+#ifdef OTA_SIGNED
+    return url != nullptr;
+#else
+    return url && !ota_url_plain(url);
+#endif
+}
+
 inline OtaParams parse_ota_params(const JsonObject &ota)
 {
     OtaParams p = {};
@@ -37,11 +105,26 @@ inline OtaParams parse_ota_params(const JsonObject &ota)
         p.fw_md5 = fw["md5"].as<const char *>();
         p.fw_size = fw["size"] | (size_t)0;
 
-        if (!p.fw_url || !p.fw_md5)
+        if (!ota_url_allowed(p.fw_url) || !p.fw_md5 || !parse_ota_compression(fw, p.fw_gzip))
         {
             p.error = OTA_ERR_PARSE;
             return p;
         }
+
+        // Необязательный "delta": при неудаче его применения качается полный образ
+        p.has_delta = fw["delta"].is<JsonObject>();
+        if (p.has_delta)
+        {
+            JsonObject delta = fw["delta"];
+            p.delta_url = delta["url"].as<const char *>();
+            p.delta_md5 = delta["md5"].as<const char *>();
+            p.delta_size = delta["size"] | (size_t)0;
+            if (!ota_url_allowed(p.delta_url) || !p.delta_md5)
+            {
+                p.error = OTA_ERR_PARSE;
+                return p;
+            }
+        }
     }
 
     if (p.has_filesystem)
@@ -51,7 +134,9 @@ inline OtaParams parse_ota_params(const JsonObject &ota)
         p.fs_md5 = fs["md5"].as<const char *>();
         p.fs_size = fs["size"] | (size_t)0;
 
-        if (!p.fs_url || !p.fs_md5)
+        // Образ LittleFS пишется прямо в раздел, распаковать его некому
+        bool fs_gzip = false;
+        if (!ota_url_allowed(p.fs_url) || !p.fs_md5 || !parse_ota_compression(fs, fs_gzip) || fs_gzip)
         {
             p.error = OTA_ERR_PARSE;
             return p;
@@ -3,28 +3,450 @@
 #include "config.h"
 #include <ESP8266WiFi.h>
 #include <ESP8266httpUpdate.h>
+#include <ESP8266HTTPClient.h>
+#include <flash_hal.h>
+#include <coredecls.h>
+#include "tls_session.h"
+#include "cpu_boost.h"
+#include "heap_policy.h"
+#include "fs_mount.h"
+#include <LittleFS.h>
+#include "ota_delta.h"
+#ifdef OTA_SIGNED
+#include "ota_public_key.h" // создается ota_signing.py из ota_public.key
+#endif
 
-bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &sett, Voltage &voltage)
+/*
+ * Точка продолжения скачивания прошивки. Скачанная часть лежит в свободной
+ * области flash между прошивкой и LittleFS, куда ее пишет Updater, и никем
+ * больше не затирается. В следующее пробуждение она заново прогоняется через
+ * Updater (для md5 и проверок), а с сервера запрашивается только остаток (Range).
+ *
+ * attiny снимает питание ESP после сна, поэтому точка лежит в файле на
+ * LittleFS. Файл пишется раз в OTA_RESUME_STEP и при обрыве скачивания,
+ * а не после каждого сектора.
+ */
+struct OtaResume
 {
-    LOG_INFO(F("OTA: start"));
+    uint32_t id;       // crc32 md5 образа
+    uint32_t offset;   // записано во flash, кратно сектору
+    uint8_t header[4]; // исходное начало образа: Updater подправляет в нем режим flash
+    uint32_t crc;
+};
+
+static uint32_t resume_crc(const OtaResume &resume)
+{
+    return crc32(&resume, offsetof(OtaResume, crc));
+}
 
-    // Проверка батареи: 3 измерения с шагом 100мс, среднее
-    // Отдельные замеры с паузой дают стабильное значение, т.к. АЦП ESP8266
-    // шумит ±30-50 мВ, а нагрузка WiFi/передачи вызывает кратковременные
-    // просадки. Пауза 100мс позволяет напряжению стабилизироваться между
-    // замерами, а усреднение сглаживает выбросы.
-    uint32_t sum_mv = 0;
-    for (uint8_t i = 0; i < 3; i++)
+static bool resume_load(OtaResume &resume)
+{
+    bool valid = false;
+    if (fs_begin())
     {
-        if (i > 0)
+        File file = LittleFS.open(OTA_RESUME_FILE, "r");
+        if (file)
         {
-            delay(100);
+            valid = file.read((uint8_t *)&resume, sizeof(resume)) == sizeof(resume) &&
+                    resume.crc == resume_crc(resume);
+            file.close();
         }
-        voltage.update();
-        sum_mv += voltage.value();
     }
-    uint16_t avg_mv = sum_mv / 3;
+    return valid;
+}
+
+static void resume_store(OtaResume &resume)
+{
+    if (!fs_begin())
+    {
+        return;
+    }
+    resume.crc = resume_crc(resume);
+    File file = LittleFS.open(OTA_RESUME_FILE, "w");
+    if (!file || file.write((const uint8_t *)&resume, sizeof(resume)) != sizeof(resume))
+    {
+        LOG_ERROR(F("OTA: Failed to store resume point"));
+    }
+    if (file)
+    {
+        file.close();
+    }
+}
+
+static void resume_clear()
+{
+    if (fs_begin() && LittleFS.exists(OTA_RESUME_FILE))
+    {
+        LittleFS.remove(OTA_RESUME_FILE);
+    }
+}
+
+// Адрес, с которого Updater::begin пишет образ прошивки размером size
+static uint32_t staging_address(const size_t size)
+{
+    uint32_t rounded = (size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+    return FS_PHYS_ADDR - rounded;
+}
+
+// Уже записанная часть: с flash обратно в Updater
+static bool replay_written(const OtaResume &resume, const uint32_t start)
+{
+    uint32_t buf[OTA_CHUNK_SIZE / sizeof(uint32_t)];
+    for (uint32_t pos = 0; pos < resume.offset; pos += sizeof(buf))
+    {
+        if (!ESP.flashRead(start + pos, buf, sizeof(buf)))
+        {
+            return false;
+        }
+        if (pos == 0)
+        {
+            memcpy(buf, resume.header, sizeof(resume.header));
+        }
+        if (Update.write((uint8_t *)buf, sizeof(buf)) != sizeof(buf))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * На время OTA: частота CPU выше - скачивание упирается в BearSSL и md5,
+ * а для прошивки с ключом Updater принимает только подписанные образы.
+ */
+class OtaGuard
+{
+public:
+    OtaGuard()
+#ifdef OTA_SIGNED
+        : _key(ota_public_key), _verifier(&_key)
+#endif
+    {
+#ifdef OTA_SIGNED
+        Update.installSignature(&_hash, &_verifier);
+#endif
+    }
+
+    ~OtaGuard()
+    {
+#ifdef OTA_SIGNED
+        Update.installSignature(nullptr, nullptr);
+#endif
+    }
+
+private:
+    CpuBoost _boost;
+#ifdef OTA_SIGNED
+    BearSSL::PublicKey _key;
+    BearSSL::HashSHA256 _hash;
+    BearSSL::SigningVerifier _verifier;
+#endif
+};
+
+/*
+ * Клиент для скачивания образа. По http:// (только с подписью образов) TLS
+ * не нужен. Для https буфер приема - на целую TLS запись: сервер шлет
+ * записи по 16 КБ, передача - минимальная, ESP отправляет только запрос.
+ */
+#define OTA_TLS_HEAP (OTA_TLS_RX_BUFFER + OTA_TLS_TX_BUFFER + HEAP_TLS_CONTEXT)
 
+static WiFiClient &ota_client(const char *url, WiFiClient &plain, WiFiClientSecure &secure, BearSSL::Session &session)
+{
+    if (ota_url_plain(url))
+    {
+        return plain;
+    }
+    secure.setInsecure();
+    secure.setBufferSizes(OTA_TLS_RX_BUFFER, OTA_TLS_TX_BUFFER);
+    secure.setSession(&session);
+    return secure;
+}
+
+/**
+ * @brief Скачивание прошивки с продолжением с места обрыва.
+ * Продолжить можно, если сервер передал размер и умеет Range.
+ *
+ * @param client клиент из ota_client
+ * @param p параметры OTA
+ * @param masterI2C для продления бодрствования
+ * @return true прошивка записана, md5 совпал
+ */
+static bool download_firmware(WiFiClient &client, const OtaParams &p, MasterI2C &masterI2C)
+{
+    OtaResume resume;
+    uint32_t id = crc32(p.fw_md5, strlen(p.fw_md5));
+    bool resumable = p.fw_size > 0;
+    if (!resumable || !resume_load(resume) || resume.id != id || resume.offset >= p.fw_size)
+    {
+        memset(&resume, 0, sizeof(resume));
+        resume.id = id;
+    }
+
+    HTTPClient http;
+    if (!http.begin(client, p.fw_url))
+    {
+        LOG_ERROR(F("OTA: bad url"));
+        return false;
+    }
+    if (resume.offset)
+    {
+        http.addHeader(F("Range"), String(F("bytes=")) + resume.offset + '-');
+    }
+    int code;
+    {
+        // Подключение выделяет буфер приема на целую TLS запись
+        HeapSelectLarge large(ota_url_plain(p.fw_url) ? 0 : OTA_TLS_HEAP);
+        code = http.GET();
+    }
+    if (code == HTTP_CODE_OK && resume.offset)
+    {
+        LOG_INFO(F("OTA: server ignored Range, from start"));
+        resume.offset = 0;
+    }
+    else if (code != HTTP_CODE_OK && code != HTTP_CODE_PARTIAL_CONTENT)
+    {
+        LOG_ERROR(F("OTA: HTTP code ") << code);
+        http.end();
+        return false;
+    }
+
+    size_t size = resumable ? p.fw_size : (size_t)_max(http.getSize(), 0);
+    if (!Update.begin(size, U_FLASH))
+    {
+        LOG_ERROR(F("OTA: ") << Update.getErrorString());
+        http.end();
+        return false;
+    }
+    Update.setMD5(p.fw_md5);
+
+    if (resume.offset)
+    {
+        LOG_INFO(F("OTA: resume from ") << resume.offset << F(" of ") << size);
+        if (!replay_written(resume, staging_address(size)))
+        {
+            LOG_ERROR(F("OTA: replay failed"));
+            Update.end();
+            http.end();
+            return false;
+        }
+    }
+
+    WiFiClient *stream = http.getStreamPtr();
+    uint8_t buf[OTA_CHUNK_SIZE];
+    size_t remaining = size - resume.offset;
+    uint32_t stored = resume.offset;
+    uint32_t data_ms = millis();
+    uint32_t extend_ms = millis();
+    while (remaining)
+    {
+        size_t avail = stream->available();
+        if (!avail)
+        {
+            if (!stream->connected() || millis() - data_ms > OTA_STALL_MS)
+            {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        size_t n = stream->readBytes(buf, _min(_min(avail, sizeof(buf)), remaining));
+        if (!n)
+        {
+            continue;
+        }
+        data_ms = millis();
+
+        // Updater принимает и сжатый, и обычный образ: проверяем, что пришел заявленный
+        if (p.fw_gzip && !Update.progress() && buf[0] != 0x1f)
+        {
+            LOG_ERROR(F("OTA: not a gzip image"));
+            break;
+        }
+
+        for (size_t i = 0; Update.progress() + i < sizeof(resume.header) && i < n; i++)
+        {
+            resume.header[Update.progress() + i] = buf[i];
+        }
+        if (Update.write(buf, n) != n)
+        {
+            break;
+        }
+        remaining -= n;
+
+        // Updater пишет во flash посекторно, записанная часть - целые сектора
+        uint32_t flushed = Update.progress() & ~(SPI_FLASH_SEC_SIZE - 1);
+        if (resumable && flushed > resume.offset)
+        {
+            resume.offset = flushed;
+            if (resume.offset - stored >= OTA_RESUME_STEP)
+            {
+                resume_store(resume);
+                stored = resume.offset;
+            }
+        }
+        if (millis() - extend_ms > OTA_EXTEND_WAKE_MS)
+        {
+            masterI2C.extendWakeUp();
+            extend_ms = millis();
+        }
+    }
+    http.end();
+
+    if (remaining)
+    {
+        LOG_ERROR(F("OTA: interrupted at ") << Update.progress() << F(", saved ") << resume.offset);
+        if (resumable && resume.offset > stored)
+        {
+            resume_store(resume);
+        }
+        Update.end(); // не закончено: Updater сбрасывается, eboot команду не получает
+        return false;
+    }
+
+    // Образ целиком: успех или неверный md5, продолжать нечего
+    resume_clear();
+    if (!Update.end())
+    {
+        LOG_ERROR(F("OTA: ") << Update.getErrorString());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Патч применяется к работающей прошивке: base читается с адреса 0, где
+ * лежит скетч вместе с eboot, результат пишется через Updater в свободную
+ * область и проверяется так же, как полный образ (md5, подпись).
+ */
+class UpdaterDeltaIo : public OtaDeltaIo
+{
+public:
+    explicit UpdaterDeltaIo(const char *md5) : _md5(md5) {}
+
+    bool read_base(uint32_t offset, uint8_t *buf, size_t len) override
+    {
+        return ESP.flashRead(offset, buf, len);
+    }
+
+    bool begin(uint32_t target_size) override
+    {
+        if (!Update.begin(target_size, U_FLASH))
+        {
+            LOG_ERROR(F("OTA: ") << Update.getErrorString());
+            return false;
+        }
+        Update.setMD5(_md5);
+        return true;
+    }
+
+    bool write(const uint8_t *buf, size_t len) override
+    {
+        return Update.write(const_cast<uint8_t *>(buf), len) == len;
+    }
+
+private:
+    const char *_md5;
+};
+
+/**
+ * @brief Скачивание патча и сборка из него нового образа.
+ * Патч маленький, поэтому без продолжения с места обрыва.
+ *
+ * @return true прошивка записана, md5 совпал. При false можно качать полный образ.
+ */
+static bool download_delta(WiFiClient &client, const OtaParams &p, MasterI2C &masterI2C)
+{
+    HTTPClient http;
+    if (!http.begin(client, p.delta_url))
+    {
+        LOG_ERROR(F("OTA: bad delta url"));
+        return false;
+    }
+    int code;
+    {
+        HeapSelectLarge large(ota_url_plain(p.delta_url) ? 0 : OTA_TLS_HEAP);
+        code = http.GET();
+    }
+    if (code != HTTP_CODE_OK)
+    {
+        LOG_ERROR(F("OTA: delta HTTP code ") << code);
+        http.end();
+        return false;
+    }
+
+    UpdaterDeltaIo io(p.delta_md5);
+    OtaDelta delta(io);
+    WiFiClient *stream = http.getStreamPtr();
+    uint8_t buf[OTA_CHUNK_SIZE];
+    uint32_t data_ms = millis();
+    uint32_t extend_ms = millis();
+    while (!delta.finished())
+    {
+        size_t avail = stream->available();
+        if (!avail)
+        {
+            if (!stream->connected() || millis() - data_ms > OTA_STALL_MS)
+            {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        size_t n = stream->readBytes(buf, _min(avail, sizeof(buf)));
+        if (!n)
+        {
+            continue;
+        }
+        data_ms = millis();
+        if (!delta.feed(buf, n))
+        {
+            LOG_ERROR(F("OTA: delta error ") << delta.error());
+            break;
+        }
+        if (millis() - extend_ms > OTA_EXTEND_WAKE_MS)
+        {
+            masterI2C.extendWakeUp();
+            extend_ms = millis();
+        }
+    }
+    http.end();
+
+    if (!delta.finished())
+    {
+        if (delta.error() != OTA_DELTA_ERR_BASE)
+        {
+            LOG_ERROR(F("OTA: delta stopped at ") << delta.written() << F(" of ") << delta.target_size());
+        }
+        else
+        {
+            LOG_INFO(F("OTA: delta is for another firmware"));
+        }
+        Update.end();
+        return false;
+    }
+    if (!Update.end())
+    {
+        LOG_ERROR(F("OTA: ") << Update.getErrorString());
+        return false;
+    }
+    LOG_INFO(F("OTA: delta applied, ") << delta.written() << F(" bytes"));
+    return true;
+}
+
+bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &sett, Voltage &voltage)
+{
+    LOG_INFO(F("OTA: start"));
+
+    // Проверка батареи: среднее фоновых замеров пробуждения (Voltage::start_sampling).
+    // АЦП ESP8266 шумит ±30-50 мВ, а нагрузка WiFi/передачи вызывает
+    // кратковременные просадки, усреднение по кольцу замеров их сглаживает.
+    // Замеры под нагрузкой передачи делают проверку строже, чем замер в покое.
+    // Без фоновых замеров - одно измерение сейчас.
+    if (voltage.samples() < OTA_MIN_VOLTAGE_SAMPLES)
+    {
+        voltage.update();
+    }
+    uint16_t avg_mv = voltage.average();
     bool usb_powered = avg_mv > OTA_USB_VOLTAGE_THRESHOLD_MV;
     if (usb_powered)
     {
@@ -32,7 +454,7 @@ bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &s
     }
     else
     {
-        LOG_INFO(F("OTA: voltage: ") << avg_mv << F(" mV (3 samples)"));
+        LOG_INFO(F("OTA: voltage: ") << avg_mv << F(" mV (") << voltage.samples() << F(" samples)"));
         if (avg_mv < OTA_MIN_VOLTAGE_MV)
         {
             LOG_ERROR(F("OTA: voltage too low (") << avg_mv << F(" < ") << OTA_MIN_VOLTAGE_MV << F(" mV), aborting"));
@@ -54,16 +476,38 @@ bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &s
 
     if (p.has_firmware)
     {
-        LOG_INFO(F("OTA: firmware url=") << p.fw_url << F(" md5=") << p.fw_md5 << F(" size=") << p.fw_size);
+        LOG_INFO(F("OTA: firmware url=") << p.fw_url << F(" md5=") << p.fw_md5 << F(" size=") << p.fw_size << (p.fw_gzip ? F(" gzip") : F("")));
+    }
+    if (p.has_delta)
+    {
+        LOG_INFO(F("OTA: delta url=") << p.delta_url << F(" md5=") << p.delta_md5 << F(" size=") << p.delta_size);
     }
     if (p.has_filesystem)
     {
         LOG_INFO(F("OTA: filesystem url=") << p.fs_url << F(" md5=") << p.fs_md5 << F(" size=") << p.fs_size);
     }
 
+    // Файловая система уже та же: 1 МБ не скачиваем
+    uint8_t fs_md5[OTA_MD5_SIZE] = {0};
+    if (p.has_filesystem && ota_md5_parse(p.fs_md5, fs_md5) && memcmp(fs_md5, sett.fs_md5, OTA_MD5_SIZE) == 0)
+    {
+        LOG_INFO(F("OTA: filesystem unchanged, skip"));
+        p.has_filesystem = false;
+        if (!p.has_firmware)
+        {
+            return true;
+        }
+    }
+
     // Продлеваем время бодрствования
     masterI2C.extendWakeUp();
 
+    OtaGuard guard;
+
+    // Одна TLS сессия на оба скачивания: второе рукопожатие будет сокращенным
+    BearSSL::Session session;
+    tls_session_load(p.has_filesystem ? p.fs_url : p.fw_url, session);
+
     // Обновление filesystem (сначала FS, потом firmware)
     if (p.has_filesystem)
     {
@@ -73,10 +517,19 @@ bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &s
         ESPhttpUpdate.rebootOnUpdate(false);
         ESPhttpUpdate.setMD5sum(p.fs_md5);
 
-        WiFiClientSecure fs_client;
-        fs_client.setInsecure();
+        WiFiClient fs_plain;
+        WiFiClientSecure fs_secure;
+        WiFiClient &fs_client = ota_client(p.fs_url, fs_plain, fs_secure, session);
+
+        // Раздел перезаписывается: до успеха образ неизвестен
+        memset(sett.fs_md5, 0, OTA_MD5_SIZE);
+        fs_end(); // журналы держат LittleFS смонтированной
 
-        t_httpUpdate_return ret = ESPhttpUpdate.updateFS(fs_client, p.fs_url);
+        t_httpUpdate_return ret;
+        {
+            HeapSelectLarge large(ota_url_plain(p.fs_url) ? 0 : OTA_TLS_HEAP);
+            ret = ESPhttpUpdate.updateFS(fs_client, p.fs_url);
+        }
         if (ret != HTTP_UPDATE_OK)
         {
             LOG_ERROR(F("OTA: filesystem update failed: ") << ESPhttpUpdate.getLastErrorString());
@@ -85,24 +538,35 @@ bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &s
             return false;
         }
         LOG_INFO(F("OTA: filesystem updated OK"));
+        memcpy(sett.fs_md5, fs_md5, OTA_MD5_SIZE);
+        store_config(sett);
     }
 
     // Обновление firmware
     if (p.has_firmware)
     {
         masterI2C.extendWakeUp();
-        LOG_INFO(F("OTA: downloading firmware..."));
-
-        ESPhttpUpdate.rebootOnUpdate(false);
-        ESPhttpUpdate.setMD5sum(p.fw_md5);
-
-        WiFiClientSecure fw_client;
-        fw_client.setInsecure();
+        bool updated = false;
+        if (p.has_delta)
+        {
+            LOG_INFO(F("OTA: downloading delta..."));
+            WiFiClient delta_plain;
+            WiFiClientSecure delta_secure;
+            WiFiClient &delta_client = ota_client(p.delta_url, delta_plain, delta_secure, session);
+            updated = download_delta(delta_client, p, masterI2C);
+        }
 
-        t_httpUpdate_return ret = ESPhttpUpdate.update(fw_client, p.fw_url);
-        if (ret != HTTP_UPDATE_OK)
+        WiFiClient fw_plain;
+        WiFiClientSecure fw_secure;
+        if (!updated)
+        {
+            LOG_INFO(F("OTA: downloading firmware..."));
+            WiFiClient &fw_client = ota_client(p.fw_url, fw_plain, fw_secure, session);
+            updated = download_firmware(fw_client, p, masterI2C);
+        }
+        if (!updated)
         {
-            LOG_ERROR(F("OTA: firmware update failed: ") << ESPhttpUpdate.getLastErrorString());
+            LOG_ERROR(F("OTA: firmware update failed"));
             sett.ota_error = OTA_ERR_FW_UPDATE;
             store_config(sett);
             return false;
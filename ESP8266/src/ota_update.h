@@ -9,6 +9,14 @@
 
 #define OTA_MIN_VOLTAGE_MV 3300
 #define OTA_USB_VOLTAGE_THRESHOLD_MV 4600
+#define OTA_MIN_VOLTAGE_SAMPLES 3  // меньше фоновых замеров - перед проверкой батареи еще один
+#define OTA_EXTEND_WAKE_MS 30000UL // продление бодрствования attiny во время скачивания
+#define OTA_STALL_MS 10000UL       // нет данных от сервера - скачивание прерывается
+#define OTA_CHUNK_SIZE 512         // буфер чтения, кратен сектору flash
+#define OTA_TLS_RX_BUFFER 16384    // прием: целая TLS запись
+#define OTA_TLS_TX_BUFFER 512      // передача: только запрос
+#define OTA_RESUME_FILE "/ota_resume.bin"
+#define OTA_RESUME_STEP 65536UL    // точка продолжения на LittleFS пишется раз в столько байт
 
 bool perform_ota_update(const JsonObject &ota, MasterI2C &masterI2C, Settings &sett, Voltage &voltage);
 
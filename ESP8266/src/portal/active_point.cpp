@@ -5,6 +5,7 @@
 #include <IPAddress.h>
 #include <DNSServer.h>
 #include <LittleFS.h>
+#include "fs_mount.h"
 #include <ArduinoJson.h>
 #include "AsyncJson.h"
 #include "setup.h"
@@ -13,12 +14,17 @@
 #include "utils.h"
 #include "config.h"
 #include "wifi_helpers.h"
+#include "wifi_scan.h"
+#include "energy.h"
+#include "espnow_frame.h"
 #include "resources.h"
 #include "ha/resources.h"
 #include "active_point_api.h"
 #include "active_point.h"
 
 #define SETUP_TIME_SEC 600UL // На какое время Attiny включает ESP (файл Attiny85\src\Setup.h)
+#define STATIC_CACHE_CONTROL "max-age=600" // статика не меняется за сеанс настройки
+#define STATIC_ETAG_FILE "/static/etag" // пишет prepare_data.py при сборке образа LittleFS
 
 bool exit_portal_flag = false;
 bool start_connect_flag = false;
@@ -28,6 +34,7 @@ wl_status_t wifi_connect_status = WL_DISCONNECTED;
 const String localIPURL = "http://192.168.4.1";
 
 FSInfo fs_info;
+String static_etag; // общий для всей статики образа, в кавычках
 
 extern AttinyData data;
 extern AttinyData runtime_data;
@@ -122,196 +129,260 @@ String processor(const String &var)
     return processor_main(var);
 }
 
-/**
- *  Функция возвращающая текстовое значение параметра по его имени. 
- *  Используется для отрисовки статических html страниц portal по ключевым словам %keyword% 
- */
-String processor_main(const String &var, const uint8_t input)
-{   
-    if (var == FPSTR(PARAM_VERSION))
-        return String(runtime_data.version);
-
-    else if (var == FPSTR(PARAM_VERSION_ESP))
-        return FIRMWARE_VERSION;
-
-    else if (var == FPSTR(PARAM_WATERIUS_HOST))
-        return replace_value(sett.waterius_host);
-    else if (var == FPSTR(PARAM_WATERIUS_EMAIL))
+static String key_version(const uint8_t) { return String(runtime_data.version); }
+static String key_version_esp(const uint8_t) { return F(FIRMWARE_VERSION); }
+static String key_waterius_host(const uint8_t) { return replace_value(sett.waterius_host); }
+static String key_waterius_email(const uint8_t)
+{
+    if (!strstr(sett.waterius_email, "@waterius.ru"))
+        return replace_value(sett.waterius_email);
+    return String();
+}
+static String key_http_url(const uint8_t) { return replace_value(sett.http_url); }
+static String key_http_compact(const uint8_t) { return template_bool(sett.http_compact); }
+static String key_log_upload(const uint8_t) { return template_bool(sett.log_upload); }
+
+static String key_mqtt_host(const uint8_t) { return replace_value(sett.mqtt_host); }
+static String key_mqtt_port(const uint8_t) { return String(sett.mqtt_port); }
+static String key_mqtt_login(const uint8_t) { return replace_value(sett.mqtt_login); }
+static String key_mqtt_password(const uint8_t) { return sett.mqtt_password[0] ? FPSTR(PARAM_ASTERICS) : String(); }
+static String key_mqtt_topic(const uint8_t) { return replace_value(sett.mqtt_topic); }
+
+// на вебстраницах входа
+static String key_input(const uint8_t input) { return String(input); }
+static String key_channel_start(const uint8_t input)
+{
+    switch (input)
     {
-        if (!strstr(sett.waterius_email, "@waterius.ru"))
-            return replace_value(sett.waterius_email);
+        case 0: return String(sett.channel0_start);
+        case 1: return String(sett.channel1_start);
     }
-    else if (var == FPSTR(PARAM_HTTP_URL))
-        return replace_value(sett.http_url);
-
-    else if (var == FPSTR(PARAM_MQTT_HOST))
-        return replace_value(sett.mqtt_host);
-    else if (var == FPSTR(PARAM_MQTT_PORT))
-        return String(sett.mqtt_port);
-    else if (var == FPSTR(PARAM_MQTT_LOGIN))
-        return replace_value(sett.mqtt_login);
-    else if (var == FPSTR(PARAM_MQTT_PASSWORD))
-        return sett.mqtt_password[0] ? FPSTR(PARAM_ASTERICS) : String();
-        
-    else if (var == FPSTR(PARAM_MQTT_TOPIC))
-        return replace_value(sett.mqtt_topic);
-
-    // на вебстраницах входа
-    else if (var == FPSTR(PARAM_INPUT))
-        return String(input);
-        
-    else if (var == FPSTR(PARAM_CHANNEL_START))
+    return String();
+}
+static String key_serial(const uint8_t input)
+{
+    switch (input)
     {
-        switch (input)
-        {
-            case 0: return String(sett.channel0_start);
-            case 1: return String(sett.channel1_start);
-        }
+        case 0: return replace_value(sett.serial0);
+        case 1: return replace_value(sett.serial1);
     }
-    else if (var == FPSTR(PARAM_SERIAL))
+    return String();
+}
+static String key_counter_name(const uint8_t input)
+{
+    switch (input)
     {
-        switch (input)
-        {
-            case 0: return replace_value(sett.serial0);
-            case 1: return replace_value(sett.serial1);
-        }
+        case 0: return String(sett.counter0_name);
+        case 1: return String(sett.counter1_name);
     }
-
-    else if (var == FPSTR(PARAM_COUNTER_NAME))
+    return String();
+}
+static String key_counter0_name(const uint8_t) { return String(sett.counter0_name); }
+static String key_counter1_name(const uint8_t) { return String(sett.counter1_name); }
+static String key_counter_img(const uint8_t input)
+{
+    switch (input)
     {
-        switch (input)
-        {
-            case 0: return String(sett.counter0_name);
-            case 1: return String(sett.counter1_name);
-        }
+        case 0: return get_counter_img(0, sett.counter0_name, runtime_data.counter_type0);
+        case 1: return get_counter_img(1, sett.counter1_name, runtime_data.counter_type1);
     }
-
-    else if (var == FPSTR(PARAM_COUNTER0_NAME))
+    return String();
+}
+static String key_counter_type(const uint8_t input)
+{
+    switch (input)
     {
-        return String(sett.counter0_name);
+        case 0: return valid_counter_type(runtime_data.counter_type0);
+        case 1: return valid_counter_type(runtime_data.counter_type1);
     }
-
-    else if (var == FPSTR(PARAM_COUNTER1_NAME))
+    return String();
+}
+static String key_counter0_type(const uint8_t) { return valid_counter_type(runtime_data.counter_type0); }
+static String key_counter1_type(const uint8_t) { return valid_counter_type(runtime_data.counter_type1); }
+static String key_factor(const uint8_t input)
+{
+    switch (input)
     {
-        return String(sett.counter1_name);
+        case 0: return String(sett.factor0); //sett.factor0 == AS_COLD_CHANNEL ? F("10") : String(sett.factor0);
+        case 1: return String(sett.factor1); //sett.factor1 == AUTO_IMPULSE_FACTOR ? F("10") : String(sett.factor1);
     }
+    return String();
+}
 
-    else if (var == FPSTR(PARAM_COUNTER_IMG))
-    {
-        switch (input)
-        {
-            case 0: return get_counter_img(0, sett.counter0_name, runtime_data.counter_type0);
-            case 1: return get_counter_img(1, sett.counter1_name, runtime_data.counter_type1);
-        }
-    }
+static String key_ip(const uint8_t) { return IPAddress(sett.ip).toString(); }
+static String key_gateway(const uint8_t) { return IPAddress(sett.gateway).toString(); }
+static String key_mask(const uint8_t) { return IPAddress(sett.mask).toString(); }
+static String key_mac_address(const uint8_t) { return WiFi.macAddress(); }
 
-    else if (var == FPSTR(PARAM_COUNTER_TYPE))
-    {
-        switch (input)
-        {
-            case 0: return valid_counter_type(runtime_data.counter_type0);
-            case 1: return valid_counter_type(runtime_data.counter_type1);
-        }
-    }
+static String key_period_min(const uint8_t) { return String(sett.wakeup_per_min); }
+static String key_period_lo(const uint8_t) { return String(sett.wakeup_per_min_lo); }
+static String key_period_hi(const uint8_t) { return String(sett.wakeup_per_min_hi); }
 
-    else if (var == FPSTR(PARAM_COUNTER0_TYPE))
-    {
-        return valid_counter_type(runtime_data.counter_type0);
-    }
+static String key_place(const uint8_t) { return String(sett.place); }
+static String key_company(const uint8_t) { return String(sett.company); }
 
-    else if (var == FPSTR(PARAM_COUNTER1_TYPE))
-    {
-        return valid_counter_type(runtime_data.counter_type1);
-    }
+static String key_mqtt_auto_discovery(const uint8_t) { return template_bool(sett.mqtt_auto_discovery); }
+static String key_mqtt_retain(const uint8_t) { return template_bool(sett.mqtt_retain); }
+static String key_mqtt_changed_only(const uint8_t) { return template_bool(sett.mqtt_changed_only); }
+static String key_mqtt_discovery_topic(const uint8_t) { return replace_value(sett.mqtt_discovery_topic); }
+
+static String key_ntp_server(const uint8_t) { return String(sett.ntp_server); }
+static String key_ntp_skip(const uint8_t) { return String(sett.ntp_skip_period); }
+
+static String key_ssid(const uint8_t) { return replace_value(sett.wifi_ssid); }
+static String key_password(const uint8_t) { return sett.wifi_password[0] ? FPSTR(PARAM_ASTERICS) : String(); }
+static String key_wifi_phy_mode(const uint8_t) { return String(sett.wifi_phy_mode); }
+
+static bool espnow_configured() { return sett.espnow.magic == ESPNOW_CONFIG_MAGIC; }
+static String key_espnow_role(const uint8_t) { return String(espnow_configured() ? sett.espnow.role : ESPNOW_ROLE_OFF); }
+static String key_espnow_channel(const uint8_t) { return String(espnow_configured() ? sett.espnow.channel : 0); }
+static String key_espnow_gateway(const uint8_t)
+{
+    char mac[18];
+    return espnow_configured() && espnow_mac_format(sett.espnow.gateway, mac) ? String(mac) : String();
+}
+static String key_espnow_key(const uint8_t) { return espnow_configured() ? FPSTR(PARAM_ASTERICS) : String(); }
 
-    else if (var == FPSTR(PARAM_FACTOR))
+static String key_waterius_on(const uint8_t) { return template_bool(sett.waterius_on); }
+static String key_http_on(const uint8_t) { return template_bool(sett.http_on); }
+static String key_mqtt_on(const uint8_t) { return template_bool(sett.mqtt_on); }
+static String key_dhcp_off(const uint8_t) { return template_bool(sett.dhcp_off); }
+
+static String key_build_date_time(const uint8_t) { return F(__DATE__ " " __TIME__); }
+static String key_fs_size(const uint8_t) { return String(fs_info.totalBytes); }
+static String key_fs_free(const uint8_t) { return String(fs_info.totalBytes - fs_info.usedBytes); }
+static String key_wifi_connect_status(const uint8_t)
+{
+    switch (wifi_connect_status)
     {
-        switch (input)
-        {
-            case 0: return String(sett.factor0); //sett.factor0 == AS_COLD_CHANNEL ? F("10") : String(sett.factor0);
-            case 1: return String(sett.factor1); //sett.factor1 == AUTO_IMPULSE_FACTOR ? F("10") : String(sett.factor1);
-        }
+        case WL_NO_SSID_AVAIL:
+        case WL_CONNECT_FAILED:
+        case WL_CONNECTION_LOST:
+            return String(F("8")); //S_WIFI_CONNECTION_LOST "Ошибка подключения. Попробуйте ещё раз.<br>Если не помогло, то пропишите статический ip. Еще можно зарезервировать MAC адрес Ватериуса в роутере. Если ничего не помогло, пришлите нам <a class='link' href='http://192.168.4.1/ssid.txt'>файл</a> параметров wi-fi сетей.";
+        case WL_WRONG_PASSWORD:
+            return String(F("9")); //S_WL_WRONG_PASSWORD "Ошибка подключения: Некорректный пароль";
+        case WL_IDLE_STATUS:
+            return String(F("10")); //S_WL_IDLE_STATUS "Ошибка подключения: Код 0";
+        case WL_DISCONNECTED:
+            return String(F("11")); //S_WL_DISCONNECTED "Ошибка подключения: Отключен";
+        case WL_NO_SHIELD:
+            return String(F("12")); //S_WL_NO_SHIELD "Ошибка подключения: Код 255";
+        case WL_SCAN_COMPLETED:
+            return String(F("13")); //S_WL_SCAN_COMPLETED "Ошибка подключения: Код 2";
+        case WL_CONNECTED:
+            break;
     }
+    return String();
+}
 
+struct TemplateKey
+{
+    const char *name; // PROGMEM
+    String (*value)(const uint8_t input);
+};
 
-    else if (var == FPSTR(PARAM_IP))
-        return IPAddress(sett.ip).toString();
-    else if (var == FPSTR(PARAM_GATEWAY))
-        return IPAddress(sett.gateway).toString();
-    else if (var == FPSTR(PARAM_MASK))
-        return IPAddress(sett.mask).toString();
-    else if (var == FPSTR(PARAM_MAC_ADDRESS))
-        return WiFi.macAddress();
+/*
+ * Ключевые слова страниц портала. Таблица во флеше, строки упорядочены
+ * по strcmp (цифры и '_' раньше букв) - поиск делением пополам.
+ * Новый ключ вставлять на свое место по алфавиту, иначе он не найдется.
+ */
+static const TemplateKey template_keys[] PROGMEM = {
+    {PARAM_BUILD_DATE_TIME, key_build_date_time},
+    {PARAM_CHANNEL_START, key_channel_start},
+    {PARAM_COMPANY, key_company},
+    {PARAM_COUNTER0_NAME, key_counter0_name},
+    {PARAM_COUNTER0_TYPE, key_counter0_type},
+    {PARAM_COUNTER1_NAME, key_counter1_name},
+    {PARAM_COUNTER1_TYPE, key_counter1_type},
+    {PARAM_COUNTER_IMG, key_counter_img},
+    {PARAM_COUNTER_NAME, key_counter_name},
+    {PARAM_COUNTER_TYPE, key_counter_type},
+    {PARAM_DHCP_OFF, key_dhcp_off},
+    {PARAM_ESPNOW_CHANNEL, key_espnow_channel},
+    {PARAM_ESPNOW_GATEWAY, key_espnow_gateway},
+    {PARAM_ESPNOW_KEY, key_espnow_key},
+    {PARAM_ESPNOW_ROLE, key_espnow_role},
+    {PARAM_FACTOR, key_factor},
+    {PARAM_FS_FREE, key_fs_free},
+    {PARAM_FS_SIZE, key_fs_size},
+    {PARAM_GATEWAY, key_gateway},
+    {PARAM_HTTP_COMPACT, key_http_compact},
+    {PARAM_HTTP_ON, key_http_on},
+    {PARAM_HTTP_URL, key_http_url},
+    {PARAM_INPUT, key_input},
+    {PARAM_IP, key_ip},
+    {PARAM_LOG_UPLOAD, key_log_upload},
+    {PARAM_MAC_ADDRESS, key_mac_address},
+    {PARAM_MASK, key_mask},
+    {PARAM_MQTT_AUTO_DISCOVERY, key_mqtt_auto_discovery},
+    {PARAM_MQTT_DISCOVERY_TOPIC, key_mqtt_discovery_topic},
+    {PARAM_MQTT_HOST, key_mqtt_host},
+    {PARAM_MQTT_LOGIN, key_mqtt_login},
+    {PARAM_MQTT_ON, key_mqtt_on},
+    {PARAM_MQTT_PASSWORD, key_mqtt_password},
+    {PARAM_MQTT_PORT, key_mqtt_port},
+    {PARAM_MQTT_RETAIN, key_mqtt_retain},
+    {PARAM_MQTT_CHANGED_ONLY, key_mqtt_changed_only},
+    {PARAM_MQTT_TOPIC, key_mqtt_topic},
+    {PARAM_NTP_SERVER, key_ntp_server},
+    {PARAM_NTP_SKIP, key_ntp_skip},
+    {PARAM_PASSWORD, key_password},
+    {PARAM_PERIOD_HI, key_period_hi},
+    {PARAM_PERIOD_LO, key_period_lo},
+    {s_period_min, key_period_min},
+    {PARAM_PLACE, key_place},
+    {PARAM_SERIAL, key_serial},
+    {PARAM_SSID, key_ssid},
+    {PARAM_VERSION, key_version},
+    {PARAM_VERSION_ESP, key_version_esp},
+    {PARAM_WATERIUS_EMAIL, key_waterius_email},
+    {PARAM_WATERIUS_HOST, key_waterius_host},
+    {PARAM_WATERIUS_ON, key_waterius_on},
+    {PARAM_WIFI_CONNECT_STATUS, key_wifi_connect_status},
+    {PARAM_WIFI_PHY_MODE, key_wifi_phy_mode},
+};
 
-    else if (var == FPSTR(s_period_min))
-        return String(sett.wakeup_per_min);
-    
-    else if (var == FPSTR(PARAM_PLACE))
-        return String(sett.place);
-    
-    else if (var == FPSTR(PARAM_COMPANY))
-        return String(sett.company);
-
-    else if (var == FPSTR(PARAM_MQTT_AUTO_DISCOVERY))
-        return template_bool(sett.mqtt_auto_discovery);
-    else if (var == FPSTR(PARAM_MQTT_RETAIN))
-        return template_bool(sett.mqtt_retain);
-    else if (var == FPSTR(PARAM_MQTT_DISCOVERY_TOPIC))
-        return replace_value(sett.mqtt_discovery_topic);
-
-    else if (var == FPSTR(PARAM_NTP_SERVER))
-        return String(sett.ntp_server);
-
-    else if (var == FPSTR(PARAM_SSID))
-        return replace_value(sett.wifi_ssid);
-    else if (var == FPSTR(PARAM_PASSWORD))
-        return sett.wifi_password[0] ? FPSTR(PARAM_ASTERICS) : String();
-
-    else if (var == FPSTR(PARAM_WIFI_PHY_MODE))
-        return String(sett.wifi_phy_mode);
-
-    else if (var == FPSTR(PARAM_WATERIUS_ON))
-        return template_bool(sett.waterius_on);
-    else if (var == FPSTR(PARAM_HTTP_ON))
-        return template_bool(sett.http_on);
-    else if (var == FPSTR(PARAM_MQTT_ON))
-        return template_bool(sett.mqtt_on);
-    else if (var == FPSTR(PARAM_DHCP_OFF))
-        return template_bool(sett.dhcp_off);
-
-    //
-    else if (var == FPSTR(PARAM_BUILD_DATE_TIME))
-        return String(__DATE__) + String(" ") + String(__TIME__);
-    else if (var == FPSTR(PARAM_FS_SIZE))
-        return String(fs_info.totalBytes);
-    else if (var == FPSTR(PARAM_FS_FREE))
-        return String(fs_info.totalBytes - fs_info.usedBytes);
-    else if (var == FPSTR(PARAM_WIFI_CONNECT_STATUS))
-    {   
-        switch (wifi_connect_status)
-        {   
-            case WL_NO_SSID_AVAIL:
-            case WL_CONNECT_FAILED:
-            case WL_CONNECTION_LOST:
-                return String(F("8")); //S_WIFI_CONNECTION_LOST "Ошибка подключения. Попробуйте ещё раз.<br>Если не помогло, то пропишите статический ip. Еще можно зарезервировать MAC адрес Ватериуса в роутере. Если ничего не помогло, пришлите нам <a class='link' href='http://192.168.4.1/ssid.txt'>файл</a> параметров wi-fi сетей.";
-            case WL_WRONG_PASSWORD:
-                return String(F("9")); //S_WL_WRONG_PASSWORD "Ошибка подключения: Некорректный пароль";
-            case WL_IDLE_STATUS:
-                return String(F("10")); //S_WL_IDLE_STATUS "Ошибка подключения: Код 0";
-            case WL_DISCONNECTED:
-                return String(F("11")); //S_WL_DISCONNECTED "Ошибка подключения: Отключен";
-            case WL_NO_SHIELD:
-                return String(F("12")); //S_WL_NO_SHIELD "Ошибка подключения: Код 255";
-            case WL_SCAN_COMPLETED:
-                return String(F("13")); //S_WL_SCAN_COMPLETED "Ошибка подключения: Код 2";
-            case WL_CONNECTED:
-                break;
+/**
+ *  Функция возвращающая текстовое значение параметра по его имени. 
+ *  Используется для отрисовки статических html страниц portal по ключевым словам %keyword% 
+ *  Сравнение строк напрямую с флешем, без временных String на каждый ключ.
+ */
+String processor_main(const String &var, const uint8_t input)
+{   
+    const char *name = var.c_str();
+    size_t lo = 0;
+    size_t hi = sizeof(template_keys) / sizeof(template_keys[0]);
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int cmp = strcmp_P(name, (PGM_P)pgm_read_ptr(&template_keys[mid].name));
+        if (cmp == 0)
+        {
+            String (*value)(const uint8_t) = (String(*)(const uint8_t))pgm_read_ptr(&template_keys[mid].value);
+            return value(input);
         }
-    }    
-
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
     return String();
 }
 
+/*
+ * Первый в списке хэндлеров: отмечает время каждого запроса,
+ * чтобы фоновое сканирование Wi-Fi не приходилось на загрузку страницы
+ */
+class RequestTimeHandler : public AsyncWebHandler
+{
+public:
+    bool canHandle(AsyncWebServerRequest *) override
+    {
+        wifi_scan_touch();
+        return false;
+    }
+};
+
 void onNotFound(AsyncWebServerRequest *request)
 {
     LOG_INFO(F("onNotFound ") << request->host() << request->url());
@@ -324,6 +395,39 @@ void onRedirectIP(AsyncWebServerRequest *request)
     request->redirect(localIPURL);
 }
 
+/*
+ * Статика из /static/ и /images/. Сжатый prepare_data.py файл лежит как name.gz,
+ * AsyncFileResponse сам отдает его с Content-Encoding: gzip. ETag - хэш всего
+ * образа, поэтому после загрузки нового образа браузер скачает файлы заново,
+ * а до этого получает 304 без тела.
+ */
+void on_static(AsyncWebServerRequest *request)
+{
+    if (static_etag.length() && request->hasHeader(F("If-None-Match")) && request->header(F("If-None-Match")) == static_etag)
+    {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader(F("Cache-Control"), F(STATIC_CACHE_CONTROL));
+        response->addHeader(F("ETag"), static_etag);
+        request->send(response);
+        return;
+    }
+
+    const String &path = request->url();
+    if (!LittleFS.exists(path) && !LittleFS.exists(path + F(".gz")))
+    {
+        onNotFound(request);
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(LittleFS, path, String());
+    response->addHeader(F("Cache-Control"), F(STATIC_CACHE_CONTROL));
+    if (static_etag.length())
+    {
+        response->addHeader(F("ETag"), static_etag);
+    }
+    request->send(response);
+}
+
 void on_root(AsyncWebServerRequest *request)
 {
     LOG_INFO(F("on_root GET ") << request->url());
@@ -358,7 +462,7 @@ void on_root(AsyncWebServerRequest *request)
 
 void start_active_point(Settings &sett, CalculatedData &cdata)
 {
-    if (!LittleFS.begin())
+    if (!fs_begin())
     {
         LOG_INFO(F("FS: Mounting LittleFS error"));
         return;
@@ -370,6 +474,14 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
     LOG_INFO(F("FS: ") << fs_info.totalBytes << F(" bytes, size"));
     LOG_INFO(F("FS: ") << fs_info.totalBytes - fs_info.usedBytes << F(" bytes, used"));
 
+    File etag = LittleFS.open(STATIC_ETAG_FILE, "r");
+    if (etag)
+    {
+        static_etag = String('"') + etag.readStringUntil('\n') + '"';
+        etag.close();
+        LOG_INFO(F("FS: static etag ") << static_etag);
+    }
+
     // Если настройки есть в конфиге то присваиваем их
     if (sett.wifi_ssid[0])
     {
@@ -423,6 +535,7 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
     LOG_INFO(F("Start HTTP server"));
     AsyncWebServer *server = new AsyncWebServer(80);
 
+    server->addHandler(new RequestTimeHandler());
     server->onNotFound(onNotFound);
 
     // Главная страница
@@ -455,9 +568,8 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
     server->on("/ncsi.txt", onRedirectIP);            // windows call home
     server->on("/fwlink", HTTP_GET, on_root);          // Microsoft captive portal. 
 
-    // TODO добавить .setLastModified( и  https://github.com/GyverLibs/buildTime/releases/tag/1.0
-    server->serveStatic("/images/", LittleFS, "/images/").setCacheControl("max-age=600");
-    server->serveStatic("/static/", LittleFS, "/static/").setCacheControl("max-age=600");
+    server->on("/images", HTTP_GET, on_static);
+    server->on("/static", HTTP_GET, on_static);
 
     // Об устройстве
     server->on("/about.html", HTTP_GET, [](AsyncWebServerRequest *request)
@@ -534,8 +646,8 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
     server->on("/start.html", HTTP_GET, [](AsyncWebServerRequest *request)
                { request->send(LittleFS, "/start.html", F("text/html"), false, processor); });
 
-    server->on("/waterius_logs.txt", HTTP_GET, [](AsyncWebServerRequest *request)
-               { request->send(LittleFS, "/waterius_logs.txt", F("text/plain")); });
+    // Лог текущего запуска из буфера в RAM
+    server->on("/waterius_logs.txt", HTTP_GET, get_log_text);
 
     // Процесс подключения к Wi-fi
     server->on("/wifi_connect.html", HTTP_GET, [](AsyncWebServerRequest *request)
@@ -567,21 +679,24 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
     server->on("/api/main_status", HTTP_GET, get_api_main_status);                 // Информационные сообщения на главной странице
     server->on("/api/status/0", HTTP_GET, get_api_status_0);                       // Статус 0-го входа (ХВС)  (из setup_cold_welcome.html)
     server->on("/api/status/1", HTTP_GET, get_api_status_1);                       // Статус 1-го входа (ГВС)  (из setup_cold_welcome.html)
+    server->on("/api/logs", HTTP_GET, get_api_logs);                               // Журнал пробуждений (из logs.html)
     server->on("/api/turnoff", HTTP_GET, get_api_turnoff);                         // Выйти из режима настройки
     server->on("/api/reset", HTTP_POST, post_api_reset);                           // Сброс к заводским настройкам
+    api_events_begin(server);                                                      // /api/events: изменения входов (из input_*.html)
 
     server->begin();
 
     LOG_INFO(F("HTTP server started"));
 
     // Начинаем сканирование Wi-Fi сетей
-    LOG_INFO(F("Start scan Wi-Fi networks"));
-    WiFi.scanNetworks(true);
+    wifi_scan_start();
 
     uint16_t start = millis();
     while (!exit_portal_flag && ((millis() - start) / 1000) < SETUP_TIME_SEC)
     {
         dns->processNextRequest();
+        api_events_loop();
+        wifi_scan_loop(start_connect_flag);
         yield();
 
         if (start_connect_flag)
@@ -611,4 +726,5 @@ void start_active_point(Settings &sett, CalculatedData &cdata)
 
     sett.setup_time = millis();
     sett.setup_finished_counter++;
+    energy_reset(sett); // после настройки считаем, что батарейки новые
 };
@@ -1,4 +1,5 @@
 #include "active_point_api.h"
+#include <memory>
 #include <IPAddress.h>
 #include <LittleFS.h>
 
@@ -8,8 +9,12 @@
 #include "utils.h"
 #include "config.h"
 #include "wifi_helpers.h"
+#include "wifi_scan.h"
 #include "resources.h"
 #include "ha/resources.h"
+#include "wake_log.h"
+#include "log_store.h"
+#include "espnow_frame.h"
 
 extern bool exit_portal_flag;
 extern bool start_connect_flag;
@@ -100,32 +105,20 @@ void get_api_networks(AsyncWebServerRequest *request)
 {
     LOG_INFO(F("GET ") << request->url());
 
-    int n = WiFi.scanComplete();
-    if (n == WIFI_SCAN_FAILED)
+    uint8_t count;
+    const WifiNetwork *networks = wifi_scan_results(count);
+
+    g_json_doc.clear();
+    JsonArray array = g_json_doc.to<JsonArray>();
+    for (uint8_t i = 0; i < count; ++i)
     {
-        WiFi.scanNetworks(true);
-        request->send(200, "", F("[]"));
+        JsonObject obj = array.add<JsonObject>();
+        obj["ssid"] = networks[i].ssid;
+        obj["level"] = int(round(map(networks[i].rssi, -100, -50, 1, 4)));
+        obj["wifi_channel"] = WiFi.channel();
     }
-    else if (n)
-    {
-        g_json_doc.clear();
-        JsonArray array = g_json_doc.to<JsonArray>();
-
-        for (int i = 0; i < n; ++i)
-        {
-            LOG_INFO(WiFi.SSID(i) << " " << WiFi.RSSI(i));
-            JsonObject obj = array.add<JsonObject>();
-            obj["ssid"] = WiFi.SSID(i);
-            obj["level"] = int(round(map(WiFi.RSSI(i), -100, -50, 1, 4)));
-            obj["wifi_channel"] = WiFi.channel();
-        }
-
-        write_ssid_to_file();
 
-        WiFi.scanDelete();
-
-        send_json_response(request, g_json_doc);
-    }
+    send_json_response(request, g_json_doc);
 };
 
 /**
@@ -258,18 +251,15 @@ void get_api_status_1(AsyncWebServerRequest *request)
 }
 
 /**
- * @brief Запрос состояния входа
+ * @brief Состояние входа по последним прочитанным данным attiny
  *
- * @param request запрос
+ * @param ret объект json
+ * @param index вход
+ * @param ok данные прочитаны
  */
-void get_api_status(AsyncWebServerRequest *request, const int index)
+static void fill_input_status(JsonObject ret, const int index, const bool ok)
 {
-    LOG_INFO(F("GET ") << request->url());
-
-    g_json_doc.clear();
-    JsonObject ret = g_json_doc.to<JsonObject>();
-
-    if (masterI2C.getAttinyData(runtime_data))
+    if (ok)
     {
         const uint16_t factor_cold = get_auto_factor(runtime_data.impulses1, data.impulses1, sett.factor1, sett.factor1);
 
@@ -291,11 +281,87 @@ void get_api_status(AsyncWebServerRequest *request, const int index)
     {
         ret[F("error")] = F("7"); // S_NO_LINK Ошибка связи с МК
     }
+}
+
+/*
+ * События состояния входов (Server-Sent Events). Пока открыта хотя бы
+ * одна страница, attiny опрашивается из цикла портала раз в EVENTS_POLL_MS,
+ * а страницам уходит событие status0/status1 только при изменении входа.
+ * get_api_status в это время отвечает из кэша MasterI2C, без i2c.
+ */
+#define EVENTS_POLL_MS 250
 
+static AsyncEventSource *events = nullptr;
+static uint32_t events_poll_ms = 0;
+static bool events_poll_ok = false;
+static uint8_t events_sent_ok = 0xFF;
+static uint32_t events_sent_impulses[2];
+
+static void send_input_event(const int index)
+{
+    char buf[80];
+    const char *name = index == INPUT0_RED ? "status0" : "status1";
+
+    g_json_doc.clear();
+    fill_input_status(g_json_doc.to<JsonObject>(), index, events_poll_ok);
+    serializeJson(g_json_doc, buf, sizeof(buf));
+    events->send(buf, name, millis());
+}
+
+void api_events_begin(AsyncWebServer *server)
+{
+    events = new AsyncEventSource(F("/api/events"));
+    events->onConnect([](AsyncEventSourceClient *)
+                      { events_sent_ok = 0xFF; }); // новой странице - текущее состояние
+    server->addHandler(events); // удалит сервер
+}
+
+void api_events_loop()
+{
+    if (!events || !events->count() || millis() - events_poll_ms < EVENTS_POLL_MS)
+    {
+        return;
+    }
+    events_poll_ms = millis();
+    events_poll_ok = masterI2C.getAttinyData(runtime_data);
+
+#if WATERIUS_MODEL == WATERIUS_MODEL_2
+    digitalWrite(CH0_LED_PIN, runtime_data.on_pulse0);
+    digitalWrite(CH1_LED_PIN, runtime_data.on_pulse1);
+#endif
+
+    bool resend = events_sent_ok != (uint8_t)events_poll_ok;
+    events_sent_ok = events_poll_ok;
+    if (resend || runtime_data.impulses0 != events_sent_impulses[0])
+    {
+        send_input_event(INPUT0_RED);
+    }
+    if (resend || runtime_data.impulses1 != events_sent_impulses[1])
+    {
+        send_input_event(INPUT1_BLUE);
+    }
+    events_sent_impulses[0] = runtime_data.impulses0;
+    events_sent_impulses[1] = runtime_data.impulses1;
+}
+
+/**
+ * @brief Запрос состояния входа
+ *
+ * @param request запрос
+ */
+void get_api_status(AsyncWebServerRequest *request, const int index)
+{
+    LOG_INFO(F("GET ") << request->url());
+
+    g_json_doc.clear();
+    JsonObject ret = g_json_doc.to<JsonObject>();
+
+    bool ok = masterI2C.getCachedData(runtime_data, EVENTS_POLL_MS);
 #if WATERIUS_MODEL == WATERIUS_MODEL_2
     digitalWrite(CH0_LED_PIN, runtime_data.on_pulse0);
     digitalWrite(CH1_LED_PIN, runtime_data.on_pulse1);
 #endif
+    fill_input_status(ret, index, ok);
 
     send_json_response(request, g_json_doc);
 };
@@ -379,9 +445,9 @@ void save_param(const AsyncWebParameter *p, char *dest, size_t size, JsonObject
     }
 }
 
-void save_param(const AsyncWebParameter *p, uint16_t &v, JsonObject &errorsObj)
+void save_param(const AsyncWebParameter *p, uint16_t &v, JsonObject &errorsObj, const bool zero_ok)
 {
-    if (p->value().toInt() == 0)
+    if (!zero_ok && p->value().toInt() == 0)
     {
         LOG_ERROR(FPSTR(ERROR_VALUE) << ": " << p->name());
         errorsObj[p->name()] = String(F("15"));  // Неверное значение
@@ -461,6 +527,62 @@ void save_ip_param(const AsyncWebParameter *p, uint32_t &v, JsonObject &errorsOb
     }
 }
 
+// Настройки ESP-NOW на месте бывших Blynk: при первом сохранении там старые данные
+static EspNowConfig &espnow_config()
+{
+    if (sett.espnow.magic != ESPNOW_CONFIG_MAGIC)
+    {
+        sett.espnow = EspNowConfig();
+        sett.espnow.magic = ESPNOW_CONFIG_MAGIC;
+    }
+    return sett.espnow;
+}
+
+void save_espnow_param(const AsyncWebParameter *p, JsonObject &errorsObj)
+{
+    const String &name = p->name();
+    EspNowConfig &config = espnow_config();
+    bool ok = true;
+    if (name == FPSTR(PARAM_ESPNOW_ROLE))
+    {
+        ok = p->value().toInt() <= ESPNOW_ROLE_GATEWAY;
+        if (ok)
+            config.role = p->value().toInt();
+    }
+    else if (name == FPSTR(PARAM_ESPNOW_CHANNEL))
+    {
+        ok = p->value().toInt() <= 14;
+        if (ok)
+            config.channel = p->value().toInt();
+    }
+    else if (name == FPSTR(PARAM_ESPNOW_GATEWAY))
+    {
+        if (p->value().length())
+            ok = espnow_mac_parse(p->value().c_str(), config.gateway);
+        else
+            memset(config.gateway, 0, sizeof(config.gateway));
+    }
+    else if (name == FPSTR(PARAM_ESPNOW_KEY))
+    {
+        if (is_all_asterisks(p->value()))
+        {
+            LOG_INFO(F("NOT ") << FPSTR(PARAM_SAVED) << name << F(" **** value"));
+            return;
+        }
+        ok = espnow_key_parse(p->value().c_str(), config.key);
+    }
+
+    if (ok)
+    {
+        LOG_INFO(FPSTR(PARAM_SAVED) << name);
+    }
+    else
+    {
+        LOG_ERROR(FPSTR(ERROR_VALUE) << ": " << name);
+        errorsObj[name] = String(F("15"));  // Неверное значение
+    }
+}
+
 bool find_wizard_param(AsyncWebServerRequest *request)
 {
     for (size_t i = 0; i < request->params(); i++)
@@ -630,6 +752,14 @@ void applyCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj)
     {
         save_bool_param(p, sett.http_on, errorsObj);
     }
+    else if (name == FPSTR(PARAM_HTTP_COMPACT))
+    {
+        save_bool_param(p, sett.http_compact, errorsObj);
+    }
+    else if (name == FPSTR(PARAM_LOG_UPLOAD))
+    {
+        save_bool_param(p, sett.log_upload, errorsObj);
+    }
     else if (name == FPSTR(PARAM_MQTT_ON))
     {
         save_bool_param(p, sett.mqtt_on, errorsObj);
@@ -642,6 +772,10 @@ void applyCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj)
     {
         save_bool_param(p, sett.mqtt_auto_discovery, errorsObj);
     }
+    else if (name == FPSTR(PARAM_MQTT_CHANGED_ONLY))
+    {
+        save_bool_param(p, sett.mqtt_changed_only, errorsObj);
+    }
 }
 
 void applyNonCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj)
@@ -664,6 +798,8 @@ void applyNonCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj
         if (name == FPSTR(PARAM_HTTP_URL))
         {
             save_param(p, sett.http_url, HOST_LEN, errorsObj);
+            sett.http_static_crc = 0; // новый сервер должен получить все поля
+            sett.config_rev = 0;      // и прислать свои настройки
         }
     }
 
@@ -720,6 +856,29 @@ void applyNonCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj
         save_param(p, sett.wakeup_per_min, errorsObj);
         reset_period_min_tuned(sett);
     }
+    else if (name == FPSTR(PARAM_PERIOD_LO))
+    {
+        save_param(p, sett.wakeup_per_min_lo, errorsObj, true);
+    }
+    else if (name == FPSTR(PARAM_PERIOD_HI))
+    {
+        save_param(p, sett.wakeup_per_min_hi, errorsObj, true);
+    }
+    else if (name == FPSTR(PARAM_WAKE_SLOT))
+    {
+        // Минуты сдвига, как в отправляемом wake_slot; -1 - по chip id
+        long slot = p->value().toInt();
+        if (slot < -1 || slot >= 0xFFFF)
+        {
+            LOG_ERROR(FPSTR(ERROR_VALUE) << ": " << p->name());
+            errorsObj[p->name()] = String(F("15"));  // Неверное значение
+        }
+        else
+        {
+            sett.wakeup_slot = slot + 1;
+            LOG_INFO(FPSTR(PARAM_SAVED) << p->name() << F("=") << slot);
+        }
+    }
     else if (name == FPSTR(s_voltage_cal))
     {
         save_param(p, sett.voltage_cal, errorsObj);
@@ -728,6 +887,11 @@ void applyNonCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj
     {
         save_param(p, sett.ntp_server, HOST_LEN, errorsObj);
     }
+    else if (name == FPSTR(PARAM_NTP_SKIP))
+    {
+        save_param(p, sett.ntp_skip_period, errorsObj, true);
+        sett.ntp_skip_count = 0;
+    }
     else if (name == FPSTR(PARAM_SSID))
     {
         save_param(p, sett.wifi_ssid, WIFI_SSID_LEN, errorsObj);
@@ -741,6 +905,10 @@ void applyNonCheckBoxParameter(const AsyncWebParameter *p, JsonObject &errorsObj
     {
         save_param(p, sett.wifi_phy_mode, errorsObj, true);
     }
+    else if (name.startsWith(F("espnow_")))
+    {
+        save_espnow_param(p, errorsObj);
+    }
     else if (name == FPSTR(PARAM_COMPANY))
     {
         save_param(p, sett.company, COMPANY_LEN, errorsObj, false);
@@ -849,6 +1017,47 @@ void post_api_save_input_type(AsyncWebServerRequest *request)
     send_json_response(request, g_json_doc);
 }
 
+/**
+ * @brief Журнал пробуждений
+ *
+ * @param request запрос
+ */
+void get_api_logs(AsyncWebServerRequest *request)
+{
+    LOG_INFO(F("GET ") << request->url());
+
+    g_json_doc.clear();
+    JsonObject ret = g_json_doc.to<JsonObject>();
+    ret[F("reset_reason")] = ESP.getResetReason();
+    wake_log_fill_json(ret);
+
+    LOG_INFO(F("JSON: Size: ") << measureJson(g_json_doc));
+
+    send_json_response(request, g_json_doc);
+}
+
+/**
+ * @brief Лог пробуждений с ошибками с LittleFS и текущего запуска.
+ * Отдается частями по мере чтения, целиком в памяти не собирается.
+ *
+ * @param request запрос
+ */
+void get_log_text(AsyncWebServerRequest *request)
+{
+    std::shared_ptr<LogStoreReader> reader = std::make_shared<LogStoreReader>();
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        "text/plain", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+        { return reader->read(buffer, maxLen); });
+    if (response)
+    {
+        request->send(response);
+    }
+    else
+    {
+        request->send(503);
+    }
+}
+
 void get_api_turnoff(AsyncWebServerRequest *request)
 {
     LOG_INFO(F("GET ") << request->url());
@@ -16,11 +16,12 @@
 
 
 void save_param(const AsyncWebParameter *p, char *dest, size_t size, JsonObject &errorsObj, bool required = true);
-void save_param(const AsyncWebParameter *p, uint16_t &v, JsonObject &errorsObj);
+void save_param(const AsyncWebParameter *p, uint16_t &v, JsonObject &errorsObj, const bool zero_ok = false);
 void save_param(const AsyncWebParameter *p, uint8_t &v, JsonObject &errorsObj, const bool zero_ok = false);
 void save_bool_param(const AsyncWebParameter *p, uint8_t &v, JsonObject &errorsObj);
 void save_param(const AsyncWebParameter *p, float &v, JsonObject &errorsObj);
 void save_ip_param(const AsyncWebParameter *p, uint32_t &v, JsonObject &errorsObj);
+void save_espnow_param(const AsyncWebParameter *p, JsonObject &errorsObj);
 
 bool find_wizard_param(AsyncWebServerRequest *request);
 void applyInputParameter(const AsyncWebParameter *p, JsonObject &errorsObj, const uint8_t input);
@@ -38,7 +39,11 @@ void get_api_main_status(AsyncWebServerRequest *request);
 void get_api_status_0(AsyncWebServerRequest *request);
 void get_api_status_1(AsyncWebServerRequest *request);
 void get_api_status(AsyncWebServerRequest *request, const int index);
+void api_events_begin(AsyncWebServer *server);
+void api_events_loop();
 void post_api_save(AsyncWebServerRequest *request);
+void get_api_logs(AsyncWebServerRequest *request);
+void get_log_text(AsyncWebServerRequest *request);
 void get_api_turnoff(AsyncWebServerRequest *request);
 void post_api_reset(AsyncWebServerRequest *request);
 
@@ -25,13 +25,24 @@ static const char PARAM_PLACE[] PROGMEM = "place";
 static const char PARAM_MQTT_AUTO_DISCOVERY[] PROGMEM = "mqtt_auto_discovery";
 static const char PARAM_MQTT_DISCOVERY_TOPIC[] PROGMEM = "mqtt_discovery_topic";
 static const char PARAM_MQTT_RETAIN[] PROGMEM = "mqtt_retain";
+static const char PARAM_MQTT_CHANGED_ONLY[] PROGMEM = "mqtt_changed_only";
 static const char PARAM_NTP_SERVER[] PROGMEM = "ntp_server";
+static const char PARAM_NTP_SKIP[] PROGMEM = "ntp_skip";
+static const char PARAM_PERIOD_LO[] PROGMEM = "period_lo";
+static const char PARAM_WAKE_SLOT[] PROGMEM = "wake_slot";
+static const char PARAM_PERIOD_HI[] PROGMEM = "period_hi";
 static const char PARAM_SSID[] PROGMEM = "ssid";
 static const char PARAM_PASSWORD[] PROGMEM = "password";
 static const char PARAM_WIFI_PHY_MODE[] PROGMEM = "wifi_phy_mode";
+static const char PARAM_ESPNOW_ROLE[] PROGMEM = "espnow_role";
+static const char PARAM_ESPNOW_GATEWAY[] PROGMEM = "espnow_gateway";
+static const char PARAM_ESPNOW_CHANNEL[] PROGMEM = "espnow_channel";
+static const char PARAM_ESPNOW_KEY[] PROGMEM = "espnow_key";
 
 static const char PARAM_WATERIUS_ON[] PROGMEM = "waterius_on";
 static const char PARAM_HTTP_ON[] PROGMEM = "http_on";
+static const char PARAM_HTTP_COMPACT[] PROGMEM = "http_compact";
+static const char PARAM_LOG_UPLOAD[] PROGMEM = "log_upload";
 static const char PARAM_MQTT_ON[] PROGMEM = "mqtt_on";
 static const char PARAM_DHCP_OFF[] PROGMEM = "dhcp_off";
 
@@ -0,0 +1,135 @@
+#include "wifi_scan.h"
+#include <ESP8266WiFi.h>
+#include "Logging.h"
+#include "wifi_helpers.h"
+
+static WifiNetwork networks[WIFI_SCAN_MAX_NETWORKS];
+static uint8_t networks_count = 0;
+static bool scanned = false;
+static bool scanning = false;
+static bool wanted = false;
+static uint32_t scan_ms = 0;
+static uint32_t request_ms = 0;
+
+static void remove_network(const uint8_t index)
+{
+    memmove(&networks[index], &networks[index + 1], (networks_count - index - 1) * sizeof(WifiNetwork));
+    networks_count--;
+}
+
+static void add_network(const char *ssid, const int8_t rssi)
+{
+    for (uint8_t i = 0; i < networks_count; i++)
+    {
+        if (strcmp(networks[i].ssid, ssid) == 0)
+        {
+            if (networks[i].rssi >= rssi)
+            {
+                return;
+            }
+            remove_network(i);
+            break;
+        }
+    }
+
+    uint8_t pos = networks_count;
+    while (pos > 0 && networks[pos - 1].rssi < rssi)
+    {
+        pos--;
+    }
+    if (pos >= WIFI_SCAN_MAX_NETWORKS)
+    {
+        return;
+    }
+    if (networks_count == WIFI_SCAN_MAX_NETWORKS)
+    {
+        networks_count--;
+    }
+    memmove(&networks[pos + 1], &networks[pos], (networks_count - pos) * sizeof(WifiNetwork));
+    strcpy(networks[pos].ssid, ssid);
+    networks[pos].rssi = rssi;
+    networks_count++;
+}
+
+static void store_results(const int n)
+{
+    networks_count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const bss_info *it = WiFi.getScanInfoByIndex(i);
+        if (!it || !it->ssid_len)
+        {
+            continue; // скрытая сеть: в списке ее не выбрать
+        }
+        char ssid[33];
+        uint8_t len = _min(it->ssid_len, (uint8_t)32);
+        memcpy(ssid, it->ssid, len);
+        ssid[len] = 0;
+        add_network(ssid, it->rssi);
+    }
+}
+
+void wifi_scan_start()
+{
+    if (scanning)
+    {
+        return;
+    }
+    LOG_INFO(F("SCAN: start"));
+    WiFi.scanNetworks(true);
+    scanning = true;
+}
+
+void wifi_scan_loop(const bool busy)
+{
+    if (scanning)
+    {
+        int n = WiFi.scanComplete();
+        if (n == WIFI_SCAN_RUNNING)
+        {
+            return;
+        }
+        scanning = false;
+        scan_ms = millis();
+        if (n >= 0)
+        {
+            store_results(n);
+            scanned = true;
+            write_ssid_to_file();
+            LOG_INFO(F("SCAN: found ") << n << F(", listed ") << networks_count);
+        }
+        else
+        {
+            LOG_ERROR(F("SCAN: failed"));
+        }
+        WiFi.scanDelete();
+        return;
+    }
+
+    if (busy || !wanted)
+    {
+        return;
+    }
+    if (scanned && millis() - scan_ms < WIFI_SCAN_MAX_AGE_MS)
+    {
+        return;
+    }
+    if (millis() - request_ms < WIFI_SCAN_QUIET_MS)
+    {
+        return;
+    }
+    wanted = false;
+    wifi_scan_start();
+}
+
+void wifi_scan_touch()
+{
+    request_ms = millis();
+}
+
+const WifiNetwork *wifi_scan_results(uint8_t &count)
+{
+    wanted = true;
+    count = networks_count;
+    return networks;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file wifi_scan.h
+ * @brief Фоновое сканирование Wi-Fi сетей для портала настройки
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Во время сканирования точка доступа ESP замолкает, поэтому /api/networks
+ * отвечает из последнего результата, а новое сканирование запускается из
+ * цикла портала: только если список спрашивали, он устарел и к порталу
+ * WIFI_SCAN_QUIET_MS не было запросов. Сети хранятся без повторов
+ * (из нескольких точек одной сети - самая сильная) по убыванию RSSI.
+ */
+#ifndef WIFI_SCAN_H_
+#define WIFI_SCAN_H_
+
+#include <Arduino.h>
+
+#ifndef WIFI_SCAN_MAX_NETWORKS
+#define WIFI_SCAN_MAX_NETWORKS 20 // в списке; самые слабые сверх отбрасываются
+#endif
+#ifndef WIFI_SCAN_MAX_AGE_MS
+#define WIFI_SCAN_MAX_AGE_MS 30000UL // старший список обновляется, если его спрашивают
+#endif
+#ifndef WIFI_SCAN_QUIET_MS
+#define WIFI_SCAN_QUIET_MS 1500UL // пауза в запросах к порталу перед сканированием
+#endif
+
+struct WifiNetwork
+{
+    char ssid[33];
+    int8_t rssi;
+};
+
+/**
+ * @brief Запускает сканирование сразу (при старте портала)
+ */
+extern void wifi_scan_start();
+
+/**
+ * @brief Забирает готовый результат и при необходимости запускает
+ * новое сканирование. Вызывается из цикла портала.
+ *
+ * @param busy идет подключение к роутеру, сканировать нельзя
+ */
+extern void wifi_scan_loop(const bool busy);
+
+/**
+ * @brief Отмечает запрос к порталу: сканирование откладывается
+ */
+extern void wifi_scan_touch();
+
+/**
+ * @brief Сети последнего сканирования. Заодно отмечает, что список нужен:
+ * устаревший будет обновлен в фоне.
+ *
+ * @param count количество сетей
+ * @return массив сетей по убыванию RSSI
+ */
+extern const WifiNetwork *wifi_scan_results(uint8_t &count);
+
+#endif
@@ -0,0 +1,150 @@
+#include "profiler.h"
+#include "Logging.h"
+#include "cpu_boost.h"
+#ifdef MMU_IRAM_HEAP
+#include <umm_malloc/umm_heap_select.h>
+#endif
+#ifdef UMM_STATS_FULL
+#include <umm_malloc/umm_malloc.h>
+#endif
+
+// Ключи json, порядок как в ProfilerPhase
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    "i2c", "wifi", "mqtt", "ntp", "send", "ota", "off"};
+
+static uint32_t phase_start_us[PHASE_COUNT] = {0};
+static uint32_t phase_total_us[PHASE_COUNT] = {0};
+static uint32_t boot_us = 0; // начало первой фазы
+static ProfilerPhase current_phase = PHASE_COUNT;
+static uint32_t heap_min = UINT32_MAX;
+static uint32_t iram_min = UINT32_MAX;
+
+// Минимум свободной памяти выбранной кучи
+static uint32_t free_heap_min()
+{
+#ifdef UMM_STATS_FULL
+    return umm_free_heap_size_min(); // точная нижняя граница, а не замер в конце фазы
+#else
+    return ESP.getFreeHeap();
+#endif
+}
+
+static void sample_heaps()
+{
+    heap_min = _min(heap_min, free_heap_min());
+#ifdef MMU_IRAM_HEAP
+    HeapSelectIram iram;
+    iram_min = _min(iram_min, free_heap_min());
+#endif
+}
+
+static inline uint16_t saturate_ms(uint32_t ms)
+{
+    return ms > 0xFFFF ? 0xFFFF : (uint16_t)ms;
+}
+
+void profiler_start(ProfilerPhase phase)
+{
+    phase_start_us[phase] = micros();
+    current_phase = phase;
+    if (!boot_us)
+    {
+        boot_us = phase_start_us[phase];
+    }
+}
+
+void profiler_stop(ProfilerPhase phase)
+{
+    if (phase_start_us[phase])
+    {
+        // фаза может быть вызвана несколько раз за цикл (повторная отправка), суммируем
+        phase_total_us[phase] += micros() - phase_start_us[phase];
+        phase_start_us[phase] = 0;
+    }
+    if (phase == current_phase)
+    {
+        // фазы могут перекрываться (NTP в фоне): текущей становится последняя начатая из оставшихся
+        current_phase = PHASE_COUNT;
+        uint32_t now = micros();
+        for (uint8_t i = 0; i < PHASE_COUNT; i++)
+        {
+            if (phase_start_us[i] && (current_phase == PHASE_COUNT ||
+                                      now - phase_start_us[i] < now - phase_start_us[current_phase]))
+            {
+                current_phase = (ProfilerPhase)i;
+            }
+        }
+    }
+    sample_heaps();
+}
+
+ProfilerPhase profiler_current()
+{
+    return current_phase;
+}
+
+const char *profiler_phase_name(ProfilerPhase phase)
+{
+    return phase < PHASE_COUNT ? PHASE_NAMES[phase] : "none";
+}
+
+void profiler_cycle(ProfilerCycle &cycle)
+{
+    for (uint8_t i = 0; i < PHASE_COUNT; i++)
+    {
+        cycle.phase_ms[i] = saturate_ms(phase_total_us[i] / 1000);
+    }
+    cycle.total_ms = saturate_ms(millis());
+}
+
+uint32_t profiler_boot_ms()
+{
+    return boot_us / 1000;
+}
+
+uint32_t profiler_heap_min()
+{
+    sample_heaps();
+    return heap_min;
+}
+
+uint32_t profiler_iram_min()
+{
+#ifdef MMU_IRAM_HEAP
+    sample_heaps();
+    return iram_min;
+#else
+    return 0;
+#endif
+}
+
+void profiler_log()
+{
+    ProfilerCycle cycle;
+    profiler_cycle(cycle);
+
+    LOG_INFO(F("PROF: boot=") << profiler_boot_ms()
+                             << F(" i2c=") << cycle.phase_ms[PHASE_I2C]
+                             << F(" wifi=") << cycle.phase_ms[PHASE_WIFI]
+                             << F(" mqtt=") << cycle.phase_ms[PHASE_MQTT]
+                             << F(" ntp=") << cycle.phase_ms[PHASE_NTP]
+                             << F(" send=") << cycle.phase_ms[PHASE_SEND]
+                             << F(" ota=") << cycle.phase_ms[PHASE_OTA]
+                             << F(" off=") << cycle.phase_ms[PHASE_SHUTDOWN]
+                             << F(" boost=") << cpu_boost_ms()
+                             << F(" total=") << cycle.total_ms
+                             << F(" dram_min=") << profiler_heap_min()
+                             << F(" iram_min=") << profiler_iram_min());
+}
+
+void profiler_fill_json(JsonObject &root)
+{
+    JsonObject timing = root[F("timing")].to<JsonObject>();
+    for (uint8_t i = 0; i < PHASE_COUNT; i++)
+    {
+        timing[PHASE_NAMES[i]] = saturate_ms(phase_total_us[i] / 1000);
+    }
+    timing[F("boot")] = profiler_boot_ms();
+    timing[F("total")] = millis();
+    timing[F("boost")] = cpu_boost_ms(); // из них на CPU_BOOST_MHZ, пересекается с фазами
+}
@@ -0,0 +1,96 @@
+/**
+ * @file profiler.h
+ * @brief Профайлер фаз цикла пробуждения
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Замеряет сколько миллисекунд заняла каждая фаза цикла (i2c, wifi, mqtt, ntp,
+ * отправка, ota, выключение wifi). Время фаз текущего цикла передается в
+ * объекте "timing" json. Историю циклов ведет сервер по этим данным, а циклы
+ * с ошибкой сохраняет wake_log: attiny снимает питание ESP после сна, и
+ * хранить историю в RTC памяти бесполезно.
+ * "boot" - время от старта ESP до первой фазы (i2c): загрузка SDK, статические
+ * конструкторы и setup(). Подсистемы, не нужные при передаче (LittleFS,
+ * портал), поднимаются при первом обращении и в него не входят.
+ */
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+enum ProfilerPhase : uint8_t
+{
+    PHASE_I2C = 0,
+    PHASE_WIFI,
+    PHASE_MQTT,
+    PHASE_NTP,
+    PHASE_SEND,
+    PHASE_OTA,
+    PHASE_SHUTDOWN,
+    PHASE_COUNT
+};
+
+/**
+ * @brief Время фаз одного цикла, мс (насыщение 65535)
+ *
+ */
+struct ProfilerCycle
+{
+    uint16_t phase_ms[PHASE_COUNT];
+    uint16_t total_ms; // время от старта ESP до засыпания
+};
+
+extern void profiler_start(ProfilerPhase phase);
+extern void profiler_stop(ProfilerPhase phase);
+
+/**
+ * @brief Фаза, которая идет сейчас: последняя начатая из незавершенных.
+ * PHASE_COUNT - между фазами.
+ */
+extern ProfilerPhase profiler_current();
+
+/**
+ * @brief Ключ фазы в json, "none" для PHASE_COUNT
+ */
+extern const char *profiler_phase_name(ProfilerPhase phase);
+
+/**
+ * @brief Время фаз текущего цикла
+ *
+ * @param cycle результат, total_ms - время с момента старта ESP
+ */
+extern void profiler_cycle(ProfilerCycle &cycle);
+
+/**
+ * @brief Время от старта ESP до начала первой фазы цикла, мс
+ */
+extern uint32_t profiler_boot_ms();
+
+/**
+ * @brief Минимальная свободная куча DRAM, замеренная в конце фаз цикла, байт.
+ * Со сборкой UMM_STATS_FULL - точный минимум за пробуждение.
+ */
+extern uint32_t profiler_heap_min();
+
+/**
+ * @brief То же для второй кучи IRAM (heap_policy.h), 0 - сборка без нее
+ */
+extern uint32_t profiler_iram_min();
+
+/**
+ * @brief Выводит в лог время фаз текущего цикла.
+ * Вызывается перед засыпанием.
+ */
+extern void profiler_log();
+
+/**
+ * @brief Добавляет объект "timing": время уже завершенных фаз текущего цикла
+ *
+ * @param root корневой объект json
+ */
+extern void profiler_fill_json(JsonObject &root);
+
+#endif
@@ -3,43 +3,300 @@
 #include "senders/sender_waterius.h"
 #include "senders/sender_http.h"
 #include "senders/sender_mqtt.h"
+#include "senders/sender_coap.h"
+#include "offline_queue.h"
+#include "async_http.h"
+#include "https_helpers.h"
+#include "cpu_boost.h"
+#include "json_arena.h"
 
 
-void send_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data, JsonDocument &json_settings)
+SendResults send_results;
+
+static void set_result(SendResult &result, bool ok, uint32_t start_time)
 {
-    // Формироуем JSON
-    get_json_data(sett, data, cdata, json_data);
+    result.status = ok ? SEND_OK : SEND_FAIL;
+    result.ms = millis() - start_time;
+}
+
+static const __FlashStringHelper *status_title(const SendResult &result)
+{
+    switch (result.status)
+    {
+    case SEND_OK:
+        return F("OK");
+    case SEND_FAIL:
+        return F("FAIL");
+    default:
+        return F("SKIP");
+    }
+}
+
+// Запоминает самую долгую просьбу сервера подождать
+static void note_retry_after(const uint32_t retry_after)
+{
+    send_results.retry_after = _max(send_results.retry_after, retry_after);
+}
+
+// Отмечает направление, ответ которого добавил настройки
+static void note_settings(const JsonDocument &json_settings, size_t &count, const uint8_t from)
+{
+    if (json_settings.size() != count)
+    {
+        send_results.settings_from |= from;
+        count = json_settings.size();
+    }
+}
+
+bool send_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data, JsonDocument &json_settings)
+{
+    uint32_t start_time = millis();
+    send_results = SendResults();
+
+    // До отправки настройки приходят только из подписки mqtt
+    size_t settings_count = 0;
+    note_settings(json_settings, settings_count, SETTINGS_FROM_MQTT);
+
+    {
+        CpuBoost boost;
+
+        // Формироуем JSON
+        get_json_data(sett, data, cdata, json_data);
+
+        // Неотправленные ранее показания уходят в этом же запросе
+        offline_queue_fill_json(sett, json_data);
+    }
 
 
     LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
 
+    // Отправки по http запускаем сразу все, они идут в фоне,
+    // пока выполняются блокирующие отправки по https и mqtt
+    String payload;
+    bool waterius_async = false;
+    bool http_async = false;
+#ifndef WATERIUS_RU_DISABLED
+    AsyncHttpPost waterius_post;
+    waterius_async = is_waterius_site(sett) && !is_https(sett.waterius_host);
+#endif
+#ifndef HTTPS_DISABLED
+    AsyncHttpPost http_post;
+    http_async = sett.http_on && sett.http_url[0] && !is_https(sett.http_url) && !is_coap(sett.http_url) && !sett.http_compact;
+#endif
+    if (waterius_async || http_async)
+    {
+        serializeJson(json_data, payload);
+    }
 #ifndef WATERIUS_RU_DISABLED
-    if (send_waterius(sett, json_data, json_settings))
+    if (waterius_async)
     {
-        LOG_INFO(F("HTTP: Send OK"));
+        waterius_async = waterius_post.begin(sett.waterius_host, sett.waterius_key, sett.waterius_email, payload);
+    }
+#endif
+#ifndef HTTPS_DISABLED
+    if (http_async)
+    {
+        http_async = http_post.begin(sett.http_url, sett.waterius_key, sett.waterius_email, payload);
+    }
+#endif
+
+#ifndef COAP_DISABLED
+    // Один обмен датаграммами, пока фоновые запросы http в пути
+    if (is_http(sett) && is_coap(sett.http_url))
+    {
+        uint32_t coap_start = millis();
+        set_result(send_results.http, send_coap(sett, json_data, json_settings, send_results.http_static_crc), coap_start);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_HTTP);
+    }
+#endif
+
+#ifndef WATERIUS_RU_DISABLED
+    if (!waterius_async && is_waterius_site(sett))
+    {
+        uint32_t waterius_start = millis();
+        set_result(send_results.waterius, send_waterius(sett, json_data, json_settings), waterius_start);
+        note_retry_after(http_retry_after);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_WATERIUS);
     }
 #endif
 
 #ifndef HTTPS_DISABLED
-    if (send_http(sett, json_data, json_settings))
+    if (!http_async && sett.http_on && sett.http_url[0] && !is_coap(sett.http_url))
     {
-        LOG_INFO(F("HTTP: Send OK"));
+        uint32_t http_start = millis();
+        set_result(send_results.http, send_http(sett, json_data, json_settings, send_results.http_static_crc), http_start);
+        note_retry_after(http_retry_after);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_HTTP);
     }
 #endif
 
 #ifndef MQTT_DISABLED
     if (is_mqtt(sett))
     {
-        if (send_mqtt(sett, json_data))
-        {
-            LOG_INFO(F("MQTT: Send OK"));
-        }
+        uint32_t mqtt_start = millis();
+        set_result(send_results.mqtt, send_mqtt(sett, json_data), mqtt_start);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_MQTT);
     }
     else
     {
         LOG_INFO(F("MQTT: SKIP"));
     }
 #endif
+
+    // Дожидаемся фоновых отправок. Повторяем обычным способом, только если
+    // запрос не начали передавать: иначе сервер мог принять показания дважды
+#ifndef WATERIUS_RU_DISABLED
+    if (waterius_async)
+    {
+        bool ok = waterius_post.wait(SERVER_TIMEOUT);
+        uint32_t retry_after = waterius_post.retry_after();
+        if (ok)
+        {
+            parse_settings_response(waterius_post.body(), json_settings);
+        }
+        else if (!retry_after && !waterius_post.request_started())
+        {
+            ok = send_waterius(sett, json_data, json_settings);
+            retry_after = http_retry_after;
+        }
+        note_retry_after(retry_after);
+        set_result(send_results.waterius, ok, start_time);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_WATERIUS);
+    }
+#endif
+#ifndef HTTPS_DISABLED
+    if (http_async)
+    {
+        bool ok = http_post.wait(SERVER_TIMEOUT);
+        uint32_t retry_after = http_post.retry_after();
+        if (ok)
+        {
+            parse_settings_response(http_post.body(), json_settings);
+        }
+        else if (!retry_after && !http_post.request_started())
+        {
+            ok = send_http(sett, json_data, json_settings, send_results.http_static_crc);
+            retry_after = http_retry_after;
+        }
+        note_retry_after(retry_after);
+        set_result(send_results.http, ok, start_time);
+        note_settings(json_settings, settings_count, SETTINGS_FROM_HTTP);
+    }
+#endif
+
+    // Подсказка в ответе 200 (принято, но следующую отправку отложить) - не настройка,
+    // подтверждать ее не нужно
+    if (json_settings.containsKey(F("retry_after")))
+    {
+        note_retry_after(_min(json_settings[F("retry_after")].as<uint32_t>(), HTTP_RETRY_AFTER_MAX));
+        json_settings.remove(F("retry_after"));
+    }
+
+    LOG_INFO(F("SEND: waterius=") << status_title(send_results.waterius) << F(" ") << send_results.waterius.ms
+                                  << F(" ms, http=") << status_title(send_results.http) << F(" ") << send_results.http.ms
+                                  << F(" ms, mqtt=") << status_title(send_results.mqtt) << F(" ") << send_results.mqtt.ms
+                                  << F(" ms, total ") << millis() - start_time << F(" ms"));
+
+    return send_results.waterius.status == SEND_OK ||
+           send_results.http.status == SEND_OK ||
+           send_results.mqtt.status == SEND_OK;
+}
+
+bool send_batch(Settings &sett, const JsonDocument &json_batch)
+{
+    bool sent = false;
+#ifndef HTTPS_DISABLED
+    if (sett.http_on && sett.http_url[0])
+    {
+        JsonDocument json_settings(&json_arena); // ответ сервера шлюзу не применяется
+#ifndef COAP_DISABLED
+        if (is_coap(sett.http_url))
+        {
+            sent |= coap_post(String(sett.http_url), sett.waterius_key, sett.waterius_email, json_batch, json_settings);
+        }
+        else
+#endif
+        {
+            sent |= post_data(String(sett.http_url), sett.waterius_key, sett.waterius_email, json_batch, json_settings);
+        }
+    }
+#endif
+#ifndef MQTT_DISABLED
+    if (is_mqtt(sett))
+    {
+        JsonDocument json_settings(&json_arena);
+        if (connect_and_subscribe_mqtt(sett, json_settings))
+        {
+            String topic = sett.mqtt_topic;
+            remove_trailing_slash(topic);
+            publish_json(mqtt_client, topic + F("/espnow"), json_batch);
+            mqtt_client.loop();
+            sent |= wifi_client.flush(MQTT_FLUSH_TIMEOUT);
+            mqtt_client.disconnect();
+        }
+    }
+#endif
+    LOG_INFO(F("SEND: batch ") << (sent ? F("OK") : F("FAIL")));
+    return sent;
+}
+
+// Поля, по которым сервер узнает устройство
+static const char ACK_KEYS[] PROGMEM = ",key,email,esp_id,version_esp,";
+
+bool send_settings_ack(Settings &sett, const AttinyData &data, const CalculatedData &cdata, const JsonDocument &json_data, JsonDocument &json_settings)
+{
+    uint32_t start_time = millis();
+    uint8_t from = send_results.settings_from;
+
+    JsonDocument fresh(&json_arena);
+    JsonDocument changed(&json_arena);
+    {
+        CpuBoost boost;
+        get_json_data(sett, data, cdata, fresh);
+
+        String keys = FPSTR(ACK_KEYS);
+        for (JsonPairConst kv : fresh.as<JsonObjectConst>())
+        {
+            String needle = String(',') + kv.key().c_str() + ',';
+            if (keys.indexOf(needle) >= 0 || json_data[kv.key()] != kv.value())
+            {
+                changed[kv.key()] = kv.value();
+            }
+        }
+    }
+    LOG_INFO(F("ACK: ") << changed.size() << F(" of ") << fresh.size() << F(" fields, to 0x") << String(from, HEX));
+
+    bool sent = false;
+#ifndef MQTT_DISABLED
+    if ((from & SETTINGS_FROM_MQTT) && is_mqtt(sett) && connect_and_subscribe_mqtt(sett, json_settings))
+    {
+        sent |= send_mqtt(sett, sett.mqtt_auto_discovery ? fresh : changed);
+    }
+#endif
+    changed[F("settings_applied")] = true;
+#ifndef WATERIUS_RU_DISABLED
+    if ((from & SETTINGS_FROM_WATERIUS) && is_waterius_site(sett))
+    {
+        sent |= post_data(String(sett.waterius_host), sett.waterius_key, sett.waterius_email, changed, json_settings);
+    }
+#endif
+#ifndef HTTPS_DISABLED
+    if ((from & SETTINGS_FROM_HTTP) && is_http(sett))
+    {
+#ifndef COAP_DISABLED
+        if (is_coap(sett.http_url))
+        {
+            sent |= coap_post(String(sett.http_url), sett.waterius_key, sett.waterius_email, changed, json_settings);
+        }
+        else
+#endif
+        {
+            sent |= post_data(String(sett.http_url), sett.waterius_key, sett.waterius_email, changed, json_settings);
+        }
+    }
+#endif
+    LOG_INFO(F("ACK: ") << (sent ? F("OK") : F("FAIL")) << F(" ") << millis() - start_time << F(" ms"));
+    return sent;
 }
 
 bool settings_received(const JsonDocument &json_settings_received)
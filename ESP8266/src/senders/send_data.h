@@ -5,9 +5,70 @@
 #include <ArduinoJson.h>
 #include "master_i2c.h"
 
-void send_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data, JsonDocument &json_settings);
+enum SendStatus : uint8_t
+{
+    SEND_SKIP = 0,
+    SEND_OK,
+    SEND_FAIL
+};
+
+// Откуда пришли настройки: туда уходит подтверждение
+#define SETTINGS_FROM_WATERIUS 0x01
+#define SETTINGS_FROM_HTTP 0x02
+#define SETTINGS_FROM_MQTT 0x04
+
+struct SendResult
+{
+    SendStatus status = SEND_SKIP;
+    uint32_t ms = 0; // время от начала отправки до результата
+};
+
+/**
+ * @brief Результаты последней отправки по каждому направлению
+ *
+ */
+struct SendResults
+{
+    SendResult waterius;
+    SendResult http;
+    SendResult mqtt;
+    uint32_t http_static_crc = 0; // crc статических полей, отправленных на http_url в компактном формате
+    uint8_t settings_from = 0;    // SETTINGS_FROM_*
+    uint32_t retry_after = 0;     // сервер просил отложить следующую отправку, с (429/503 или retry_after в ответе)
+};
+
+extern SendResults send_results;
+
+/**
+ * @brief Отправляет показания во все включенные интеграции.
+ * Запросы по http запускаются одновременно в фоне, https и mqtt идут следом.
+ *
+ * @return true если хотя бы одна отправка удалась
+ */
+bool send_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data, JsonDocument &json_settings);
 bool settings_received(const JsonDocument &json_settings_received);
 
+/**
+ * @brief Подтверждает примененные настройки вместо повторной полной отправки:
+ * только тем направлениям, от которых они пришли (send_results.settings_from),
+ * и только поля, изменившиеся относительно отправленного json_data
+ * (плюс key, email, esp_id и "settings_applied": true). В Home Assistant
+ * шаблоны читают весь json, поэтому в единый топик он публикуется целиком.
+ *
+ * @param json_data документ первой отправки
+ * @param json_settings настройки; ответы серверов добавляются в него (например, OTA)
+ * @return true если хотя бы одна отправка удалась
+ */
+bool send_settings_ack(Settings &sett, const AttinyData &data, const CalculatedData &cdata, const JsonDocument &json_data, JsonDocument &json_settings);
+
+/**
+ * @brief Пересылает готовый документ (пакет кадров шлюза ESP-NOW) на http_url
+ * и в топик <mqtt_topic>/espnow. Ответ сервера не применяется.
+ *
+ * @return true если хотя бы одна отправка удалась
+ */
+bool send_batch(Settings &sett, const JsonDocument &json_batch);
+
 inline bool has_ota(const JsonDocument &json_settings_received)
 {
     return json_settings_received.containsKey(F("ota"));
@@ -15,6 +76,7 @@ inline bool has_ota(const JsonDocument &json_settings_received)
 
 #ifndef MQTT_DISABLED
 bool connect_and_subscribe_mqtt(Settings &sett, JsonDocument &json_settings_received);
+bool monitor_mqtt(Settings &sett, const AttinyData &data, JsonDocument &json_settings_received);
 #endif
 
 #endif
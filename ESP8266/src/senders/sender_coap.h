@@ -0,0 +1,56 @@
+/**
+ * @file sender_coap.h
+ * @brief Функции отправки сведений по CoAP на свой сервер
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Включается ссылкой coap://host[:port][/path] в поле http_url.
+ * Повторы на уровне датаграмм делает coap_post, других попыток нет.
+ */
+#ifndef SENDERCOAP_h_
+#define SENDERCOAP_h_
+#ifndef COAP_DISABLED
+#include "setup.h"
+#include "Logging.h"
+#include "json.h"
+#include "json_arena.h"
+#include "coap_client.h"
+
+/**
+ * @brief Отправляет показания на http_url вида coap://
+ *
+ * @param static_crc crc32 статических полей отправленного документа (для компактного формата)
+ */
+bool send_coap(const Settings &sett, JsonDocument &jsonData, JsonDocument &json_settings, uint32_t &static_crc)
+{
+    uint32_t start_time = millis();
+
+    LOG_INFO(F("-- START -- "));
+    LOG_INFO(F("COAP: Send new data"));
+
+    JsonDocument compact(&json_arena);
+    if (sett.http_compact)
+    {
+        static_crc = get_compact_json(jsonData, sett.mode == TRANSMIT_MODE ? sett.http_static_crc : 0, compact);
+    }
+    const JsonDocument &body = sett.http_compact ? compact : jsonData;
+
+    bool result = coap_post(String(sett.http_url), sett.waterius_key, sett.waterius_email, body, json_settings, sett.http_compact);
+    if (result)
+    {
+        LOG_INFO(F("COAP: Data sent. Time ") << millis() - start_time << F(" ms"));
+    }
+    else
+    {
+        LOG_ERROR(F("COAP: Failed send data. Time ") << millis() - start_time << F(" ms"));
+    }
+
+    LOG_INFO(F("-- END --"));
+
+    return result;
+}
+
+#endif
+#endif
@@ -15,11 +15,17 @@
 #include "master_i2c.h"
 #include "Logging.h"
 #include "json.h"
+#include "json_arena.h"
 #include "https_helpers.h"
 
 #define HTTP_SEND_ATTEMPTS 3
 
-bool send_http(const Settings &sett, JsonDocument &jsonData, JsonDocument &json_settings)
+/**
+ * @brief Отправляет показания на http_url
+ *
+ * @param static_crc crc32 статических полей отправленного документа (для компактного формата)
+ */
+bool send_http(const Settings &sett, JsonDocument &jsonData, JsonDocument &json_settings, uint32_t &static_crc)
 {
     if (!(sett.http_on && sett.http_url[0]))
     {
@@ -32,18 +38,25 @@ bool send_http(const Settings &sett, JsonDocument &jsonData, JsonDocument &json_
     LOG_INFO(F("-- START -- "));
     LOG_INFO(F("HTTP: Send new data"));
 
-    String payload = "";
-    serializeJson(jsonData, payload);
     String url = sett.http_url;
 
+    // В компактном формате статические поля уходят только при изменении.
+    // В режиме настройки отправляем все, сервер мог быть сменен
+    JsonDocument compact(&json_arena);
+    if (sett.http_compact)
+    {
+        static_crc = get_compact_json(jsonData, sett.mode == TRANSMIT_MODE ? sett.http_static_crc : 0, compact);
+    }
+    const JsonDocument &body = sett.http_compact ? compact : jsonData;
+
     int attempts = HTTP_SEND_ATTEMPTS;
     bool result = false;
     do
     {
         LOG_INFO(F("HTTP: Attempt #") << HTTP_SEND_ATTEMPTS - attempts + 1 << F(" from ") << HTTP_SEND_ATTEMPTS);
-        result = post_data(url, sett.waterius_key, sett.waterius_email, payload, json_settings);
+        result = post_data(url, sett.waterius_key, sett.waterius_email, body, json_settings, sett.http_compact);
 
-    } while (!result && --attempts);
+    } while (!result && !http_retry_after && --attempts); // занятый сервер не нагружаем повторами
 
     if (result)
     {
@@ -21,7 +21,12 @@
 #undef MQTT_MAX_PACKET_SIZE
 #endif
 #define MQTT_MAX_PACKET_SIZE 256
-#define MQTT_DELAY_SUBSCRIPTION 100 // задержка для получения данных по подписке
+#define MQTT_DRAIN_IDLE 50       // мс без входящих данных: брокер отдал накопленные сообщения
+#define MQTT_DRAIN_TIMEOUT 500    // мс, максимальное время приема после подписки
+#define MQTT_SYNC_TIMEOUT 2000    // мс, ожидание эха метки синхронизации
+#define MQTT_FLUSH_TIMEOUT 1000   // мс, ожидание подтверждения TCP перед отключением
+#define MQTT_MONITOR_POLL_MS 250     // мс, опрос attiny в мониторе
+#define MQTT_MONITOR_EXTEND_MS 30000 // мс, продление бодрствования: attiny ждет ESP не дольше WAIT_ESP_MSEC (2 мин)
 
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
@@ -33,7 +38,10 @@
 #include "ha/publish_discovery.h"
 #include "ha/subscribe.h"
 #include "utils.h"
+#include "dns_cache.h"
+#include "config.h"
 
+extern MasterI2C masterI2C;
 extern AttinyData data;
 extern CalculatedData cdata;
 
@@ -42,12 +50,25 @@ PubSubClient mqtt_client(wifi_client);
 
 bool connect_and_subscribe_mqtt(Settings &sett, JsonDocument &json_settings_received)
 {
+    if (mqtt_client.connected())
+    {
+        return true; // соединение оставлено для монитора
+    }
+
     String mqtt_topic = sett.mqtt_topic;
     remove_trailing_slash(mqtt_topic);
 
     wifi_client.setTimeout(MQTT_SOCKET_TIMEOUT * 1000);
     mqtt_client.setBufferSize(MQTT_MAX_PACKET_SIZE);
-    mqtt_client.setServer(sett.mqtt_host, sett.mqtt_port);
+    IPAddress mqtt_ip;
+    if (dns_resolve(sett.mqtt_host, mqtt_ip))
+    {
+        mqtt_client.setServer(mqtt_ip, sett.mqtt_port);
+    }
+    else
+    {
+        mqtt_client.setServer(sett.mqtt_host, sett.mqtt_port);
+    }
     mqtt_client.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
 
     if (sett.mqtt_auto_discovery)
@@ -65,8 +86,12 @@ bool connect_and_subscribe_mqtt(Settings &sett, JsonDocument &json_settings_rece
     {
         if (sett.mqtt_auto_discovery)
         {
-            mqtt_subscribe(mqtt_client, mqtt_topic);
-            mqtt_client.loop();
+            // Подписка не удалась - метка не вернется, принимаем по паузе
+            if (!mqtt_subscribe(mqtt_client, mqtt_topic) ||
+                !mqtt_sync(mqtt_client, wifi_client, mqtt_topic, MQTT_SYNC_TIMEOUT))
+            {
+                mqtt_drain(mqtt_client, wifi_client, MQTT_DRAIN_IDLE, MQTT_DRAIN_TIMEOUT);
+            }
         }
     }
     else
@@ -115,14 +140,140 @@ bool send_mqtt(const Settings &sett, JsonDocument &json_data)
     publish_data(mqtt_client, mqtt_topic, json_data, sett.mqtt_auto_discovery);
 
     mqtt_client.loop();
-    mqtt_unsubscribe(mqtt_client, mqtt_topic);
+    // Подписку не снимаем: в постоянной сессии брокер сохранит команды до следующего пробуждения
 
-    mqtt_client.loop();
+    if (mqtt_monitor_pending())
+    {
+        LOG_INFO(F("MQTT: Keep connection for monitor"));
+        return true;
+    }
+
+    // Ждем, пока брокер подтвердит прием всех отправленных данных, и сразу отключаемся
+    if (!wifi_client.flush(MQTT_FLUSH_TIMEOUT))
+    {
+        LOG_ERROR(F("MQTT: Flush timeout"));
+    }
     mqtt_client.disconnect();
 
     LOG_INFO(F("MQTT: Disconnect. ") << millis() - start_time << F(" milliseconds elapsed"));
     return true;
 }
 
+/**
+ * @brief Монитор для пусконаладки: по команде <topic>/monitor/set (минуты)
+ * ESP остается на связи и публикует импульсы и показания входов сразу
+ * при изменении, вместо нескольких пробуждений с полным подключением.
+ * Новая команда в сессии задает новый срок, 0 - остановить.
+ *
+ * Предел жесткий: бодрствование продлевается командой attiny 'E' только
+ * до конца срока, после него attiny выключит ESP даже при зависании.
+ *
+ * @param sett настройки
+ * @param data показания, уже опубликованные send_mqtt
+ * @param json_settings_received полученные настройки
+ * @return true монитор выполнялся
+ */
+bool monitor_mqtt(Settings &sett, const AttinyData &data, JsonDocument &json_settings_received)
+{
+    uint8_t minutes = 0;
+    if (!mqtt_monitor_take(minutes) || !minutes)
+    {
+        return false;
+    }
+    if (!connect_and_subscribe_mqtt(sett, json_settings_received))
+    {
+        return false;
+    }
+
+    String mqtt_topic = sett.mqtt_topic;
+    remove_trailing_slash(mqtt_topic);
+    String monitor_topic = mqtt_topic + F("/monitor");
+    const bool retain = sett.mqtt_retain;
+
+    AttinyData current = data;
+    AttinyData published = data;
+    CalculatedData values;
+    uint32_t start = millis();
+    uint32_t limit_ms = minutes * 60000UL;
+    uint32_t extend_ms = 0;
+    uint32_t poll_ms = start;
+    uint16_t changes = 0;
+    bool extended = false;
+    LOG_INFO(F("MQTT: Monitor ") << minutes << F(" min"));
+    mqtt_client.publish(monitor_topic.c_str(), String(minutes).c_str(), retain);
+
+    while (mqtt_client.connected() && millis() - start < limit_ms)
+    {
+        if (!extended || millis() - extend_ms >= MQTT_MONITOR_EXTEND_MS)
+        {
+            if (!masterI2C.extendWakeUp())
+            {
+                LOG_ERROR(F("MQTT: Monitor can't extend wake up"));
+                break;
+            }
+            extend_ms = millis();
+            extended = true;
+        }
+
+        mqtt_client.loop();
+        if (mqtt_monitor_take(minutes))
+        {
+            if (!minutes)
+            {
+                break;
+            }
+            start = millis();
+            limit_ms = minutes * 60000UL;
+            LOG_INFO(F("MQTT: Monitor ") << minutes << F(" min"));
+        }
+
+        if (millis() - poll_ms < MQTT_MONITOR_POLL_MS)
+        {
+            delay(10);
+            continue;
+        }
+        poll_ms = millis();
+        if (!masterI2C.getAttinyData(current) ||
+            (current.impulses0 == published.impulses0 && current.impulses1 == published.impulses1))
+        {
+            continue;
+        }
+
+        values = cdata;
+        calculate_values(sett, current, values);
+        String topic = mqtt_topic + '/';
+        const unsigned int base = topic.length();
+        if (current.impulses0 != published.impulses0)
+        {
+            topic.remove(base);
+            topic += F("imp0");
+            mqtt_client.publish(topic.c_str(), String(current.impulses0).c_str(), retain);
+            topic.remove(base);
+            topic += F("ch0");
+            mqtt_client.publish(topic.c_str(), String(values.channel0, 3).c_str(), retain);
+        }
+        if (current.impulses1 != published.impulses1)
+        {
+            topic.remove(base);
+            topic += F("imp1");
+            mqtt_client.publish(topic.c_str(), String(current.impulses1).c_str(), retain);
+            topic.remove(base);
+            topic += F("ch1");
+            mqtt_client.publish(topic.c_str(), String(values.channel1, 3).c_str(), retain);
+        }
+        published = current;
+        changes++;
+    }
+
+    mqtt_client.publish(monitor_topic.c_str(), "0", retain);
+    if (!wifi_client.flush(MQTT_FLUSH_TIMEOUT))
+    {
+        LOG_ERROR(F("MQTT: Flush timeout"));
+    }
+    mqtt_client.disconnect();
+    LOG_INFO(F("MQTT: Monitor end, ") << changes << F(" changes, ") << millis() - start << F(" ms"));
+    return true;
+}
+
 #endif
 #endif
\ No newline at end of file
@@ -32,8 +32,6 @@ bool send_waterius(const Settings &sett, JsonDocument &jsonData, JsonDocument &j
     LOG_INFO(F("-- START -- "));
     LOG_INFO(F("WATR: Send new data"));
 
-    String payload = "";
-    serializeJson(jsonData, payload);
     String url = sett.waterius_host;
 
     int attempts = HTTP_SEND_ATTEMPTS;
@@ -41,9 +39,9 @@ bool send_waterius(const Settings &sett, JsonDocument &jsonData, JsonDocument &j
     do
     {
         LOG_INFO(F("WATR: Attempt #") << HTTP_SEND_ATTEMPTS - attempts + 1 << F(" from ") << HTTP_SEND_ATTEMPTS);
-        result = post_data(url, sett.waterius_key, sett.waterius_email, payload, json_settings);
+        result = post_data(url, sett.waterius_key, sett.waterius_email, jsonData, json_settings);
 
-    } while (!result && --attempts);
+    } while (!result && !http_retry_after && --attempts); // занятый сервер не нагружаем повторами
 
     if (result)
     {
@@ -295,9 +295,23 @@
 
 #define ESP_CONNECT_TIMEOUT 10000UL // Время подключения к точке доступа, ms
 
+#define WIFI_FAST_CONNECT_TIMEOUT 3000UL // Время подключения по кэшу прошлой аренды DHCP, ms
+
+#define WIFI_FAST_CONNECT_MAX_USES 96 // После стольких быстрых подключений обновляем аренду по DHCP
+
+#define NTP_SKIP_MAX_DRIFT 20000UL // Синхронизировать NTP, если оценка времени могла уйти на столько, ms
+
+#define DNS_TIMEOUT 1000UL        // Ожидание ответа DNS, ms
+#define DNS_CACHE_MAX_AGE 86400UL // Столько секунд адрес из кэша используется без ожидания DNS
+#define DNS_SLOW_TIMEOUT 150UL    // Ждем ответ DNS не дольше, если есть прошлый адрес, ms
+#ifndef DNS_LAST_IP_FALLBACK
+#define DNS_LAST_IP_FALLBACK true // Если DNS не ответил, использовать последний известный адрес
+#endif
+
 #define SERVER_TIMEOUT 12000UL // Время ответа сервера, ms
 
 #define I2C_SLAVE_ADDR 10 // i2c адрес Attiny85
+#define I2C_CLOCK 100000L // Attiny85 на 1 МГц (USI) быстрее не успевает даже с растяжкой SCL
 
 #define VER_8 8
 #define VER_9 9
@@ -350,6 +364,19 @@
 #define DEFAULT_WAKEUP_PERIOD_MIN 1440
 #endif
 
+/*
+Политика периода пробуждения (wakeup_policy в config.cpp): период
+сокращается при большом расходе или подозрении на протечку, увеличивается
+после нескольких дней без расхода и при разряженной батарее
+*/
+#define WAKEUP_POLICY_HIGH_FLOW_LPH 60 // Расход больше, л/ч - период вдвое короче
+#define WAKEUP_POLICY_LEAK_PERIODS 6   // Расход во всех последних N интервалах attiny - протечка
+#define WAKEUP_POLICY_IDLE_MIN 2880    // Без расхода дольше, мин - период вдвое длиннее
+#define WAKEUP_POLICY_LOW_BATTERY_DAYS 60 // Прогноз energy меньше, дней - максимальный период
+
+#define WIFI_BACKOFF_FAILURES 3 // После стольких неудачных подключений подряд пробуждения пропускаются
+#define WIFI_BACKOFF_MAX_SKIP 8 // Пропуск растет вдвое с каждой неудачей, но не больше, пробуждений
+
 #define AUTO_IMPULSE_FACTOR 3
 #define AS_COLD_CHANNEL 7
 
@@ -374,6 +401,7 @@
 #define SETUP_MODE 1
 #define TRANSMIT_MODE 2
 #define MANUAL_TRANSMIT_MODE 3
+#define ALARM_TRANSMIT_MODE 4 // attiny заметила протечку или прорыв
 
 // waterius-2
 #define CH0_LED_PIN 12
@@ -401,6 +429,8 @@ enum OtaError
     OTA_ERR_LOW_BATTERY = 4
 };
 
+#define OTA_MD5_SIZE 16 // байт в MD5 образа
+
 /*
    Вход attiny
  */
@@ -452,6 +482,28 @@ enum DataType
     HEATING_KWT = 12
 };
 
+/*
+Передача показаний шлюзу по ESP-NOW (см. espnow_link.h).
+Занимает место бывших настроек Blynk: у обновленных устройств там
+старые строки, поэтому настройки действуют только с ESPNOW_CONFIG_MAGIC
+*/
+#define ESPNOW_CONFIG_MAGIC 0xE50A
+#define ESPNOW_ROLE_OFF 0     // только Wi-Fi
+#define ESPNOW_ROLE_SENDER 1  // обычные пробуждения - кадр шлюзу, Wi-Fi при неудаче
+#define ESPNOW_ROLE_GATEWAY 2 // плата с постоянным питанием без attiny принимает кадры
+#define ESPNOW_KEY_SIZE 16
+
+struct EspNowConfig
+{
+    uint16_t magic = 0;
+    uint8_t role = ESPNOW_ROLE_OFF;
+    uint8_t channel = 0;         // канал Wi-Fi шлюза, 0 - канал последнего подключения
+    uint8_t gateway[6] = {0};    // MAC шлюза
+    uint8_t key[ESPNOW_KEY_SIZE] = {0}; // общий ключ подписи кадров
+    uint8_t reserved[12] = {0};
+}; // 38 байт, BLYNK_RESERVED
+static_assert(sizeof(EspNowConfig) == BLYNK_RESERVED, "sizeof EspNowConfig != BLYNK_RESERVED");
+
 struct CalculatedData
 {
     // Показания в кубометрах
@@ -495,7 +547,7 @@ struct Settings
     char company[COMPANY_LEN] = {0};
     char place[PLACE_LEN] = {0};
 
-    char reserved_blynk[BLYNK_RESERVED] = {0};
+    EspNowConfig espnow;
 
     char http_url[HOST_LEN] = {0};
 
@@ -635,12 +687,137 @@ struct Settings
     */
     uint8_t voltage_cal = 100;
 
-    uint8_t reserved8 = 0;
+    /*
+    Отправлять лог пробуждений с ошибками на http_url (log_store.h)
+    */
+    uint8_t log_upload = (uint8_t) false;
+
+    /*
+    Часть очереди неотправленных показаний сброшена в файл на LittleFS
+    */
+    uint8_t offline_queue_file = 0;
+
+    /*
+    Формат отправки на http_url: 0 - JSON, 1 - компактный MessagePack
+    */
+    uint8_t http_compact = (uint8_t) false;
+
+    /*
+    crc32 статических полей, последними принятых сервером http_url.
+    Пока не изменятся, в компактном формате они не отправляются
+    */
+    uint32_t http_static_crc = 0;
+
+    /*
+    Синхронизация NTP каждое N-е пробуждение (0 или 1 - каждое).
+    В остальных время оценивается по прошлому времени и длительности сна
+    */
+    uint8_t ntp_skip_period = 0;
+
+    /*
+    Пробуждений подряд без синхронизации NTP
+    */
+    uint8_t ntp_skip_count = 0;
+
+    /*
+    Наблюдаемая ошибка оценки времени за одно пробуждение, мс
+    */
+    uint16_t ntp_drift_ms = 0;
+
+    /*
+    Отношение фактической длительности сна к заданной (k) * 1000000, 0 - неизвестно
+    */
+    uint32_t clock_ratio = 0;
+
+    /*
+    Номер записи журнала горячих полей (hot_state), с которого
+    журнал новее этой копии настроек
+    */
+    uint32_t hot_seq = 0;
+
+    /*
+    Всего записей настроек во flash (журнал и EEPROM) и из них
+    полных перезаписей сектора EEPROM
+    */
+    uint32_t flash_writes = 0;
+    uint32_t config_commits = 0;
+
+    /*
+    Расход батареи по модели energy: накопленный с настройки
+    и за последний цикл (пробуждение и сон), мкА*ч
+    */
+    uint32_t energy_uah = 0;
+    uint16_t energy_cycle_uah = 0;
+
+    /*
+    Границы периода пробуждения для политики wakeup_policy, мин.
+    Задаются в настройках и сервером, 0 - период не меньше (не больше) wakeup_per_min
+    */
+    uint16_t wakeup_per_min_lo = 0;
+    uint16_t wakeup_per_min_hi = 0;
+
+    /*
+    Период пробуждения, выбранный политикой (0 - wakeup_per_min),
+    и сколько минут подряд не было расхода
+    */
+    uint16_t period_policy_min = 0;
+    uint16_t idle_min = 0;
+
+    /*
+    MD5 образа LittleFS, записанного по OTA (нули - неизвестен).
+    Сообщается серверу, OTA с тем же fs_md5 не перезаписывает файловую систему
+    */
+    uint8_t fs_md5[OTA_MD5_SIZE] = {0};
+
+    /*
+    Неудачных подключений к Wi-Fi подряд и сколько пробуждений
+    еще пропустить без подключения (wifi_backoff)
+    */
+    uint8_t wifi_fail_streak = 0;
+    uint8_t wifi_backoff_skip = 0;
+
+    /*
+    Номер последнего кадра ESP-NOW: шлюз отбрасывает повторы старых кадров
+    */
+    uint32_t espnow_seq = 0;
+
+    /*
+    MQTT без Home Assistant: публиковать только поля, изменившиеся
+    с прошлого пробуждения (брокер хранит остальные с retain)
+    */
+    uint8_t mqtt_changed_only = (uint8_t) false;
+
+    /*
+    Номер сервера пула NTP (+1), ответившего первым в прошлый раз, 0 - неизвестен.
+    С него начинается следующая синхронизация. Меняется часто, поэтому
+    пишется в журнал горячих полей (hot_state), а не в EEPROM
+    */
+    uint8_t ntp_fast_server = 0;
+
+    /*
+    Место пробуждений устройства в периоде: сдвиг расписания от base_time, мин + 1,
+    0 - сдвиг по chip id (так читаются и нули резерва старых настроек).
+    Сервер передает и получает в wake_slot минуты без +1, -1 - по chip id
+    */
+    uint16_t wakeup_slot = 0;
+
+    /*
+    Ревизия настроек сервера http_url, последними примененными (0 - нет).
+    Сообщается в данных, сервер присылает настройки только при другой ревизии
+    */
+    uint32_t config_rev = 0;
+
+    /*
+    Подключений по кэшу прошлой аренды DHCP (WIFI_CACHE_FILE) с ее получения.
+    После WIFI_FAST_CONNECT_MAX_USES аренда обновляется по DHCP
+    */
+    uint8_t wifi_fast_uses = 0;
+
     /*
     Зарезервируем кучу места, чтобы не писать конвертер конфигураций.
     Будет актуально для On-the-Air обновлений
     */
-    uint8_t reserved9[74] = {0};
+    uint8_t reserved9[3] = {0};
 
 }; // 960 байт
 
@@ -4,6 +4,8 @@
 #include <WiFiUdp.h>
 #include <ESP8266WiFi.h>
 #include <time.h>
+#include "dns_cache.h"
+#include <lwip/udp.h>
 
 // Модуль основан на следующих модулях
 // https://github.com/arduino-libraries/NTPClient/blob/master/NTPClient.cpp
@@ -11,7 +13,6 @@
 // https://github.com/arendst/Tasmota/blob/development/tasmota/tasmota_support/support_wifi.ino
 
 #define START_VALID_TIME 1704067201UL // Jan 01 2024 00:00:01
-#define DNS_TIMEOUT 1000              // 1 секунда
 #define NTP_TIMEOUT 300               // обычно ответ приходит за 30-50 мсек
 #define NTP_PORT 123
 #define SEVENTY_YEARS 2208988800UL // от 1900 до 1970 в секундах
@@ -21,10 +22,15 @@
 #define TIME_FORMAT "%FT%T%z"
 #define UDP_PORT_ATTEMPTS 3
 #define NTP_ATTEMPTS 5
+#define NTP_POOL_SIZE 4 // 0..3.ru.pool.ntp.org
+#define NTP_RACE_SIZE 3 // запросов к разным серверам одновременно
 
 const uint32_t NTP_PACKET_SIZE = 48;    // NTP time is in the first 48 bytes of message
 uint8_t packet_buffer[NTP_PACKET_SIZE]; // Buffer to hold incoming & outgoing packets
 
+static int ntp_server_id = -1;
+static bool ntp_server_peeked = false; // следующий сервер уже выбран заранее
+
 /**
  * @brief Получает следующий ижентификатор в пуле серверов
  *
@@ -32,17 +38,20 @@ uint8_t packet_buffer[NTP_PACKET_SIZE]; // Buffer to hold incoming & outgoing pa
  */
 int get_next_ntp_server_id()
 {
-    static int ntp_server_id = -1;
     // первый раз сервер выбирается случайным образом из пула
     // каждый следующий разу будет выбираться следующий в пуле
-    if (ntp_server_id < 0)
+    if (ntp_server_peeked)
+    {
+        ntp_server_peeked = false;
+    }
+    else if (ntp_server_id < 0)
     {
         ntp_server_id = random(0, 3);
     }
     else
     {
         ntp_server_id++;
-        if (ntp_server_id > 3)
+        if (ntp_server_id >= NTP_POOL_SIZE)
         {
             ntp_server_id = 0;
         }
@@ -50,6 +59,33 @@ int get_next_ntp_server_id()
     return ntp_server_id;
 }
 
+/**
+ * @brief Следующим из пула будет сервер, ответивший первым в прошлый раз
+ *
+ * @param sett настройки устройства
+ */
+static void prefer_fast_ntp_server(const Settings &sett)
+{
+    if (ntp_server_id < 0 && sett.ntp_fast_server)
+    {
+        ntp_server_id = (sett.ntp_fast_server - 1) % NTP_POOL_SIZE;
+        ntp_server_peeked = true;
+    }
+}
+
+static String get_pool_ntp_server_name(int id)
+{
+    String ntp_server_name = String(id);
+    ntp_server_name += F(".ru.pool.ntp.org");
+    return ntp_server_name;
+}
+
+static bool is_custom_ntp_server(const Settings &sett)
+{
+    String ntp_server = sett.ntp_server;
+    return sett.ntp_server[0] && !ntp_server.equalsIgnoreCase(String(DEFAULT_NTP_SERVER));
+}
+
 /**
  * @brief Получает имя следующего в пуле сервера
  *
@@ -57,9 +93,25 @@ int get_next_ntp_server_id()
  */
 String get_next_ntp_server_name()
 {
-    int ntp_server_id = get_next_ntp_server_id();
-    String ntp_server_name = String(ntp_server_id);
-    ntp_server_name += F(".ru.pool.ntp.org");
+    return get_pool_ntp_server_name(get_next_ntp_server_id());
+}
+
+/**
+ * @brief Имя сервера, с которого начнется синхронизация.
+ * Сервер из пула выбирается заранее, чтобы запрос DNS ушел одновременно с остальными.
+ *
+ * @param sett настройки устройства
+ * @return String имя сервера
+ */
+String get_ntp_server_name(const Settings &sett)
+{
+    prefer_fast_ntp_server(sett);
+    if (is_custom_ntp_server(sett))
+    {
+        return String(sett.ntp_server);
+    }
+    String ntp_server_name = get_next_ntp_server_name();
+    ntp_server_peeked = true;
     return ntp_server_name;
 }
 
@@ -86,6 +138,66 @@ bool begin_udp_random_port(WiFiUDP &udp)
     return false;
 }
 
+/**
+ * @brief Разбор пакета ответа NTP сервера
+ *
+ * @param packet пакет NTP_PACKET_SIZE байт
+ * @return uint64_t время отправки ответа сервером в наносекундах или 0
+ */
+static uint64_t parse_ntp_packet(const uint8_t *packet)
+{
+    if ((packet[0] & 0b11000000) == 0b11000000)
+    {
+        // Leap-Indicator: unknown (clock unsynchronized)
+        // See: https://github.com/letscontrolit/ESPEasy/issues/2886#issuecomment-586656384
+        LOG_ERROR(F("NTP: unsynced IP"));
+        return 0;
+    }
+
+    // 0 - Kiss-o'-Death (сервер просит не опрашивать его), больше 15 - не синхронизирован
+    if (packet[1] == 0 || packet[1] > 15)
+    {
+        LOG_ERROR(F("NTP: Bad stratum ") << packet[1]);
+        return 0;
+    }
+
+    // convert four bytes starting at location 40 to a long integer
+    // TX time is used here.
+    uint32_t secs_since_1900 = (uint32_t)packet[40] << 24;
+    secs_since_1900 |= (uint32_t)packet[41] << 16;
+    secs_since_1900 |= (uint32_t)packet[42] << 8;
+    secs_since_1900 |= (uint32_t)packet[43];
+    if (0 == secs_since_1900) // No time stamp received
+    {
+        LOG_ERROR(F("NTP: No time stamp received"));
+        return 0;
+    }
+
+    uint32_t tmp_fraction = (uint32_t)packet[44] << 24;
+    tmp_fraction |= (uint32_t)packet[45] << 16;
+    tmp_fraction |= (uint32_t)packet[46] << 8;
+    tmp_fraction |= (uint32_t)packet[47];
+    uint32_t fraction = (((uint64_t)tmp_fraction) * NSEC) >> 32;
+
+    return (((uint64_t)secs_since_1900) - SEVENTY_YEARS) * NSEC + fraction;
+}
+
+/**
+ * @brief Заполняет пакет запроса к NTP серверу
+ */
+static void fill_ntp_request(uint8_t *packet)
+{
+    memset(packet, 0, NTP_PACKET_SIZE);
+    packet[0] = 0b11100011; // LI, Version, Mode
+    packet[1] = 0;          // Stratum, or type of clock
+    packet[2] = 6;          // Polling Interval
+    packet[3] = 0xEC;       // Peer Clock Precision
+    packet[12] = 49;
+    packet[13] = 0x4E;
+    packet[14] = 49;
+    packet[15] = 52;
+}
+
 /**
  * @brief Парсинг ответа NTP сервера
  *
@@ -106,34 +218,12 @@ uint64_t get_ntp_response(WiFiUDP &udp)
             udp.read(packet_buffer, NTP_PACKET_SIZE); // Read packet into the buffer
             udp.stop();
 
-            if ((packet_buffer[0] & 0b11000000) == 0b11000000)
+            uint64_t ntp_nanos = parse_ntp_packet(packet_buffer);
+            if (!ntp_nanos)
             {
-                // Leap-Indicator: unknown (clock unsynchronized)
-                // See: https://github.com/letscontrolit/ESPEasy/issues/2886#issuecomment-586656384
-                LOG_ERROR(F("NTP: unsynced IP"));
-                return false;
+                return 0;
             }
 
-            // convert four bytes starting at location 40 to a long integer
-            // TX time is used here.
-            uint32_t secs_since_1900 = (uint32_t)packet_buffer[40] << 24;
-            secs_since_1900 |= (uint32_t)packet_buffer[41] << 16;
-            secs_since_1900 |= (uint32_t)packet_buffer[42] << 8;
-            secs_since_1900 |= (uint32_t)packet_buffer[43];
-            if (0 == secs_since_1900) // No time stamp received
-            {
-                LOG_ERROR(F("NTP: No time stamp received"));
-                return false;
-            }
-
-            uint32_t tmp_fraction = (uint32_t)packet_buffer[44] << 24;
-            tmp_fraction |= (uint32_t)packet_buffer[45] << 16;
-            tmp_fraction |= (uint32_t)packet_buffer[46] << 8;
-            tmp_fraction |= (uint32_t)packet_buffer[47];
-            uint32_t fraction = (((uint64_t)tmp_fraction) * NSEC) >> 32;
-
-            uint64_t ntp_nanos = (((uint64_t)secs_since_1900) - SEVENTY_YEARS) * NSEC + fraction;
-
             uint32_t total_delay = millis() - begin_wait;
 
             // compensate for the delay by adding half the total delay
@@ -168,15 +258,7 @@ bool send_ntp_request(WiFiUDP &udp, IPAddress &ntp_server_ip)
         yield();
     }
 
-    memset(packet_buffer, 0, NTP_PACKET_SIZE);
-    packet_buffer[0] = 0b11100011; // LI, Version, Mode
-    packet_buffer[1] = 0;          // Stratum, or type of clock
-    packet_buffer[2] = 6;          // Polling Interval
-    packet_buffer[3] = 0xEC;       // Peer Clock Precision
-    packet_buffer[12] = 49;
-    packet_buffer[13] = 0x4E;
-    packet_buffer[14] = 49;
-    packet_buffer[15] = 52;
+    fill_ntp_request(packet_buffer);
 
     if (udp.beginPacket(ntp_server_ip, NTP_PORT) == 0) // NTP requests are to port 123
     {
@@ -201,7 +283,7 @@ uint64_t get_ntp_nanos(const String &ntp_server_name)
 {
     IPAddress ntp_server_ip;
 
-    if (WiFi.hostByName(ntp_server_name.c_str(), ntp_server_ip, DNS_TIMEOUT) != 1)
+    if (!dns_resolve(ntp_server_name, ntp_server_ip))
     {
         LOG_ERROR(F("NTP: Unable to resolve ") << ntp_server_name);
         return 0;
@@ -325,6 +407,408 @@ bool sync_ntp_time(const Settings &sett)
     return sync_ntp_time();
 }
 
+static time_t time_estimate = 0; // оценка времени при millis() == 0, 0 - нет
+
+static void set_time(time_t t)
+{
+    struct timeval tv;
+    tv.tv_sec = t;
+    tv.tv_usec = 0;
+    settimeofday(&tv, NULL);
+}
+
+/**
+ * @brief Оценивает время по прошлой отметке last_send, длительности сна и коэффициенту k
+ *
+ * @param sett настройки устройства
+ * @return time_t оценка времени старта (millis() == 0) или 0, если оценить нельзя
+ */
+static time_t estimate_time(const Settings &sett)
+{
+    // Только после сна по таймеру attiny: при нажатии кнопки длительность сна неизвестна
+    if (sett.mode != TRANSMIT_MODE || !sett.clock_ratio || !is_valid_time(sett.last_send))
+    {
+        return 0;
+    }
+    double slept = (double)sett.period_min_tuned * 60.0 * sett.clock_ratio / CLOCK_RATIO_SCALE;
+    return sett.last_send + (time_t)slept;
+}
+
+void apply_time_estimate(const Settings &sett)
+{
+    time_estimate = estimate_time(sett);
+    if (time_estimate)
+    {
+        set_time(time_estimate + millis() / MSEC);
+        LOG_INFO(F("TIME: Estimated ") << get_current_time() << F(" k=") << sett.clock_ratio);
+    }
+}
+
+/**
+ * @brief Уточняет k и ошибку оценки по времени NTP
+ *
+ * @param sett настройки устройства
+ * @param now время после синхронизации
+ */
+static void update_clock_model(Settings &sett, time_t now)
+{
+    if (sett.mode != TRANSMIT_MODE || !is_valid_time(sett.last_send) || !sett.period_min_tuned)
+    {
+        return;
+    }
+
+    // сколько периодов прошло с last_send (пробуждения без NTP тоже двигали last_send)
+    double period = (double)sett.period_min_tuned * 60.0;
+    double awake = millis() / MSEC;
+    uint32_t ratio;
+    if (time_estimate && sett.clock_ratio)
+    {
+        // ошибка накопилась за ntp_skip_count + 1 пробуждений
+        double periods = sett.ntp_skip_count + 1;
+        double residual = difftime(now, time_estimate) - awake;
+        ratio = sett.clock_ratio + (int32_t)(residual / (periods * period) * CLOCK_RATIO_SCALE / 2);
+
+        uint32_t drift = (uint32_t)(fabs(residual) * MSEC / periods);
+        // осторожная оценка: растет сразу, уменьшается плавно
+        drift = _max(drift, ((uint32_t)sett.ntp_drift_ms * 3 + drift) / 4);
+        sett.ntp_drift_ms = _min(drift, (uint32_t)UINT16_MAX);
+        LOG_INFO(F("TIME: Estimate error ") << residual << F(" s, drift ") << sett.ntp_drift_ms << F(" ms per wake"));
+    }
+    else
+    {
+        ratio = (uint32_t)((difftime(now, sett.last_send) - awake) / period * CLOCK_RATIO_SCALE);
+        sett.ntp_drift_ms = UINT16_MAX; // до первой проверки оценке не доверяем
+    }
+
+    // больше 30% - не уход часов, а пропущенные пробуждения или смена периода
+    if (ratio < CLOCK_RATIO_SCALE * 7 / 10 || ratio > CLOCK_RATIO_SCALE * 13 / 10)
+    {
+        LOG_ERROR(F("TIME: Clock ratio out of range ") << ratio);
+        ratio = 0;
+    }
+    sett.clock_ratio = ratio;
+}
+
+/**
+ * @brief Асинхронный запрос NTP: ответ принимает колбек lwIP,
+ * пока основной код подключается к серверам. Запросы к NTP_RACE_SIZE
+ * серверам идут одновременно, время берется из первого годного ответа.
+ */
+struct AsyncNtpRequest
+{
+    udp_pcb *pcb;
+    String host;
+    int8_t pool_id; // номер сервера пула, -1 - сервер пользователя
+    bool sent;
+    bool failed;
+    uint32_t sent_ms;
+    volatile uint32_t reply_ms;
+    volatile bool replied;
+    uint8_t packet[NTP_PACKET_SIZE];
+};
+
+static AsyncNtpRequest ntp_requests[NTP_RACE_SIZE];
+static uint8_t ntp_request_count = 0;
+static uint32_t ntp_race_start = 0;
+static bool ntp_skipped = false;
+
+static void ntp_recv(void *arg, udp_pcb *pcb, pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    AsyncNtpRequest *request = (AsyncNtpRequest *)arg;
+    if (!request->replied && port == NTP_PORT && p->tot_len >= NTP_PACKET_SIZE)
+    {
+        pbuf_copy_partial(p, request->packet, NTP_PACKET_SIZE, 0);
+        request->reply_ms = millis();
+        request->replied = true;
+    }
+    pbuf_free(p);
+}
+
+static void ntp_request_close(AsyncNtpRequest &request)
+{
+    if (request.pcb)
+    {
+        udp_remove(request.pcb);
+        request.pcb = nullptr;
+    }
+}
+
+static void ntp_race_close()
+{
+    for (uint8_t i = 0; i < ntp_request_count; i++)
+    {
+        ntp_request_close(ntp_requests[i]);
+    }
+}
+
+/**
+ * @brief Отправляет запрос NTP и сразу возвращает управление
+ *
+ * @param request запрос
+ * @param ntp_server_ip адрес сервера
+ * @return true запрос отправлен
+ */
+static bool ntp_request_send(AsyncNtpRequest &request, IPAddress &ntp_server_ip)
+{
+    request.sent = true;
+    request.pcb = udp_new();
+    if (!request.pcb)
+    {
+        LOG_ERROR(F("NTP: Unable to open udp port "));
+        return false;
+    }
+    request.replied = false;
+    udp_recv(request.pcb, ntp_recv, &request);
+
+    pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_SIZE, PBUF_RAM);
+    if (!p)
+    {
+        ntp_request_close(request);
+        return false;
+    }
+    fill_ntp_request((uint8_t *)p->payload);
+    request.sent_ms = millis();
+    err_t err = udp_sendto(request.pcb, p, ntp_server_ip, NTP_PORT);
+    pbuf_free(p);
+    if (err != ERR_OK)
+    {
+        LOG_ERROR(F("NTP: Unable to send"));
+        ntp_request_close(request);
+        return false;
+    }
+
+    LOG_INFO(F("NTP: Async request to ") << request.host << F(" IP ") << ntp_server_ip.toString());
+    return true;
+}
+
+/**
+ * @brief Отправляет запрос, если адрес сервера уже известен
+ *
+ * @return false адрес еще не получен
+ */
+static bool ntp_request_poll_dns(AsyncNtpRequest &request)
+{
+    IPAddress ntp_server_ip;
+    if (!dns_poll(request.host, ntp_server_ip))
+    {
+        return false;
+    }
+    if (!ntp_server_ip.isSet())
+    {
+        LOG_ERROR(F("NTP: Unable to resolve ") << request.host);
+        request.sent = true;
+        request.failed = true;
+    }
+    else
+    {
+        request.failed = !ntp_request_send(request, ntp_server_ip);
+    }
+    return true;
+}
+
+static void ntp_race_add(const String &host, const int8_t pool_id)
+{
+    AsyncNtpRequest &request = ntp_requests[ntp_request_count++];
+    request.pcb = nullptr;
+    request.host = host;
+    request.pool_id = pool_id;
+    request.sent = false;
+    request.failed = false;
+    request.replied = false;
+}
+
+/**
+ * @brief Запускает запросы: первый сервер (его адрес уже запрошен в dns_prefetch)
+ * и следующие из пула. Запасные отправляются по мере ответов DNS.
+ *
+ * @param sett настройки устройства
+ * @param ntp_server_name первый сервер
+ */
+static void ntp_race_begin(const Settings &sett, const String &ntp_server_name)
+{
+    ntp_race_start = millis();
+    ntp_request_count = 0;
+    bool custom = is_custom_ntp_server(sett);
+    ntp_race_add(ntp_server_name, custom ? -1 : ntp_server_id);
+    while (ntp_request_count < NTP_RACE_SIZE)
+    {
+        int id = get_next_ntp_server_id();
+        ntp_race_add(get_pool_ntp_server_name(id), id);
+    }
+
+    // запасным серверам DNS запрашиваем сразу, пока ждем первый
+    for (uint8_t i = 1; i < ntp_request_count; i++)
+    {
+        ntp_request_poll_dns(ntp_requests[i]);
+    }
+
+    AsyncNtpRequest &first = ntp_requests[0];
+    IPAddress ntp_server_ip;
+    if (!dns_resolve(first.host, ntp_server_ip))
+    {
+        LOG_ERROR(F("NTP: Unable to resolve ") << first.host);
+        first.sent = true;
+        first.failed = true;
+    }
+    else
+    {
+        first.failed = !ntp_request_send(first, ntp_server_ip);
+    }
+
+    for (uint8_t i = 1; i < ntp_request_count; i++)
+    {
+        if (!ntp_requests[i].sent)
+        {
+            ntp_request_poll_dns(ntp_requests[i]);
+        }
+    }
+}
+
+/**
+ * @brief Устанавливает время по ответу
+ *
+ * @return false ответ негодный (leap, stratum, время)
+ */
+static bool ntp_request_apply(const AsyncNtpRequest &request)
+{
+    uint64_t ntp_nanos = parse_ntp_packet(request.packet);
+    if (!ntp_nanos)
+    {
+        return false;
+    }
+
+    // половина задержки на дорогу и время с момента ответа
+    uint32_t total_delay = request.reply_ms - request.sent_ms;
+    ntp_nanos += (uint64_t)(total_delay / 2 + millis() - request.reply_ms) * (NSEC / MSEC);
+
+    struct timeval tv;
+    tv.tv_sec = ntp_nanos / NSEC;
+    tv.tv_usec = (ntp_nanos % NSEC) / 1000;
+    if (!is_valid_time(tv.tv_sec))
+    {
+        LOG_ERROR(F("NTP: Unable to sync time"));
+        return false;
+    }
+    settimeofday(&tv, NULL);
+    LOG_INFO(F("NTP: ") << request.host << F(" replied: delay ") << total_delay << F(" mSec, waited ") << millis() - ntp_race_start << F(" mSec"));
+    LOG_INFO(F("NTP: Current time ") << get_current_time());
+    return true;
+}
+
+/**
+ * @brief Ждет первый годный ответ. Каждый запрос ждем не дольше NTP_TIMEOUT
+ * от отправки, адрес запасного сервера - не дольше DNS_TIMEOUT.
+ * Остальные запросы закрываются.
+ *
+ * @param sett настройки устройства, запоминается ответивший сервер пула
+ * @return true время синхронизировано
+ */
+static bool ntp_race_wait(Settings &sett)
+{
+    bool pending = ntp_request_count > 0;
+    while (pending)
+    {
+        pending = false;
+        for (uint8_t i = 0; i < ntp_request_count; i++)
+        {
+            AsyncNtpRequest &request = ntp_requests[i];
+            if (!request.sent)
+            {
+                pending |= !ntp_request_poll_dns(request) || !request.failed;
+                continue;
+            }
+            if (request.failed)
+            {
+                continue;
+            }
+            if (request.replied)
+            {
+                ntp_request_close(request);
+                if (ntp_request_apply(request))
+                {
+                    ntp_race_close();
+                    if (request.pool_id >= 0)
+                    {
+                        sett.ntp_fast_server = request.pool_id + 1;
+                    }
+                    return true;
+                }
+                request.failed = true;
+                continue;
+            }
+            if (millis() - request.sent_ms >= NTP_TIMEOUT)
+            {
+                LOG_ERROR(F("NTP: No reply from ") << request.host);
+                ntp_request_close(request);
+                request.failed = true;
+                continue;
+            }
+            pending = true;
+        }
+        if (pending)
+        {
+            delay(1);
+        }
+    }
+    ntp_race_close();
+    return false;
+}
+
+void sync_time_begin(Settings &sett)
+{
+    ntp_request_count = 0;
+    ntp_skipped = time_estimate && sett.ntp_skip_period > 1 && sett.ntp_skip_count + 1 < sett.ntp_skip_period && (uint32_t)(sett.ntp_skip_count + 1) * sett.ntp_drift_ms <= NTP_SKIP_MAX_DRIFT;
+    if (ntp_skipped)
+    {
+        return;
+    }
+
+    // сервер из пула уже выбран для dns_prefetch, запасные - следующие за ним
+    String ntp_server_name = get_ntp_server_name(sett);
+    ntp_server_peeked = false;
+    ntp_race_begin(sett, ntp_server_name);
+}
+
+bool sync_time_end(Settings &sett)
+{
+    if (ntp_skipped)
+    {
+        sett.ntp_skip_count++;
+        LOG_INFO(F("NTP: Skip, use estimate. Wakes without sync: ") << sett.ntp_skip_count);
+        return true;
+    }
+
+    // никто не ответил - синхронно по остальным серверам пула
+    if (!ntp_race_wait(sett) && !sync_ntp_time())
+    {
+        if (time_estimate)
+        {
+            // оценка лучше, чем ничего
+            set_time(time_estimate + millis() / MSEC);
+            sett.ntp_skip_count++;
+        }
+        return false;
+    }
+
+    update_clock_model(sett, time(nullptr));
+    sett.ntp_skip_count = 0;
+    return true;
+}
+
+void advance_time_estimate(Settings &sett)
+{
+    // Пробуждение без отправки: сдвигаем отметку, чтобы следующая оценка считала от этого сна
+    time_t now = time(nullptr);
+    if (time_estimate && is_valid_time(now))
+    {
+        sett.last_send = now;
+        if (sett.ntp_skip_count < UINT8_MAX)
+        {
+            sett.ntp_skip_count++;
+        }
+    }
+}
+
 /**
  * @brief Получает текущее время
  *
@@ -15,9 +15,44 @@
 #include "setup.h"
 #include "time.h"
 
+#define CLOCK_RATIO_SCALE 1000000UL // масштаб Settings::clock_ratio
+
+class WiFiUDP;
+
 extern bool sync_ntp_time(const Settings &sett);
 extern bool sync_ntp_time();
 extern bool sync_ntp_time(const String &ntp_server_name);
+extern String get_ntp_server_name(const Settings &sett);
+
+/**
+ * @brief Устанавливает время по оценке: last_send + период сна * k.
+ * Вызывается в начале пробуждения, до подключения к wifi.
+ */
+extern void apply_time_estimate(const Settings &sett);
+
+/**
+ * @brief Начинает синхронизацию времени: отправляет запрос NTP и сразу возвращает управление.
+ * Если разрешено настройкой ntp_skip_period и ожидаемая ошибка мала, остается оценка.
+ */
+extern void sync_time_begin(Settings &sett);
+
+/**
+ * @brief Дожидается ответа NTP (при неудаче синхронизирует по другим серверам)
+ * и уточняет модель ухода часов attiny. Вызывается перед формированием данных.
+ *
+ * @return false не удалось синхронизировать время по NTP
+ */
+extern bool sync_time_end(Settings &sett);
+
+/**
+ * @brief Переносит last_send на оценку времени, если пробуждение прошло без отправки
+ */
+extern void advance_time_estimate(Settings &sett);
+
+/**
+ * @brief Открывает UDP на случайном порту (для NTP и CoAP)
+ */
+extern bool begin_udp_random_port(WiFiUDP &udp);
 
 extern String get_current_time();
 
@@ -0,0 +1,114 @@
+#include "tls_session.h"
+#include <coredecls.h>
+#include "Logging.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include "sync_time.h"
+#include "utils.h"
+
+extern Settings sett;
+
+struct TlsSessionFile
+{
+    uint32_t host_crc;
+    time_t created; // время полного рукопожатия, 0 - неизвестно
+    BearSSL::Session session;
+    uint32_t crc;
+};
+
+static uint32_t file_crc(const TlsSessionFile &cache)
+{
+    return crc32(&cache, offsetof(TlsSessionFile, crc));
+}
+
+static bool file_load(TlsSessionFile &cache)
+{
+    bool valid = false;
+    if (fs_begin())
+    {
+        File file = LittleFS.open(TLS_SESSION_FILE, "r");
+        if (file)
+        {
+            valid = file.read((uint8_t *)&cache, sizeof(cache)) == sizeof(cache) &&
+                    cache.crc == file_crc(cache);
+            file.close();
+        }
+    }
+    return valid;
+}
+
+static uint32_t host_crc(const String &url)
+{
+    String host = get_host(url);
+    return crc32(host.c_str(), host.length());
+}
+
+/* Хост, для которого храним сессию */
+static uint32_t preferred_host_crc()
+{
+    if (is_waterius_site(sett) && is_https(sett.waterius_host))
+    {
+        return host_crc(sett.waterius_host);
+    }
+    if (sett.http_on && is_https(sett.http_url))
+    {
+        return host_crc(sett.http_url);
+    }
+    return 0;
+}
+
+bool tls_session_load(const String &url, BearSSL::Session &session)
+{
+    TlsSessionFile cache;
+    if (!file_load(cache) || cache.host_crc != host_crc(url))
+    {
+        return false;
+    }
+    time_t now = time(nullptr);
+    if (is_valid_time(now) && cache.created && (now < cache.created || now - cache.created > (time_t)TLS_SESSION_TTL))
+    {
+        LOG_INFO(F("TLS: session expired"));
+        return false;
+    }
+    memcpy((void *)&session, (const void *)&cache.session, sizeof(session));
+    LOG_INFO(F("TLS: session loaded"));
+    return true;
+}
+
+void tls_session_store(const String &url, const BearSSL::Session &session)
+{
+    uint32_t crc = host_crc(url);
+    if (crc != preferred_host_crc())
+    {
+        return;
+    }
+
+    TlsSessionFile cache;
+    if (file_load(cache) && cache.host_crc == crc &&
+        memcmp((const void *)&cache.session, (const void *)&session, sizeof(session)) == 0)
+    {
+        // сессия возобновлена: параметры те же, flash не трогаем
+        return;
+    }
+
+    memset((void *)&cache, 0, sizeof(cache));
+    cache.host_crc = crc;
+    time_t now = time(nullptr);
+    cache.created = is_valid_time(now) ? now : 0;
+    memcpy((void *)&cache.session, (const void *)&session, sizeof(session));
+    cache.crc = file_crc(cache);
+
+    if (!fs_begin())
+    {
+        return;
+    }
+    File file = LittleFS.open(TLS_SESSION_FILE, "w");
+    if (!file || file.write((const uint8_t *)&cache, sizeof(cache)) != sizeof(cache))
+    {
+        LOG_ERROR(F("TLS: Failed to store session"));
+    }
+    if (file)
+    {
+        file.close();
+    }
+}
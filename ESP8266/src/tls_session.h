@@ -0,0 +1,47 @@
+/**
+ * @file tls_session.h
+ * @brief Кэш TLS сессии на LittleFS для возобновления рукопожатия
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * С сохраненной сессией BearSSL делает сокращенное рукопожатие без
+ * обмена ключами: меньше CPU и времени с включенным радио.
+ * Если сервер сессию не принял, происходит полное рукопожатие.
+ *
+ * attiny снимает питание ESP после сна, поэтому сессия лежит в файле на
+ * LittleFS. Файл перезаписывается только после полного рукопожатия: при
+ * возобновлении параметры сессии не меняются. Сессия старше TLS_SESSION_TTL
+ * не предлагается, сервер ее уже забыл.
+ *
+ * Хранится одна сессия: хоста сайта Ватериуса (с него же обычно и OTA),
+ * а если он не https - хоста http_url.
+ */
+#ifndef TLS_SESSION_H_
+#define TLS_SESSION_H_
+
+#include <Arduino.h>
+#include <WiFiClientSecureBearSSL.h>
+
+#define TLS_SESSION_FILE "/tls.bin"
+#define TLS_SESSION_TTL 86400UL // время жизни сессии, с
+
+/**
+ * @brief Загружает сессию для хоста ссылки с LittleFS
+ *
+ * @param url ссылка https
+ * @param session сессия для WiFiClientSecure::setSession
+ * @return true сессия найдена
+ */
+extern bool tls_session_load(const String &url, BearSSL::Session &session);
+
+/**
+ * @brief Сохраняет сессию после удачного подключения
+ *
+ * @param url ссылка https
+ * @param session сессия, обновленная клиентом при рукопожатии
+ */
+extern void tls_session_store(const String &url, const BearSSL::Session &session);
+
+#endif
@@ -5,6 +5,7 @@
 #include "porting.h"
 #include "wifi_helpers.h"
 #include "setup.h"
+#include "crc.h"
 
 /**
  * @brief Форимрует строку с именем устройства
@@ -54,25 +55,8 @@ String get_mac_address_hex()
  */
 uint16_t get_checksum(const Settings &sett)
 {
-	uint8_t *buf = (uint8_t *)&sett;
-	uint16_t crc = 0xffff, poly = 0xa001;
-	uint16_t i = 0;
-	uint16_t len = sizeof(sett) - 2;
-
-	for (i = 0; i < len; i++)
-	{
-		crc ^= buf[i];
-		for (uint8_t j = 0; j < 8; j++)
-		{
-			if (crc & 0x01)
-			{
-				crc >>= 1;
-				crc ^= poly;
-			}
-			else
-				crc >>= 1;
-		}
-	}
+	// CRC-16/MODBUS по всем полям, кроме самой контрольной суммы
+	uint16_t crc = crc16_modbus((const uint8_t *)&sett, sizeof(sett) - 2);
 	LOG_INFO(F("get_checksum crc=") << crc);
 	return crc;
 }
@@ -95,6 +79,24 @@ String get_proto(const String &url)
 	return proto;
 }
 
+/**
+ * @brief Возвращает имя хоста ссылки (без порта)
+ *
+ * @param url ссылка вида proto://host[:port][/path]
+ * @return имя хоста
+ */
+String get_host(const String &url)
+{
+	int start = url.indexOf(F("://"));
+	start = start < 0 ? 0 : start + 3;
+	int end = start;
+	while (end < (int)url.length() && url[end] != '/' && url[end] != ':')
+	{
+		end++;
+	}
+	return url.substring(start, end);
+}
+
 /**
  * @brief Возвращает признак является ли ссылка https
  *
@@ -113,6 +115,22 @@ extern bool is_https(const char *url)
 	return false;
 }
 
+/**
+ * @brief Возвращает признак является ли ссылка coap (отправка по UDP)
+ *
+ * @param url ссылка
+ * @return true если ссылка coap
+ */
+extern bool is_coap(const char *url)
+{
+	if (url[0])
+	{
+		String urlStr = String(url);
+		return get_proto(urlStr) == PROTO_COAP;
+	}
+	return false;
+}
+
 /**
  * @brief убирает в коце строки слэш
  *
@@ -6,6 +6,7 @@
 #define MAC_STR_HEX "%02X%02X%02X%02X%02X%02X"
 #define PROTO_HTTPS "https"
 #define PROTO_HTTP "http"
+#define PROTO_COAP "coap"
 
 /*
 Запишем 0 в конце буфера принудительно.
@@ -26,6 +27,8 @@ extern uint16_t get_checksum(const Settings &sett);
 
 extern String get_proto(const String &url);
 
+extern String get_host(const String &url);
+
 extern void remove_trailing_slash(String &topic);
 
 extern bool is_waterius_site(const Settings &sett);
@@ -40,6 +43,8 @@ extern bool is_dhcp(const Settings &sett);
 
 extern bool is_https(const char *url);
 
+extern bool is_coap(const char *url);
+
 extern void log_system_info();
 
 extern void generateSha256Token(char *token, const int token_len, const char *email);
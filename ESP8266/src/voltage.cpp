@@ -11,6 +11,7 @@ Voltage::Voltage()
 {
     _min_voltage = 0xFFFF;
     _max_voltage = 0;
+    _min_phase = PHASE_COUNT;
     _num_probes = 0;
 }
 
@@ -24,9 +25,7 @@ void Voltage::update()
     _voltage = (uint32_t)ESP.getVcc() * 1000 / 1024;  // system_get_vdd33
 #endif
 #if WATERIUS_MODEL == WATERIUS_MODEL_2
-    masterI2C.updateVoltage();
-    delay(5);
-    if (!masterI2C.getAttinyData(runtime_data)) {
+    if (!masterI2C.readVoltage(runtime_data)) {
         return;
     }
 
@@ -35,17 +34,72 @@ void Voltage::update()
     if (_min_voltage == 0) {
         _min_voltage = _voltage;
     }
-    _min_voltage = _min(_voltage, _min_voltage);
+    if (_voltage < _min_voltage) {
+        _min_voltage = _voltage;
+        _min_phase = profiler_current();
+    }
     _max_voltage = _max(_voltage, _max_voltage);
     _probes[_num_probes % MAX_PROBES] = _voltage;
+    _phases[_num_probes % MAX_PROBES] = profiler_current();
 #ifdef DEBUG_VOLTAGE
-    LOG_INFO(F("VOLTAGE: Probe #: ") << _num_probes);
+    LOG_INFO(F("VOLTAGE: Probe #: ") << _num_probes << F(" phase ") << profiler_phase_name(profiler_current()));
     LOG_INFO(F("VOLTAGE: Value (mV):") << _voltage);
     LOG_INFO(F("VOLTAGE: Min (mV):") << _min_voltage);
     LOG_INFO(F("VOLTAGE: Max (mV):") << _max_voltage);
 #endif
     _num_probes++;
 }
+/**
+ * @brief Запускает фоновые замеры по таймеру до stop_sampling()
+ *
+ * Таймер срабатывает в системном контексте, пока основной код ждет в delay()
+ * или yield(): подключение к wifi, ожидание ответа сервера. Так минимум
+ * попадает на просадку во время передачи, а не на паузы между фазами.
+ * Если шина i2c занята основным кодом, замер пропускается (BusyGuard).
+ *
+ * @param period_ms период замеров
+ */
+void Voltage::start_sampling(uint32_t period_ms)
+{
+    _sampler.attach_ms(period_ms, [this]() { update(); });
+}
+
+/**
+ * @brief Останавливает фоновые замеры. До команды сна attiny
+ *
+ */
+void Voltage::stop_sampling()
+{
+    _sampler.detach();
+}
+
+/**
+ * @brief Количество замеров в кольце, по которым считается average()
+ *
+ */
+uint8_t Voltage::samples()
+{
+    return _num_probes > MAX_PROBES ? MAX_PROBES : _num_probes;
+}
+
+/**
+ * @brief Минимальное напряжение за пробуждение в миливольтах
+ *
+ */
+uint16_t Voltage::min_value()
+{
+    return _num_probes ? _min_voltage : _voltage;
+}
+
+/**
+ * @brief Фаза цикла, в которой измерен минимум. PHASE_COUNT - вне фаз
+ *
+ */
+ProfilerPhase Voltage::min_phase()
+{
+    return (ProfilerPhase)_min_phase;
+}
+
 /**
  * @brief Разница между измеренными напряжениями  в миливольтах
  *
@@ -117,8 +171,9 @@ uint8_t Voltage::get_battery_level()
  */
 uint16_t Voltage::average()
 {
-    uint16_t avrg, sum = 0;
-    int count = _num_probes > MAX_PROBES ? MAX_PROBES : _num_probes;
+    uint16_t avrg;
+    uint32_t sum = 0;
+    uint8_t count = samples();
     for (int i = 0; i < count; i++)
     {
         sum += _probes[i];
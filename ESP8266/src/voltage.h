@@ -1,13 +1,16 @@
 #ifndef _WATERIUS_VOLTAGE_h
 #define _WATERIUS_VOLTAGE_h
 
+#include <Ticker.h>
 #include "setup.h"
 #include "Logging.h"
+#include "profiler.h"
 
 #define LOW_BATTERY_DIFF_MV 50 // надо еще учесть качество замеров (компаратора у ESP)
 #define ALERT_POWER_DIFF_MV 100
 #define BATTERY_LOW_THRESHOLD_MV 2900
 #define MAX_PROBES 20
+#define VOLTAGE_SAMPLE_MS 200 // период фоновых замеров: 20 замеров - последние 4с пробуждения
 
 class Voltage
 { 
@@ -15,8 +18,11 @@ private:
     uint16_t _voltage;
     uint16_t _min_voltage;
     uint16_t _max_voltage;
-    uint8_t _num_probes;
+    uint8_t _min_phase;
+    uint16_t _num_probes;
     uint16_t _probes[MAX_PROBES];
+    uint8_t _phases[MAX_PROBES]; // ProfilerPhase, в которой сделан замер
+    Ticker _sampler;
 
 public:
     Voltage();
@@ -25,6 +31,11 @@ public:
     uint16_t value();
     uint16_t average();
     uint16_t diff();
+    uint16_t min_value();
+    ProfilerPhase min_phase();
+    uint8_t samples();
+    void start_sampling(uint32_t period_ms = VOLTAGE_SAMPLE_MS);
+    void stop_sampling();
     bool low_voltage();
     uint8_t get_battery_level();
 };
@@ -0,0 +1,151 @@
+#include "wake_log.h"
+#include <LittleFS.h>
+#include "fs_mount.h"
+#include <coredecls.h>
+#include "Logging.h"
+#include "sync_time.h"
+
+static int8_t wake_rssi = 0;
+
+static uint32_t record_crc(const WakeRecord &record)
+{
+    return crc32(&record, offsetof(WakeRecord, crc));
+}
+
+static bool valid(const WakeRecord &record)
+{
+    return record.crc == record_crc(record);
+}
+
+void wake_log_set_rssi(int8_t rssi)
+{
+    wake_rssi = rssi;
+}
+
+void wake_log_store(const Settings &sett, WakeExit wake_exit)
+{
+    WakeRecord record;
+    memset(&record, 0, sizeof(record));
+
+    time_t now = time(nullptr);
+    record.timestamp = is_valid_time(now) ? (uint32_t)(now - millis() / 1000) : 0;
+
+    const rst_info *info = ESP.getResetInfoPtr();
+    record.reset_reason = info->reason;
+    record.exccause = info->exccause;
+    record.epc1 = info->epc1;
+
+    record.flash_writes = sett.flash_writes;
+    profiler_cycle(record.cycle);
+    record.heap_min = _min(profiler_heap_min(), (uint32_t)UINT16_MAX);
+    record.mode = sett.mode;
+    record.exit = wake_exit;
+    record.rssi = wake_rssi;
+
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return;
+    }
+
+    // Следующий номер - после самой новой целой записи
+    File file = LittleFS.open(WAKE_LOG_FILE, LittleFS.exists(WAKE_LOG_FILE) ? "r+" : "w+");
+    if (!file)
+    {
+        LOG_ERROR(F("WAKE: Failed to open ") << WAKE_LOG_FILE);
+        return;
+    }
+
+    WakeRecord item;
+    bool found = false;
+    while (file.read((uint8_t *)&item, sizeof(item)) == sizeof(item))
+    {
+        if (valid(item) && (!found || item.seq >= record.seq))
+        {
+            record.seq = item.seq + 1;
+            found = true;
+        }
+    }
+    record.crc = record_crc(record);
+
+    size_t slot = record.seq % WAKE_LOG_SIZE;
+    if (file.size() < slot * sizeof(record))
+    {
+        // файл поврежден или обрезан: начинаем журнал заново
+        file.truncate(0);
+        record.seq = 0;
+        record.crc = record_crc(record);
+        slot = 0;
+    }
+    file.seek(slot * sizeof(record), SeekSet);
+    bool ok = file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+    file.close();
+
+    if (ok)
+    {
+        LOG_INFO(F("WAKE: seq=") << record.seq << F(" reason=") << record.reset_reason << F(" exit=") << record.exit
+                                 << F(" heap_min=") << record.heap_min);
+    }
+    else
+    {
+        LOG_ERROR(F("WAKE: Store failed"));
+    }
+}
+
+uint8_t wake_log_fill_json(JsonObject &root)
+{
+    JsonArray wakes = root[F("wakes")].to<JsonArray>();
+    if (!fs_begin())
+    {
+        LOG_ERROR(F("FS: Mounting LittleFS error"));
+        return 0;
+    }
+
+    File file = LittleFS.open(WAKE_LOG_FILE, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    // Самая старая запись идет следом за самой новой
+    WakeRecord item;
+    uint32_t last_seq = 0;
+    bool found = false;
+    while (file.read((uint8_t *)&item, sizeof(item)) == sizeof(item))
+    {
+        if (valid(item) && (!found || item.seq > last_seq))
+        {
+            last_seq = item.seq;
+            found = true;
+        }
+    }
+
+    uint8_t count = 0;
+    for (uint32_t i = 1; found && i <= WAKE_LOG_SIZE; i++)
+    {
+        file.seek(((last_seq + i) % WAKE_LOG_SIZE) * sizeof(WakeRecord), SeekSet);
+        if (file.read((uint8_t *)&item, sizeof(item)) != sizeof(item) || !valid(item) || item.seq > last_seq)
+        {
+            continue;
+        }
+        JsonArray w = wakes.add<JsonArray>();
+        w.add(item.seq);
+        w.add(item.timestamp);
+        w.add(item.reset_reason);
+        w.add(item.exccause);
+        w.add(item.epc1);
+        w.add(item.mode);
+        w.add(item.exit);
+        w.add(item.rssi);
+        w.add(item.heap_min);
+        w.add(item.flash_writes);
+        w.add(item.cycle.total_ms);
+        for (uint8_t j = 0; j < PHASE_COUNT; j++)
+        {
+            w.add(item.cycle.phase_ms[j]);
+        }
+        count++;
+    }
+    file.close();
+    return count;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file wake_log.h
+ * @brief Журнал пробуждений: причина сброса, время фаз, итог цикла
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Каждое пробуждение оставляет запись в кольцевом файле на LittleFS
+ * из WAKE_LOG_SIZE записей фиксированного размера: запись с номером seq
+ * лежит в ячейке seq % WAKE_LOG_SIZE, поэтому файл не растет, а
+ * перезаписывается по одной ячейке за цикл.
+ *
+ * В RTC памяти журнал не хранится: она занята, и attiny снимает питание ESP
+ * во сне. По той же причине причина сброса почти всегда "deep sleep" или
+ * "power on", а исключения и сторожевые таймеры видны при перезагрузке ESP
+ * без снятия питания (режим настройки, OTA, падение прошивки).
+ *
+ * Журнал отдается в режиме настройки по /api/logs.
+ */
+#ifndef WAKE_LOG_H_
+#define WAKE_LOG_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "setup.h"
+#include "profiler.h"
+
+#define WAKE_LOG_FILE "/wakes.bin"
+#define WAKE_LOG_SIZE 32 // Записей в журнале
+
+/**
+ * @brief Чем закончился цикл пробуждения
+ */
+enum WakeExit : uint8_t
+{
+    WAKE_EXIT_OK = 0,       // показания отправлены
+    WAKE_EXIT_NO_ATTINY,    // нет ответа attiny по i2c
+    WAKE_EXIT_NO_CONFIG,    // настройки не загружены
+    WAKE_EXIT_SETUP,        // режим настройки
+    WAKE_EXIT_NO_WIFI,      // не подключились к Wi-Fi
+    WAKE_EXIT_NOT_SENT,     // ни один сервер не принял показания
+    WAKE_EXIT_WIFI_BACKOFF, // Wi-Fi пропущен после неудач подряд
+};
+
+struct WakeRecord
+{
+    uint32_t seq;
+    uint32_t timestamp;    // время пробуждения, 0 - неизвестно
+    uint32_t epc1;         // адрес исключения при сбросе из-за него
+    uint32_t flash_writes; // Settings::flash_writes на конец цикла
+    ProfilerCycle cycle;   // время фаз, мс
+    uint16_t heap_min;     // минимальная свободная куча, байт
+    uint8_t reset_reason;  // rst_info::reason
+    uint8_t exccause;      // rst_info::exccause
+    uint8_t mode;          // режим пробуждения
+    uint8_t exit;          // WakeExit
+    int8_t rssi;           // 0 - не подключались
+    uint8_t reserved;
+    uint32_t crc;
+};
+
+/**
+ * @brief Запоминает уровень сигнала для записи цикла
+ */
+extern void wake_log_set_rssi(int8_t rssi);
+
+/**
+ * @brief Записывает текущий цикл в журнал. Вызывается перед засыпанием.
+ *
+ * @param sett настройки (режим, счетчик записей во flash)
+ * @param wake_exit итог цикла
+ */
+extern void wake_log_store(const Settings &sett, WakeExit wake_exit);
+
+/**
+ * @brief Добавляет массив "wakes" с записями журнала от старых к новым:
+ * [seq, timestamp, reset_reason, exccause, epc1, mode, exit, rssi, heap_min,
+ *  flash_writes, total_ms, i2c, wifi, mqtt, ntp, send, ota, off]
+ *
+ * @param root объект json
+ * @return количество записей
+ */
+extern uint8_t wake_log_fill_json(JsonObject &root);
+
+#endif
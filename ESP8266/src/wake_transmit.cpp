@@ -0,0 +1,263 @@
+#include "wake_transmit.h"
+#include <ESP8266WiFi.h>
+#include "Logging.h"
+#include "config.h"
+#include "master_i2c.h"
+#include "senders/send_data.h"
+#include "http_pool.h"
+#include "json_arena.h"
+#include "ha/apply_settings.h"
+#include "voltage.h"
+#include "utils.h"
+#include "sync_time.h"
+#include "wifi_helpers.h"
+#include "ota_update.h"
+#include "profiler.h"
+#include "offline_queue.h"
+#include "dns_cache.h"
+#include "log_store.h"
+#include "energy.h"
+#include "espnow_link.h"
+
+extern MasterI2C masterI2C;
+extern AttinyData data;
+extern AttinySnapshots snapshots;
+extern AttinyFlowStats flow_stats;
+extern AttinyPulseLog pulse_log;
+extern Settings sett;
+extern CalculatedData cdata;
+extern Voltage voltage;
+
+WakeExit wake_transmit(uint8_t mode, ArduinoJson::Allocator *allocator)
+{
+    WakeExit wake_exit = WAKE_EXIT_NO_WIFI;
+
+    // Забираем интервальные данные, пока не включили wifi
+    if (data.version >= ATTINY_SNAPSHOT_MIN_VERSION)
+    {
+        masterI2C.getSnapshots(snapshots);
+    }
+    if (masterI2C.hasCapability(ATTINY_CAP_FLOW_STATS))
+    {
+        masterI2C.getFlowStats(flow_stats);
+    }
+    // Без новых импульсов расход нулевой, интервалы не нужны
+    if (masterI2C.hasCapability(ATTINY_CAP_PULSE_LOG) &&
+        (data.impulses0 != sett.impulses0_previous || data.impulses1 != sett.impulses1_previous))
+    {
+        masterI2C.getPulseLog(pulse_log);
+    }
+    if (masterI2C.hasCapability(ATTINY_CAP_WDT_RATES))
+    {
+        // Неизвестные прошивке теги она пропустит
+        static const uint8_t tags[] = {ATTINY_TAG_WDT_RATES, ATTINY_TAG_STORAGE};
+        masterI2C.getFields(tags, sizeof(tags), data);
+    }
+    if (masterI2C.hasCapability(ATTINY_CAP_FLOW_ALARM))
+    {
+        // В ответ attiny (ATTINY_FIELDS_SIZE) три поля с предыдущими не помещаются
+        static const uint8_t tags[] = {ATTINY_TAG_FLOW_ALARM, ATTINY_TAG_EEPROM_SKIPPED};
+        masterI2C.getFields(tags, sizeof(tags), data);
+    }
+
+    // Пока нет NTP, время оцениваем по длительности сна
+    apply_time_estimate(sett);
+
+    // Дальше напряжение меряется в фоне, в том числе под нагрузкой передачи wifi
+    voltage.start_sampling();
+
+    // Обычное пробуждение с шлюзом ESP-NOW рядом: кадр шлюзу без подключения к роутеру
+    bool espnow_sent = false;
+#ifndef ESPNOW_DISABLED
+    if (mode == TRANSMIT_MODE && espnow_role(sett) == ESPNOW_ROLE_SENDER)
+    {
+        profiler_start(PHASE_SEND);
+        espnow_sent = espnow_send(sett, data, cdata, voltage.average());
+        profiler_stop(PHASE_SEND);
+    }
+#endif
+
+    // После нескольких неудач подряд Wi-Fi пропускается: показания в очередь и сразу спать
+    bool backoff = !espnow_sent && wifi_backoff(sett, mode);
+    bool wifi_connected = false;
+    if (!backoff && !espnow_sent)
+    {
+        profiler_start(PHASE_WIFI);
+        wifi_connected = wifi_connect(sett);
+        profiler_stop(PHASE_WIFI);
+        wifi_backoff_result(sett, wifi_connected);
+    }
+
+    if (wifi_connected)
+    {
+        wake_log_set_rssi(WiFi.RSSI());
+        // Запросы DNS для всех серверов идут параллельно с остальными фазами
+        dns_prefetch(sett);
+
+        log_system_info();
+
+        JsonDocument json_data(allocator);
+        JsonDocument json_settings_received(allocator);
+
+        // Время нужно только при использовании хттпс или мктт.
+        // Ответ NTP приходит в фоне, пока подключаемся к серверам
+        bool need_time = is_mqtt(sett) || is_https(sett.waterius_host) || is_https(sett.http_url);
+        if (need_time)
+        {
+            sync_time_begin(sett);
+        }
+
+        // Подключаемся и подписываемся на мктт
+#ifndef MQTT_DISABLED
+        if (is_mqtt(sett))
+        {
+            profiler_start(PHASE_MQTT);
+            connect_and_subscribe_mqtt(sett, json_settings_received);
+            profiler_stop(PHASE_MQTT);
+        }
+#endif
+
+        // TLS с setInsecure не проверяет сроки сертификата, время нужно только для данных
+        if (need_time)
+        {
+            profiler_start(PHASE_NTP);
+            if (!sync_time_end(sett)) {
+                sett.ntp_error_counter++;
+            }
+            profiler_stop(PHASE_NTP);
+        }
+
+        LOG_INFO(F("Free memory: ") << ESP.getFreeHeap());
+
+        profiler_start(PHASE_SEND);
+        bool sent = send_data(sett, data, cdata, json_data, json_settings_received);
+        profiler_stop(PHASE_SEND);
+
+        if (send_results.http.status == SEND_OK && send_results.http_static_crc)
+        {
+            // сервер принял статические поля, дальше шлем только при их изменении
+            sett.http_static_crc = send_results.http_static_crc;
+        }
+
+        wake_exit = sent ? WAKE_EXIT_OK : WAKE_EXIT_NOT_SENT;
+        if (sent)
+        {
+            // Очередь у всех направлений общая: пока хоть одно не приняло
+            // показания, храним их (точки с теми же timestamp придут повторно)
+            if (send_results.waterius.status != SEND_FAIL &&
+                send_results.http.status != SEND_FAIL &&
+                send_results.mqtt.status != SEND_FAIL)
+            {
+                offline_queue_clear(sett);
+            }
+            else
+            {
+                offline_queue_push(sett, data, voltage.average());
+            }
+            if (snapshots.count)
+            {
+                masterI2C.clearSnapshots();
+            }
+            if (flow_stats.valid)
+            {
+                masterI2C.clearFlowStats();
+            }
+        }
+        else
+        {
+            // сохраним показания, чтобы отправить при следующем подключении
+            offline_queue_push(sett, data, voltage.average());
+        }
+
+        if (sett.ota_error != OTA_ERR_NONE)
+        {
+            sett.ota_error = OTA_ERR_NONE;
+            store_config(sett);
+        }
+
+        if (settings_received(json_settings_received))
+        {
+            apply_settings(json_settings_received, sett, data, cdata);
+            // Подтверждаем только тем, кто прислал настройки, и только изменения
+            profiler_start(PHASE_SEND);
+            send_settings_ack(sett, data, cdata, json_data, json_settings_received);
+            profiler_stop(PHASE_SEND);
+        }
+
+        if (send_results.http.status == SEND_OK)
+        {
+            // сервер на связи - отдаем лог прошлых неудачных пробуждений
+            profiler_start(PHASE_SEND);
+            log_store_upload(sett);
+            profiler_stop(PHASE_SEND);
+        }
+
+        // Подтверждение и лог шли по открытым соединениям, дальше они не нужны
+        http_pool_close();
+        LOG_INFO(F("JSON: arena peak ") << json_arena.peak() << F(" of ") << json_arena.capacity()
+                                        << F(", heap fallbacks ") << json_arena.fallbacks());
+
+#if WATERIUS_MODEL == WATERIUS_MODEL_2
+        if (has_ota(json_settings_received))
+        {
+            profiler_start(PHASE_OTA);
+            perform_ota_update(json_settings_received[F("ota")].as<JsonObject>(), masterI2C, sett, voltage);
+            profiler_stop(PHASE_OTA);
+        }
+#endif
+
+#ifndef MQTT_DISABLED
+        // Монитор входов по команде из Home Assistant
+        if (is_mqtt(sett))
+        {
+            profiler_start(PHASE_MQTT);
+            if (monitor_mqtt(sett, data, json_settings_received) && settings_received(json_settings_received))
+            {
+                // команды, пришедшие за время сессии, иначе потеряются: retain уже удален
+                apply_settings(json_settings_received, sett, data, cdata);
+            }
+            profiler_stop(PHASE_MQTT);
+        }
+#endif
+
+        // Все уже отправили,  wifi не нужен - выключаем
+        dns_cache_store();
+
+        profiler_start(PHASE_SHUTDOWN);
+        wifi_shutdown();
+        profiler_stop(PHASE_SHUTDOWN);
+
+        wakeup_policy(sett, cdata, snapshots, energy_battery_low(sett));
+        update_config(sett, data, cdata);
+        wakeup_defer(sett, send_results.retry_after);
+
+        if (!masterI2C.setWakeUpPeriod(sett.period_min_tuned))
+        {
+            LOG_ERROR(F("Wakeup period wasn't set"));
+        }
+    }
+    else if (espnow_sent)
+    {
+        wake_exit = WAKE_EXIT_OK;
+        profiler_start(PHASE_SHUTDOWN);
+        wifi_shutdown();
+        profiler_stop(PHASE_SHUTDOWN);
+
+        wakeup_policy(sett, cdata, snapshots, energy_battery_low(sett));
+        update_config(sett, data, cdata);
+
+        if (!masterI2C.setWakeUpPeriod(sett.period_min_tuned))
+        {
+            LOG_ERROR(F("Wakeup period wasn't set"));
+        }
+    }
+    else
+    {
+        wake_exit = backoff ? WAKE_EXIT_WIFI_BACKOFF : WAKE_EXIT_NO_WIFI;
+        offline_queue_push(sett, data, voltage.average());
+        advance_time_estimate(sett);
+    }
+    energy_account(sett);
+    store_config(sett);  // т.к. сохраняем число ошибок подключения
+    return wake_exit;
+}
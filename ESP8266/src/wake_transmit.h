@@ -0,0 +1,32 @@
+/**
+ * @file wake_transmit.h
+ * @brief Передача показаний за одно пробуждение
+ * @version 0.1
+ * @date 2026-10-15
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Часть loop() после загрузки настроек: данные attiny, подключение,
+ * отправка, настройки с сервера, OTA, новый период сна и сохранение
+ * настроек. Эту же функцию выполняет симулятор пробуждения
+ * (test/test_wake) с заглушками сетевых модулей, поэтому путь передачи
+ * в нем не расходится с прошивкой.
+ */
+#ifndef WAKE_TRANSMIT_H_
+#define WAKE_TRANSMIT_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "wake_log.h"
+
+/**
+ * @brief Выполняет передачу показаний. Настройки уже загружены,
+ * данные attiny получены.
+ *
+ * @param mode режим пробуждения от attiny
+ * @param allocator память для документов json (json_arena)
+ * @return итог пробуждения
+ */
+extern WakeExit wake_transmit(uint8_t mode, ArduinoJson::Allocator *allocator);
+
+#endif
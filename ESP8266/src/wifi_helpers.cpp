@@ -3,12 +3,441 @@
 #include "utils.h"
 #include <LittleFS.h>
 #include <ESP8266WiFiScan.h>
+#include <coredecls.h>
+#include "fs_mount.h"
 
 #define WIFI_SET_MODE_ATTEMPTS 2
+#define WIFI_STATE_TIMEOUT 500 // Максимальное ожидание смены состояния радио, ms
+
+/**
+ * @brief Кэш последнего подключения.
+ * Позволяет подключиться на известный BSSID/канал со статическими
+ * адресами из прошлой аренды DHCP без сканирования и согласования DHCP.
+ *
+ * attiny снимает питание ESP после сна, поэтому кэш лежит в файле на
+ * LittleFS и перезаписывается только при новой аренде. Подключения по кэшу
+ * считает горячее поле настроек wifi_fast_uses: журнал настроек и так
+ * пишется каждое пробуждение.
+ */
+struct WifiFastCache
+{
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns1;
+    uint32_t dns2;
+    uint32_t ssid_crc; // crc ssid и пароля, чтобы не использовать кэш после смены сети
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t crc;
+};
+
+static uint32_t wifi_ssid_crc(const Settings &sett)
+{
+    uint32_t crc = crc32(sett.wifi_ssid, strnlen(sett.wifi_ssid, WIFI_SSID_LEN));
+    return crc32(sett.wifi_password, strnlen(sett.wifi_password, WIFI_PWD_LEN), crc);
+}
+
+static uint32_t wifi_cache_crc(const WifiFastCache &cache)
+{
+    return crc32(&cache, offsetof(WifiFastCache, crc));
+}
+
+static bool wifi_cache_load(WifiFastCache &cache)
+{
+    bool valid = false;
+    if (fs_begin())
+    {
+        File file = LittleFS.open(WIFI_CACHE_FILE, "r");
+        if (file)
+        {
+            valid = file.read((uint8_t *)&cache, sizeof(cache)) == sizeof(cache) &&
+                    cache.crc == wifi_cache_crc(cache);
+            file.close();
+        }
+    }
+    return valid;
+}
+
+static void wifi_cache_invalidate()
+{
+    if (fs_begin() && LittleFS.exists(WIFI_CACHE_FILE))
+    {
+        LittleFS.remove(WIFI_CACHE_FILE);
+    }
+}
+
+static void wifi_cache_store(Settings &sett, bool from_dhcp)
+{
+    if (!from_dhcp)
+    {
+        // адреса не менялись, увеличиваем только счетчик
+        if (sett.wifi_fast_uses < 255)
+        {
+            sett.wifi_fast_uses++;
+        }
+        return;
+    }
+
+    WifiFastCache cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.mask = WiFi.subnetMask();
+    cache.dns1 = WiFi.dnsIP(0);
+    cache.dns2 = WiFi.dnsIP(1);
+    cache.ssid_crc = wifi_ssid_crc(sett);
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.crc = wifi_cache_crc(cache);
+    sett.wifi_fast_uses = 0;
+
+    WifiFastCache stored;
+    if (wifi_cache_load(stored) && memcmp(&stored, &cache, sizeof(cache)) == 0)
+    {
+        // DHCP выдал ту же аренду: flash не трогаем
+        return;
+    }
+
+    if (!fs_begin())
+    {
+        return;
+    }
+    File file = LittleFS.open(WIFI_CACHE_FILE, "w");
+    if (!file || file.write((const uint8_t *)&cache, sizeof(cache)) != sizeof(cache))
+    {
+        LOG_ERROR(F("WIFI: Failed to store cache"));
+    }
+    if (file)
+    {
+        file.close();
+    }
+}
+
+/**
+ * @brief Быстрое подключение по кэшу прошлой аренды без задержек.
+ * Работает только в режиме DHCP: при статическом IP адреса уже известны.
+ *
+ * @param sett настройки
+ * @return true подключились
+ */
+static bool wifi_fast_connect(const Settings &sett)
+{
+    WifiFastCache cache;
+    if (!is_dhcp(sett) || !wifi_cache_load(cache))
+    {
+        return false;
+    }
+
+    if (cache.ssid_crc != wifi_ssid_crc(sett) || !cache.channel || !cache.ip)
+    {
+        LOG_INFO(F("WIFI: cache is not valid"));
+        return false;
+    }
+
+    if (sett.wifi_fast_uses >= WIFI_FAST_CONNECT_MAX_USES)
+    {
+        LOG_INFO(F("WIFI: cache expired, renew DHCP lease"));
+        return false;
+    }
+
+    LOG_INFO(F("WIFI: fast connect channel: ") << cache.channel << F(" ip: ") << IPAddress(cache.ip).toString());
+
+    WiFi.persistent(false);
+    wifi_set_mode(WIFI_STA);
+    if (sett.wifi_phy_mode)
+    {
+        WiFi.setPhyMode((WiFiPhyMode_t)sett.wifi_phy_mode);
+    }
+    WiFi.config(cache.ip, cache.gateway, cache.mask, cache.dns1, cache.dns2);
+    WiFi.hostname(get_device_name());
+    WiFi.begin(sett.wifi_ssid, sett.wifi_password, cache.channel, cache.bssid);
+
+    if (WiFi.waitForConnectResult(WIFI_FAST_CONNECT_TIMEOUT) == WL_CONNECTED)
+    {
+        return true;
+    }
+
+    LOG_ERROR(F("WIFI: fast connect failed, status=") << WiFi.status());
+    wifi_cache_invalidate();
+    // возвращаем DHCP для обычного подключения
+    WiFi.config(0U, 0U, 0U);
+    return false;
+}
+
+/**
+ * @brief Статистика подключений по вариантам (точка доступа, режим PHY).
+ *
+ * В mesh сети сохраненный BSSID не всегда лучший, а режим PHY, заданный
+ * в настройках или по умолчанию (N), не всегда подключается быстрее.
+ * Первая попытка идет по варианту с наименьшим средним временем
+ * подключения (неудачи подряд - штраф), изредка - по другому варианту,
+ * чтобы статистика не устаревала. Новые точки доступа попадают в таблицу,
+ * когда SDK сам выбирает точку (попытка без BSSID).
+ *
+ * attiny снимает питание ESP, поэтому таблица лежит в файле на LittleFS
+ * и перезаписывается, только если заметно изменилась.
+ */
+struct WifiOption
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t phy_mode; // WiFiPhyMode_t
+    uint16_t avg_ms;  // скользящее среднее времени подключения
+    uint8_t connects; // успешных подключений (насыщение 255)
+    uint8_t fails;    // неудач подряд
+};
+
+struct WifiStats
+{
+    uint32_t ssid_crc; // статистика другой сети не используется
+    uint8_t count;
+    uint8_t reserved[3];
+    WifiOption options[WIFI_STATS_SIZE];
+    uint32_t crc;
+};
+
+static WifiStats wifi_stats;
+static bool wifi_stats_loaded = false;
+static bool wifi_stats_dirty = false;
+
+static uint32_t wifi_stats_crc(const WifiStats &stats)
+{
+    return crc32(&stats, offsetof(WifiStats, crc));
+}
+
+static void wifi_stats_load(const Settings &sett)
+{
+    if (wifi_stats_loaded)
+    {
+        return;
+    }
+    wifi_stats_loaded = true;
+
+    bool valid = false;
+    if (fs_begin())
+    {
+        File file = LittleFS.open(WIFI_STATS_FILE, "r");
+        if (file)
+        {
+            valid = file.read((uint8_t *)&wifi_stats, sizeof(wifi_stats)) == sizeof(wifi_stats) &&
+                    wifi_stats.crc == wifi_stats_crc(wifi_stats) &&
+                    wifi_stats.ssid_crc == wifi_ssid_crc(sett) &&
+                    wifi_stats.count <= WIFI_STATS_SIZE;
+            file.close();
+        }
+    }
+    if (!valid)
+    {
+        memset(&wifi_stats, 0, sizeof(wifi_stats));
+        wifi_stats.ssid_crc = wifi_ssid_crc(sett);
+    }
+}
+
+static void wifi_stats_store()
+{
+    if (!wifi_stats_dirty || !fs_begin())
+    {
+        return;
+    }
+    wifi_stats.crc = wifi_stats_crc(wifi_stats);
+    File file = LittleFS.open(WIFI_STATS_FILE, "w");
+    if (!file || file.write((const uint8_t *)&wifi_stats, sizeof(wifi_stats)) != sizeof(wifi_stats))
+    {
+        LOG_ERROR(F("WIFI: Failed to store stats"));
+    }
+    if (file)
+    {
+        file.close();
+    }
+    wifi_stats_dirty = false;
+}
+
+// Оценка варианта для выбора: меньше - лучше
+static uint32_t wifi_option_score(const WifiOption &option)
+{
+    return option.avg_ms + (uint32_t)option.fails * WIFI_STATS_FAIL_PENALTY_MS;
+}
+
+static WifiOption *wifi_stats_find(const uint8_t *bssid, uint8_t phy_mode)
+{
+    for (uint8_t i = 0; i < wifi_stats.count; i++)
+    {
+        WifiOption &option = wifi_stats.options[i];
+        if (option.phy_mode == phy_mode && memcmp(option.bssid, bssid, sizeof(option.bssid)) == 0)
+        {
+            return &option;
+        }
+    }
+    return nullptr;
+}
+
+// Вариант для новой пары: свободное место или худший по оценке
+static WifiOption *wifi_stats_add(const uint8_t *bssid, uint8_t channel, uint8_t phy_mode)
+{
+    WifiOption *option;
+    if (wifi_stats.count < WIFI_STATS_SIZE)
+    {
+        option = &wifi_stats.options[wifi_stats.count++];
+    }
+    else
+    {
+        option = &wifi_stats.options[0];
+        for (uint8_t i = 1; i < WIFI_STATS_SIZE; i++)
+        {
+            if (wifi_option_score(wifi_stats.options[i]) > wifi_option_score(*option))
+            {
+                option = &wifi_stats.options[i];
+            }
+        }
+    }
+    memset(option, 0, sizeof(*option));
+    memcpy(option->bssid, bssid, sizeof(option->bssid));
+    option->channel = channel;
+    option->phy_mode = phy_mode;
+    wifi_stats_dirty = true;
+    return option;
+}
+
+/**
+ * @brief Учитывает результат попытки подключения
+ *
+ * @param bssid точка доступа
+ * @param channel канал
+ * @param phy_mode режим PHY попытки
+ * @param connected подключились
+ * @param ms время попытки
+ */
+static void wifi_stats_result(const uint8_t *bssid, uint8_t channel, uint8_t phy_mode, bool connected, uint32_t ms)
+{
+    WifiOption *option = wifi_stats_find(bssid, phy_mode);
+    if (!option)
+    {
+        if (!connected)
+        {
+            return; // неизвестную точку не запоминаем
+        }
+        option = wifi_stats_add(bssid, channel, phy_mode);
+    }
+
+    if (!connected)
+    {
+        if (option->fails < UINT8_MAX)
+        {
+            option->fails++;
+        }
+        wifi_stats_dirty = true;
+        return;
+    }
+
+    uint16_t avg_ms = option->connects ? (option->avg_ms * 3UL + ms) / 4 : _min(ms, (uint32_t)UINT16_MAX);
+    if (option->fails || option->channel != channel || !option->connects ||
+        abs((int32_t)avg_ms - (int32_t)option->avg_ms) >= WIFI_STATS_STORE_DIFF_MS)
+    {
+        wifi_stats_dirty = true;
+    }
+    option->avg_ms = avg_ms;
+    option->channel = channel;
+    option->fails = 0;
+    if (option->connects < UINT8_MAX)
+    {
+        option->connects++;
+    }
+}
+
+/**
+ * @brief Выбирает вариант первой попытки подключения
+ *
+ * @param sett настройки: режим PHY, если задан, не меняется
+ * @param choice выбранный вариант
+ * @return true вариант выбран, false - подключаться как раньше
+ */
+static bool wifi_stats_choose(const Settings &sett, WifiOption &choice)
+{
+    wifi_stats_load(sett);
+
+    WifiOption *best = nullptr;
+    WifiOption *rare = nullptr; // меньше всего подключений
+    for (uint8_t i = 0; i < wifi_stats.count; i++)
+    {
+        WifiOption &option = wifi_stats.options[i];
+        if (sett.wifi_phy_mode && option.phy_mode != sett.wifi_phy_mode)
+        {
+            continue;
+        }
+        if (!best || wifi_option_score(option) < wifi_option_score(*best))
+        {
+            best = &option;
+        }
+        if (!rare || option.connects < rare->connects)
+        {
+            rare = &option;
+        }
+    }
+    if (!best)
+    {
+        return false;
+    }
+
+    choice = *best;
+    if (ESP.random() % WIFI_STATS_PROBE_PERIOD == 0)
+    {
+        // Проба: другой режим PHY на лучшей точке, затем реже всего выбираемый вариант,
+        // иначе выбор точки SDK - так находятся другие точки mesh сети
+        static const uint8_t phy_modes[] = {WIFI_PHY_MODE_11N, WIFI_PHY_MODE_11G};
+        bool found = false;
+        for (uint8_t phy_mode : phy_modes)
+        {
+            if (!sett.wifi_phy_mode && !wifi_stats_find(best->bssid, phy_mode))
+            {
+                choice.phy_mode = phy_mode;
+                found = true;
+                break;
+            }
+        }
+        if (!found && rare != best)
+        {
+            choice = *rare;
+            found = true;
+        }
+        if (!found)
+        {
+            choice.channel = 0;
+        }
+        LOG_INFO(F("WIFI: probe channel ") << choice.channel << F(" mode ") << wifi_phy_mode_title((WiFiPhyMode_t)choice.phy_mode));
+    }
+    return true;
+}
 
 // Adoption of Tasmota wifi module
 // https://github.com/arendst/Tasmota/blob/development/tasmota/tasmota_support/support_wifi.ino
 
+WifiTransitions wifi_transitions;
+
+/**
+ * @brief Ждет пока SDK перейдет в нужное состояние, но не дольше timeout_ms
+ *
+ * @param condition условие перехода
+ * @param timeout_ms максимальное время ожидания
+ * @return время ожидания, мс
+ */
+template <typename Condition>
+static uint16_t wifi_wait(Condition condition, uint32_t timeout_ms)
+{
+    uint32_t start = millis();
+    while (!condition())
+    {
+        if (millis() - start >= timeout_ms)
+        {
+            LOG_ERROR(F("WIFI: state timeout ") << timeout_ms << F(" ms"));
+            break;
+        }
+        delay(1); // отдаем управление SDK
+    }
+    return millis() - start;
+}
+
 void wifi_set_mode(WiFiMode_t wifi_mode)
 {
     if (WiFi.getMode() == wifi_mode)
@@ -16,46 +445,54 @@ void wifi_set_mode(WiFiMode_t wifi_mode)
         return;
     }
 
+    uint32_t start = millis();
     if (wifi_mode != WIFI_OFF)
     {
         WiFi.forceSleepWake();
-        delay(100);
+        wifi_transitions.wake_ms = wifi_wait([]()
+                                             { return wifi_fpm_get_sleep_type() == NONE_SLEEP_T; },
+                                             WIFI_STATE_TIMEOUT);
     }
 
     uint32_t attempts = WIFI_SET_MODE_ATTEMPTS;
     while (!WiFi.mode(wifi_mode) && attempts--)
     {
         LOG_INFO(F("WIFI: Retry set Mode..."));
-        delay(100);
     }
+    wifi_transitions.mode_ms = wifi_wait([wifi_mode]()
+                                         { return WiFi.getMode() == wifi_mode; },
+                                         WIFI_STATE_TIMEOUT);
 
     if (wifi_mode == WIFI_OFF)
     {
-        delay(1000); // TODO: наверное нужно уменьшить до 100-300 мсек
         WiFi.forceSleepBegin();
-        delay(1);
-    }
-    else
-    {
-        delay(30); // Must allow for some time to init.
+        delay(1); // без него SDK не переведет модем в сон
+        wifi_transitions.sleep_ms = millis() - start;
     }
+
+    LOG_INFO(F("WIFI: mode ") << wifi_mode << F(" set in ") << millis() - start << F(" ms"));
 }
 
-void wifi_begin(Settings &sett, WiFiMode_t wifi_mode)
+void wifi_begin(Settings &sett, WiFiMode_t wifi_mode, uint8_t phy_mode /*= 0*/)
 {
+    if (!phy_mode)
+    {
+        phy_mode = sett.wifi_phy_mode;
+    }
 
     WiFi.persistent(false); // Solve possible wifi init errors (re-add at 6.2.1.16 #4044, #4083)
     WiFi.disconnect(true);  // Delete SDK wifi config
+    wifi_transitions.disconnect_ms = wifi_wait([]()
+                                               { return !WiFi.isConnected(); },
+                                               WIFI_STATE_TIMEOUT);
     LOG_INFO(F("WIFI: disconnect"));
 
-    delay(200); // подождем чтобы проинициализировалась сеть
-
     wifi_set_mode(wifi_mode); // Disable AP mode
-    if (sett.wifi_phy_mode)
+    if (phy_mode)
     {
-        if (!WiFi.setPhyMode((WiFiPhyMode_t)sett.wifi_phy_mode))
+        if (!WiFi.setPhyMode((WiFiPhyMode_t)phy_mode))
         {
-            LOG_ERROR(F("WIFI: Failed set phy mode ") << sett.wifi_phy_mode);
+            LOG_ERROR(F("WIFI: Failed set phy mode ") << phy_mode);
         }
     }
 
@@ -105,8 +542,9 @@ void wifi_begin(Settings &sett, WiFiMode_t wifi_mode)
 void wifi_shutdown()
 {
     WiFi.disconnect(true);
-    delay(100);
-    yield();
+    wifi_transitions.disconnect_ms = wifi_wait([]()
+                                               { return !WiFi.isConnected(); },
+                                               WIFI_STATE_TIMEOUT);
     wifi_set_mode(WIFI_OFF);
 }
 
@@ -132,30 +570,69 @@ bool wifi_connect(Settings &sett, WiFiMode_t wifi_mode /*= WIFI_STA*/)
     uint32_t start_time = millis();
     LOG_INFO(F("WIFI: Connecting..."));
     sett.wifi_connect_attempt = WIFI_CONNECT_ATTEMPTS;
+    wifi_transitions.connect_ms = 0;
+
+    if ((wifi_mode == WIFI_STA) && wifi_fast_connect(sett))
+    {
+        wifi_cache_store(sett, false);
+        wifi_transitions.connect_ms = millis() - start_time;
+        LOG_INFO(F("WIFI: Connected. BSSID: ") << WiFi.BSSIDstr());
+        LOG_INFO(F("WIFI: Time spent ") << wifi_transitions.connect_ms << F(" ms"));
+        return true;
+    }
+
+    // Первая попытка - по статистике прошлых подключений, в режиме портала - как задано
+    WifiOption choice;
+    bool chosen = (wifi_mode == WIFI_STA) && wifi_stats_choose(sett, choice);
+
     do
     {
         LOG_INFO(F("WIFI: Attempt #") << WIFI_CONNECT_ATTEMPTS - sett.wifi_connect_attempt + 1 << F(" from ") << WIFI_CONNECT_ATTEMPTS);
-        wifi_begin(sett, wifi_mode);
+        uint8_t phy_mode = 0;
+        if (chosen)
+        {
+            sett.wifi_channel = choice.channel;
+            memcpy(sett.wifi_bssid, choice.bssid, sizeof(sett.wifi_bssid));
+            phy_mode = choice.phy_mode;
+        }
+        uint32_t attempt_time = millis();
+        wifi_begin(sett, wifi_mode, phy_mode);
+        if (wifi_mode == WIFI_STA && (sett.wifi_channel || WiFi.isConnected()))
+        {
+            const uint8_t *bssid = WiFi.isConnected() ? WiFi.BSSID() : sett.wifi_bssid;
+            uint8_t channel = WiFi.isConnected() ? WiFi.channel() : sett.wifi_channel;
+            wifi_stats_result(bssid, channel, WiFi.getPhyMode(), WiFi.isConnected(), millis() - attempt_time);
+        }
+        chosen = false;
+
         if (WiFi.isConnected())
         {
             sett.wifi_channel = WiFi.channel(); // сохраняем для быстрого коннекта
             uint8_t *bssid = WiFi.BSSID();
             memcpy((void *)&sett.wifi_bssid, (void *)bssid, sizeof(sett.wifi_bssid)); // сохраняем для быстрого коннекта
+            if (is_dhcp(sett))
+            {
+                wifi_cache_store(sett, true);
+            }
+            wifi_stats_store();
+            wifi_transitions.connect_ms = millis() - start_time;
             LOG_INFO(F("WIFI: Connected."));
             LOG_INFO(F("WIFI: SSID: ") << WiFi.SSID() 
                 << F(" Channel: ") << WiFi.channel() 
                 << F(" BSSID: ") << WiFi.BSSIDstr()
                 << F(" mode: ") << wifi_phy_mode_title(WiFi.getPhyMode()));
 
-            LOG_INFO(F("WIFI: Time spent ") << millis() - start_time << F(" ms"));
+            LOG_INFO(F("WIFI: Time spent ") << wifi_transitions.connect_ms << F(" ms"));
             return true;
         }
         sett.wifi_channel = 0;
         LOG_ERROR(F("WIFI: Connection failed."));
     } while (--sett.wifi_connect_attempt);
 
+    wifi_stats_store();
     sett.wifi_connect_errors++;
-    LOG_ERROR(F("WIFI: Connection failed.") << millis() - start_time << F(" ms"));
+    wifi_transitions.connect_ms = millis() - start_time;
+    LOG_ERROR(F("WIFI: Connection failed.") << wifi_transitions.connect_ms << F(" ms"));
     return false;
 }
 
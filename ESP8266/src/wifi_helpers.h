@@ -13,8 +13,36 @@
 #include <ESP8266WiFi.h>
 #include "setup.h"
 
+#define WIFI_STATS_FILE "/wifi.bin"
+#define WIFI_CACHE_FILE "/wifi_fast.bin" // аренда DHCP для быстрого подключения
+#define WIFI_STATS_SIZE 6               // вариантов (точка доступа, режим PHY) в статистике
+#define WIFI_STATS_PROBE_PERIOD 16      // в среднем раз в столько подключений пробуем другой вариант
+#define WIFI_STATS_FAIL_PENALTY_MS 5000 // штраф варианта за каждую неудачу подряд
+#define WIFI_STATS_STORE_DIFF_MS 100    // среднее изменилось меньше - файл не перезаписываем
+
+/**
+ * @brief Длительность последних переходов радио, мс
+ *
+ */
+struct WifiTransitions
+{
+    uint16_t wake_ms;       // выход модема из сна
+    uint16_t mode_ms;       // смена режима
+    uint16_t disconnect_ms; // отключение от точки доступа
+    uint16_t sleep_ms;      // выключение wifi целиком
+    uint16_t connect_ms;    // wifi_connect целиком, со всеми попытками
+};
+
+extern WifiTransitions wifi_transitions;
+
 extern bool wifi_connect(Settings &sett, WiFiMode_t wifi_mode = WIFI_STA);
-extern void wifi_begin(Settings &sett, WiFiMode_t wifi_mode);
+/**
+ * @brief Одна попытка подключения на sett.wifi_channel и sett.wifi_bssid
+ * (0 - точку выбирает SDK)
+ *
+ * @param phy_mode режим PHY попытки, 0 - из настроек
+ */
+extern void wifi_begin(Settings &sett, WiFiMode_t wifi_mode, uint8_t phy_mode = 0);
 extern void wifi_set_mode(WiFiMode_t wifi_mode);
 extern void wifi_shutdown();
 extern String wifi_phy_mode_title(const WiFiPhyMode_t mode);
@@ -0,0 +1,356 @@
+/**
+ * @file Arduino.h
+ * @brief Заглушка ядра Arduino для сборки прошивки на компьютере (env:native)
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Только то, что используют модули прошивки, которые собираются в тестах:
+ * String поверх std::string, Print, Serial и часы millis()/micros() симулятора.
+ * Строки F() на компьютере лежат в обычной памяти.
+ */
+#ifndef MOCK_ARDUINO_H_
+#define MOCK_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include "sim.h"
+
+#ifndef ESP8266
+#define ESP8266
+#endif
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+typedef char __FlashStringHelper;
+
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+#define strncpy_P strncpy
+#define strstr_P strstr
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+
+#define _min(a, b) ((a) < (b) ? (a) : (b))
+#define _max(a, b) ((a) > (b) ? (a) : (b))
+
+#define DEC 10
+#define HEX 16
+
+#define ADC_MODE(mode)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+inline unsigned long millis() { return (unsigned long)(sim::now_us / 1000); }
+inline unsigned long micros() { return (unsigned long)sim::now_us; }
+inline void delay(unsigned long ms) { sim::advance((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { sim::advance(us); }
+inline void yield() { sim::advance(1); }
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void randomSeed(unsigned long seed) { srand((unsigned)seed); }
+inline long random(long max) { return max ? rand() % max : 0; }
+inline long random(long min, long max) { return min + random(max - min); }
+
+class String
+{
+    std::string _s;
+
+    static std::string number(unsigned long long value, unsigned char base)
+    {
+        char buf[68];
+        char *p = buf + sizeof(buf) - 1;
+        *p = 0;
+        do
+        {
+            unsigned digit = value % base;
+            *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value);
+        return p;
+    }
+
+    static std::string number(long long value, unsigned char base)
+    {
+        if (value < 0 && base == DEC)
+        {
+            return "-" + number((unsigned long long)-value, base);
+        }
+        return number((unsigned long long)value, base);
+    }
+
+public:
+    String(const char *s = "") : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char v, unsigned char base = DEC) : _s(number((unsigned long long)v, base)) {}
+    explicit String(int v, unsigned char base = DEC) : _s(number((long long)v, base)) {}
+    explicit String(unsigned int v, unsigned char base = DEC) : _s(number((unsigned long long)v, base)) {}
+    explicit String(long v, unsigned char base = DEC) : _s(number((long long)v, base)) {}
+    explicit String(unsigned long v, unsigned char base = DEC) : _s(number((unsigned long long)v, base)) {}
+    explicit String(long long v, unsigned char base = DEC) : _s(number(v, base)) {}
+    explicit String(unsigned long long v, unsigned char base = DEC) : _s(number(v, base)) {}
+    explicit String(double v, unsigned char decimals = 2)
+    {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        _s = buf;
+    }
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned int size)
+    {
+        _s.reserve(size);
+        return true;
+    }
+
+    char operator[](unsigned int index) const { return index < _s.length() ? _s[index] : 0; }
+    char &operator[](unsigned int index) { return _s[index]; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    bool concat(const String &s)
+    {
+        _s += s._s;
+        return true;
+    }
+    bool concat(const char *s)
+    {
+        _s += s ? s : "";
+        return true;
+    }
+    bool concat(const char *s, unsigned int len)
+    {
+        _s.append(s, len);
+        return true;
+    }
+    bool concat(char c)
+    {
+        _s += c;
+        return true;
+    }
+    template <typename T>
+    bool concat(T v) { return concat(String(v)); }
+
+    template <typename T>
+    String &operator+=(const T &v)
+    {
+        concat(v);
+        return *this;
+    }
+
+    bool equals(const String &s) const { return _s == s._s; }
+    bool equals(const char *s) const { return _s == (s ? s : ""); }
+    bool operator==(const String &s) const { return equals(s); }
+    bool operator==(const char *s) const { return equals(s); }
+    bool operator!=(const String &s) const { return !equals(s); }
+    bool operator!=(const char *s) const { return !equals(s); }
+    bool operator<(const String &s) const { return _s < s._s; }
+    bool equalsIgnoreCase(const String &s) const
+    {
+        String a(*this), b(s);
+        a.toLowerCase();
+        b.toLowerCase();
+        return a == b;
+    }
+
+    bool startsWith(const String &s) const { return _s.compare(0, s._s.length(), s._s) == 0; }
+    bool endsWith(const String &s) const
+    {
+        return _s.length() >= s._s.length() && _s.compare(_s.length() - s._s.length(), s._s.length(), s._s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return find(_s.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return find(_s.find(s._s, from)); }
+    int indexOf(const char *s, unsigned int from = 0) const { return find(_s.find(s, from)); }
+    int lastIndexOf(char c) const { return find(_s.rfind(c)); }
+
+    String substring(unsigned int from) const { return from < _s.length() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+        {
+            std::swap(from, to);
+        }
+        return from < _s.length() ? String(_s.substr(from, to - from)) : String();
+    }
+
+    void remove(unsigned int index)
+    {
+        if (index < _s.length())
+        {
+            _s.erase(index);
+        }
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < _s.length())
+        {
+            _s.erase(index, count);
+        }
+    }
+    void replace(const String &from, const String &to)
+    {
+        size_t pos = 0;
+        while (!from._s.empty() && (pos = _s.find(from._s, pos)) != std::string::npos)
+        {
+            _s.replace(pos, from._s.length(), to._s);
+            pos += to._s.length();
+        }
+    }
+    void toLowerCase() { std::transform(_s.begin(), _s.end(), _s.begin(), ::tolower); }
+    void toUpperCase() { std::transform(_s.begin(), _s.end(), _s.begin(), ::toupper); }
+    void trim()
+    {
+        size_t first = _s.find_first_not_of(" \t\r\n");
+        size_t last = _s.find_last_not_of(" \t\r\n");
+        _s = first == std::string::npos ? std::string() : _s.substr(first, last - first + 1);
+    }
+    long toInt() const { return atol(_s.c_str()); }
+    float toFloat() const { return atof(_s.c_str()); }
+
+private:
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+inline String operator+(const String &a, const String &b)
+{
+    String s(a);
+    s.concat(b);
+    return s;
+}
+inline String operator+(const String &a, const char *b)
+{
+    String s(a);
+    s.concat(b);
+    return s;
+}
+inline String operator+(const char *a, const String &b)
+{
+    String s(a);
+    s.concat(b);
+    return s;
+}
+template <typename T>
+inline String operator+(const String &a, T b)
+{
+    String s(a);
+    s.concat(b);
+    return s;
+}
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() = default;
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print
+{
+    size_t printNumber(unsigned long long value, int base) { return print(String(value, (unsigned char)base)); }
+
+public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+        {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    virtual void flush() {}
+
+    size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return printNumber(v, base); }
+    size_t print(int v, int base = DEC) { return print((long long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return printNumber(v, base); }
+    size_t print(long v, int base = DEC) { return print((long long)v, base); }
+    size_t print(unsigned long v, int base = DEC) { return printNumber(v, base); }
+    size_t print(long long v, int base = DEC)
+    {
+        if (v < 0 && base == DEC)
+        {
+            return print('-') + printNumber((unsigned long long)-v, base);
+        }
+        return printNumber((unsigned long long)v, base);
+    }
+    size_t print(unsigned long long v, int base = DEC) { return printNumber(v, base); }
+    size_t print(double v, int digits = 2) { return print(String(v, (unsigned char)digits)); }
+    size_t print(const Printable &p) { return p.printTo(*this); }
+
+    template <typename T>
+    size_t println(const T &v) { return print(v) + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        return write((const uint8_t *)buf, _min((size_t)len, sizeof(buf) - 1));
+    }
+};
+
+#define SERIAL_8N1 0x1c
+
+/**
+ * @brief UART: каждый байт занимает линию 10 бит, вывод в stdout только по запросу
+ */
+class HardwareSerial : public Print
+{
+    unsigned long _baud = 115200;
+
+public:
+    bool echo = false; // печатать вывод в stdout
+
+    void begin(unsigned long baud, int /* config */ = SERIAL_8N1) { _baud = baud; }
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        sim::advance((uint64_t)size * 10 * 1000000 / _baud);
+        if (echo)
+        {
+            fwrite(buffer, 1, size, stdout);
+        }
+        return size;
+    }
+    using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+#include "Esp.h"
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file ESP8266WiFi.h
+ * @brief Заглушки WiFi и BearSSL::HashSHA256 для сборки на компьютере
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Точка доступа всегда одна и та же: адреса и уровень сигнала заданы полями WiFi.
+ */
+#ifndef MOCK_ESP8266WIFI_H_
+#define MOCK_ESP8266WIFI_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiClient.h>
+#include <coredecls.h>
+
+typedef enum WiFiMode
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum WiFiPhyMode
+{
+    WIFI_PHY_MODE_11B = 1,
+    WIFI_PHY_MODE_11G = 2,
+    WIFI_PHY_MODE_11N = 3
+} WiFiPhyMode_t;
+
+class ESP8266WiFiClass
+{
+    uint8_t _bssid[6] = {0x1C, 0x61, 0xB4, 0x10, 0x20, 0x30};
+
+public:
+    int32_t rssi = -67;
+    uint8_t wifi_channel = 6;
+    WiFiPhyMode_t phy_mode = WIFI_PHY_MODE_11N;
+
+    int32_t channel() { return wifi_channel; }
+    WiFiPhyMode_t getPhyMode() { return phy_mode; }
+    uint8_t *BSSID() { return _bssid; }
+    String BSSIDstr() { return String("1C:61:B4:10:20:30"); }
+    int32_t RSSI() { return rssi; }
+    String SSID() { return String("waterius"); }
+    String hostname() { return String("waterius-11259375"); }
+
+    uint8_t *macAddress(uint8_t *mac)
+    {
+        static const uint8_t address[6] = {0x5C, 0xCF, 0x7F, 0xAB, 0xCD, 0xEF};
+        memcpy(mac, address, sizeof(address));
+        return mac;
+    }
+    String macAddress() { return String("5C:CF:7F:AB:CD:EF"); }
+
+    IPAddress localIP() { return IPAddress(192, 168, 1, 42); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    IPAddress dnsIP(uint8_t /* num */ = 0) { return IPAddress(192, 168, 1, 1); }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+namespace BearSSL
+{
+    /**
+     * @brief Не криптографический хэш: токену в тестах нужна только стабильность
+     */
+    class HashSHA256
+    {
+        uint8_t _hash[32] = {0};
+        uint32_t _crc = 0xffffffff;
+
+    public:
+        void begin() { _crc = 0xffffffff; }
+        void add(const void *data, uint32_t len) { _crc = crc32(data, len, _crc); }
+        void end()
+        {
+            for (size_t i = 0; i < sizeof(_hash); i += sizeof(_crc))
+            {
+                _crc = crc32(&_crc, sizeof(_crc), _crc);
+                memcpy(&_hash[i], &_crc, sizeof(_crc));
+            }
+        }
+        int len() { return sizeof(_hash); }
+        const void *hash() { return _hash; }
+    };
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file Esp.h
+ * @brief Заглушка объекта ESP для сборки на компьютере
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Свободная куча считается от sim::heap_used, чтобы freemem в json
+ * и heap_min профайлера менялись вместе с памятью, занятой кодом прошивки.
+ * RTC память живет между пробуждениями: её хранит объект ESP.
+ * Flash эмулируется для двух секторов настроек (EEPROM_start и перед ним):
+ * запись только сбрасывает биты, как у настоящей flash, а flash_write_budget
+ * обрывает запись, как пропадание питания.
+ */
+#ifndef MOCK_ESP_H_
+#define MOCK_ESP_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+#include "flash_hal.h"
+extern "C"
+{
+#include "user_interface.h"
+}
+
+#define SIM_HEAP_SIZE 40000 // свободно в DRAM после загрузки скетча
+#define SIM_FLASH_SECTORS 2
+#define SIM_FLASH_FIRST_SECTOR ((EEPROM_start - 0x40200000) / SPI_FLASH_SEC_SIZE - SIM_FLASH_SECTORS + 1)
+
+class EspClass
+{
+    uint32_t _rtc[128] = {0};
+    uint8_t _flash[SIM_FLASH_SECTORS * SPI_FLASH_SEC_SIZE];
+
+    uint8_t *flash_at(uint32_t address, size_t size)
+    {
+        uint32_t begin = SIM_FLASH_FIRST_SECTOR * SPI_FLASH_SEC_SIZE;
+        if (address < begin || address + size > begin + sizeof(_flash))
+        {
+            return nullptr;
+        }
+        return _flash + (address - begin);
+    }
+
+public:
+    rst_info reset_info = {REASON_DEEP_SLEEP_AWAKE, 0, 0, 0, 0, 0, 0};
+    uint16_t vcc = 3100;
+    size_t flash_write_budget = SIZE_MAX; // байт записи до "пропадания питания"
+
+    EspClass() { flashClear(); }
+
+    uint32_t getChipId() { return 0x00ABCDEF; }
+    uint32_t getFlashChipId() { return 0x001640EF; }
+    uint8_t getFlashChipVendorId() { return 0xEF; }
+    uint32_t getFreeHeap() { return sim::heap_used < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - sim::heap_used : 0; }
+    uint8_t getHeapFragmentation() { return 0; }
+    uint32_t getSketchSize() { return 500000; }
+    uint32_t getFreeSketchSpace() { return 500000; }
+    uint16_t getVcc() { return vcc; }
+    rst_info *getResetInfoPtr() { return &reset_info; }
+
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+    {
+        if (offset * 4 + size > sizeof(_rtc))
+        {
+            return false;
+        }
+        memcpy(data, (uint8_t *)_rtc + offset * 4, size);
+        return true;
+    }
+
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+    {
+        if (offset * 4 + size > sizeof(_rtc))
+        {
+            return false;
+        }
+        memcpy((uint8_t *)_rtc + offset * 4, data, size);
+        return true;
+    }
+
+    /**
+     * @brief Питание ESP снимали: RTC память потеряна
+     */
+    void rtcClear() { memset(_rtc, 0, sizeof(_rtc)); }
+    uint32_t *rtc() { return _rtc; }
+    static constexpr size_t rtc_size = sizeof(_rtc);
+
+    bool eraseConfig() { return true; }
+    bool flashEraseSector(uint32_t sector)
+    {
+        uint8_t *dst = flash_at(sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+        if (dst)
+        {
+            memset(dst, 0xFF, SPI_FLASH_SEC_SIZE);
+            sim::sector_erases++;
+            sim::advance(sim::eeprom_commit_us);
+        }
+        return true;
+    }
+
+    bool flashRead(uint32_t address, uint32_t *data, size_t size)
+    {
+        uint8_t *src = flash_at(address, size);
+        if (!src)
+        {
+            return false;
+        }
+        memcpy(data, src, size);
+        return true;
+    }
+
+    bool flashWrite(uint32_t address, const uint32_t *data, size_t size)
+    {
+        uint8_t *dst = flash_at(address, size);
+        if (!dst)
+        {
+            return false;
+        }
+        const uint8_t *src = (const uint8_t *)data;
+        size_t n = size < flash_write_budget ? size : flash_write_budget;
+        for (size_t i = 0; i < n; i++)
+        {
+            dst[i] &= src[i];
+        }
+        if (flash_write_budget != SIZE_MAX)
+        {
+            flash_write_budget -= n;
+        }
+        return n == size;
+    }
+
+    /**
+     * @brief Чистая flash, как после прошивки с очисткой
+     */
+    void flashClear() { memset(_flash, 0xFF, sizeof(_flash)); }
+    uint8_t *flash() { return _flash; }
+    static constexpr size_t flash_size = sizeof(_flash);
+    void reset() {}
+    void restart() {}
+};
+
+inline EspClass ESP;
+
+#endif
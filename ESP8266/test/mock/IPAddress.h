@@ -0,0 +1,57 @@
+/**
+ * @file IPAddress.h
+ * @brief Заглушка IPAddress для сборки на компьютере
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_IPADDRESS_H_
+#define MOCK_IPADDRESS_H_
+
+#include <Arduino.h>
+
+class IPAddress : public Printable
+{
+    uint8_t _bytes[4] = {0};
+
+public:
+    IPAddress() = default;
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _bytes{a, b, c, d} {}
+    IPAddress(uint32_t address) { memcpy(_bytes, &address, sizeof(_bytes)); }
+
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, _bytes, sizeof(address));
+        return address;
+    }
+
+    uint8_t operator[](int index) const { return _bytes[index]; }
+
+    bool isSet() const { return (uint32_t)*this != 0; }
+
+    bool fromString(const char *address)
+    {
+        unsigned a, b, c, d;
+        if (sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+        {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String &address) { return fromString(address.c_str()); }
+
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+        return String(buf);
+    }
+
+    size_t printTo(Print &p) const override { return p.print(toString()); }
+};
+
+#endif
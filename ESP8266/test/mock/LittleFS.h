@@ -0,0 +1,155 @@
+/**
+ * @file LittleFS.h
+ * @brief Заглушка LittleFS: файлы в памяти, переживают пробуждения
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Поддерживает режимы открытия "r", "r+", "w", "w+", "a" и то подмножество
+ * File, которое используют журналы прошивки. Запись сдвигает часы
+ * симулятора и учитывается в sim::fs_writes.
+ */
+#ifndef MOCK_LITTLEFS_H_
+#define MOCK_LITTLEFS_H_
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File
+{
+    std::shared_ptr<std::vector<uint8_t>> _data;
+    size_t _pos = 0;
+    bool _read = false;
+    bool _write = false;
+    bool _append = false;
+
+public:
+    File() = default;
+    File(std::shared_ptr<std::vector<uint8_t>> data, bool read, bool write, bool append)
+        : _data(data), _pos(append ? data->size() : 0), _read(read), _write(write), _append(append) {}
+
+    explicit operator bool() const { return (bool)_data; }
+
+    size_t size() const { return _data ? _data->size() : 0; }
+    size_t position() const { return _pos; }
+    int available() const { return _data ? _data->size() - _pos : 0; }
+
+    size_t read(uint8_t *buf, size_t size)
+    {
+        if (!_data || !_read)
+        {
+            return 0;
+        }
+        size = _min(size, _data->size() - _pos);
+        memcpy(buf, _data->data() + _pos, size);
+        _pos += size;
+        return size;
+    }
+
+    size_t write(const uint8_t *buf, size_t size)
+    {
+        if (!_data || !_write)
+        {
+            return 0;
+        }
+        if (_append)
+        {
+            _pos = _data->size();
+        }
+        if (_pos + size > _data->size())
+        {
+            _data->resize(_pos + size);
+        }
+        memcpy(_data->data() + _pos, buf, size);
+        _pos += size;
+        sim::fs_writes++;
+        sim::advance(sim::fs_write_us);
+        return size;
+    }
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet)
+    {
+        if (!_data)
+        {
+            return false;
+        }
+        size_t base = mode == SeekSet ? 0 : mode == SeekCur ? _pos : _data->size();
+        if (base + pos > _data->size())
+        {
+            return false;
+        }
+        _pos = base + pos;
+        return true;
+    }
+
+    bool truncate(uint32_t size)
+    {
+        if (!_data || !_write)
+        {
+            return false;
+        }
+        _data->resize(size);
+        _pos = _min(_pos, (size_t)size);
+        return true;
+    }
+
+    void flush() {}
+    void close() { _data.reset(); }
+};
+
+class FS
+{
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> _files;
+
+public:
+    bool begin()
+    {
+        sim::advance(sim::fs_mount_us);
+        return true;
+    }
+    void end() {}
+
+    bool exists(const char *path) const { return _files.count(path) != 0; }
+
+    File open(const char *path, const char *mode)
+    {
+        bool plus = strchr(mode, '+') != nullptr;
+        auto it = _files.find(path);
+        if (mode[0] == 'r')
+        {
+            if (it == _files.end())
+            {
+                return File();
+            }
+            return File(it->second, true, plus, false);
+        }
+        if (it == _files.end() || mode[0] == 'w')
+        {
+            it = _files.insert_or_assign(path, std::make_shared<std::vector<uint8_t>>()).first;
+        }
+        return File(it->second, plus, true, mode[0] == 'a');
+    }
+
+    bool remove(const char *path) { return _files.erase(path) != 0; }
+
+    /**
+     * @brief Пустая файловая система, как после загрузки образа без данных
+     */
+    void format() { _files.clear(); }
+
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> &files() { return _files; }
+};
+
+inline FS LittleFS;
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file Ticker.h
+ * @brief Заглушка Ticker ядра ESP8266
+ * @version 0.1
+ * @date 2026-10-15
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Таймер не срабатывает: delay() симулятора только сдвигает часы и не
+ * отдает управление системному контексту. Фоновые замеры напряжения
+ * (Voltage::start_sampling) в симуляторе пробуждения не выполняются
+ * и в обмен по i2c не входят.
+ */
+#ifndef MOCK_TICKER_H_
+#define MOCK_TICKER_H_
+
+#include <stdint.h>
+#include <functional>
+
+class Ticker
+{
+public:
+    typedef std::function<void(void)> callback_function_t;
+
+    void attach_ms(uint32_t milliseconds, callback_function_t callback)
+    {
+        _callback = callback;
+        _period_ms = milliseconds;
+    }
+
+    void detach()
+    {
+        _callback = nullptr;
+        _period_ms = 0;
+    }
+
+    bool active() const { return (bool)_callback; }
+
+private:
+    callback_function_t _callback;
+    uint32_t _period_ms = 0;
+};
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ * @file WiFiClient.h
+ * @brief Заглушка: заголовок подключается из config.h
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_WIFICLIENT_H_
+#define MOCK_WIFICLIENT_H_
+
+#include <Arduino.h>
+
+#endif
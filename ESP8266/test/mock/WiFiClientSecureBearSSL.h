@@ -0,0 +1,22 @@
+/**
+ * @file WiFiClientSecureBearSSL.h
+ * @brief Заглушка: http_pool.h хранит указатели на клиента и сессию TLS
+ * @version 0.1
+ * @date 2026-10-15
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_WIFICLIENTSECUREBEARSSL_H_
+#define MOCK_WIFICLIENTSECUREBEARSSL_H_
+
+#include <ESP8266WiFi.h>
+
+class WiFiClient;
+
+namespace BearSSL
+{
+    class Session;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file Wire.h
+ * @brief Заглушка i2c master: передает транзакции эмулятору ведомого
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Каждая транзакция сдвигает часы симулятора на время передачи по шине:
+ * 9 тактов SCL на байт (с ACK) плюс адрес, старт и стоп.
+ */
+#ifndef MOCK_WIRE_H_
+#define MOCK_WIRE_H_
+
+#include <Arduino.h>
+
+#define I2C_MOCK_BUFFER_SIZE 128
+
+/**
+ * @brief Ведомое устройство на шине (эмулятор attiny)
+ */
+class I2cSlave
+{
+public:
+    virtual ~I2cSlave() = default;
+    virtual void receive(const uint8_t *data, size_t size) = 0;
+    virtual size_t request(uint8_t *data, size_t size) = 0;
+};
+
+class TwoWire
+{
+    I2cSlave *_slave = nullptr;
+    uint32_t _clock = 100000;
+    uint8_t _tx[I2C_MOCK_BUFFER_SIZE];
+    size_t _tx_len = 0;
+    uint8_t _rx[I2C_MOCK_BUFFER_SIZE];
+    size_t _rx_len = 0;
+    size_t _rx_pos = 0;
+
+    void bus(size_t bytes)
+    {
+        // старт + адрес + данные + стоп
+        sim::advance((uint64_t)(bytes + 1) * 9 * 1000000 / _clock + 2 * 1000000 / _clock);
+        transactions++;
+        bytes_total += bytes;
+    }
+
+public:
+    uint32_t transactions = 0; // всего транзакций с включения
+    uint32_t bytes_total = 0;  // байт данных в обе стороны
+
+    void attach(I2cSlave *slave) { _slave = slave; }
+
+    void begin(int /* sda */, int /* scl */) {}
+    void setClock(uint32_t clock) { _clock = clock; }
+    void setClockStretchLimit(uint32_t /* limit */) {}
+
+    void beginTransmission(uint8_t /* address */) { _tx_len = 0; }
+
+    size_t write(uint8_t data)
+    {
+        if (_tx_len >= sizeof(_tx))
+        {
+            return 0;
+        }
+        _tx[_tx_len++] = data;
+        return 1;
+    }
+
+    uint8_t endTransmission(bool /* stop */ = true)
+    {
+        bus(_tx_len);
+        if (!_slave)
+        {
+            return 2; // NACK на адрес
+        }
+        _slave->receive(_tx, _tx_len);
+        return 0;
+    }
+
+    size_t requestFrom(uint8_t /* address */, size_t size)
+    {
+        size = _min(size, sizeof(_rx));
+        _rx_len = _slave ? _slave->request(_rx, size) : 0;
+        _rx_pos = 0;
+        bus(size);
+        // без ведомого линия подтянута, но Wire вернет 0 байт
+        return _rx_len;
+    }
+    size_t requestFrom(int address, int size) { return requestFrom((uint8_t)address, (size_t)size); }
+
+    int available() { return _rx_len - _rx_pos; }
+
+    int read() { return _rx_pos < _rx_len ? _rx[_rx_pos++] : -1; }
+
+    size_t readBytes(uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (n < size && _rx_pos < _rx_len)
+        {
+            buffer[n++] = _rx[_rx_pos++];
+        }
+        return n;
+    }
+};
+
+inline TwoWire Wire;
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @file coredecls.h
+ * @brief Заглушка ядра ESP8266: crc32 как в cores/esp8266/crc32.cpp
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_COREDECLS_H_
+#define MOCK_COREDECLS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0xffffffff)
+{
+    const uint8_t *ldata = (const uint8_t *)data;
+    while (length--)
+    {
+        uint8_t c = *ldata++;
+        for (uint32_t i = 0x80; i > 0; i >>= 1)
+        {
+            bool bit = crc & 0x80000000;
+            if (c & i)
+            {
+                bit = !bit;
+            }
+            crc <<= 1;
+            if (bit)
+            {
+                crc ^= 0x04c11db7;
+            }
+        }
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file flash_hal.h
+ * @brief Заглушка адресов flash ESP8266
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_FLASH_HAL_H_
+#define MOCK_FLASH_HAL_H_
+
+#define SPI_FLASH_SEC_SIZE 4096
+#define EEPROM_start 0x402FB000
+
+// Как в eagle.flash.4m1m.ld: между концом LittleFS и EEPROM свободный сектор
+#define FS_PHYS_ADDR 0x000DA000
+#define FS_PHYS_SIZE 0x00020000
+
+#endif
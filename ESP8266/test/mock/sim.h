@@ -0,0 +1,63 @@
+/**
+ * @file sim.h
+ * @brief Состояние хост-симулятора: часы, куча, счетчики записи во flash
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Заглушки Arduino/ESP8266 из test/mock не ждут по-настоящему: delay(),
+ * обмен по i2c, подключение к wifi и запись во flash сдвигают часы
+ * симулятора на оценку времени операции. По часам считаем время
+ * бодрствования ESP, по счетчикам - износ flash, по куче - пик памяти.
+ */
+#ifndef MOCK_SIM_H_
+#define MOCK_SIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sim
+{
+    inline uint64_t now_us = 0; // время с включения ESP
+
+    inline size_t heap_used = 0; // занято в куче (operator new и JsonDocument)
+    inline size_t heap_peak = 0; // пик занятой кучи
+
+    inline uint32_t sector_erases = 0; // стирания сектора настроек (ESP.flashEraseSector)
+    inline uint32_t fs_writes = 0;     // вызовы File::write
+
+    inline uint8_t cpu_mhz = 80; // system_update_cpu_freq
+
+    // Задержки операций, мкс
+    inline uint32_t eeprom_commit_us = 45000; // стирание сектора 4 Кб и запись
+    inline uint32_t fs_write_us = 3000;       // запись блока LittleFS с метаданными
+    inline uint32_t fs_mount_us = 8000;       // LittleFS.begin
+
+    inline void advance(uint64_t us) { now_us += us; }
+
+    inline void heap_alloc(size_t size)
+    {
+        heap_used += size;
+        if (heap_used > heap_peak)
+        {
+            heap_peak = heap_used;
+        }
+    }
+
+    inline void heap_free(size_t size) { heap_used -= size; }
+
+    /**
+     * @brief Новое пробуждение: ESP включилась с нуля
+     */
+    inline void power_on()
+    {
+        now_us = 0;
+        heap_peak = heap_used;
+        sector_erases = 0;
+        fs_writes = 0;
+        cpu_mhz = 80;
+    }
+}
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file user_interface.h
+ * @brief Заглушка SDK ESP8266: причина перезагрузки, частота CPU
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef MOCK_USER_INTERFACE_H_
+#define MOCK_USER_INTERFACE_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+enum rst_reason
+{
+    REASON_DEFAULT_RST = 0,
+    REASON_WDT_RST = 1,
+    REASON_EXCEPTION_RST = 2,
+    REASON_SOFT_WDT_RST = 3,
+    REASON_SOFT_RESTART = 4,
+    REASON_DEEP_SLEEP_AWAKE = 5,
+    REASON_EXT_SYS_RST = 6
+};
+
+struct rst_info
+{
+    uint32_t reason;
+    uint32_t exccause;
+    uint32_t epc1;
+    uint32_t epc2;
+    uint32_t epc3;
+    uint32_t excvaddr;
+    uint32_t depc;
+};
+
+#define SYS_CPU_80MHZ 80
+#define SYS_CPU_160MHZ 160
+
+inline uint8_t system_get_cpu_freq() { return sim::cpu_mhz; }
+inline bool system_update_cpu_freq(uint8_t mhz)
+{
+    sim::cpu_mhz = mhz;
+    return true;
+}
+
+#endif
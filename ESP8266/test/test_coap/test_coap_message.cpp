@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "coap_message.h"
+
+static const uint8_t TOKEN[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+TEST(CoapWriter, PostRequest)
+{
+    uint8_t buf[64];
+    CoapWriter writer(buf, sizeof(buf));
+    writer.header(COAP_TYPE_CON, COAP_CODE_POST, 0x1234, TOKEN, sizeof(TOKEN));
+    writer.uri_path("/api/data");
+    writer.option_uint(COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_JSON);
+    writer.option(COAP_OPTION_URI_QUERY, "key=k", 5);
+    uint8_t *body = writer.payload();
+    ASSERT_NE(body, nullptr);
+    memcpy(body, "{}", 2);
+    size_t len = writer.finish(2);
+    ASSERT_TRUE(writer.ok());
+
+    const uint8_t expected[] = {
+        0x44, 0x02, 0x12, 0x34, 0xDE, 0xAD, 0xBE, 0xEF, // CON POST, токен 4 байта
+        0xB3, 'a', 'p', 'i',                           // Uri-Path (11)
+        0x04, 'd', 'a', 't', 'a',                      // Uri-Path, дельта 0
+        0x11, 50,                                      // Content-Format (12) = json
+        0x35, 'k', 'e', 'y', '=', 'k',                 // Uri-Query (15)
+        0xFF, '{', '}'};
+    ASSERT_EQ(len, sizeof(expected));
+    EXPECT_EQ(memcmp(buf, expected, len), 0);
+}
+
+TEST(CoapWriter, ExtendedOption)
+{
+    uint8_t buf[400];
+    CoapWriter writer(buf, sizeof(buf));
+    writer.header(COAP_TYPE_NON, COAP_CODE_POST, 1, nullptr, 0);
+    writer.option_uint(COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_MSGPACK);
+    char query[300];
+    memset(query, 'q', sizeof(query));
+    writer.option(COAP_OPTION_URI_QUERY, query, sizeof(query));
+    ASSERT_TRUE(writer.ok());
+
+    // Content-Format: дельта 12, 2 байта 65000 = 0xFDE8
+    EXPECT_EQ(buf[4], 0xC2);
+    EXPECT_EQ(buf[5], 0xFD);
+    EXPECT_EQ(buf[6], 0xE8);
+    // Uri-Query: дельта 3, длина 300 = 14 + (300 - 269)
+    EXPECT_EQ(buf[7], 0x3E);
+    EXPECT_EQ(buf[8], 0x00);
+    EXPECT_EQ(buf[9], 31);
+    EXPECT_EQ(writer.length(), 10u + sizeof(query));
+
+    CoapMessage msg;
+    ASSERT_TRUE(coap_parse(buf, writer.length(), msg));
+    EXPECT_EQ(msg.type, COAP_TYPE_NON);
+    EXPECT_EQ(msg.payload, nullptr);
+}
+
+TEST(CoapWriter, Overflow)
+{
+    uint8_t buf[16];
+    CoapWriter writer(buf, sizeof(buf));
+    writer.header(COAP_TYPE_CON, COAP_CODE_POST, 1, TOKEN, sizeof(TOKEN));
+    writer.uri_path("/a");
+    EXPECT_TRUE(writer.ok());
+    ASSERT_NE(writer.payload(), nullptr);
+    EXPECT_EQ(writer.available(), 16u - 11u);
+    EXPECT_EQ(writer.finish(6), 0u);
+    EXPECT_FALSE(writer.ok());
+    EXPECT_EQ(writer.payload(), nullptr);
+}
+
+TEST(CoapWriter, OptionsOrder)
+{
+    uint8_t buf[32];
+    CoapWriter writer(buf, sizeof(buf));
+    writer.header(COAP_TYPE_CON, COAP_CODE_POST, 1, TOKEN, sizeof(TOKEN));
+    writer.option_uint(COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_JSON);
+    writer.uri_path("/late"); // номер меньше предыдущего
+    EXPECT_FALSE(writer.ok());
+}
+
+TEST(CoapParse, PiggybackedResponse)
+{
+    const uint8_t raw[] = {
+        0x64, 0x44, 0x12, 0x34, 0xDE, 0xAD, 0xBE, 0xEF, // ACK 2.04, токен
+        0xC1, 50,                                      // Content-Format
+        0xFF, '{', '}'};
+    CoapMessage msg;
+    ASSERT_TRUE(coap_parse(raw, sizeof(raw), msg));
+    EXPECT_EQ(msg.type, COAP_TYPE_ACK);
+    EXPECT_EQ(msg.code, COAP_CODE(2, 4));
+    EXPECT_EQ(COAP_CODE_CLASS(msg.code), 2);
+    EXPECT_EQ(msg.message_id, 0x1234);
+    EXPECT_TRUE(coap_token_match(msg, TOKEN, sizeof(TOKEN)));
+    ASSERT_EQ(msg.payload_len, 2u);
+    EXPECT_EQ(memcmp(msg.payload, "{}", 2), 0);
+}
+
+TEST(CoapParse, EmptyAck)
+{
+    const uint8_t raw[] = {0x60, 0x00, 0x12, 0x34};
+    CoapMessage msg;
+    ASSERT_TRUE(coap_parse(raw, sizeof(raw), msg));
+    EXPECT_EQ(msg.type, COAP_TYPE_ACK);
+    EXPECT_EQ(msg.code, COAP_CODE_EMPTY);
+    EXPECT_FALSE(coap_token_match(msg, TOKEN, sizeof(TOKEN)));
+}
+
+TEST(CoapParse, Malformed)
+{
+    CoapMessage msg;
+    const uint8_t short_header[] = {0x40, 0x02, 0x00};
+    EXPECT_FALSE(coap_parse(short_header, sizeof(short_header), msg));
+    const uint8_t bad_version[] = {0x84, 0x02, 0x00, 0x01};
+    EXPECT_FALSE(coap_parse(bad_version, sizeof(bad_version), msg));
+    const uint8_t long_token[] = {0x49, 0x02, 0x00, 0x01, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    EXPECT_FALSE(coap_parse(long_token, sizeof(long_token), msg));
+    const uint8_t option_overrun[] = {0x40, 0x02, 0x00, 0x01, 0xB5, 'a'};
+    EXPECT_FALSE(coap_parse(option_overrun, sizeof(option_overrun), msg));
+    const uint8_t empty_payload[] = {0x40, 0x02, 0x00, 0x01, 0xFF};
+    EXPECT_FALSE(coap_parse(empty_payload, sizeof(empty_payload), msg));
+    const uint8_t reserved_nibble[] = {0x40, 0x02, 0x00, 0x01, 0xF1, 0x00};
+    EXPECT_FALSE(coap_parse(reserved_nibble, sizeof(reserved_nibble), msg));
+}
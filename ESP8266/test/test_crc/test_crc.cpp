@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <stdio.h>
+#include "crc.h"
+
+// Стандартная строка для контрольных величин CRC
+static const uint8_t check_string[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = seed >> 16;
+    }
+}
+
+// Стандартная контрольная величина CRC-8/MAXIM для "123456789"
+TEST(Crc8, CheckValue)
+{
+    EXPECT_EQ(crc8<Crc8Bitwise<> >(check_string, sizeof(check_string), 0), 0xA1);
+    EXPECT_EQ(crc8<Crc8Nibble<> >(check_string, sizeof(check_string), 0), 0xA1);
+    EXPECT_EQ(crc8<Crc8Table<> >(check_string, sizeof(check_string), 0), 0xA1);
+}
+
+// Все варианты совпадают на каждом байте и любом начальном значении
+TEST(Crc8, AllByteValues)
+{
+    for (int crc = 0; crc < 256; crc++)
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint8_t expected = Crc8Bitwise<>::update(crc, b);
+            ASSERT_EQ(Crc8Nibble<>::update(crc, b), expected) << crc << " " << b;
+            ASSERT_EQ(Crc8Table<>::update(crc, b), expected) << crc << " " << b;
+        }
+    }
+}
+
+// Расчет по частям (блоки EEPROM, поля I2C) равен расчету по всему буферу
+TEST(Crc8, Incremental)
+{
+    uint8_t buf[64];
+    fill(buf, sizeof(buf), 1);
+    uint8_t whole = crc8<Crc8Table<> >(buf, sizeof(buf), 0xFF);
+    for (size_t split = 0; split <= sizeof(buf); split++)
+    {
+        uint8_t crc = crc8<Crc8Nibble<> >(buf, split, 0xFF);
+        crc = crc8<Crc8Table<> >(buf + split, sizeof(buf) - split, crc);
+        ASSERT_EQ(crc, whole) << split;
+    }
+}
+
+// Пустой буфер не меняет начальное значение
+TEST(Crc8, Empty)
+{
+    EXPECT_EQ(crc8<Crc8Table<> >(check_string, 0, 0xFF), 0xFF);
+    EXPECT_EQ(crc8<Crc8Nibble<> >(check_string, 0, 0), 0);
+}
+
+// Контрольная величина CRC-16/MODBUS для "123456789"
+TEST(Crc16Modbus, CheckValue)
+{
+    EXPECT_EQ(crc16_modbus(check_string, sizeof(check_string)), 0x4B37);
+}
+
+// Табличный расчет совпадает с прежним побитовым get_checksum на буфере размером с Settings
+TEST(Crc16Modbus, MatchesBitwise)
+{
+    uint8_t buf[960];
+    fill(buf, sizeof(buf), 7);
+    uint16_t expected = 0xFFFF;
+    for (size_t i = 0; i < sizeof(buf) - 2; i++)
+    {
+        expected = Crc16Modbus<>::bitwise(expected, buf[i]);
+    }
+    EXPECT_EQ(crc16_modbus(buf, sizeof(buf) - 2), expected);
+}
+
+template <class F>
+static double ns_per_byte(F f, size_t len, int rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        f();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ((double)len * rounds);
+}
+
+// Замер скорости на ПК: печатает нс/байт для каждого варианта.
+// Абсолютные значения к микроконтроллерам не относятся, проверяется только
+// что табличные варианты не медленнее побитового.
+TEST(CrcBenchmark, Throughput)
+{
+    static uint8_t buf[960];
+    fill(buf, sizeof(buf), 3);
+    const int rounds = 2000;
+    volatile uint32_t sink = 0;
+
+    double bitwise = ns_per_byte([&]
+                                 { sink += crc8<Crc8Bitwise<> >(buf, sizeof(buf), sink); }, sizeof(buf), rounds);
+    double nibble = ns_per_byte([&]
+                                { sink += crc8<Crc8Nibble<> >(buf, sizeof(buf), sink); }, sizeof(buf), rounds);
+    double table = ns_per_byte([&]
+                               { sink += crc8<Crc8Table<> >(buf, sizeof(buf), sink); }, sizeof(buf), rounds);
+    double modbus_bitwise = ns_per_byte([&]
+                                        {
+                                            uint16_t crc = sink;
+                                            for (size_t i = 0; i < sizeof(buf); i++)
+                                                crc = Crc16Modbus<>::bitwise(crc, buf[i]);
+                                            sink += crc; }, sizeof(buf), rounds);
+    double modbus = ns_per_byte([&]
+                                { sink += crc16_modbus(buf, sizeof(buf), sink); }, sizeof(buf), rounds);
+
+    printf("CRC-8 bitwise: %.2f ns/byte\n", bitwise);
+    printf("CRC-8 nibble:  %.2f ns/byte\n", nibble);
+    printf("CRC-8 table:   %.2f ns/byte\n", table);
+    printf("CRC-16 bitwise: %.2f ns/byte\n", modbus_bitwise);
+    printf("CRC-16 table:   %.2f ns/byte\n", modbus);
+
+    EXPECT_LE(table, bitwise * 1.5);
+    EXPECT_LE(modbus, modbus_bitwise * 1.5);
+}
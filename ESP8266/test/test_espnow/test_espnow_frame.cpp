@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include "espnow_frame.h"
+
+static EspNowFrame make_frame(uint32_t chip_id, uint32_t seq)
+{
+    EspNowFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.magic = ESPNOW_FRAME_MAGIC;
+    frame.version = ESPNOW_FRAME_VERSION;
+    frame.chip_id = chip_id;
+    frame.seq = seq;
+    return frame;
+}
+
+TEST(EspNowMac, ParseAndFormat)
+{
+    uint8_t mac[6];
+    ASSERT_TRUE(espnow_mac_parse("a4:CF:12:0b:7e:01", mac));
+    const uint8_t expected[6] = {0xA4, 0xCF, 0x12, 0x0B, 0x7E, 0x01};
+    EXPECT_EQ(memcmp(mac, expected, 6), 0);
+    ASSERT_TRUE(espnow_mac_parse("A4-CF-12-0B-7E-01", mac));
+    EXPECT_EQ(memcmp(mac, expected, 6), 0);
+
+    char text[18];
+    EXPECT_TRUE(espnow_mac_format(mac, text));
+    EXPECT_STREQ(text, "A4:CF:12:0B:7E:01");
+
+    const uint8_t zero[6] = {0};
+    EXPECT_FALSE(espnow_mac_format(zero, text));
+}
+
+TEST(EspNowMac, Rejected)
+{
+    uint8_t mac[6] = {1, 2, 3, 4, 5, 6};
+    EXPECT_FALSE(espnow_mac_parse(nullptr, mac));
+    EXPECT_FALSE(espnow_mac_parse("", mac));
+    EXPECT_FALSE(espnow_mac_parse("A4:CF:12:0B:7E", mac));
+    EXPECT_FALSE(espnow_mac_parse("A4:CF:12:0B:7E:0G", mac));
+    EXPECT_FALSE(espnow_mac_parse("A4.CF.12.0B.7E.01", mac));
+}
+
+TEST(EspNowKey, Parse)
+{
+    uint8_t key[ESPNOW_KEY_SIZE] = {0};
+    EXPECT_TRUE(espnow_key_parse("00112233445566778899aabbccddeeFF", key));
+    EXPECT_EQ(key[0], 0x00);
+    EXPECT_EQ(key[9], 0x99);
+    EXPECT_EQ(key[15], 0xFF);
+
+    // Ошибка не портит сохраненный ключ
+    EXPECT_FALSE(espnow_key_parse("00112233445566778899aabbccddeeF", key));
+    EXPECT_FALSE(espnow_key_parse("zz112233445566778899aabbccddeeff", key));
+    EXPECT_EQ(key[15], 0xFF);
+}
+
+TEST(EspNowFrame, HeaderChecked)
+{
+    EspNowFrame frame = make_frame(1, 1);
+    EXPECT_TRUE(espnow_frame_valid((const uint8_t *)&frame, sizeof(frame)));
+    EXPECT_FALSE(espnow_frame_valid((const uint8_t *)&frame, sizeof(frame) - 1));
+    frame.version++;
+    EXPECT_FALSE(espnow_frame_valid((const uint8_t *)&frame, sizeof(frame)));
+    EXPECT_EQ(ESPNOW_SIGNED_SIZE, sizeof(frame) - ESPNOW_TAG_SIZE);
+}
+
+// Кадр с номером не больше принятого - повтор
+TEST(EspNowTable, ReplayRejected)
+{
+    EspNowTable table;
+    EXPECT_EQ(table.accept(make_frame(100, 5), 0), ESPNOW_ACCEPTED);
+    EXPECT_EQ(table.accept(make_frame(100, 5), 10), ESPNOW_REPLAY);
+    EXPECT_EQ(table.accept(make_frame(100, 4), 20), ESPNOW_REPLAY);
+    EXPECT_EQ(table.accept(make_frame(200, 1), 30), ESPNOW_ACCEPTED);
+    EXPECT_EQ(table.accept(make_frame(100, 6), 40), ESPNOW_ACCEPTED);
+    EXPECT_EQ(table.count(), 2);
+    EXPECT_EQ(table.pending(), 2);
+}
+
+// Переслано то, что принято до начала пересылки
+TEST(EspNowTable, MarkSent)
+{
+    EspNowTable table;
+    table.accept(make_frame(1, 1), 100);
+    table.accept(make_frame(2, 1), 200);
+    table.mark_sent(150);
+    EXPECT_EQ(table.pending(), 1);
+    table.accept(make_frame(1, 2), 300);
+    EXPECT_EQ(table.pending(), 2);
+    table.mark_sent(300);
+    EXPECT_EQ(table.pending(), 0);
+}
+
+// Полная таблица: новое устройство вытесняет давнее из пересланных
+TEST(EspNowTable, EvictsOldestSent)
+{
+    EspNowTable table;
+    for (uint32_t i = 0; i < ESPNOW_GATEWAY_DEVICES; i++)
+    {
+        ASSERT_EQ(table.accept(make_frame(i + 1, 1), i * 10), ESPNOW_ACCEPTED);
+    }
+    EXPECT_EQ(table.accept(make_frame(1000, 1), 1000), ESPNOW_FULL);
+
+    table.mark_sent(1000);
+    table.accept(make_frame(1, 2), 1100); // первое устройство снова на связи
+    EXPECT_EQ(table.accept(make_frame(1000, 1), 1200), ESPNOW_ACCEPTED);
+    EXPECT_EQ(table.count(), ESPNOW_GATEWAY_DEVICES);
+
+    // Вытеснено второе (самое давнее), первое осталось
+    bool first = false, second = false;
+    for (uint8_t i = 0; i < table.count(); i++)
+    {
+        first |= table.device(i).frame.chip_id == 1;
+        second |= table.device(i).frame.chip_id == 2;
+    }
+    EXPECT_TRUE(first);
+    EXPECT_FALSE(second);
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "ha/mqtt_pipeline.h"
+#include "../../src/log_buffer.cpp"
+#include "../../src/fs_mount.cpp"
+#include "../../src/ha/field_cache.cpp"
+
+// Сокет: запоминает данные и размер каждой записи
+class RecordingPrint : public Print
+{
+public:
+    std::vector<uint8_t> data;
+    std::vector<size_t> writes;
+    size_t limit = SIZE_MAX; // после стольких байт клиент перестает принимать
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        size_t n = std::min(size, limit - data.size());
+        data.insert(data.end(), buffer, buffer + n);
+        writes.push_back(size);
+        return n;
+    }
+};
+
+TEST(MqttPipeline, PublishPacket)
+{
+    RecordingPrint out;
+    MqttPipeline pipeline(out, true);
+    ASSERT_TRUE(pipeline.publish("w/ch0", 5, "12.5", 4));
+    ASSERT_TRUE(pipeline.flush());
+
+    const uint8_t expected[] = {
+        0x31, 11,                // PUBLISH, retain, длина 2 + 5 + 4
+        0x00, 0x05, 'w', '/', 'c', 'h', '0',
+        '1', '2', '.', '5'};
+    ASSERT_EQ(out.data.size(), sizeof(expected));
+    EXPECT_EQ(memcmp(out.data.data(), expected, sizeof(expected)), 0);
+    EXPECT_EQ(pipeline.count(), 1);
+}
+
+TEST(MqttPipeline, LongPayloadLength)
+{
+    RecordingPrint out;
+    MqttPipeline pipeline(out, false);
+    std::string payload(200, 'x');
+    ASSERT_TRUE(pipeline.publish("t", 1, payload.data(), payload.size()));
+    ASSERT_TRUE(pipeline.flush());
+
+    // 2 + 1 + 200 = 203 = 0x4B + 1 * 128
+    EXPECT_EQ(out.data[0], 0x30);
+    EXPECT_EQ(out.data[1], 0xCB);
+    EXPECT_EQ(out.data[2], 0x01);
+    EXPECT_EQ(out.data.size(), 3 + 2 + 1 + 200u);
+}
+
+TEST(MqttPipeline, PacketsShareSegments)
+{
+    RecordingPrint out;
+    MqttPipeline pipeline(out, true);
+    char topic[16];
+    for (int i = 0; i < 60; i++)
+    {
+        int len = snprintf(topic, sizeof(topic), "waterius/f%d", i);
+        ASSERT_TRUE(pipeline.publish(topic, len, "1234.567", 8));
+    }
+    ASSERT_TRUE(pipeline.flush());
+
+    EXPECT_EQ(pipeline.count(), 60);
+    EXPECT_EQ(pipeline.written(), out.data.size());
+    // вместо 180 записей - по одной на заполненный буфер
+    EXPECT_EQ(out.writes.size(), (out.data.size() + MQTT_PIPELINE_BUFFER - 1) / MQTT_PIPELINE_BUFFER);
+    for (size_t i = 0; i + 1 < out.writes.size(); i++)
+    {
+        EXPECT_EQ(out.writes[i], MQTT_PIPELINE_BUFFER);
+    }
+}
+
+TEST(MqttPipeline, ClientRejects)
+{
+    RecordingPrint out;
+    out.limit = 10;
+    MqttPipeline pipeline(out, true);
+    ASSERT_TRUE(pipeline.publish("w/ch0", 5, "12.5", 4));
+    EXPECT_FALSE(pipeline.flush());
+}
+
+TEST(FieldCache, PublishesOnlyChanges)
+{
+    LittleFS.format();
+    String topic = "waterius/1";
+    {
+        FieldCache cache;
+        cache.load(topic);
+        EXPECT_TRUE(cache.changed("ch0", 1));
+        cache.update("ch0", 1);
+        cache.update("ch1", 2);
+        cache.store();
+    }
+    FieldCache cache;
+    cache.load(topic);
+    EXPECT_FALSE(cache.changed("ch0", 1));
+    EXPECT_FALSE(cache.changed("ch1", 2));
+    EXPECT_TRUE(cache.changed("ch1", 3));
+    EXPECT_TRUE(cache.changed("voltage", 1));
+}
+
+TEST(FieldCache, TopicChangeResets)
+{
+    LittleFS.format();
+    {
+        FieldCache cache;
+        cache.load("waterius/1");
+        cache.update("ch0", 1);
+        cache.store();
+    }
+    FieldCache cache;
+    cache.load("waterius/2");
+    EXPECT_TRUE(cache.changed("ch0", 1));
+}
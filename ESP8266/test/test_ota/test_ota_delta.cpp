@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "ota_delta.h"
+#include "../../src/ota_delta.cpp"
+
+class MemoryDeltaIo : public OtaDeltaIo
+{
+public:
+    explicit MemoryDeltaIo(const std::vector<uint8_t> &base) : base(base) {}
+
+    bool read_base(uint32_t offset, uint8_t *buf, size_t len) override
+    {
+        if (offset + len > base.size())
+        {
+            return false;
+        }
+        memcpy(buf, base.data() + offset, len);
+        return true;
+    }
+
+    bool begin(uint32_t size) override
+    {
+        target_size = size;
+        began = true;
+        return true;
+    }
+
+    bool write(const uint8_t *buf, size_t len) override
+    {
+        out.insert(out.end(), buf, buf + len);
+        return true;
+    }
+
+    std::vector<uint8_t> base;
+    std::vector<uint8_t> out;
+    uint32_t target_size = 0;
+    bool began = false;
+};
+
+// Патч собираем вручную, как scripts/ota_delta.py
+class PatchBuilder
+{
+public:
+    PatchBuilder(const std::vector<uint8_t> &base, const uint32_t target_size)
+    {
+        le32(OTA_DELTA_MAGIC);
+        le32(base.size());
+        le32(crc32(base.data() + OTA_DELTA_HEADER_SKIP, base.size() - OTA_DELTA_HEADER_SKIP));
+        le32(target_size);
+    }
+
+    PatchBuilder &copy(const int32_t delta, const uint32_t len)
+    {
+        bytes.push_back(OTA_DELTA_OP_COPY);
+        varint(delta < 0 ? ((uint32_t)(-(delta + 1)) << 1) | 1 : (uint32_t)delta << 1);
+        varint(len);
+        return *this;
+    }
+
+    PatchBuilder &insert(const std::vector<uint8_t> &data)
+    {
+        bytes.push_back(OTA_DELTA_OP_INSERT);
+        varint(data.size());
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        return *this;
+    }
+
+    std::vector<uint8_t> bytes;
+
+private:
+    void le32(const uint32_t v)
+    {
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            bytes.push_back(v >> (8 * i));
+        }
+    }
+
+    void varint(uint32_t v)
+    {
+        do
+        {
+            uint8_t b = v & 0x7F;
+            v >>= 7;
+            bytes.push_back(v ? b | 0x80 : b);
+        } while (v);
+    }
+};
+
+static std::vector<uint8_t> make_base(const size_t size)
+{
+    std::vector<uint8_t> base(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        base[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    return base;
+}
+
+// Новый образ: заголовок, база со вставкой в середине и хвост из начала базы
+static void make_patch(const std::vector<uint8_t> &base, std::vector<uint8_t> &target, std::vector<uint8_t> &patch)
+{
+    std::vector<uint8_t> header(16, 0xE9);
+    std::vector<uint8_t> changed = {1, 2, 3, 4};
+    target = header;
+    target.insert(target.end(), base.begin() + 16, base.begin() + 1000);
+    target.insert(target.end(), changed.begin(), changed.end());
+    target.insert(target.end(), base.begin() + 1004, base.end());
+    target.insert(target.end(), base.begin() + 100, base.begin() + 300);
+
+    PatchBuilder builder(base, target.size());
+    builder.insert(header)                  // cursor 16
+        .copy(0, 1000 - 16)                 // cursor 1000
+        .insert(changed)                    // cursor 1004
+        .copy(0, base.size() - 1004)        // cursor = base.size()
+        .copy(100 - (int32_t)base.size(), 200);
+    patch = builder.bytes;
+}
+
+TEST(OtaDelta, ApplyWholePatch)
+{
+    std::vector<uint8_t> base = make_base(3000), target, patch;
+    make_patch(base, target, patch);
+
+    MemoryDeltaIo io(base);
+    OtaDelta delta(io);
+    EXPECT_TRUE(delta.feed(patch.data(), patch.size()));
+    EXPECT_TRUE(delta.finished());
+    EXPECT_EQ(delta.error(), OTA_DELTA_OK);
+    EXPECT_EQ(io.target_size, target.size());
+    EXPECT_EQ(io.out, target);
+}
+
+// Границы порций приходятся на любые места команд
+TEST(OtaDelta, FeedByteByByte)
+{
+    std::vector<uint8_t> base = make_base(3000), target, patch;
+    make_patch(base, target, patch);
+
+    MemoryDeltaIo io(base);
+    OtaDelta delta(io);
+    for (size_t i = 0; i < patch.size(); i++)
+    {
+        ASSERT_TRUE(delta.feed(&patch[i], 1)) << i;
+        EXPECT_EQ(delta.finished(), i + 1 == patch.size());
+    }
+    EXPECT_EQ(io.out, target);
+}
+
+// Патч для другой прошивки: ничего не пишется, Updater не начинается
+TEST(OtaDelta, BaseMismatch)
+{
+    std::vector<uint8_t> base = make_base(3000), target, patch;
+    make_patch(base, target, patch);
+    base[2000] ^= 0xFF;
+
+    MemoryDeltaIo io(base);
+    OtaDelta delta(io);
+    EXPECT_FALSE(delta.feed(patch.data(), patch.size()));
+    EXPECT_EQ(delta.error(), OTA_DELTA_ERR_BASE);
+    EXPECT_FALSE(io.began);
+    EXPECT_TRUE(io.out.empty());
+
+    // Флаги режима flash в заголовке base не учитываются
+    base[2000] ^= 0xFF;
+    base[3] = 0x20;
+    MemoryDeltaIo io2(base);
+    OtaDelta delta2(io2);
+    EXPECT_TRUE(delta2.feed(patch.data(), patch.size()));
+    EXPECT_TRUE(delta2.finished());
+}
+
+TEST(OtaDelta, RejectsBadCommands)
+{
+    std::vector<uint8_t> base = make_base(3000);
+
+    // Копирование за конец base
+    PatchBuilder past_end(base, 100);
+    past_end.copy(2950, 100);
+    MemoryDeltaIo io1(base);
+    OtaDelta d1(io1);
+    EXPECT_FALSE(d1.feed(past_end.bytes.data(), past_end.bytes.size()));
+    EXPECT_EQ(d1.error(), OTA_DELTA_ERR_FORMAT);
+
+    // Копирование заголовка base
+    PatchBuilder header(base, 100);
+    header.copy(-16, 16);
+    MemoryDeltaIo io2(base);
+    OtaDelta d2(io2);
+    EXPECT_FALSE(d2.feed(header.bytes.data(), header.bytes.size()));
+
+    // Больше target_size
+    PatchBuilder too_long(base, 10);
+    too_long.insert(std::vector<uint8_t>(11, 0));
+    MemoryDeltaIo io3(base);
+    OtaDelta d3(io3);
+    EXPECT_FALSE(d3.feed(too_long.bytes.data(), too_long.bytes.size()));
+
+    // Неизвестная команда и чужой файл
+    PatchBuilder unknown(base, 10);
+    unknown.bytes.push_back(0x7F);
+    MemoryDeltaIo io4(base);
+    OtaDelta d4(io4);
+    EXPECT_FALSE(d4.feed(unknown.bytes.data(), unknown.bytes.size()));
+
+    std::vector<uint8_t> bin(64, 0xE9);
+    MemoryDeltaIo io5(base);
+    OtaDelta d5(io5);
+    EXPECT_FALSE(d5.feed(bin.data(), bin.size()));
+    EXPECT_EQ(d5.error(), OTA_DELTA_ERR_FORMAT);
+    EXPECT_FALSE(d5.feed(bin.data(), 1)); // после ошибки данные не принимаются
+}
+
+// Оборванный патч не считается примененным
+TEST(OtaDelta, Truncated)
+{
+    std::vector<uint8_t> base = make_base(3000), target, patch;
+    make_patch(base, target, patch);
+
+    MemoryDeltaIo io(base);
+    OtaDelta delta(io);
+    EXPECT_TRUE(delta.feed(patch.data(), patch.size() - 1));
+    EXPECT_FALSE(delta.finished());
+}
@@ -136,6 +136,130 @@ TEST(ParseOtaParams, FirmwareNotObject)
     EXPECT_EQ(p.error, OTA_ERR_PARSE);
 }
 
+// Сжатая прошивка
+TEST(ParseOtaParams, FirmwareGzip)
+{
+    JsonDocument doc;
+    doc["firmware"]["url"] = "https://example.com/fw.bin.gz";
+    doc["firmware"]["md5"] = "abc";
+    doc["firmware"]["size"] = 380000;
+    doc["firmware"]["compression"] = "gzip";
+
+    OtaParams p = parse_ota_params(doc.as<JsonObject>());
+
+    EXPECT_EQ(p.error, OTA_ERR_NONE);
+    EXPECT_TRUE(p.fw_gzip);
+    EXPECT_EQ(p.fw_size, 380000u);
+}
+
+// compression не указан или none — несжатая
+TEST(ParseOtaParams, FirmwareNoCompression)
+{
+    JsonDocument doc;
+    doc["firmware"]["url"] = "https://example.com/fw.bin";
+    doc["firmware"]["md5"] = "abc";
+
+    EXPECT_FALSE(parse_ota_params(doc.as<JsonObject>()).fw_gzip);
+
+    doc["firmware"]["compression"] = "none";
+    OtaParams p = parse_ota_params(doc.as<JsonObject>());
+    EXPECT_EQ(p.error, OTA_ERR_NONE);
+    EXPECT_FALSE(p.fw_gzip);
+}
+
+// Неизвестное сжатие — ошибка
+TEST(ParseOtaParams, FirmwareUnknownCompression)
+{
+    JsonDocument doc;
+    doc["firmware"]["url"] = "https://example.com/fw.bin.xz";
+    doc["firmware"]["md5"] = "abc";
+    doc["firmware"]["compression"] = "xz";
+
+    EXPECT_EQ(parse_ota_params(doc.as<JsonObject>()).error, OTA_ERR_PARSE);
+}
+
+// Сжатый образ filesystem не поддерживается
+TEST(ParseOtaParams, FilesystemGzipRejected)
+{
+    JsonDocument doc;
+    doc["filesystem"]["url"] = "https://example.com/fs.bin.gz";
+    doc["filesystem"]["md5"] = "abc";
+    doc["filesystem"]["compression"] = "gzip";
+
+    EXPECT_EQ(parse_ota_params(doc.as<JsonObject>()).error, OTA_ERR_PARSE);
+}
+
+// Патч от работающей прошивки рядом с полным образом
+TEST(ParseOtaParams, FirmwareDelta)
+{
+    JsonDocument doc;
+    doc["firmware"]["url"] = "https://example.com/fw.bin";
+    doc["firmware"]["md5"] = "abc";
+    OtaParams p = parse_ota_params(doc.as<JsonObject>());
+    EXPECT_FALSE(p.has_delta);
+
+    doc["firmware"]["delta"]["url"] = "https://example.com/fw-1-to-2.delta";
+    doc["firmware"]["delta"]["md5"] = "def";
+    doc["firmware"]["delta"]["size"] = 5000;
+    p = parse_ota_params(doc.as<JsonObject>());
+    EXPECT_EQ(p.error, OTA_ERR_NONE);
+    EXPECT_TRUE(p.has_delta);
+    EXPECT_STREQ(p.delta_url, "https://example.com/fw-1-to-2.delta");
+    EXPECT_STREQ(p.delta_md5, "def");
+    EXPECT_EQ(p.delta_size, 5000u);
+
+    // Без md5 результат не проверить
+    JsonDocument no_md5;
+    no_md5["firmware"]["url"] = "https://example.com/fw.bin";
+    no_md5["firmware"]["md5"] = "abc";
+    no_md5["firmware"]["delta"]["url"] = "https://example.com/fw-1-to-2.delta";
+    EXPECT_EQ(parse_ota_params(no_md5.as<JsonObject>()).error, OTA_ERR_PARSE);
+}
+
+// http:// без подписи образов не принимается: целостность только по md5
+TEST(ParseOtaParams, PlainHttpRejectedWithoutSigning)
+{
+    JsonDocument doc;
+    doc["firmware"]["url"] = "http://example.com/fw.bin";
+    doc["firmware"]["md5"] = "abc";
+
+    OtaParams p = parse_ota_params(doc.as<JsonObject>());
+#ifdef OTA_SIGNED
+    EXPECT_EQ(p.error, OTA_ERR_NONE);
+#else
+    EXPECT_EQ(p.error, OTA_ERR_PARSE);
+#endif
+    EXPECT_TRUE(ota_url_plain("http://example.com/fw.bin"));
+    EXPECT_FALSE(ota_url_plain("https://example.com/fw.bin"));
+}
+
+// MD5 образа: hex в байты и обратно
+TEST(OtaMd5, ParseAndFormat)
+{
+    uint8_t md5[OTA_MD5_SIZE];
+    ASSERT_TRUE(ota_md5_parse("6C023B5558cc375843449565ff0f2570", md5));
+    EXPECT_EQ(md5[0], 0x6c);
+    EXPECT_EQ(md5[15], 0x70);
+
+    char hex[2 * OTA_MD5_SIZE + 1];
+    EXPECT_TRUE(ota_md5_format(md5, hex));
+    EXPECT_STREQ(hex, "6c023b5558cc375843449565ff0f2570");
+}
+
+// Не MD5 — не сравнивается, нули — неизвестный образ
+TEST(OtaMd5, Invalid)
+{
+    uint8_t md5[OTA_MD5_SIZE] = {0};
+    EXPECT_FALSE(ota_md5_parse(nullptr, md5));
+    EXPECT_FALSE(ota_md5_parse("def456", md5));
+    EXPECT_FALSE(ota_md5_parse("6c023b5558cc375843449565ff0f257g", md5));
+    EXPECT_FALSE(ota_md5_parse("6c023b5558cc375843449565ff0f25700", md5));
+
+    uint8_t zero[OTA_MD5_SIZE] = {0};
+    char hex[2 * OTA_MD5_SIZE + 1];
+    EXPECT_FALSE(ota_md5_format(zero, hex));
+}
+
 // Коды ошибок — проверяем значения
 TEST(OtaErrorCodes, Values)
 {
@@ -0,0 +1,261 @@
+/**
+ * @file attiny_emulator.h
+ * @brief Эмулятор attiny85 на шине i2c для хост-симулятора пробуждения
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Отвечает на команды, которые ESP шлет в цикле передачи, так же, как
+ * прошивка attiny версии 47: заголовок одной транзакцией ('D') и побайтно ('B'),
+ * возможности ('I'), поля по тегам ('R'), страницы снимков ('G'/'H'),
+ * статистика расхода ('F'), интервалы между импульсами ('L').
+ * Ответ на команду читается по частям, как из буфера TinyWire.
+ */
+#ifndef ATTINY_EMULATOR_H_
+#define ATTINY_EMULATOR_H_
+
+#include <Wire.h>
+#include <vector>
+#include "master_i2c.h"
+
+#define ATTINY_EMULATOR_VERSION 47
+
+class AttinyEmulator : public I2cSlave
+{
+    std::vector<uint8_t> _reply;
+    size_t _pos = 0;
+
+    template <typename T>
+    static void put(std::vector<uint8_t> &buf, const T &value)
+    {
+        const uint8_t *p = (const uint8_t *)&value;
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    void seal(size_t from)
+    {
+        _reply.push_back(crc_8(_reply.data() + from, _reply.size() - from, INIT_ATTINY_CRC));
+    }
+
+    void header()
+    {
+        put(_reply, version);
+        put(_reply, service);
+        put(_reply, voltage);
+        put(_reply, (uint8_t)0);
+        put(_reply, setup_started);
+        put(_reply, resets);
+        put(_reply, model);
+        put(_reply, counter_type0);
+        put(_reply, counter_type1);
+        put(_reply, impulses0);
+        put(_reply, impulses1);
+        put(_reply, adc0);
+        put(_reply, adc1);
+        seal(0);
+    }
+
+    void field(uint8_t tag)
+    {
+        std::vector<uint8_t> value;
+        switch (tag)
+        {
+        case ATTINY_TAG_SERVICE:
+            put(value, service);
+            break;
+        case ATTINY_TAG_VOLTAGE:
+            put(value, voltage);
+            break;
+        case ATTINY_TAG_COUNTERS:
+            put(value, impulses0);
+            put(value, impulses1);
+            break;
+        case ATTINY_TAG_ADC:
+            put(value, adc0);
+            put(value, adc1);
+            break;
+        case ATTINY_TAG_WDT_RATES:
+            put(value, wdt_minutes);
+            break;
+        case ATTINY_TAG_STORAGE:
+            put(value, eeprom_writes);
+            put(value, eeprom_left);
+            break;
+        case ATTINY_TAG_FLOW_ALARM:
+            put(value, flow_alarm);
+            break;
+        case ATTINY_TAG_EEPROM_SKIPPED:
+            put(value, eeprom_skipped);
+            break;
+        default:
+            return;
+        }
+        if (_reply.size() + 2 + value.size() + 1 > ATTINY_FIELDS_SIZE)
+        {
+            return;
+        }
+        _reply.push_back(tag);
+        _reply.push_back(value.size());
+        _reply.insert(_reply.end(), value.begin(), value.end());
+    }
+
+    void fields(const uint8_t *tags, size_t count)
+    {
+        _reply.push_back(0);
+        for (size_t i = 0; i < count; i++)
+        {
+            field(tags[i]);
+        }
+        _reply[0] = _reply.size() - 1;
+        seal(0);
+        _reply.resize(ATTINY_FIELDS_SIZE, 0);
+    }
+
+    void snapshots_page(uint8_t page)
+    {
+        if (page == 0)
+        {
+            put(_reply, snapshot_count);
+            put(_reply, snapshot_period);
+            put(_reply, snapshot_age);
+            put(_reply, impulses0);
+            put(_reply, impulses1);
+        }
+        else
+        {
+            for (uint8_t i = 0; i < ATTINY_SNAPSHOT_PAGE_COUNT; i++)
+            {
+                uint8_t index = (page - 1) * ATTINY_SNAPSHOT_PAGE_COUNT + i;
+                uint16_t d0 = index < snapshot_count ? 10 + index : 0;
+                uint16_t d1 = index < snapshot_count ? 3 * index : 0;
+                put(_reply, d0);
+                put(_reply, d1);
+            }
+        }
+        _reply.resize(ATTINY_SNAPSHOT_PAGE_SIZE, 0);
+        seal(0);
+    }
+
+public:
+    uint8_t version = ATTINY_EMULATOR_VERSION;
+    uint8_t mode = TRANSMIT_MODE;
+    uint8_t service = 0;
+    uint16_t voltage = 3050;
+    uint8_t setup_started = 1;
+    uint8_t resets = 0;
+    uint8_t model = WATERIUS_MODEL_2;
+    uint8_t counter_type0 = 0;
+    uint8_t counter_type1 = 0;
+    uint32_t impulses0 = 1000;
+    uint32_t impulses1 = 2000;
+    uint16_t adc0 = 120;
+    uint16_t adc1 = 130;
+    uint16_t wdt_minutes[ATTINY_WDT_RATES] = {0, 0, 0, 15};
+    uint32_t eeprom_writes = 100;
+    uint32_t eeprom_left = 1000000;
+    uint32_t eeprom_skipped = 0;
+    uint8_t snapshot_count = 0;
+    uint8_t snapshot_period = 15;
+    uint16_t snapshot_age = 0;
+    uint8_t flow_alarm = 0;
+    AttinyFlowChannel flow[2] = {{4, 3, 12, 1300}, {2, 5, 6, 1400}};
+    // Сжатые интервалы, как их хранит attiny: количество, возраст, интервалы
+    uint8_t pulse_log[2][ATTINY_PULSE_LOG_CHANNEL_SIZE] = {{3, 10, 100, 96, 90}, {1, 50, 120}};
+    uint8_t caps = ATTINY_CAP_BULK | ATTINY_CAP_SNAPSHOTS | ATTINY_CAP_FIELDS | ATTINY_CAP_WDT_RATES | ATTINY_CAP_STORAGE |
+                   ATTINY_CAP_FLOW_ALARM | ATTINY_CAP_FLOW_STATS | ATTINY_CAP_PULSE_LOG;
+
+    // Что ESP сообщила attiny перед сном
+    uint16_t wakeup_period = 0;
+    bool sleep = false;
+
+    /**
+     * @brief Прошел период сна: attiny насчитала импульсы и будит ESP
+     */
+    void wake(uint32_t pulses0, uint32_t pulses1)
+    {
+        impulses0 += pulses0;
+        impulses1 += pulses1;
+        sleep = false;
+    }
+
+    void receive(const uint8_t *data, size_t size) override
+    {
+        if (!size)
+        {
+            return;
+        }
+        _reply.clear();
+        _pos = 0;
+        switch (data[0])
+        {
+        case 'M':
+            _reply.push_back(mode);
+            break;
+        case 'D':
+        case 'B':
+            header();
+            break;
+        case 'I':
+            _reply.push_back(1);
+            _reply.push_back(caps);
+            _reply.push_back(ATTINY_FIELDS_SIZE);
+            seal(0);
+            break;
+        case 'R':
+            fields(data + 1, size - 1);
+            break;
+        case 'G':
+        case 'H':
+            if (size == 2)
+            {
+                snapshots_page(data[1]);
+            }
+            break;
+        case 'S':
+            if (size == 4 && crc_8(data + 1, 2, INIT_ATTINY_CRC) == data[3])
+            {
+                wakeup_period = (data[1] << 8) | data[2];
+            }
+            break;
+        case 'h':
+            snapshot_count = 0;
+            break;
+        case 'F':
+            for (const AttinyFlowChannel &channel : flow)
+            {
+                put(_reply, channel.max_ppm);
+                put(_reply, channel.events);
+                put(_reply, channel.longest_min);
+                put(_reply, channel.zero_min);
+            }
+            seal(0);
+            break;
+        case 'f':
+            flow[0] = AttinyFlowChannel();
+            flow[1] = AttinyFlowChannel();
+            break;
+        case 'L':
+            _reply.insert(_reply.end(), &pulse_log[0][0], &pulse_log[0][0] + sizeof(pulse_log));
+            seal(0);
+            break;
+        case 'Z':
+            sleep = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    size_t request(uint8_t *data, size_t size) override
+    {
+        // за концом ответа attiny отдает 0xFF, как пустой буфер TinyWire
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = _pos < _reply.size() ? _reply[_pos++] : 0xFF;
+        }
+        return size;
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+/*
+Модули прошивки, которые выполняются в симуляторе пробуждения без изменений,
+и заглушки тех, что работают с сетью (sync_time, wifi_helpers, отправка,
+mqtt, OTA, DNS, ESP-NOW). Глобальные объекты - как в main.cpp.
+*/
+#include "../../src/log_buffer.cpp"
+#include "../../src/master_i2c.cpp"
+#include "../../src/utils.cpp"
+#include "../../src/voltage.cpp"
+#include "../../src/cpu_boost.cpp"
+#include "../../src/profiler.cpp"
+#include "../../src/energy.cpp"
+#include "../../src/fs_mount.cpp"
+#include "../../src/hot_state.cpp"
+#include "../../src/config.cpp"
+#include "../../src/offline_queue.cpp"
+#include "../../src/wake_log.cpp"
+#include "../../src/json.cpp"
+#include "../../src/json_arena.cpp"
+#include "../../src/wake_transmit.cpp"
+#include "json_stream.h"
+#include "wake_cycle.h"
+
+MasterI2C masterI2C;
+AttinyData data;
+AttinySnapshots snapshots;
+AttinyFlowStats flow_stats;
+AttinyPulseLog pulse_log;
+AttinyData runtime_data;
+Settings sett;
+CalculatedData cdata;
+Voltage voltage;
+
+// sync_time.cpp: время берем у компьютера, NTP - только задержка
+
+#define START_VALID_TIME 1704067201UL
+#define TIME_FORMAT "%FT%T%z"
+
+void apply_time_estimate(const Settings &/* sett */) {}
+
+void sync_time_begin(Settings &/* sett */) {}
+
+bool sync_time_end(Settings &/* sett */)
+{
+    delay(conditions.ntp_ms);
+    return true;
+}
+
+void advance_time_estimate(Settings &/* sett */) {}
+
+String get_current_time()
+{
+    char buf[100];
+    time_t now = time(nullptr);
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    strftime(buf, sizeof(buf), TIME_FORMAT, &timeinfo);
+    return String(buf);
+}
+
+bool is_valid_time(time_t time)
+{
+    return time > (time_t)START_VALID_TIME;
+}
+
+// wifi_helpers.cpp: подключение - задержка из условий пробуждения
+
+WifiTransitions wifi_transitions;
+
+bool wifi_connect(Settings &sett, WiFiMode_t /* wifi_mode */)
+{
+    sett.wifi_connect_attempt = WIFI_CONNECT_ATTEMPTS;
+    if (conditions.wifi_ok)
+    {
+        delay(conditions.wifi_connect_ms);
+        sett.wifi_channel = WiFi.channel();
+        wifi_transitions.connect_ms = conditions.wifi_connect_ms;
+        return true;
+    }
+    // все попытки до таймаута
+    delay(ESP_CONNECT_TIMEOUT * WIFI_CONNECT_ATTEMPTS);
+    wifi_transitions.connect_ms = ESP_CONNECT_TIMEOUT * WIFI_CONNECT_ATTEMPTS;
+    sett.wifi_connect_attempt = 0;
+    sett.wifi_channel = 0;
+    sett.wifi_connect_errors++;
+    return false;
+}
+
+void wifi_shutdown()
+{
+    delay(conditions.wifi_shutdown_ms);
+}
+
+String wifi_phy_mode_title(const WiFiPhyMode_t m)
+{
+    switch (m)
+    {
+    case WIFI_PHY_MODE_11B:
+        return F("B");
+    case WIFI_PHY_MODE_11G:
+        return F("G");
+    case WIFI_PHY_MODE_11N:
+        return F("N");
+    default:
+        return String((int)m);
+    }
+}
+
+// senders/send_data.cpp: тот же json, что уходит на сервер, сеть - задержки
+
+SendResults send_results;
+
+bool send_data(const Settings &sett, const AttinyData &data, const CalculatedData &cdata, JsonDocument &json_data, JsonDocument &/* json_settings */)
+{
+    send_results = SendResults();
+    {
+        CpuBoost boost;
+        get_json_data(sett, data, cdata, json_data);
+        offline_queue_fill_json(sett, json_data);
+    }
+
+    wake_metrics->json_size = measureJson(json_data);
+    wake_metrics->msgpack_size = measureMsgPack(json_data);
+
+    // Тело запроса проходит через тот же буфер, что и в сокет
+    Crc32Print body;
+    stream_json(json_data, body);
+
+    delay(conditions.connect_ms);
+    delay((uint64_t)body.length * 8 / conditions.uplink_kbit);
+    delay(conditions.response_ms);
+
+    SendStatus status = conditions.server_ok ? SEND_OK : SEND_FAIL;
+    if (is_waterius_site(sett))
+    {
+        send_results.waterius.status = status;
+    }
+    if (is_http(sett))
+    {
+        send_results.http.status = status;
+    }
+    send_results.retry_after = conditions.server_ok ? 0 : conditions.retry_after;
+    return conditions.server_ok;
+}
+
+// Сервер настройки не присылает
+bool settings_received(const JsonDocument &/* json_settings_received */)
+{
+    return false;
+}
+
+bool send_settings_ack(Settings &/* sett */, const AttinyData &/* data */, const CalculatedData &/* cdata */, const JsonDocument &/* json_data */, JsonDocument &/* json_settings */)
+{
+    return false;
+}
+
+void apply_settings(const JsonDocument &/* json_settings_received */, Settings &/* sett */, const AttinyData &/* data */, CalculatedData &/* cdata */) {}
+
+bool connect_and_subscribe_mqtt(Settings &/* sett */, JsonDocument &/* json_settings_received */)
+{
+    return false;
+}
+
+bool monitor_mqtt(Settings &/* sett */, const AttinyData &/* data */, JsonDocument &/* json_settings_received */)
+{
+    return false;
+}
+
+// http_pool.cpp, log_store.cpp, ota_update.cpp, dns_cache.cpp, espnow_link.cpp
+
+void http_pool_close() {}
+
+bool log_store_upload(const Settings &/* sett */)
+{
+    return true;
+}
+
+bool perform_ota_update(const JsonObject &/* ota */, MasterI2C &/* masterI2C */, Settings &/* sett */, Voltage &/* voltage */)
+{
+    return false;
+}
+
+void dns_prefetch(const Settings &/* sett */) {}
+
+void dns_cache_store() {}
+
+uint8_t espnow_role(const Settings &/* sett */)
+{
+    return ESPNOW_ROLE_OFF;
+}
+
+bool espnow_send(Settings &/* sett */, const AttinyData &/* data */, const CalculatedData &/* cdata */, const uint16_t /* voltage */)
+{
+    return false;
+}
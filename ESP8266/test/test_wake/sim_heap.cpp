@@ -0,0 +1,109 @@
+#include "sim_heap.h"
+#include <new>
+#include <stdlib.h>
+#include "sim.h"
+
+namespace
+{
+    struct alignas(alignof(max_align_t)) Block
+    {
+        size_t size;
+    };
+
+    void *heap_allocate(size_t size)
+    {
+        Block *block = (Block *)malloc(sizeof(Block) + size);
+        if (!block)
+        {
+            return nullptr;
+        }
+        block->size = size;
+        sim::heap_alloc(size);
+        return block + 1;
+    }
+
+    void heap_free(void *ptr)
+    {
+        if (ptr)
+        {
+            Block *block = (Block *)ptr - 1;
+            sim::heap_free(block->size);
+            free(block);
+        }
+    }
+
+    void *heap_reallocate(void *ptr, size_t size)
+    {
+        if (!ptr)
+        {
+            return heap_allocate(size);
+        }
+        Block *block = (Block *)ptr - 1;
+        size_t old_size = block->size;
+        block = (Block *)realloc(block, sizeof(Block) + size);
+        if (!block)
+        {
+            return nullptr;
+        }
+        block->size = size;
+        sim::heap_free(old_size);
+        sim::heap_alloc(size);
+        return block + 1;
+    }
+}
+
+void *SimAllocator::allocate(size_t size)
+{
+    return heap_allocate(size);
+}
+
+void SimAllocator::deallocate(void *ptr)
+{
+    heap_free(ptr);
+}
+
+void *SimAllocator::reallocate(void *ptr, size_t new_size)
+{
+    return heap_reallocate(ptr, new_size);
+}
+
+SimAllocator *SimAllocator::instance()
+{
+    static SimAllocator allocator;
+    return &allocator;
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = heap_allocate(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    heap_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    heap_free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    heap_free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    heap_free(ptr);
+}
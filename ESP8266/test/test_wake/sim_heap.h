@@ -0,0 +1,28 @@
+/**
+ * @file sim_heap.h
+ * @brief Учет кучи хост-симулятора
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Глобальные operator new/delete (String, std::vector внутри заглушек)
+ * и распределитель для JsonDocument ведут счетчики sim::heap_used/heap_peak.
+ * Перед каждым выделением хранится его размер, как в umm_malloc.
+ */
+#ifndef SIM_HEAP_H_
+#define SIM_HEAP_H_
+
+#include <ArduinoJson.h>
+
+class SimAllocator : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override;
+    void deallocate(void *ptr) override;
+    void *reallocate(void *ptr, size_t new_size) override;
+
+    static SimAllocator *instance();
+};
+
+#endif
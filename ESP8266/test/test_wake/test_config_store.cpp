@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "utils.h"
+#include "log_buffer.h"
+
+// Настройки во flash: две копии, при обрыве записи остается предыдущая
+class ConfigStoreTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ESP.flashClear();
+        ESP.flash_write_budget = SIZE_MAX;
+        LittleFS.format();
+    }
+
+    void TearDown() override
+    {
+        ESP.flash_write_budget = SIZE_MAX;
+        log_buffer = LogBuffer(); // ошибка записи включила прямой вывод лога, как после перезагрузки
+    }
+
+    static void store_period(uint16_t period)
+    {
+        Settings s;
+        load_config(s);
+        s.wakeup_per_min = period;
+        store_config(s);
+    }
+
+    static uint16_t load_period()
+    {
+        Settings s;
+        EXPECT_TRUE(load_config(s));
+        return s.wakeup_per_min;
+    }
+};
+
+TEST_F(ConfigStoreTest, AlternatesSectors)
+{
+    uint32_t erases = sim::sector_erases;
+    store_period(15);
+    store_period(30);
+    store_period(60);
+    EXPECT_EQ(load_period(), 60);
+    EXPECT_EQ(sim::sector_erases - erases, 3u);
+
+    // обе копии целые: в секторах разные записи
+    EXPECT_NE(memcmp(ESP.flash(), ESP.flash() + SPI_FLASH_SEC_SIZE, sizeof(Settings)), 0);
+}
+
+TEST_F(ConfigStoreTest, PowerLossKeepsPreviousCopy)
+{
+    store_period(15);
+    store_period(30);
+    for (size_t budget : {(size_t)0, (size_t)100, sizeof(Settings), sizeof(Settings) + 4})
+    {
+        ESP.flash_write_budget = budget;
+        store_period(45);
+        ESP.flash_write_budget = SIZE_MAX;
+        EXPECT_EQ(load_period(), 30) << "budget " << budget;
+    }
+    store_period(45);
+    EXPECT_EQ(load_period(), 45);
+}
+
+TEST_F(ConfigStoreTest, ConfigChangedOnlyByColdFields)
+{
+    store_period(15);
+    Settings s;
+    load_config(s);
+    EXPECT_FALSE(config_changed(s));
+
+    // часто меняющиеся поля пишутся в hot state, настройки от них не меняются
+    s.wake_time = 1234;
+    s.last_send = 5678;
+    EXPECT_FALSE(config_changed(s));
+
+    // ревизия от сервера - обычная настройка
+    s.config_rev = 7;
+    EXPECT_TRUE(config_changed(s));
+    uint32_t erases = sim::sector_erases;
+    store_config(s);
+    EXPECT_EQ(sim::sector_erases - erases, 1u);
+    EXPECT_FALSE(config_changed(s));
+}
+
+TEST_F(ConfigStoreTest, ReadsLegacyEepromLayout)
+{
+    // Прежний формат: Settings и crc, дальше стертая flash
+    Settings legacy;
+    init_config(legacy);
+    legacy.wakeup_per_min = 720;
+    uint16_t crc = get_checksum(legacy);
+    uint8_t *sector_a = ESP.flash() + SPI_FLASH_SEC_SIZE;
+    memcpy(sector_a, &legacy, sizeof(legacy));
+    memcpy(sector_a + sizeof(legacy), &crc, sizeof(crc));
+
+    EXPECT_EQ(load_period(), 720);
+    store_period(360);
+    EXPECT_EQ(load_period(), 360);
+    ASSERT_EQ(memcmp(sector_a, &legacy, sizeof(legacy)), 0) << "legacy copy kept until the next write";
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "json_arena.h"
+
+class JsonArenaTest : public ::testing::Test
+{
+protected:
+    alignas(8) uint8_t block[256];
+    JsonArena arena;
+
+    void SetUp() override { arena.begin(block, sizeof(block)); }
+
+    bool in_block(const void *ptr) const { return ptr >= block && ptr < block + sizeof(block); }
+};
+
+TEST_F(JsonArenaTest, BumpAndResetWhenEmpty)
+{
+    void *a = arena.allocate(10);
+    void *b = arena.allocate(20);
+    ASSERT_TRUE(in_block(a));
+    ASSERT_TRUE(in_block(b));
+    EXPECT_GT(b, a);
+    EXPECT_EQ((uintptr_t)b % sizeof(void *), 0u);
+
+    arena.deallocate(a); // не последнее: память вернется вместе с остальными
+    size_t used = arena.used();
+    EXPECT_GT(used, 0u);
+
+    arena.deallocate(b);
+    EXPECT_EQ(arena.used(), 0u);
+    EXPECT_EQ(arena.allocate(8), (void *)(block + 2 * sizeof(size_t))); // блок снова с начала
+}
+
+TEST_F(JsonArenaTest, LastAllocationFreedAndGrownInPlace)
+{
+    void *a = arena.allocate(16);
+    void *b = arena.allocate(16);
+    size_t used = arena.used();
+
+    void *c = arena.reallocate(b, 64); // строка ArduinoJson растет на месте
+    EXPECT_EQ(c, b);
+    EXPECT_GT(arena.used(), used);
+
+    c = arena.reallocate(c, 8); // shrinkToFit
+    EXPECT_EQ(c, b);
+
+    arena.deallocate(c);
+    EXPECT_LT(arena.used(), used);
+    arena.deallocate(a);
+    EXPECT_EQ(arena.used(), 0u);
+    EXPECT_EQ(arena.fallbacks(), 0u);
+}
+
+TEST_F(JsonArenaTest, FreedBelowTopReturnedWithTop)
+{
+    void *a = arena.allocate(16);
+    size_t after_a = arena.used();
+    void *b = arena.allocate(16);
+    void *c = arena.allocate(16);
+    size_t used = arena.used();
+
+    arena.deallocate(b); // временный документ закрыт раньше следующего
+    EXPECT_EQ(arena.used(), used);
+    arena.deallocate(c);
+    EXPECT_EQ(arena.used(), after_a);
+
+    void *d = arena.allocate(16);
+    EXPECT_EQ(d, b);
+    arena.deallocate(d);
+    arena.deallocate(a);
+    EXPECT_EQ(arena.used(), 0u);
+}
+
+TEST_F(JsonArenaTest, MoveKeepsContent)
+{
+    char *a = (char *)arena.allocate(8);
+    strcpy(a, "abcdefg");
+    void *b = arena.allocate(8);
+    char *moved = (char *)arena.reallocate(a, 32);
+    EXPECT_NE(moved, a);
+    EXPECT_TRUE(in_block(moved));
+    EXPECT_STREQ(moved, "abcdefg");
+    arena.deallocate(b);
+    arena.deallocate(moved);
+    EXPECT_EQ(arena.used(), 0u);
+}
+
+TEST_F(JsonArenaTest, FallbackToHeap)
+{
+    void *a = arena.allocate(200);
+    ASSERT_TRUE(in_block(a));
+    void *b = arena.allocate(100); // не помещается
+    ASSERT_NE(b, nullptr);
+    EXPECT_FALSE(in_block(b));
+    EXPECT_EQ(arena.fallbacks(), 1u);
+
+    char *grown = (char *)arena.reallocate(a, 400); // последнее, но блока не хватает
+    ASSERT_NE(grown, nullptr);
+    EXPECT_FALSE(in_block(grown));
+    EXPECT_EQ(arena.used(), 0u);
+
+    arena.deallocate(b);
+    arena.deallocate(grown);
+    EXPECT_EQ(arena.peak(), 2 * sizeof(size_t) + 200u);
+}
+
+TEST(JsonArena, WithoutBlock)
+{
+    JsonArena arena;
+    void *a = arena.allocate(16);
+    ASSERT_NE(a, nullptr);
+    a = arena.reallocate(a, 32);
+    arena.deallocate(a);
+    EXPECT_EQ(arena.capacity(), 0u);
+    EXPECT_EQ(arena.fallbacks(), 1u);
+}
@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+#include "wake_cycle.h"
+#include "wake_log.h"
+
+/*
+Бюджеты цикла передачи. Если изменение их превышает - либо это регрессия
+энергопотребления, либо бюджет нужно осознанно пересмотреть в этом файле.
+Куча на 64-битном компьютере больше, чем на ESP: указатели и слоты
+ArduinoJson вдвое шире.
+*/
+#ifndef BUDGET_AWAKE_MS
+#define BUDGET_AWAKE_MS 1650 // при wifi_connect_ms = 1200
+#endif
+#ifndef BUDGET_HEAP_PEAK
+#define BUDGET_HEAP_PEAK 12000 // байт кучи за пробуждение
+#endif
+#ifndef BUDGET_JSON_SIZE
+#define BUDGET_JSON_SIZE 2000 // тело запроса с интервальными данными, байт
+#endif
+#ifndef BUDGET_I2C_TRANSACTIONS
+#define BUDGET_I2C_TRANSACTIONS 34 // с чтением всех страниц снимков и интервалов импульсов
+#endif
+#ifndef BUDGET_FS_WRITES
+#define BUDGET_FS_WRITES 3 // журнал горячих полей, журнал пробуждений
+#endif
+
+static void print_metrics(const char *title, const WakeMetrics &m)
+{
+    printf("[ WAKE     ] %-10s exit=%u awake=%u ms heap=%u json=%u msgpack=%u i2c=%u/%u B erases=%u fs=%u period=%u cycle=%u uAh days=%u\n",
+           title, m.exit, m.awake_ms, m.heap_peak, m.json_size, m.msgpack_size,
+           m.i2c_transactions, m.i2c_bytes, m.sector_erases, m.fs_writes, m.wakeup_period,
+           m.cycle_uah, m.battery_days);
+}
+
+class WakeCycle : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        attiny = AttinyEmulator();
+        conditions = WakeConditions();
+        device_setup("waterius");
+    }
+
+    WakeMetrics wake(const char *title, uint32_t pulses0 = 15, uint32_t pulses1 = 4)
+    {
+        attiny.wake(pulses0, pulses1);
+        WakeMetrics m = device_wake();
+        EXPECT_TRUE(m.completed) << title << ": wake crashed";
+        print_metrics(title, m);
+        return m;
+    }
+};
+
+// Обычное пробуждение укладывается в бюджеты
+TEST_F(WakeCycle, TransmitWithinBudget)
+{
+    wake("first");
+    WakeMetrics m = wake("steady");
+
+    EXPECT_EQ(m.exit, WAKE_EXIT_OK);
+    EXPECT_TRUE(m.sent);
+    EXPECT_TRUE(attiny.sleep);
+    EXPECT_GT(m.wakeup_period, 0);
+    EXPECT_LE(m.awake_ms, BUDGET_AWAKE_MS);
+    EXPECT_LE(m.heap_peak, BUDGET_HEAP_PEAK);
+    EXPECT_GT(m.json_size, 0u);
+    EXPECT_LE(m.json_size, BUDGET_JSON_SIZE);
+    EXPECT_LT(m.msgpack_size, m.json_size);
+    EXPECT_LE(m.i2c_transactions, BUDGET_I2C_TRANSACTIONS);
+    EXPECT_LE(m.fs_writes, BUDGET_FS_WRITES);
+
+    ::testing::Test::RecordProperty("awake_ms", m.awake_ms);
+    ::testing::Test::RecordProperty("heap_peak", m.heap_peak);
+    ::testing::Test::RecordProperty("json_size", m.json_size);
+}
+
+// Горячие поля уходят в журнал LittleFS: сектор EEPROM не стирается каждое пробуждение
+TEST_F(WakeCycle, SteadyWakesDoNotEraseEeprom)
+{
+    wake("first");
+    for (int i = 0; i < 5; i++)
+    {
+        WakeMetrics m = wake("steady");
+        EXPECT_EQ(m.sector_erases, 0u) << "wake " << i;
+    }
+}
+
+// Без wifi показания копятся в очереди и уходят со следующей отправкой
+TEST_F(WakeCycle, OfflineQueueFlushedAfterReconnect)
+{
+    wake("first");
+    WakeMetrics online = wake("online");
+
+    conditions.wifi_ok = false;
+    WakeMetrics offline = wake("no wifi");
+    EXPECT_EQ(offline.exit, WAKE_EXIT_NO_WIFI);
+    EXPECT_FALSE(offline.sent);
+
+    conditions.wifi_ok = true;
+    WakeMetrics back = wake("reconnect");
+    EXPECT_EQ(back.exit, WAKE_EXIT_OK);
+    EXPECT_GT(back.json_size, online.json_size);
+
+    WakeMetrics after = wake("after");
+    EXPECT_LT(after.json_size, back.json_size);
+}
+
+// После WIFI_BACKOFF_FAILURES неудач подряд часть пробуждений обходится без Wi-Fi
+TEST_F(WakeCycle, WifiBackoff)
+{
+    wake("first");
+    conditions.wifi_ok = false;
+    WakeMetrics failed;
+    for (int i = 0; i < WIFI_BACKOFF_FAILURES; i++)
+    {
+        failed = wake("no wifi");
+        EXPECT_EQ(failed.exit, WAKE_EXIT_NO_WIFI) << "wake " << i;
+    }
+
+    WakeMetrics skipped = wake("backoff");
+    EXPECT_EQ(skipped.exit, WAKE_EXIT_WIFI_BACKOFF);
+    EXPECT_LT(skipped.awake_ms, failed.awake_ms / 4);
+    EXPECT_LT(skipped.cycle_uah, failed.cycle_uah);
+    EXPECT_TRUE(attiny.sleep);
+
+    // Следующая неудача удваивает отсрочку
+    EXPECT_EQ(wake("no wifi").exit, WAKE_EXIT_NO_WIFI);
+    EXPECT_EQ(wake("backoff").exit, WAKE_EXIT_WIFI_BACKOFF);
+    EXPECT_EQ(wake("backoff").exit, WAKE_EXIT_WIFI_BACKOFF);
+
+    // Сеть вернулась: накопленное уходит, отсрочка сбрасывается
+    conditions.wifi_ok = true;
+    WakeMetrics back = wake("reconnect");
+    EXPECT_EQ(back.exit, WAKE_EXIT_OK);
+    EXPECT_GT(back.json_size, 0u);
+    EXPECT_EQ(wake("online").exit, WAKE_EXIT_OK);
+}
+
+// Сервер не ответил: пробуждение завершается штатно, точка сохраняется
+TEST_F(WakeCycle, ServerDown)
+{
+    wake("first");
+    conditions.server_ok = false;
+    WakeMetrics m = wake("down");
+    EXPECT_EQ(m.exit, WAKE_EXIT_NOT_SENT);
+    EXPECT_TRUE(attiny.sleep);
+
+    conditions.server_ok = true;
+    WakeMetrics back = wake("up");
+    EXPECT_EQ(back.exit, WAKE_EXIT_OK);
+}
+
+// Перегруженный сервер просит подождать: показания в очереди, следующее пробуждение позже
+TEST_F(WakeCycle, ServerBackpressure)
+{
+    wake("first");
+    conditions.server_ok = false;
+    conditions.retry_after = 3 * 86400;
+    WakeMetrics busy = wake("busy");
+    EXPECT_EQ(busy.exit, WAKE_EXIT_NOT_SENT);
+    EXPECT_GE(busy.wakeup_period, 3 * 1440); // часы attiny в симуляторе точные
+
+    conditions.server_ok = true;
+    conditions.retry_after = 0;
+    WakeMetrics back = wake("back");
+    EXPECT_EQ(back.exit, WAKE_EXIT_OK);
+    EXPECT_LT(back.wakeup_period, 3 * 1440);
+}
+
+// Интервальные данные attiny: 24 снимка читаются постранично и очищаются после отправки
+TEST_F(WakeCycle, SnapshotsReadAndCleared)
+{
+    wake("first");
+    WakeMetrics plain = wake("plain");
+
+    attiny.snapshot_count = ATTINY_SNAPSHOT_COUNT;
+    WakeMetrics m = wake("snapshots");
+    EXPECT_GT(m.i2c_transactions, plain.i2c_transactions);
+    EXPECT_GT(m.json_size, plain.json_size);
+    EXPECT_EQ(attiny.snapshot_count, 0);
+    EXPECT_LE(m.i2c_transactions, BUDGET_I2C_TRANSACTIONS);
+    EXPECT_LE(m.json_size, BUDGET_JSON_SIZE);
+}
+
+// Расход копится в горячих полях, неудачное подключение к wifi дороже обычного
+TEST_F(WakeCycle, EnergyAccumulated)
+{
+    WakeMetrics first = wake("first");
+    WakeMetrics steady = wake("steady");
+    EXPECT_GT(steady.cycle_uah, 0u);
+    EXPECT_EQ(steady.energy_uah, first.energy_uah + steady.cycle_uah);
+    EXPECT_GT(steady.battery_days, 0u);
+    EXPECT_EQ(steady.sector_erases, 0u);
+
+    conditions.wifi_ok = false;
+    WakeMetrics offline = wake("no wifi");
+    EXPECT_GT(offline.cycle_uah, steady.cycle_uah);
+    EXPECT_LT(offline.battery_days, steady.battery_days);
+}
+
+// Политика периода: без расхода период растет до верхней границы,
+// с расходом возвращается к заданному, при протечке - нижняя граница
+TEST_F(WakeCycle, WakeupPolicy)
+{
+    device_setup("waterius", 60, 4 * DEFAULT_WAKEUP_PERIOD_MIN);
+    wake("first"); // все импульсы с начала - большой расход, период сокращается
+    EXPECT_EQ(wake("steady").wakeup_period, DEFAULT_WAKEUP_PERIOD_MIN);
+    EXPECT_EQ(wake("idle 1d", 0, 0).wakeup_period, DEFAULT_WAKEUP_PERIOD_MIN);
+    EXPECT_EQ(wake("idle 2d", 0, 0).wakeup_period, 2 * DEFAULT_WAKEUP_PERIOD_MIN);
+    EXPECT_EQ(wake("idle 4d", 0, 0).wakeup_period, 4 * DEFAULT_WAKEUP_PERIOD_MIN);
+    EXPECT_EQ(wake("idle 8d", 0, 0).wakeup_period, 4 * DEFAULT_WAKEUP_PERIOD_MIN);
+
+    WakeMetrics flow = wake("flow");
+    EXPECT_EQ(flow.wakeup_period, DEFAULT_WAKEUP_PERIOD_MIN);
+    EXPECT_EQ(flow.sector_erases, 0u);
+
+    attiny.snapshot_count = ATTINY_SNAPSHOT_COUNT;
+    EXPECT_EQ(wake("leak").wakeup_period, 60);
+}
+
+// Статистика расхода attiny уходит на сервер и очищается только после отправки
+TEST_F(WakeCycle, FlowStatsClearedAfterSend)
+{
+    wake("first");
+    attiny.flow[0].events = 3;
+    conditions.server_ok = false;
+    wake("down");
+    EXPECT_EQ(attiny.flow[0].events, 3);
+
+    conditions.server_ok = true;
+    attiny.caps &= ~ATTINY_CAP_FLOW_STATS;
+    WakeMetrics plain = wake("no stats");
+    EXPECT_EQ(attiny.flow[0].events, 3);
+
+    attiny.caps |= ATTINY_CAP_FLOW_STATS;
+    WakeMetrics m = wake("stats");
+    EXPECT_EQ(attiny.flow[0].events, 0);
+    EXPECT_GT(m.json_size, plain.json_size);
+}
+
+// Интервалы между импульсами читаются только после новых импульсов
+TEST_F(WakeCycle, PulseLogReadOnFlow)
+{
+    wake("first");
+    WakeMetrics idle = wake("idle", 0, 0);
+    WakeMetrics flow = wake("flow");
+    EXPECT_EQ(flow.i2c_transactions, idle.i2c_transactions + 2);
+    EXPECT_GT(flow.json_size, idle.json_size);
+
+    attiny.caps &= ~ATTINY_CAP_PULSE_LOG;
+    WakeMetrics old = wake("old attiny");
+    EXPECT_EQ(old.i2c_transactions, idle.i2c_transactions);
+    EXPECT_EQ(old.exit, WAKE_EXIT_OK);
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include "config.h"
+
+// Место пробуждений в периоде: сдвиг по chip id или назначенный сервером
+static const time_t SETUP_TIME = 1767225600 + 19 * 3600; // 2026-01-01 19:00 UTC
+
+TEST(WakeSlot, ChipIdSlotWithinPeriod)
+{
+    Settings sett;
+    sett.base_time = SETUP_TIME;
+    uint32_t slot = wakeup_slot_sec(sett, 1440);
+    EXPECT_LT(slot, 1440UL * 60);
+    EXPECT_EQ(wakeup_slot_sec(sett, 1440), slot); // детерминирован
+    EXPECT_EQ(wakeup_base_time(sett, 1440), SETUP_TIME + (time_t)slot);
+}
+
+TEST(WakeSlot, ServerSlot)
+{
+    Settings sett;
+    sett.base_time = SETUP_TIME;
+    sett.wakeup_slot = 8 * 60 + 1; // через 8 часов после настройки, 03:00 UTC
+    EXPECT_EQ(wakeup_slot_sec(sett, 1440), 8UL * 3600);
+    EXPECT_EQ(wakeup_base_time(sett, 1440), (time_t)1767225600 + 27 * 3600);
+
+    // сдвиг больше короткого периода берется по модулю
+    EXPECT_EQ(wakeup_slot_sec(sett, 60), 0UL);
+
+    sett.wakeup_slot = 1;
+    EXPECT_EQ(wakeup_base_time(sett, 1440), SETUP_TIME);
+}
+
+TEST(WakeSlot, TuneTargetsSlot)
+{
+    Settings sett;
+    sett.base_time = SETUP_TIME;
+    sett.wakeup_slot = 8 * 60 + 1;
+    time_t base = wakeup_base_time(sett, 1440);
+
+    // часы attiny точные: проснулись через period_min_tuned минут после настройки
+    uint16_t tuned = 1300;
+    time_t last_send = SETUP_TIME;
+    time_t now = last_send + tuned * 60;
+    uint16_t next = tune_wakeup(now, base, last_send, 1440, tuned);
+
+    time_t wake = now + next * 60;
+    EXPECT_NEAR((double)((wake - base) % (1440 * 60)), 0.0, 60.0);
+    EXPECT_GE(next, 1440 * 3 / 10);
+}
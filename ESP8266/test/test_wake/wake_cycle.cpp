@@ -0,0 +1,260 @@
+#include "wake_cycle.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include "config.h"
+#include "master_i2c.h"
+#include "voltage.h"
+#include "utils.h"
+#include "profiler.h"
+#include "energy.h"
+#include "wake_log.h"
+#include "wake_transmit.h"
+#include "sim_heap.h"
+
+extern MasterI2C masterI2C;
+extern AttinyData data;
+extern AttinyData runtime_data;
+extern Settings sett;
+extern CalculatedData cdata;
+extern Voltage voltage;
+
+AttinyEmulator attiny;
+WakeConditions conditions;
+WakeMetrics *wake_metrics = nullptr;
+
+/*
+Состояние, которое переживает отключение питания ESP:
+flash (EEPROM, LittleFS), RTC память, регистры attiny.
+Дочерний процесс отдает его родителю через pipe вместе с замерами.
+*/
+static void put(std::vector<uint8_t> &out, const void *src, size_t size)
+{
+    out.insert(out.end(), (const uint8_t *)src, (const uint8_t *)src + size);
+}
+
+static bool get(const std::vector<uint8_t> &in, size_t &pos, void *dst, size_t size)
+{
+    if (pos + size > in.size())
+    {
+        return false;
+    }
+    memcpy(dst, in.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+static std::vector<uint8_t> save_state(const WakeMetrics &metrics)
+{
+    std::vector<uint8_t> out;
+    put(out, &metrics, sizeof(metrics));
+    put(out, ESP.flash(), EspClass::flash_size);
+    put(out, ESP.rtc(), EspClass::rtc_size);
+    put(out, &attiny.wakeup_period, sizeof(attiny.wakeup_period));
+    put(out, &attiny.sleep, sizeof(attiny.sleep));
+    put(out, &attiny.snapshot_count, sizeof(attiny.snapshot_count));
+    put(out, attiny.flow, sizeof(attiny.flow));
+
+    uint32_t count = LittleFS.files().size();
+    put(out, &count, sizeof(count));
+    for (const auto &file : LittleFS.files())
+    {
+        uint32_t name_len = file.first.size();
+        uint32_t size = file.second->size();
+        put(out, &name_len, sizeof(name_len));
+        put(out, file.first.data(), name_len);
+        put(out, &size, sizeof(size));
+        put(out, file.second->data(), size);
+    }
+    return out;
+}
+
+static bool load_state(const std::vector<uint8_t> &in, WakeMetrics &metrics)
+{
+    size_t pos = 0;
+    uint32_t count = 0;
+    if (!get(in, pos, &metrics, sizeof(metrics)) ||
+        !get(in, pos, ESP.flash(), EspClass::flash_size) ||
+        !get(in, pos, ESP.rtc(), EspClass::rtc_size) ||
+        !get(in, pos, &attiny.wakeup_period, sizeof(attiny.wakeup_period)) ||
+        !get(in, pos, &attiny.sleep, sizeof(attiny.sleep)) ||
+        !get(in, pos, &attiny.snapshot_count, sizeof(attiny.snapshot_count)) ||
+        !get(in, pos, attiny.flow, sizeof(attiny.flow)) ||
+        !get(in, pos, &count, sizeof(count)))
+    {
+        return false;
+    }
+
+    LittleFS.format();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t name_len, size;
+        if (!get(in, pos, &name_len, sizeof(name_len)))
+        {
+            return false;
+        }
+        std::string name(name_len, 0);
+        if (!get(in, pos, &name[0], name_len) || !get(in, pos, &size, sizeof(size)))
+        {
+            return false;
+        }
+        auto file = std::make_shared<std::vector<uint8_t>>(size);
+        if (!get(in, pos, file->data(), size))
+        {
+            return false;
+        }
+        LittleFS.files()[name] = file;
+    }
+    return true;
+}
+
+/**
+ * @brief Выполняет body в новом процессе: статические переменные модулей
+ * прошивки в нем такие же, как после включения питания
+ */
+template <typename Body>
+static WakeMetrics power_cycle(Body body)
+{
+    WakeMetrics metrics = {};
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return metrics;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        sim::power_on();
+        size_t heap_base = sim::heap_used;
+        WakeMetrics result = {};
+        wake_metrics = &result;
+        body(result);
+        result.completed = true;
+        result.awake_ms = millis();
+        result.heap_peak = sim::heap_peak - heap_base;
+        result.sector_erases = sim::sector_erases;
+        result.fs_writes = sim::fs_writes;
+        result.i2c_transactions = Wire.transactions;
+        result.i2c_bytes = Wire.bytes_total;
+
+        std::vector<uint8_t> out = save_state(result);
+        for (size_t pos = 0; pos < out.size();)
+        {
+            ssize_t n = write(fds[1], out.data() + pos, out.size() - pos);
+            if (n <= 0)
+            {
+                _exit(1);
+            }
+            pos += n;
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::vector<uint8_t> in;
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    {
+        in.insert(in.end(), buf, buf + n);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !load_state(in, metrics))
+    {
+        metrics = {};
+    }
+    return metrics;
+}
+
+/*
+Начало loop() в main.cpp до wake_transmit() и завершение после него.
+Режим настройки не выполняется, сетевые модули - заглушки в firmware.cpp.
+*/
+static void simulate_loop(WakeMetrics &metrics)
+{
+    masterI2C.begin();
+
+    uint8_t mode = TRANSMIT_MODE;
+    bool config_loaded = false;
+    WakeExit wake_exit = WAKE_EXIT_NO_ATTINY;
+
+    profiler_start(PHASE_I2C);
+    bool attiny_ready = masterI2C.getMode(mode) && masterI2C.getAttinyData(data);
+    profiler_stop(PHASE_I2C);
+
+    if (attiny_ready)
+    {
+        runtime_data = data;
+        voltage.update();
+
+        config_loaded = load_config(sett);
+        sett.mode = mode;
+        calculate_values(sett, data, cdata);
+
+        if (config_loaded)
+        {
+            wake_exit = wake_transmit(mode, SimAllocator::instance());
+            metrics.sent = wake_exit == WAKE_EXIT_OK;
+            metrics.cycle_uah = sett.energy_cycle_uah;
+            metrics.energy_uah = sett.energy_uah;
+            metrics.battery_days = energy_battery_days(sett);
+        }
+    }
+
+    if (!config_loaded && attiny_ready)
+    {
+        wake_exit = WAKE_EXIT_NO_CONFIG;
+    }
+
+    profiler_log();
+    wake_log_store(sett, wake_exit);
+
+    metrics.exit = wake_exit;
+    metrics.wakeup_period = attiny.wakeup_period;
+
+    voltage.stop_sampling();
+    masterI2C.setSleep();
+}
+
+void device_setup(const char *ssid, uint16_t period_lo, uint16_t period_hi)
+{
+    ESP.flashClear();
+    LittleFS.format();
+    ESP.rtcClear();
+    Wire.attach(&attiny);
+
+    power_cycle([ssid, period_lo, period_hi](WakeMetrics &)
+                {
+                    // Так же, как после сохранения настроек в веб-портале
+                    load_config(sett);
+                    strncpy0(sett.wifi_ssid, ssid, WIFI_SSID_LEN);
+                    sett.wakeup_per_min_lo = period_lo;
+                    sett.wakeup_per_min_hi = period_hi;
+                    sett.wakeup_slot = 1; // без сдвига: расписание от времени настройки
+                    sett.mode = TRANSMIT_MODE;
+                    sett.setup_finished_counter++;
+                    reset_period_min_tuned(sett);
+                    store_config(sett); });
+    attiny.mode = TRANSMIT_MODE;
+}
+
+WakeMetrics device_wake()
+{
+    if (!conditions.rtc_kept)
+    {
+        ESP.rtcClear();
+    }
+    WakeMetrics metrics = power_cycle([](WakeMetrics &metrics)
+                                      {
+                                          delay(conditions.boot_ms);
+                                          simulate_loop(metrics); });
+    return metrics;
+}
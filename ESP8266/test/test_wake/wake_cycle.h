@@ -0,0 +1,89 @@
+/**
+ * @file wake_cycle.h
+ * @brief Хост-симулятор цикла пробуждения ESP
+ * @version 0.1
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Прогоняет путь передачи показаний из loop() (main.cpp) - ту же функцию
+ * wake_transmit() на настоящих модулях прошивки: i2c с эмулятором attiny,
+ * настройки в EEPROM, журналы LittleFS, профайлер, формирование json.
+ * Сеть (wifi, ntp, отправка) заменена задержками из WakeConditions.
+ *
+ * Каждое пробуждение выполняется в дочернем процессе: как и на устройстве,
+ * после снятия питания статические переменные модулей начинаются заново,
+ * а EEPROM, LittleFS и attiny сохраняются между пробуждениями. RTC память
+ * по умолчанию очищается, как на устройстве: attiny снимает питание ESP.
+ */
+#ifndef WAKE_CYCLE_H_
+#define WAKE_CYCLE_H_
+
+#include <Arduino.h>
+#include "attiny_emulator.h"
+
+/**
+ * @brief Условия пробуждения: задержки сети и результат операций
+ */
+struct WakeConditions
+{
+    uint32_t boot_ms = 60;          // от EN до setup()
+    bool rtc_kept = false;          // RTC память пережила сон: на устройстве attiny снимает питание ESP
+    bool wifi_ok = true;            // точка доступа доступна
+    uint32_t wifi_connect_ms = 1200; // подключение и DHCP
+    uint32_t wifi_shutdown_ms = 5;
+    uint32_t ntp_ms = 40;
+    bool server_ok = true;          // сервер ответил 200
+    uint32_t retry_after = 0;       // иначе ответил 503 с Retry-After, с
+    uint32_t connect_ms = 60;       // TCP подключение к серверу
+    uint32_t response_ms = 120;     // ответ сервера после тела запроса
+    uint32_t uplink_kbit = 1000;    // скорость передачи тела запроса
+};
+
+/**
+ * @brief Замеры одного пробуждения
+ */
+struct WakeMetrics
+{
+    bool completed;         // дочерний процесс дошел до сна
+    uint8_t exit;           // WakeExit
+    bool sent;
+    uint32_t awake_ms;      // от EN до команды сна attiny
+    uint32_t heap_peak;     // пик кучи за пробуждение, байт
+    uint32_t json_size;     // тело запроса json, байт
+    uint32_t msgpack_size;  // то же в MessagePack
+    uint32_t i2c_transactions;
+    uint32_t i2c_bytes;
+    uint32_t sector_erases; // стирания сектора EEPROM
+    uint32_t fs_writes;     // записи LittleFS
+    uint16_t wakeup_period; // период сна, переданный attiny
+    uint16_t cycle_uah;     // расход цикла по модели energy, мкА*ч
+    uint32_t energy_uah;    // накопленный расход
+    uint16_t battery_days;  // прогноз работы батареи
+};
+
+extern AttinyEmulator attiny;
+extern WakeConditions conditions;
+
+/**
+ * @brief Замеры пробуждения, которое выполняется сейчас (в дочернем процессе).
+ * Размеры json записывает заглушка отправки.
+ */
+extern WakeMetrics *wake_metrics;
+
+/**
+ * @brief Первое включение: пустые EEPROM и LittleFS, настройка как из веб-портала
+ *
+ * @param ssid имя сети wifi
+ * @param period_lo, period_hi границы периода пробуждения для политики, мин
+ */
+extern void device_setup(const char *ssid, uint16_t period_lo = 0, uint16_t period_hi = 0);
+
+/**
+ * @brief Одно пробуждение по таймеру attiny (TRANSMIT_MODE)
+ *
+ * @return замеры; completed == false, если пробуждение упало
+ */
+extern WakeMetrics device_wake();
+
+#endif
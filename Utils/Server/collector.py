@@ -0,0 +1,421 @@
+# -*- coding: utf-8 -*-
+"""
+Сборщик показаний Ватериусов для парка устройств.
+
+server.py - пример на Flask для одного ватериуса. Сборщик рассчитан
+на тысячи устройств в минуту: asyncio, HTTP/1.1 с keep-alive, без
+потока на соединение. Принимает всё, что отправляет прошивка:
+
+    - полный JSON (application/json);
+    - компактный формат (http_compact): MessagePack (application/msgpack)
+      со "sv" и "sc"; статические поля приходят только при изменении их crc
+      и хранятся сборщиком по токену устройства (заголовок Waterius-Token);
+    - очередь неотправленных показаний "queue": [[timestamp, imp0, imp1, voltage_mv], ...];
+    - пакеты шлюза ESP-NOW: {"gateway": ..., "devices": [...]};
+    - лог пробуждений с ошибками (Content-Encoding: gzip, настройка log_upload).
+
+Повторы отбрасываются по паре esp_id + время показаний (у устройств шлюза
+вместо времени - номер кадра seq). Показания дописываются построчно JSON
+в файл --out отдельной задачей, обработка запроса на диск не ждет.
+
+Ответ - то, что ждет post_data: 200 и JSON настроек, если для устройства
+они заданы в --settings. Устройство сообщает ревизию примененных настроек
+"config_rev" (crc32 набора из --settings): при другой ревизии в ответе только
+поля, отличающиеся от присланных устройством, и новая "config_rev", при той же -
+204 без тела. Прошивке без config_rev настройки повторяются в каждом ответе,
+пока она не пришлет "settings_applied". "ota" отправляется без ревизии.
+Сверх --max-inflight одновременных запросов сборщик отвечает
+503 с Retry-After: прошивка переносит следующую отправку (wakeup_defer).
+
+Файл настроек:
+    {"*": {"period_min": 60}, "a1b2c3...": {"ota": {"firmware": {"url": "https://...", "md5": "..."}}}}
+ключ - токен устройства (key) или esp_id, "*" - для всех. "ota_version" -
+версия прошивки из "ota": устройству с этой версией "ota" больше не отправляется.
+
+Если сборщик перезапущен без --state, компактные показания без статических
+полей придут с неизвестным "sc": показания сохраняются без них, устройство
+считается в static_missing, пока его статические поля не изменятся.
+
+Пример вызова (Python 3.7+, для MessagePack: pip install msgpack):
+    python3 collector.py --port 10000 --out readings.jsonl --settings settings.json --state state.json
+
+Нагрузка - loadgen.py.
+"""
+import argparse
+import asyncio
+import gzip
+import json
+import os
+import sys
+import time
+import zlib
+from collections import deque
+from datetime import datetime
+
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
+
+DEDUP_WINDOW = 256        # последних меток времени на устройство
+MAX_BODY = 64 * 1024      # больше прошивка не отправляет
+HEADER_TIMEOUT = 30       # с, простой keep-alive соединения
+STATS_PERIOD = 10         # с, вывод статистики
+WRITE_BATCH = 512         # строк за одну запись в файл
+
+REASONS = {200: 'OK', 204: 'No Content', 400: 'Bad Request', 404: 'Not Found', 411: 'Length Required',
+           413: 'Payload Too Large', 415: 'Unsupported Media Type', 503: 'Service Unavailable'}
+
+
+class Device(object):
+    """Состояние устройства: статические поля компактного формата и окно повторов"""
+    __slots__ = ('static', 'static_crc', 'seen', 'seen_order', 'requests')
+
+    def __init__(self):
+        self.static = {}
+        self.static_crc = None
+        self.seen = set()
+        self.seen_order = deque()
+        self.requests = 0
+
+    def first_time(self, mark):
+        """True, если показания с этой меткой еще не принимались"""
+        if mark in self.seen:
+            return False
+        self.seen.add(mark)
+        self.seen_order.append(mark)
+        if len(self.seen_order) > DEDUP_WINDOW:
+            self.seen.discard(self.seen_order.popleft())
+        return True
+
+
+class Stats(object):
+    def __init__(self):
+        self.requests = 0
+        self.readings = 0
+        self.duplicates = 0
+        self.queued = 0
+        self.espnow = 0
+        self.logs = 0
+        self.busy = 0
+        self.errors = 0
+        self.static_missing = 0
+        self.latency = []
+
+    def line(self, period, devices):
+        lat = sorted(self.latency)
+
+        def pct(p):
+            return lat[min(len(lat) - 1, int(len(lat) * p))] * 1000 if lat else 0.0
+
+        return ('{:.0f} req/s, requests {}, readings {}, duplicates {}, queue {}, espnow {}, logs {}, '
+                'busy {}, errors {}, static_missing {}, devices {}, latency p50 {:.2f} ms p99 {:.2f} ms').format(
+            self.requests / period, self.requests, self.readings, self.duplicates, self.queued, self.espnow,
+            self.logs, self.busy, self.errors, self.static_missing, devices, pct(0.5), pct(0.99))
+
+
+class Collector(object):
+    def __init__(self, args):
+        self.args = args
+        self.devices = {}
+        self.settings = {}
+        self.applied = set()  # устройства, подтвердившие текущие настройки
+        self.stats = Stats()
+        self.inflight = 0
+        self.out_queue = asyncio.Queue()
+        if args.settings:
+            with open(args.settings) as f:
+                self.settings = json.load(f)
+        if args.state and os.path.exists(args.state):
+            self.load_state()
+
+    # --- состояние между перезапусками ---
+
+    def load_state(self):
+        with open(self.args.state) as f:
+            state = json.load(f)
+        for token, s in state.items():
+            dev = self.devices[token] = Device()
+            dev.static = s['static']
+            dev.static_crc = s['sc']
+        print('State: {} devices'.format(len(self.devices)))
+
+    def save_state(self):
+        state = {token: {'static': dev.static, 'sc': dev.static_crc}
+                 for token, dev in self.devices.items() if dev.static_crc is not None}
+        tmp = self.args.state + '.tmp'
+        with open(tmp, 'w') as f:
+            json.dump(state, f)
+        os.replace(tmp, self.args.state)
+
+    # --- разбор данных ---
+
+    def device(self, token):
+        dev = self.devices.get(token)
+        if dev is None:
+            dev = self.devices[token] = Device()
+        return dev
+
+    def decode(self, headers, body):
+        if headers.get('content-type', '').startswith('application/msgpack'):
+            if msgpack is None:
+                raise ValueError('msgpack not installed')
+            return msgpack.unpackb(body, raw=False)
+        return json.loads(body.decode('utf-8'))
+
+    def merge_static(self, dev, data):
+        """Компактный формат: запоминает или подставляет статические поля"""
+        sc = data.get('sc')
+        if sc is None:
+            return
+        if 'esp_id' in data:
+            # статические поля пришли: их набор - всё, что не меняется между пробуждениями
+            dev.static = {k: v for k, v in data.items() if k in STATIC_KEYS}
+            dev.static_crc = sc
+        elif dev.static_crc == sc:
+            for k, v in dev.static.items():
+                data.setdefault(k, v)
+        else:
+            self.stats.static_missing += 1
+
+    def emit(self, dev, mark, record):
+        if not dev.first_time(mark):
+            self.stats.duplicates += 1
+            return
+        self.stats.readings += 1
+        if self.args.out:
+            self.out_queue.put_nowait(record)
+
+    def reading(self, token, data, now):
+        dev = self.device(token)
+        dev.requests += 1
+        esp_id = data.get('esp_id', token)
+        ts = parse_timestamp(data.get('timestamp')) or now
+
+        for point in data.pop('queue', None) or []:
+            if len(point) >= 4:
+                self.stats.queued += 1
+                self.emit(dev, point[0], {'esp_id': esp_id, 'ts': point[0], 'imp0': point[1],
+                                          'imp1': point[2], 'voltage': point[3] / 1000.0, 'queued': True})
+        data['esp_id'] = esp_id
+        data['ts'] = ts
+        self.emit(dev, ts, data)
+
+    def espnow(self, data, now):
+        for d in data.get('devices', []):
+            esp_id = d.get('esp_id')
+            self.stats.espnow += 1
+            d['ts'] = int(now - d.get('age', 0))
+            d['gateway'] = data.get('gateway')
+            self.emit(self.device('espnow:{}'.format(esp_id)), ('seq', d.get('seq')), d)
+
+    def response(self, token, data):
+        """
+        Настройки для устройства. Прошивка с config_rev получает только
+        отличающиеся от ее данных поля и новую ревизию, пока ревизия не совпадет;
+        прежняя - все настройки, пока не пришлет "settings_applied".
+        """
+        s = dict(self.settings.get('*', {}))
+        s.update(self.settings.get(token, {}))
+        s.update(self.settings.get(str(data.get('esp_id')), {}))
+        ota = s.pop('ota', None)
+        # обновление уже стоит: подтверждения OTA прошивка не присылает, смотрим на версию
+        target = s.pop('ota_version', None)
+        if target and target == data.get('version_esp'):
+            ota = None
+
+        if 'config_rev' in data:
+            rev = config_rev(s)
+            if data.get('settings_applied') or data['config_rev'] == rev:
+                s = {}
+            else:
+                s = {k: v for k, v in s.items() if data.get(k) != v}
+                s['config_rev'] = rev
+        elif data.get('settings_applied'):
+            self.applied.add(token)
+            return None
+        elif token in self.applied:
+            s = {}
+        if ota and not data.get('settings_applied'):
+            s['ota'] = ota
+        return s
+
+    def handle(self, method, path, headers, body):
+        if method == 'GET':
+            if path == '/ping':
+                return 200, b'pong', 'text/plain'
+            if path == '/stats':
+                return 200, json.dumps({'devices': len(self.devices), 'readings': self.stats.readings,
+                                        'duplicates': self.stats.duplicates}).encode(), 'application/json'
+            return 404, b'', 'text/plain'
+
+        token = headers.get('waterius-token', '')
+        if headers.get('content-encoding') == 'gzip':
+            self.stats.logs += 1
+            if self.args.logs:
+                name = os.path.join(self.args.logs, '{}.txt'.format(token or 'unknown'))
+                with open(name, 'ab') as f:
+                    f.write(gzip.decompress(body))
+            return 200, b'OK', 'text/plain'
+
+        data = self.decode(headers, body)
+        now = int(time.time())
+        if 'devices' in data:
+            self.espnow(data, now)
+            return 200, b'', 'text/plain'
+
+        token = token or data.get('key') or str(data.get('esp_id', ''))
+        self.merge_static(self.device(token), data)
+        settings = self.response(token, data)
+        if not data.get('settings_applied'):
+            self.reading(token, data, now)
+        if settings:
+            return 200, json.dumps(settings).encode(), 'application/json'
+        # прошивка с config_rev: настройки актуальны, тело не нужно
+        return (204 if 'config_rev' in data else 200), b'', 'text/plain'
+
+    # --- HTTP ---
+
+    async def connection(self, reader, writer):
+        try:
+            while True:
+                try:
+                    head = await asyncio.wait_for(reader.readuntil(b'\r\n\r\n'), HEADER_TIMEOUT)
+                except (asyncio.IncompleteReadError, asyncio.TimeoutError, asyncio.LimitOverrunError):
+                    break
+                started = time.monotonic()
+                lines = head.decode('latin-1').split('\r\n')
+                parts = lines[0].split(' ')
+                if len(parts) < 3:
+                    break
+                method, path, version = parts[0], parts[1], parts[2]
+                headers = {}
+                for line in lines[1:]:
+                    if ':' in line:
+                        k, v = line.split(':', 1)
+                        headers[k.strip().lower()] = v.strip()
+
+                # занятые запросы: от заголовка до отправки ответа, с ожиданием тела и сокета
+                self.inflight += 1
+                try:
+                    length = headers.get('content-length')
+                    if method == 'POST' and length is None:
+                        code, body, ctype = 411, b'', 'text/plain'
+                    elif length and int(length) > MAX_BODY:
+                        code, body, ctype = 413, b'', 'text/plain'
+                    else:
+                        body = await reader.readexactly(int(length)) if length else b''
+                        self.stats.requests += 1
+                        if method == 'POST' and self.inflight > self.args.max_inflight:
+                            self.stats.busy += 1
+                            code, body, ctype = 503, b'', 'text/plain'
+                        else:
+                            try:
+                                code, body, ctype = self.handle(method, path, headers, body)
+                            except Exception as err:
+                                self.stats.errors += 1
+                                code, body, ctype = 400, str(err).encode(), 'text/plain'
+                    keep = self.respond(writer, code, body, ctype, headers, version)
+                    await writer.drain()
+                finally:
+                    self.inflight -= 1
+                self.stats.latency.append(time.monotonic() - started)
+                if not keep:
+                    break
+        except (ConnectionError, asyncio.IncompleteReadError):
+            pass
+        finally:
+            writer.close()
+
+    def respond(self, writer, code, body, ctype, headers, version):
+        """Пишет ответ, True - соединение остается открытым"""
+        keep = headers.get('connection', '').lower() != 'close' and version == 'HTTP/1.1'
+        out = ['HTTP/1.1 {} {}'.format(code, REASONS.get(code, '')),
+               'Content-Type: ' + ctype,
+               'Content-Length: {}'.format(len(body)),
+               'Connection: ' + ('keep-alive' if keep else 'close')]
+        if code == 503:
+            out.append('Retry-After: {}'.format(self.args.retry_after))
+        writer.write(('\r\n'.join(out) + '\r\n\r\n').encode('latin-1') + body)
+        return keep
+
+    async def writer_task(self):
+        """Запись показаний пачками: один вызов write на много строк"""
+        with open(self.args.out, 'a') as f:
+            while True:
+                lines = [json.dumps(await self.out_queue.get())]
+                while not self.out_queue.empty() and len(lines) < WRITE_BATCH:
+                    lines.append(json.dumps(self.out_queue.get_nowait()))
+                f.write('\n'.join(lines) + '\n')
+                f.flush()
+
+    async def stats_task(self):
+        while True:
+            await asyncio.sleep(STATS_PERIOD)
+            print('{} {}'.format(datetime.now().strftime('%H:%M:%S'), self.stats.line(STATS_PERIOD, len(self.devices))))
+            if self.args.state:
+                self.save_state()
+            # за период: счетчики запросов и задержки заново
+            self.stats.requests = 0
+            self.stats.latency = []
+
+
+# Поля, которые прошивка отправляет только при изменении (STATIC_KEYS в json.cpp)
+STATIC_KEYS = frozenset((
+    'version', 'version_esp', 'model', 'esp_id', 'flash_id', 'mac', 'key', 'email', 'company', 'place',
+    'serial0', 'serial1', 'cname0', 'cname1', 'data_type0', 'data_type1', 'ctype0', 'ctype1', 'f0', 'f1',
+    'ch0_start', 'ch1_start', 'wifi_phy_mode_s', 'dhcp', 'mqtt', 'ha', 'http', 'mqtt_retain',
+    'voltage_cal', 'setuptime', 'setup_finished', 'period_min', 'period_lo', 'period_hi', 'config_rev'))
+
+
+def config_rev(settings):
+    """Ревизия набора настроек: crc32 JSON, 0 у прошивки - настроек не было"""
+    return zlib.crc32(json.dumps(settings, sort_keys=True).encode()) or 1
+
+
+def parse_timestamp(value):
+    """2019-11-29T23:29:55+0800 -> секунды UTC, None без NTP"""
+    if not isinstance(value, str):
+        return None
+    try:
+        ts = int(datetime.strptime(value, '%Y-%m-%dT%H:%M:%S%z').timestamp())
+    except ValueError:
+        return None
+    return ts if ts > 1600000000 else None
+
+
+async def main(args):
+    collector = Collector(args)
+    server = await asyncio.start_server(collector.connection, args.host, args.port,
+                                        backlog=args.backlog, limit=MAX_BODY)
+    tasks = [asyncio.ensure_future(collector.stats_task())]
+    if args.out:
+        tasks.append(asyncio.ensure_future(collector.writer_task()))
+    print('Listening {}:{}{}'.format(args.host, args.port, '' if msgpack else ', msgpack not installed'))
+    try:
+        async with server:
+            await server.serve_forever()
+    finally:
+        if args.state:
+            collector.save_state()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Waterius fleet collector')
+    parser.add_argument('--host', default='0.0.0.0', help='Ip address')
+    parser.add_argument('--port', type=int, default=10000, help='Port')
+    parser.add_argument('--out', default='readings.jsonl', help='Readings file (JSON lines), empty - do not store')
+    parser.add_argument('--logs', default='', help='Directory for uploaded wake logs')
+    parser.add_argument('--settings', default='', help='JSON file with settings for devices')
+    parser.add_argument('--state', default='', help='File with static fields of compact format')
+    parser.add_argument('--max-inflight', type=int, default=1000, help='Requests in progress before 503')
+    parser.add_argument('--retry-after', type=int, default=600, help='Retry-After seconds for 503')
+    parser.add_argument('--backlog', type=int, default=1024, help='Listen backlog')
+    args = parser.parse_args()
+    if sys.version_info < (3, 7):
+        sys.exit('Python 3.7+ required')
+    try:
+        asyncio.run(main(args))
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,329 @@
+# -*- coding: utf-8 -*-
+"""
+Нагрузка на сервер показаний от парка ватериусов.
+
+Каждое устройство просыпается по расписанию прошивки: период пробуждения
+считает tune_wakeup (ESP8266/src/config.cpp), attiny отсчитывает его
+со своей ошибкой часов, сдвиг в периоде (wakeup_slot_sec) - crc32 от esp_id.
+Устройства "настроены" в случайное время за --history-hours до начала,
+их расписание прокручивается без отправки, так что к старту нагрузки
+оно уже сошлось, как у живого парка.
+
+Время виртуальное: --speed 60 - минута расписания за секунду. Каждое
+пробуждение - новое соединение и POST, как у устройства:
+    - первое пробуждение полный JSON, дальше при --compact только
+      изменяемые поля с "sv" и "sc" (MessagePack, если установлен msgpack
+      и задан --msgpack);
+    - с вероятностью --offline показания не отправляются и уходят
+      позже в "queue";
+    - с вероятностью --dup запрос повторяется (ответ потерян), сервер
+      должен отбросить повтор;
+    - ответ с настройками применяется (period_min, config_rev) и подтверждается
+      "settings_applied", 204 - настройки актуальны, 503/429 переносит
+      следующее пробуждение по Retry-After.
+
+Пример вызова:
+    python3 collector.py --port 10000 --out ''
+    python3 loadgen.py --url http://127.0.0.1:10000/data --devices 20000 --period 15 --speed 60 --minutes 60 --compact
+"""
+import argparse
+import asyncio
+import heapq
+import json
+import math
+import random
+import struct
+import time
+import zlib
+from datetime import datetime, timezone
+from urllib.parse import urlparse
+
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
+
+JSON_SCHEMA_VERSION = 1
+SETUP_EPOCH = 1790000000  # начало виртуального времени
+
+
+def tune_wakeup(now, base_time, last_send, wakeup_per_min, period_min_tuned):
+    """Перенос tune_wakeup из config.cpp, время в секундах"""
+    actual_slept_min = (now - last_send) / 60.0
+
+    k_estimated = 1.0
+    if period_min_tuned > 0:
+        k_estimated = actual_slept_min / period_min_tuned
+
+    k_estimated = k_estimated - int(k_estimated)
+    if k_estimated < 0.7:
+        k_estimated += 1
+
+    time_since_base_min = (now - base_time) / 60.0
+    target_num = int(math.floor(time_since_base_min / wakeup_per_min)) + 1
+    next_expected = base_time + target_num * wakeup_per_min * 60
+    minutes_to_next = (next_expected - now) / 60.0
+
+    if minutes_to_next < 1.0 or minutes_to_next < wakeup_per_min * 0.3:
+        target_num += 1
+        next_expected = base_time + target_num * wakeup_per_min * 60
+        minutes_to_next = (next_expected - now) / 60.0
+
+    ideal = minutes_to_next
+    if k_estimated > 0.1:
+        ideal = minutes_to_next / k_estimated
+    # round() в C++ округляет половину от нуля
+    return min(int(math.floor(ideal + 0.5)), 0xFFFF)
+
+
+class Device(object):
+    def __init__(self, n, args, rnd):
+        self.n = n
+        self.esp_id = 10000000 + n
+        self.key = 'lg{:030x}'.format(n)
+        self.period = args.period
+        self.clock = rnd.uniform(1 - args.clock_error, 1 + args.clock_error)  # минута attiny в минутах
+        self.base_time = SETUP_EPOCH + rnd.uniform(0, args.history_hours * 3600)
+        self.slot = zlib.crc32(struct.pack('<I', self.esp_id)) % (self.period * 60)
+        self.period_tuned = self.period
+        self.last_send = self.base_time
+        self.wake = self.base_time + self.period * 60 * self.clock
+        self.imp0 = rnd.randint(0, 100000)
+        self.imp1 = rnd.randint(0, 100000)
+        self.static_crc = None
+        self.config_rev = 0
+        self.queue = []
+
+    def schedule(self, now, rnd):
+        """Конец пробуждения: период по tune_wakeup и сон на часах attiny"""
+        self.period_tuned = tune_wakeup(now, self.base_time + self.slot, self.last_send, self.period, self.period_tuned)
+        self.last_send = now
+        waketime = rnd.uniform(2, 6)
+        self.wake = now + waketime + self.period_tuned * 60 * self.clock
+
+    def defer(self, seconds):
+        """wakeup_defer: сервер занят"""
+        minutes = int(math.ceil(seconds / 60.0 / self.clock))
+        if minutes > self.period_tuned:
+            self.period_tuned = minutes
+
+    def static(self):
+        return {'version': 47, 'version_esp': '2.0.44', 'model': 1, 'esp_id': self.esp_id, 'flash_id': 1458400,
+                'mac': 'AA:AA:AA:{:02X}:{:02X}:{:02X}'.format((self.esp_id >> 16) & 0xFF, (self.esp_id >> 8) & 0xFF,
+                                                             self.esp_id & 0xFF),
+                'key': self.key, 'email': '', 'serial0': '', 'serial1': '', 'cname0': 0, 'cname1': 1,
+                'data_type0': 1, 'data_type1': 0, 'ctype0': 0, 'ctype1': 0, 'f0': 10, 'f1': 10,
+                'dhcp': True, 'mqtt': False, 'ha': False, 'http': True, 'period_min': self.period,
+                'config_rev': self.config_rev}
+
+    def payload(self, now, compact, rnd):
+        self.imp0 += rnd.choice((0, 0, 1, 3, 10))
+        self.imp1 += rnd.choice((0, 0, 1, 2))
+        data = {'imp0': self.imp0, 'imp1': self.imp1, 'ch0': self.imp0 / 100.0, 'ch1': self.imp1 / 100.0,
+                'voltage': round(rnd.uniform(2.9, 3.2), 3), 'rssi': rnd.randint(-85, -50), 'mode': 1,
+                'timestamp': datetime.fromtimestamp(int(now), timezone.utc).strftime('%Y-%m-%dT%H:%M:%S%z'),
+                'waketime': rnd.randint(1500, 6000), 'period_min_tuned': self.period_tuned}
+        static = self.static()
+        sc = zlib.crc32(json.dumps(static, sort_keys=True).encode())
+        if not compact or sc != self.static_crc:
+            data.update(static)
+        if compact:
+            data['sv'] = JSON_SCHEMA_VERSION
+            data['sc'] = sc
+        if self.queue:
+            data['queue'] = self.queue
+        return data, sc
+
+    def reading(self, now, data):
+        """Точка для очереди offline_queue: [timestamp, imp0, imp1, voltage_mv]"""
+        return [int(now), data['imp0'], data['imp1'], int(data['voltage'] * 1000)]
+
+
+class Stats(object):
+    def __init__(self):
+        self.sent = 0
+        self.ok = 0
+        self.busy = 0
+        self.errors = 0
+        self.offline = 0
+        self.dups = 0
+        self.acks = 0
+        self.empty = 0  # 204: настройки с ревизией config_rev актуальны
+        self.bytes = 0
+        self.latency = []
+        self.per_minute = {}  # виртуальная минута -> пробуждений
+
+
+async def post(url, headers, body, timeout):
+    """Один POST по новому соединению: код, заголовки, тело"""
+    port = url.port or (443 if url.scheme == 'https' else 80)
+    reader, writer = await asyncio.wait_for(
+        asyncio.open_connection(url.hostname, port, ssl=url.scheme == 'https'), timeout)
+    try:
+        head = ['POST {} HTTP/1.1'.format(url.path or '/'), 'Host: ' + url.hostname,
+                'User-Agent: ESP8266HTTPClient', 'Content-Length: {}'.format(len(body)), 'Connection: close']
+        head += ['{}: {}'.format(k, v) for k, v in headers.items()]
+        writer.write(('\r\n'.join(head) + '\r\n\r\n').encode('latin-1') + body)
+        await writer.drain()
+        response = await asyncio.wait_for(reader.read(), timeout)
+    finally:
+        writer.close()
+    status, _, rest = response.partition(b'\r\n')
+    header_text, _, content = rest.partition(b'\r\n\r\n')
+    parts = status.split(b' ')
+    code = int(parts[1]) if len(parts) > 1 else -1
+    resp_headers = {}
+    for line in header_text.decode('latin-1').split('\r\n'):
+        if ':' in line:
+            k, v = line.split(':', 1)
+            resp_headers[k.strip().lower()] = v.strip()
+    return code, resp_headers, content
+
+
+def encode(data, use_msgpack):
+    if use_msgpack:
+        return 'application/msgpack', msgpack.packb(data)
+    return 'application/json', json.dumps(data, separators=(',', ':')).encode()
+
+
+async def wake(dev, now, args, url, stats, rnd):
+    stats.per_minute[int(now // 60)] = stats.per_minute.get(int(now // 60), 0) + 1
+    data, sc = dev.payload(now, args.compact, rnd)
+
+    if rnd.random() < args.offline:
+        stats.offline += 1
+        dev.queue = (dev.queue + [dev.reading(now, data)])[-96:]  # OFFLINE_QUEUE_FILE_SIZE
+        dev.schedule(now, rnd)
+        return
+
+    ctype, body = encode(data, args.msgpack)
+    headers = {'Content-Type': ctype, 'Waterius-Token': dev.key, 'Waterius-Email': ''}
+    repeats = 2 if rnd.random() < args.dup else 1
+    for _ in range(repeats):
+        started = time.monotonic()
+        try:
+            code, resp_headers, content = await post(url, headers, body, args.timeout)
+        except (OSError, asyncio.TimeoutError):
+            stats.errors += 1
+            code = -1
+        stats.latency.append(time.monotonic() - started)
+        stats.sent += 1
+        stats.bytes += len(body)
+    stats.dups += repeats - 1
+
+    if code in (200, 204):
+        stats.ok += 1
+        stats.empty += code == 204
+        dev.queue = []
+        if args.compact:
+            dev.static_crc = sc
+        settings = json.loads(content) if content.startswith(b'{') else None
+        if settings:
+            changed = {}
+            if settings.get('config_rev', dev.config_rev) != dev.config_rev:
+                dev.config_rev = changed['config_rev'] = settings['config_rev']
+            if settings.get('period_min') and settings['period_min'] != dev.period:
+                dev.period = int(settings['period_min'])
+                dev.slot = zlib.crc32(struct.pack('<I', dev.esp_id)) % (dev.period * 60)
+                changed['period_min'] = dev.period
+            ack = {'key': dev.key, 'email': '', 'esp_id': dev.esp_id, 'version_esp': '2.0.44',
+                   'settings_applied': True}
+            ack.update(changed)
+            ctype, body = encode(ack, False)
+            try:
+                await post(url, {'Content-Type': ctype, 'Waterius-Token': dev.key}, body, args.timeout)
+                stats.acks += 1
+            except (OSError, asyncio.TimeoutError):
+                stats.errors += 1
+    else:
+        if code in (429, 503):
+            stats.busy += 1
+            try:
+                dev.defer(int(resp_headers.get('retry-after', 3600)))
+            except ValueError:
+                dev.defer(3600)
+        dev.queue = (dev.queue + [dev.reading(now, data)])[-96:]
+    dev.schedule(now, rnd)
+
+
+def report(stats, elapsed, start):
+    lat = sorted(stats.latency)
+
+    def pct(p):
+        return lat[min(len(lat) - 1, int(len(lat) * p))] * 1000 if lat else 0.0
+
+    minutes = [v for k, v in stats.per_minute.items() if k >= start // 60]
+    print('requests {} ({:.0f}/s), ok {} (204 {}), busy {}, errors {}, offline {}, dups {}, acks {}, {:.1f} KB'.format(
+        stats.sent, stats.sent / elapsed if elapsed else 0, stats.ok, stats.empty, stats.busy, stats.errors,
+        stats.offline, stats.dups, stats.acks, stats.bytes / 1024.0))
+    print('latency p50 {:.1f} ms, p95 {:.1f} ms, p99 {:.1f} ms, max {:.1f} ms'.format(
+        pct(0.5), pct(0.95), pct(0.99), lat[-1] * 1000 if lat else 0.0))
+    if minutes:
+        print('wakeups per virtual minute: avg {:.1f}, max {}'.format(sum(minutes) / float(len(minutes)),
+                                                                     max(minutes)))
+
+
+async def main(args):
+    rnd = random.Random(args.seed)
+    url = urlparse(args.url)
+    devices = [Device(n, args, rnd) for n in range(args.devices)]
+
+    # Прокрутка истории: расписание сходится до начала нагрузки
+    start = SETUP_EPOCH + args.history_hours * 3600
+    for dev in devices:
+        while dev.wake < start:
+            dev.schedule(dev.wake, rnd)
+    heap = [(dev.wake, n) for n, dev in enumerate(devices)]
+    heapq.heapify(heap)
+    print('{} devices, period {} min, virtual {} min at x{}'.format(args.devices, args.period, args.minutes,
+                                                                   args.speed))
+
+    stats = Stats()
+    limit = asyncio.Semaphore(args.connections)
+    tasks = set()
+    end = start + args.minutes * 60
+    real_start = time.monotonic()
+
+    async def run(dev, now):
+        async with limit:
+            await wake(dev, now, args, url, stats, rnd)
+        heapq.heappush(heap, (dev.wake, dev.n))
+
+    while heap and heap[0][0] < end:
+        now, n = heapq.heappop(heap)
+        delay = (now - start) / args.speed - (time.monotonic() - real_start)
+        if delay > 0:
+            await asyncio.sleep(delay)
+        task = asyncio.ensure_future(run(devices[n], now))
+        tasks.add(task)
+        task.add_done_callback(tasks.discard)
+        # пока пробуждение идет, в куче устройства нет; следующее добавит run()
+        while not heap and tasks:
+            await asyncio.sleep(0.01)
+    if tasks:
+        await asyncio.wait(tasks)
+
+    report(stats, time.monotonic() - real_start, start)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Waterius fleet load generator')
+    parser.add_argument('--url', default='http://127.0.0.1:10000/data', help='Server url')
+    parser.add_argument('--devices', type=int, default=1000, help='Devices')
+    parser.add_argument('--period', type=int, default=15, help='period_min')
+    parser.add_argument('--clock-error', type=float, default=0.1, help='Attiny clock error, part')
+    parser.add_argument('--history-hours', type=int, default=24, help='Schedule history before load')
+    parser.add_argument('--minutes', type=int, default=60, help='Virtual minutes of load')
+    parser.add_argument('--speed', type=float, default=60, help='Virtual seconds per real second')
+    parser.add_argument('--connections', type=int, default=500, help='Simultaneous connections')
+    parser.add_argument('--timeout', type=float, default=10, help='Request timeout, s')
+    parser.add_argument('--compact', action='store_true', help='Compact format (http_compact)')
+    parser.add_argument('--msgpack', action='store_true', help='MessagePack body for compact format')
+    parser.add_argument('--offline', type=float, default=0.02, help='Probability of failed wifi')
+    parser.add_argument('--dup', type=float, default=0.01, help='Probability of repeated request')
+    parser.add_argument('--seed', type=int, default=1, help='Random seed')
+    args = parser.parse_args()
+    if args.msgpack and (msgpack is None or not args.compact):
+        parser.error('--msgpack needs --compact and pip install msgpack')
+    asyncio.run(main(args))
@@ -58,6 +58,11 @@ def root():
     """
     try:
         print(datetime.utcnow())
+        if request.headers.get('Content-Encoding') == 'gzip':
+            # лог пробуждений с ошибками (настройка log_upload)
+            import gzip
+            print(gzip.decompress(request.data).decode('utf-8', 'replace'))
+            return 'OK'
         print(request.data)
         j = request.get_json()
         ret = 'OK' if j['ch0'] > 0 and j['ch1'] > 0 else 'ERROR null value'
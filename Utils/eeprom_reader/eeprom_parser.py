@@ -37,7 +37,13 @@ EEPROM layout (512 bytes, Attiny85):
                       type0: uint8_t (тип входа 0)
                       type1: uint8_t (тип входа 1)
   190-191   2       CRC-8 для каждого Config блока (v27+)
-  192-511   320     Не используется
+  192-503   312     Журнал показаний (v43+): 24 блока по 13 байт
+                      value0, value1: uint32_t (LE)
+                      seq: uint32_t - номер записи с начала работы
+                      crc: uint8_t - CRC-8 (init=0xFF) по value0, value1, seq
+                    Активный - блок с максимальным seq. В v43+ Data ring
+                    buffer по offset 0 только читается для переноса показаний.
+  504-511   8       Не используется
 
   В старых прошивках (v12-v26) по offset 180 хранился resets,
   по offset 181 — setup_started_counter (вне ring buffer).
@@ -69,6 +75,11 @@ CONFIG_CRC_START = CONFIG_START + CONFIG_SIZE * CONFIG_BLOCKS  # 190
 
 TOTAL_USED = CONFIG_CRC_START + CONFIG_BLOCKS            # 192
 
+SEQ_START = TOTAL_USED                                   # 192
+SEQ_BLOCK_SIZE = DATA_SIZE + 4 + 1                       # Data + seq + crc
+SEQ_BLOCKS = (512 - SEQ_START) // SEQ_BLOCK_SIZE         # 24
+EEPROM_ENDURANCE = 100000
+
 COUNTER_TYPE = {
     0: "NAMUR",
     1: "DISCRETE",
@@ -327,6 +338,41 @@ def parse_config_blocks(eeprom, fmt):
     return blocks, active
 
 
+def parse_seq_blocks(eeprom):
+    """Парсит журнал показаний v43+. Возвращает список блоков и индекс активного."""
+    blocks = []
+    active = -1
+    for i in range(SEQ_BLOCKS):
+        offset = SEQ_START + i * SEQ_BLOCK_SIZE
+        block_bytes = eeprom[offset:offset + SEQ_BLOCK_SIZE]
+        if len(block_bytes) < SEQ_BLOCK_SIZE:
+            break
+        value0, value1, seq, crc_stored = struct.unpack_from('<IIIB', block_bytes)
+        valid = crc_8(block_bytes[:-1]) == crc_stored
+        blocks.append({"index": i, "valid": valid, "value0": value0, "value1": value1, "seq": seq})
+        if valid and (active < 0 or seq > blocks[active]["seq"]):
+            active = i
+    return blocks, active
+
+
+def print_seq_table(seq_blocks, seq_active):
+    """Выводит журнал показаний v43+."""
+    if seq_active < 0:
+        return
+
+    print_header(f"ЖУРНАЛ ПОКАЗАНИЙ v43+ ({SEQ_BLOCKS} блоков × {SEQ_BLOCK_SIZE} байт)")
+    head = seq_blocks[seq_active]
+    total = EEPROM_ENDURANCE * SEQ_BLOCKS
+    print(f"  Показания вход 0 (value0): {head['value0']}")
+    print(f"  Показания вход 1 (value1): {head['value1']}")
+    print(f"  Записей: {head['seq']}, осталось ресурса: {max(total - head['seq'], 0)} ({100 * max(total - head['seq'], 0) // total}%)")
+    print(f"  {'#':>2}  {'value0':>10}  {'value1':>10}  {'seq':>10}  {'Статус'}")
+    for blk in seq_blocks:
+        marker = " <-- ACTIVE" if blk["index"] == seq_active else ""
+        status = "OK" if blk["valid"] else "BAD CRC"
+        print(f"  {blk['index']:>2}  {blk['value0']:>10}  {blk['value1']:>10}  {blk['seq']:>10}  {status}{marker}")
+
+
 # --- Display ---
 
 def fmt_counter_type(t):
@@ -461,6 +507,8 @@ def print_raw_dump(eeprom):
             label = f"  Config[{block_num}]"
         elif offset < TOTAL_USED:
             label = "  Config CRC"
+        elif offset < SEQ_START + SEQ_BLOCKS * SEQ_BLOCK_SIZE:
+            label = f"  Seq[{(offset - SEQ_START) // SEQ_BLOCK_SIZE}]"
 
         print(f"  {offset:04X}: {hex_part:<48s} |{ascii_part}|{label}")
 
@@ -498,6 +546,9 @@ def main():
     print_data_table(data_blocks, data_active, fmt)
     print_config_table(config_blocks, config_active)
 
+    seq_blocks, seq_active = parse_seq_blocks(eeprom)
+    print_seq_table(seq_blocks, seq_active)
+
     if args.hex_dump:
         print_raw_dump(eeprom)
 
@@ -1,151 +1,327 @@
 #include "Arduino.h"
+#include <Wire.h>
 
-#include "TaskScheduler.h"
+#include "crc.h"
 
-// 
-// Генератор импульсов для тестирования счетчика импульсов
-// 
-// Настройка:
-// диапазон длины импульса 
-// диапазон длины паузы 
-// 2 выхода
-// 
-// В случайном порядке импульсы будут поданы на выходы
-// 
+//
+// Бенчмарк точности счета импульсов attiny85
+//
+// Генератор подает на 2 выхода серии импульсов заданной длины и паузы,
+// от медленных до предела детектора входа, для типов DISCRETE, ELECTRONIC
+// и HALL. Arduino заменяет ESP: по сигналу питания ESP забирает показания
+// attiny по i2c, задает тип входов и период пробуждения 1 мин, поэтому
+// серии идут и во время сеансов связи. Перед частью серий attiny простаивает
+// несколько минут и успевает перейти на редкий опрос (watchdog 1-2с).
+//
+// Для каждой конфигурации печатается прирост показаний, пропущенные и
+// лишние импульсы. Конфигурации в пределах спецификации входа должны
+// сходиться точно, за пределами - только для сведения.
+//
+// Подключение (Nano на 3.3В или через преобразователь уровней):
+// выход 1 (D11) - вход 0 attiny, выход 2 (D12) - вход 1 attiny,
+// D2 - питание ESP (PB1 attiny), A4/A5 - SDA/SCL.
+//
 
-#define OUTPUT1_PIN 11 
+#define OUTPUT1_PIN 11
 #define OUTPUT2_PIN 12
+#define ESP_POWER_PIN 2
 
+#define I2C_SLAVE_ADDR 10
+#define I2C_CLOCK 50000L
+#define INIT_ATTINY_CRC 0xFF
+#define HEADER_SIZE 23 // 'D': заголовок одной транзакцией, последний байт - CRC
 
-#define RETRIES 10000
+#define WAKEUP_PER_MIN 1
+#define SETTLE_MS 3000 // attiny досчитывает последний импульс до чтения
 
-#define IMPULSE_MS_MIN 250+25
-#define IMPULSE_MS_MAX 3000
+// Типы входа attiny (CounterType)
+#define DISCRETE 1
+#define ELECTRONIC 2
+#define HALL 3
+#define NONE 0xFF
 
-#define WAIT_MS_MIN 750+75
-#define WAIT_MS_MAX 3000
-#define WAIT_BAD 120  //паузу меньше будем считать не импульсом (так считает ватериус)
+struct Config
+{
+	const char *name;
+	uint8_t type0;      // тип входа 0, NONE - выход 1 не используется
+	uint8_t type1;      // тип входа 1
+	uint16_t pulse_ms;  // замыкание
+	uint16_t pause_ms;  // размыкание
+	uint16_t count;     // импульсов в серии
+	uint16_t idle_s;    // простой перед серией
+	bool in_spec;       // детектор обязан считать без ошибок
+};
+
+static const Config configs[] = {
+	// DISCRETE: опрос watchdog 250мс, предел - 250мс замыкание + 750мс размыкание
+	{"discrete",      DISCRETE, DISCRETE,   1000, 1000,  100,   0, true},
+	{"discrete",      DISCRETE, DISCRETE,    500,  750,  100,   0, true},
+	{"discrete",      DISCRETE, DISCRETE,    250,  750,  200,   0, true},
+	{"discrete idle", DISCRETE, DISCRETE,    250,  750,   50, 180, true},
+	{"discrete",      DISCRETE, DISCRETE,    150,  500,  100,   0, false},
+	// ELECTRONIC: по прерыванию
+	{"electronic",    ELECTRONIC, ELECTRONIC, 100,  100,  500,   0, true},
+	{"electronic",    ELECTRONIC, ELECTRONIC,  20,   20, 1000,   0, true},
+	{"electronic",    ELECTRONIC, ELECTRONIC,   5,    5, 2000,   0, true},
+	{"electronic idle", ELECTRONIC, ELECTRONIC, 20,  20,  200, 180, true},
+	{"electronic",    ELECTRONIC, ELECTRONIC,   2,    2, 2000,   0, false},
+	// HALL: только вход 1, у входа 0 нет питания датчика
+	{"hall",          NONE, HALL,            100,  100,  500,   0, true},
+	{"hall",          NONE, HALL,             20,   20, 1000,   0, true},
+	{"hall idle",     NONE, HALL,             20,   20,  200, 180, true},
+	{"hall",          NONE, HALL,              5,    5, 1000,   0, false},
+};
+
+#define CONFIG_COUNT (sizeof(configs) / sizeof(configs[0]))
+
+enum Stage
+{
+	WAIT_CONFIG, // ждем пробуждения, чтобы задать тип входов
+	IDLE,        // attiny простаивает
+	PULSES,      // идет серия
+	WAIT_RESULT, // ждем пробуждения, чтобы прочитать показания
+	DONE
+};
 
-void WrapperStart();
-void ImpulseStart1();
-void ImpulseStop1();
-void ImpulseStart2();
-void ImpulseStop2();
-void TurnOn(uint8_t pin);
-void TurnOff(uint8_t pin);
+Stage stage = WAIT_CONFIG;
+uint8_t current = 0;
+uint32_t stage_ms = 0;
 
-Scheduler ts;
+uint32_t base0 = 0;
+uint32_t base1 = 0;
 
-uint32_t count1 = 0;
-uint32_t count2 = 0;
-float    total_hours = 0.0;
+uint16_t sent = 0;          // подано импульсов в серии
+bool level = false;         // выходы замкнуты
+uint32_t edge_ms = 0;       // время последнего переключения выходов
 
-Task tStart(0, TASK_ONCE, &WrapperStart, &ts, true);
-Task tImpulseOn1(0, TASK_ONCE, &ImpulseStart1, &ts, false);
-Task tImpulseOff1(0, TASK_ONCE, &ImpulseStop1, &ts, false);
-Task tImpulseOn2(0, TASK_ONCE, &ImpulseStart2, &ts, false);
-Task tImpulseOff2(0, TASK_ONCE, &ImpulseStop2, &ts, false);
+bool powered = false;
+uint16_t wakes = 0;         // сеансов связи за серию
+uint16_t i2c_errors = 0;    // ошибок чтения за серию
+uint8_t failed = 0;         // конфигураций в спецификации с ошибками
 
-void WrapperStart()
-{	
-	Serial.print(millis());
-	Serial.print(" : ");
-	Serial.println("Wrapper");
-	tImpulseOn1.restartDelayed(WAIT_MS_MIN + random(WAIT_MS_MAX-WAIT_MS_MIN));
-	tImpulseOn2.restartDelayed(WAIT_MS_MIN + random(WAIT_MS_MAX-WAIT_MS_MIN));
+uint8_t crc_8(const uint8_t *b, size_t num_bytes)
+{
+	return crc8<Crc8Nibble<> >(b, num_bytes, INIT_ATTINY_CRC);
 }
 
-void ImpulseStart1()
+bool sendData(const uint8_t *buf, uint8_t size)
 {
-	TurnOn(OUTPUT1_PIN);
-	tImpulseOff1.restartDelayed(IMPULSE_MS_MIN + random(IMPULSE_MS_MAX-IMPULSE_MS_MIN));
-	digitalWrite(LED_BUILTIN, LOW);
+	Wire.beginTransmission(I2C_SLAVE_ADDR);
+	Wire.write(buf, size);
+	return Wire.endTransmission() == 0;
 }
 
-void ImpulseStop1()
+bool sendCmd(uint8_t cmd)
 {
-	TurnOff(OUTPUT1_PIN);
+	return sendData(&cmd, 1);
+}
 
-	digitalWrite(LED_BUILTIN, HIGH);
-	if (random(1000) % 2)
+bool readCounters(uint32_t &imp0, uint32_t &imp1)
+{
+	uint8_t buf[HEADER_SIZE];
+
+	if (!sendCmd('D') || Wire.requestFrom(I2C_SLAVE_ADDR, HEADER_SIZE) != HEADER_SIZE)
 	{
-		if (count1 < RETRIES)
-		{
-			tImpulseOn1.restartDelayed(random(WAIT_BAD));
-		}
+		return false;
 	}
-	else
+	for (uint8_t i = 0; i < HEADER_SIZE; i++)
 	{
-		if (++count1 < RETRIES)
-		{
-			tImpulseOn1.restartDelayed(WAIT_MS_MIN + random(WAIT_MS_MAX-WAIT_MS_MIN));
-		}
+		buf[i] = Wire.read();
+	}
+	if (crc_8(buf, HEADER_SIZE - 1) != buf[HEADER_SIZE - 1])
+	{
+		return false;
 	}
+	memcpy(&imp0, &buf[10], sizeof(imp0));
+	memcpy(&imp1, &buf[14], sizeof(imp1));
+	return true;
 }
 
-void ImpulseStart2()
+bool setCountersType(uint8_t type0, uint8_t type1)
 {
-	TurnOn(OUTPUT2_PIN);
-	tImpulseOff2.restartDelayed(IMPULSE_MS_MIN + random(IMPULSE_MS_MAX-IMPULSE_MS_MIN));
-	digitalWrite(LED_BUILTIN, LOW);
+	uint8_t buf[4] = {'C', type0, type1, 0};
+	buf[3] = crc_8(&buf[1], 2);
+	return sendData(buf, sizeof(buf));
 }
 
-void ImpulseStop2()
+bool setWakeUpPeriod(uint16_t period)
 {
-	TurnOff(OUTPUT2_PIN);
-	if (++count2 < RETRIES)
-	{
-		digitalWrite(LED_BUILTIN, HIGH);
-		tImpulseOn2.restartDelayed(WAIT_MS_MIN + random(WAIT_MS_MAX-WAIT_MS_MIN));
-	}
+	uint8_t buf[4] = {'S', (uint8_t)(period >> 8), (uint8_t)period, 0};
+	buf[3] = crc_8(&buf[1], 2);
+	return sendData(buf, sizeof(buf));
 }
 
 void TurnOn(uint8_t pin)
 {
-	Serial.print(millis());
-	Serial.print(" : ");
-	Serial.print("ON ");
-	Serial.println(pin);
-
 	pinMode(pin, OUTPUT);
 	digitalWrite(pin, LOW);
 }
 
 void TurnOff(uint8_t pin)
-{	
-	Serial.print(millis());
-	Serial.print(" : ");
-	Serial.print("OFF ");
-	Serial.println(pin);
-
+{
 	digitalWrite(pin, HIGH);
 	pinMode(pin, INPUT);
 }
 
-void setup() 
+void setOutputs(bool on)
 {
-	Serial.begin(115200);
-	
-	total_hours = (IMPULSE_MS_MAX - IMPULSE_MS_MIN + WAIT_MS_MAX - WAIT_MS_MIN) / 2.0 / 1000.0 * RETRIES / 60.0 / 60.0;
-	Serial.print("Total time ~: ");
-	if (total_hours >= 1.0) 
+	const Config &c = configs[current];
+	level = on;
+	edge_ms = millis();
+	if (c.type0 != NONE)
+	{
+		on ? TurnOn(OUTPUT1_PIN) : TurnOff(OUTPUT1_PIN);
+	}
+	on ? TurnOn(OUTPUT2_PIN) : TurnOff(OUTPUT2_PIN);
+	digitalWrite(LED_BUILTIN, on ? HIGH : LOW);
+}
+
+void printConfig(const Config &c)
+{
+	char line[80];
+	snprintf(line, sizeof(line), "%-16s %5u/%-5u ms x%-5u idle %3us",
+			 c.name, c.pulse_ms, c.pause_ms, c.count, c.idle_s);
+	Serial.print(line);
+}
+
+void printChannel(uint8_t channel, uint32_t counted, uint16_t expected)
+{
+	char line[64];
+	int32_t delta = (int32_t)counted - expected;
+	snprintf(line, sizeof(line), " | in%u %5lu missed %4ld extra %4ld",
+			 channel, (unsigned long)counted, delta < 0 ? -delta : 0L, delta > 0 ? delta : 0L);
+	Serial.print(line);
+}
+
+void report(uint32_t imp0, uint32_t imp1)
+{
+	const Config &c = configs[current];
+	uint16_t expected0 = c.type0 != NONE ? c.count : 0;
+	bool ok = imp0 - base0 == expected0 && imp1 - base1 == c.count;
+
+	printConfig(c);
+	printChannel(0, imp0 - base0, expected0);
+	printChannel(1, imp1 - base1, c.count);
+	Serial.print(F(" | wakes "));
+	Serial.print(wakes);
+	Serial.print(F(" i2c err "));
+	Serial.print(i2c_errors);
+	Serial.println(ok ? F(" OK") : (c.in_spec ? F(" FAIL") : F(" (out of spec)")));
+
+	if (!ok && c.in_spec)
+	{
+		failed++;
+	}
+}
+
+// Следующая серия: задаем тип входов, показания сейчас - база
+void configure(uint32_t imp0, uint32_t imp1)
+{
+	const Config &c = configs[current];
+	if (!setCountersType(c.type0, c.type1) || !setWakeUpPeriod(WAKEUP_PER_MIN))
+	{
+		Serial.println(F("Config send failed, retry on next wake"));
+		return;
+	}
+	base0 = imp0;
+	base1 = imp1;
+	sent = 0;
+	wakes = 0;
+	i2c_errors = 0;
+	stage = IDLE;
+	stage_ms = millis();
+}
+
+// attiny включила ESP: читаем показания и отпускаем ее спать
+void onWake()
+{
+	uint32_t imp0, imp1;
+	if (!readCounters(imp0, imp1))
+	{
+		i2c_errors++;
+		sendCmd('Z');
+		return;
+	}
+	wakes++;
+
+	if (stage == WAIT_RESULT && millis() - stage_ms >= SETTLE_MS)
+	{
+		report(imp0, imp1);
+		if (++current >= CONFIG_COUNT)
+		{
+			Serial.print(F("Done, failed configurations: "));
+			Serial.println(failed);
+			stage = DONE;
+		}
+		else
+		{
+			stage = WAIT_CONFIG;
+		}
+	}
+	if (stage == WAIT_CONFIG)
+	{
+		configure(imp0, imp1);
+	}
+	sendCmd('Z');
+}
+
+void pulses()
+{
+	const Config &c = configs[current];
+	uint32_t now = millis();
+
+	if (level && now - edge_ms >= c.pulse_ms)
 	{
-		Serial.print(total_hours);
-		Serial.println(" hours");
+		setOutputs(false);
+		if (++sent >= c.count)
+		{
+			stage = WAIT_RESULT;
+			stage_ms = now;
+		}
 	}
-	else
+	else if (!level && now - edge_ms >= c.pause_ms)
 	{
-		Serial.print(total_hours * 60.0);
-		Serial.println(" minutes");
+		setOutputs(true);
 	}
-	
+}
+
+void setup()
+{
+	Serial.begin(115200);
+	Serial.println(F("Pulse accuracy benchmark, wait attiny wake up"));
+
+	pinMode(LED_BUILTIN, OUTPUT);
+	pinMode(ESP_POWER_PIN, INPUT);
 	pinMode(OUTPUT1_PIN, INPUT);
 	pinMode(OUTPUT2_PIN, INPUT);
-	randomSeed(analogRead(0) + millis());
+
+	Wire.begin();
+	Wire.setClock(I2C_CLOCK);
 }
 
-void loop() 
+void loop()
 {
-	pinMode(LED_BUILTIN, OUTPUT);
-	ts.execute();
+	bool power = digitalRead(ESP_POWER_PIN) == HIGH;
+	if (power && !powered && stage != DONE)
+	{
+		delay(50); // attiny включает i2c после подачи питания ESP
+		onWake();
+	}
+	powered = power;
+
+	switch (stage)
+	{
+	case IDLE:
+		if (millis() - stage_ms >= configs[current].idle_s * 1000UL)
+		{
+			stage = PULSES;
+			setOutputs(false);
+		}
+		break;
+	case PULSES:
+		pulses();
+		break;
+	default:
+		break;
+	}
 }
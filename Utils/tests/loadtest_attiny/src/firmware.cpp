@@ -0,0 +1,6 @@
+/*
+Обмен с attiny - модулями прошивки ESP8266 без изменений,
+чтобы стенд проверял тот же протокол, что уходит в устройства.
+*/
+#include "../../../../ESP8266/src/log_buffer.cpp"
+#include "../../../../ESP8266/src/master_i2c.cpp"
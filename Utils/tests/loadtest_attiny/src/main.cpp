@@ -1,136 +1,228 @@
 #include <Arduino.h>
+#include <Ticker.h>
+#include <Wire.h>
 
 #include "master_i2c.h"
-#include "logging.h"
 
+//
+// Бенчмарк связи ESP8266 - Attiny85 по i2c.
+//
+// Каждое пробуждение attiny прогоняет команды master_i2c.cpp на нескольких
+// частотах шины, пока на входы счетчиков подаются импульсы. Для каждой
+// команды выводится задержка (мин/сред/макс), ошибки шины и контрольной
+// суммы, переходы с чтения блоком на побайтное и пропускная способность.
+// В конце прохода показания attiny сверяются с количеством поданных импульсов.
+//
+// Подключение (D1 mini): SDA D2, SCL D1, вход 0 - D5, вход 1 - D6,
+// питание ESP от attiny - D7.
+//
 
 #define PIN_COUNTER0 D5
 #define PIN_COUNTER1 D6
 #define PIN_DETECT_POWER D7
-#define PIN_VIRT_BUTTON SCL
 
+#define ITERATIONS 200     // вызовов каждой команды на частоте
+#define PULSE_MS 300       // длительность импульса и паузы на входах
+#define WAKEUP_PER_MIN 1   // следующий проход через минуту
+#define SETTLE_MS (4 * PULSE_MS) // attiny досчитывает последний импульс
 
-MasterI2C masterI2C; // Для общения с Attiny85 по i2c
+static const uint32_t clocks[] = {50000L, 100000L, 200000L, 400000L};
 
-uint16_t wakeup_per_min = 5;
+MasterI2C masterI2C;
+AttinyData data;
 
-uint32_t impulses0 = 0;
-uint32_t impulses1 = 0;
+Ticker pulser;
+volatile bool pulse_level = false;
+volatile uint32_t pulses = 0; // Поданных импульсов на каждый вход
 
-SlaveData prev_data;
+uint32_t passes = 0;
 
+typedef bool (*CommandFunc)();
 
-bool communicate(SlaveData &data)
+struct Command
 {
-  LOG_INFO("Communicate");
+    const char *name;
+    CommandFunc run;
+    uint8_t cap; // ATTINY_CAP_*, без которой команду не вызываем
+};
 
-  memset(&data, 0, sizeof(data));
+static const uint8_t counter_tags[] = {ATTINY_TAG_COUNTERS};
 
-  masterI2C.begin();    //Включаем i2c master
+static const Command commands[] = {
+    {"getMode", []() { uint8_t mode; return masterI2C.getMode(mode); }, 0},
+    {"getAttinyData", []() { return masterI2C.getAttinyData(data); }, 0},
+    {"getFields", []() { return masterI2C.getFields(counter_tags, sizeof(counter_tags), data); }, ATTINY_CAP_FIELDS},
+    {"setWakeUpPeriod", []() { return masterI2C.setWakeUpPeriod(WAKEUP_PER_MIN); }, 0},
+};
 
-  uint8_t mode = SETUP_MODE;  // TRANSMIT_MODE;
-
-  if (masterI2C.getMode(mode) && masterI2C.getSlaveData(data)) { 
-    if (mode == SETUP_MODE) {   // Режим настройки 
-        
-        uint32_t start = millis();
-        #define SETUP_TIME 2000
-        while (millis() - start < SETUP_TIME) {
-            delay(300);
-        }
+struct Result
+{
+    uint16_t calls;
+    uint16_t fails;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t total_us;
+    MasterI2CStats link;
+};
+
+void pulse()
+{
+    pulse_level = !pulse_level;
+    digitalWrite(PIN_COUNTER0, pulse_level ? HIGH : LOW);
+    digitalWrite(PIN_COUNTER1, pulse_level ? HIGH : LOW);
+    if (!pulse_level)
+    {
+        ++pulses;
     }
-    if (mode == TRANSMIT_MODE) { // Проснулись для передачи показаний
-
-        if(!masterI2C.setWakeUpPeriod(wakeup_per_min)){
-            LOG_ERROR(F("Wakeup period wasn't set"));
-        } //"Разбуди меня через..."
-        else{
-            LOG_INFO(F("Wakeup period, min:") << wakeup_per_min);
-        }
-
-        uint32_t start = millis();
-        #define ESP_CONNECT_TIMEOUT 2000
-        while (millis() - start < ESP_CONNECT_TIMEOUT) {
-            delay(300);
-        }
-        
-        if (masterI2C.getSlaveData(data)) {  //т.к. в check_voltage не проверяем crc
-            
-        }
-    } 
-  }
-  else {
-    return false;
-  }
-  LOG_INFO(F("Going to sleep"));
-  masterI2C.sendCmd('Z');        // "Можешь идти спать, attiny"
-
-  delay(100);
-
-  return true;
 }
 
-void setup() {
-  LOG_BEGIN(115200);
-  LOG_INFO("Wait First wake up");
-
-  pinMode(PIN_DETECT_POWER, INPUT);
-  pinMode(PIN_COUNTER0, OUTPUT);
-  pinMode(PIN_COUNTER1, OUTPUT);
-
-  while (digitalRead(PIN_DETECT_POWER) != HIGH)
-    ;
-  LOG_INFO("First wake up OK");
-
-  communicate(prev_data);
-  impulses0 = prev_data.impulses0;
-  impulses1 = prev_data.impulses1;
+void start_pulses()
+{
+    pulse_level = false;
+    pulses = 0;
+    pulser.attach_ms(PULSE_MS, pulse);
+}
 
-  LOG_INFO("Start impulse0: " << impulses0);
-  LOG_INFO("Start impulse1: " << impulses1);
+uint32_t stop_pulses()
+{
+    pulser.detach();
+    if (pulse_level)
+    {
+        pulse(); // досчитываем начатый импульс
+    }
+    return pulses;
+}
 
-  delay(500);
+void run_command(const Command &cmd, Result &res)
+{
+    memset(&res, 0, sizeof(res));
+    res.min_us = UINT32_MAX;
+    masterI2C.resetStats();
+
+    for (uint16_t i = 0; i < ITERATIONS; i++)
+    {
+        uint32_t start = micros();
+        bool ok = cmd.run();
+        uint32_t elapsed = micros() - start;
+
+        res.calls++;
+        if (!ok)
+        {
+            res.fails++;
+        }
+        res.total_us += elapsed;
+        res.min_us = _min(res.min_us, elapsed);
+        res.max_us = _max(res.max_us, elapsed);
+        yield();
+    }
+    res.link = masterI2C.stats();
 }
 
-void impulse(uint8_t pin, uint32_t &counter) {
-  digitalWrite(pin, HIGH);
-  delay(random(500, 15000));
-  digitalWrite(pin, LOW);
-  ++counter;
+void print_header()
+{
+    Serial.printf("\n%7s %-16s %6s %5s %5s %5s %5s %7s %7s %7s %7s\n",
+                  "clock", "command", "calls", "fail", "crc", "bus", "bulk",
+                  "min us", "avg us", "max us", "B/s");
 }
 
-void check(SlaveData &data) {
+void print_result(uint32_t clock, const char *name, const Result &res)
+{
+    uint32_t avg = res.calls ? res.total_us / res.calls : 0;
+    uint32_t throughput = res.total_us ? (uint64_t)res.link.bytes * 1000000UL / res.total_us : 0;
+    Serial.printf("%7u %-16s %6u %5u %5u %5u %5u %7u %7u %7u %7u\n",
+                  clock, name, res.calls, res.fails, res.link.crc_errors, res.link.bus_errors,
+                  res.link.bulk_fallbacks, res.min_us, avg, res.max_us, throughput);
+}
 
-  if (data.impulses0 != impulses0) {
-    LOG_ERROR("we: " << impulses0 << " attiny: " << data.impulses0);
-  }
-  if (data.impulses1 != impulses1) {
-    LOG_ERROR("we: " << impulses1 << " attiny: " << data.impulses1);
-  }
+/**
+ * @brief Один проход бенчмарка за пробуждение attiny
+ *
+ * @return true attiny ответила и импульсы сошлись
+ */
+bool benchmark()
+{
+    masterI2C.begin();
 
-  if (data.resets != prev_data.resets) {
-    LOG_ERROR("resets: " << data.resets);
-  } 
+    uint8_t mode;
+    if (!masterI2C.getMode(mode) || !masterI2C.getAttinyData(data))
+    {
+        Serial.println(F("Attiny not responding"));
+        return false;
+    }
+    uint32_t base0 = data.impulses0;
+    uint32_t base1 = data.impulses1;
+    Serial.printf("\nPass %u: attiny v%u mode %u imp0 %u imp1 %u\n",
+                  ++passes, data.version, mode, base0, base1);
+
+    start_pulses();
+    print_header();
+    for (uint32_t clock : clocks)
+    {
+        // продлеваем бодрствование на штатной частоте, пока шина исправна
+        Wire.setClock(I2C_CLOCK);
+        masterI2C.extendWakeUp();
+        Wire.setClock(clock);
+
+        for (const Command &cmd : commands)
+        {
+            if (cmd.cap && !masterI2C.hasCapability(cmd.cap))
+            {
+                continue;
+            }
+            Result res;
+            run_command(cmd, res);
+            print_result(clock, cmd.name, res);
+        }
+    }
+    Wire.setClock(I2C_CLOCK);
 
-}
+    uint32_t driven = stop_pulses();
+    delay(SETTLE_MS);
 
-void loop() {
-  
-  if (digitalRead(PIN_DETECT_POWER) == HIGH) {
-    
-    wakeup_per_min = random(1, 100);
-
-    SlaveData data;
-    if (communicate(data)) {
-      check(data);
-      prev_data = data;
-    } else {
-      LOG_ERROR("Communicate error");
+    if (!masterI2C.getAttinyData(data))
+    {
+        Serial.println(F("Final read failed"));
+        return false;
+    }
+    uint32_t counted0 = data.impulses0 - base0;
+    uint32_t counted1 = data.impulses1 - base1;
+    Serial.printf("Pulses driven %u, counted %u / %u\n", driven, counted0, counted1);
+
+    masterI2C.setWakeUpPeriod(WAKEUP_PER_MIN);
+    masterI2C.setSleep(); // "Можешь идти спать, attiny"
+    delay(100);
+
+    if (counted0 != driven || counted1 != driven)
+    {
+        Serial.println(F("ERROR: pulses lost during i2c load"));
+        return false;
     }
+    return true;
+}
 
-  }
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println(F("\nWait attiny wake up"));
+
+    pinMode(PIN_DETECT_POWER, INPUT);
+    pinMode(PIN_COUNTER0, OUTPUT);
+    pinMode(PIN_COUNTER1, OUTPUT);
+    digitalWrite(PIN_COUNTER0, LOW);
+    digitalWrite(PIN_COUNTER1, LOW);
+}
 
-  impulse(PIN_COUNTER0, impulses0);
-  impulse(PIN_COUNTER1, impulses1);
-  delay(random(500, 5000));
-}
\ No newline at end of file
+void loop()
+{
+    if (digitalRead(PIN_DETECT_POWER) == HIGH)
+    {
+        benchmark();
+
+        // attiny снимает питание после 'Z'
+        while (digitalRead(PIN_DETECT_POWER) == HIGH)
+        {
+            delay(10);
+        }
+    }
+    delay(10);
+}
@@ -1,34 +1,246 @@
-#include <iostream>
+/*
+Симуляция хранилищ показаний attiny на ПК: годы импульсов, износ ячеек
+и отключение питания посреди записи.
+
+Хранилища берутся из прошивки без изменений (Attiny85/src/Storage.cpp),
+EEPROM - модель virtual_eeprom с подсчетом записей по ячейкам.
+Питание пропадает на случайном байте внутри add(), после чего хранилище
+создается заново, как после перезагрузки, и init() должен найти
+последние целые показания: записанные до add() или, если запись успела
+пройти, новые. Любое другое значение - ошибка.
+
+Сборка и запуск:
+	g++ -std=c++11 -O2 -fpack-struct -Imock -I../../../Attiny85/src -I../../../common main.cpp virtual_eeprom.cpp -o eeprom_sim
+	./eeprom_sim [лет=5] [блоков EEPROMStorage=20] [отключение раз в N записей=100] [seed=1]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
 #include <random>
-#include "Storage.h"
 
+#include "../../../Attiny85/src/Storage.cpp"
 
+#define MINUTES_IN_YEAR (365UL * 24 * 60)
+#define WAKEUP_PERIOD_MIN 15   // передача показаний, в конце периода attiny пишет показания
+#define FLOW_EVENTS_PER_DAY 8  // использований воды в сутки
+#define FLOW_MINUTES_MAX 10    // длительность использования
+#define PULSES_PER_MINUTE_MAX 6
+#define REPORT_ERRORS 10       // подробно выводим первые ошибки
 
-std::random_device rd;     // only used once to initialise (seed) engine
-std::mt19937 rng(rd());    // random-number engine used (Mersenne-Twister in this case)
-std::uniform_int_distribution<uint32_t> uni(0, 0xFFFFFFFF); // guaranteed unbiased
+std::mt19937 rng;
+
+uint32_t uniform(uint32_t lo, uint32_t hi)
+{
+	return std::uniform_int_distribution<uint32_t>(lo, hi)(rng);
+}
 
+// Единый интерфейс к EEPROMStorage и SeqStorage
+bool read(EEPROMStorage<Data> &s, Data &d) { return s.get(d); }
+bool read(SeqStorage<Data> &s, Data &d) { s.get(d); return true; }
 
-int main(int argc, char **argv)
+bool equal(const Data &a, const Data &b)
+{
+	return a.value0 == b.value0 && a.value1 == b.value1;
+}
+
+struct Result
+{
+	uint32_t adds = 0;
+	uint32_t power_losses = 0;
+	uint32_t errors = 0;
+	uint32_t reboots = 0;
+	uint32_t init_reads_max = 0;
+	uint64_t init_reads_total = 0;
+	uint64_t init_ns_total = 0;
+	uint64_t init_ns_max = 0;
+};
+
+/*
+Перезагрузка: новое хранилище, init() и чтение показаний.
+Время init() - по ПК, на attiny оно пропорционально числу чтений EEPROM.
+*/
+template <class S>
+bool reboot(const std::function<S()> &make, S &storage, Data &data, Result &res)
+{
+	storage = make();
+	uint32_t reads = eeprom_reads;
+	auto start = std::chrono::steady_clock::now();
+	bool ok = storage.init();
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	reads = eeprom_reads - reads;
+
+	res.reboots++;
+	res.init_reads_total += reads;
+	res.init_reads_max = std::max(res.init_reads_max, reads);
+	res.init_ns_total += ns;
+	res.init_ns_max = std::max(res.init_ns_max, ns);
+	return ok && read(storage, data);
+}
+
+/*
+Запись показаний с возможным отключением питания.
+Возвращает false, если после перезагрузки показания не те.
+*/
+template <class S>
+bool add(const std::function<S()> &make, S &storage, Data &committed, Data &current,
+		 uint32_t loss_every, Result &res)
 {
-	EEPROMStorage<Data> storage(4);
-	
-	Data d;
-	for (size_t i = 0; i < 100; i++)
+	res.adds++;
+	bool loss = uniform(1, loss_every) == 1;
+	if (loss)
 	{
-		d.value0 = d.value1 = uni(rng);
-		storage.add(d);
+		eeprom_power_budget = uniform(0, sizeof(Data) + 5); // блок, seq и crc
+		eeprom_torn_write = uniform(0, 1);
+	}
+	try
+	{
+		storage.add(current);
+		eeprom_power_budget = -1;
+		committed = current;
+		return true;
+	}
+	catch (const PowerLoss &)
+	{
+		eeprom_power_budget = -1;
+	}
 
-		EEPROMStorage<Data> storage2(4);
-		Data d2;
-		storage2.get(d2);
-		if (d.value0 != d2.value0 || d.value1 != d2.value1)
+	res.power_losses++;
+	Data recovered;
+	bool ok = reboot(make, storage, recovered, res) &&
+			  (equal(recovered, committed) || equal(recovered, current));
+	if (!ok && ++res.errors <= REPORT_ERRORS)
+	{
+		printf("  ERROR add #%u: before %u/%u, writing %u/%u, recovered %u/%u\n",
+			   res.adds, committed.value0, committed.value1, current.value0, current.value1,
+			   recovered.value0, recovered.value1);
+	}
+	// Импульсы после последней записи теряются, как на устройстве
+	committed = current = ok ? recovered : committed;
+	return ok;
+}
+
+// Поминутный трафик: запись не чаще раза в минуту при импульсах и в конце каждого периода
+template <class S>
+Result simulate(const std::function<S()> &make, uint32_t years, uint32_t loss_every)
+{
+	Result res;
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	memset(eeprom_cell_writes, 0, sizeof(eeprom_cell_writes));
+	eeprom_skipped = 0;
+
+	S storage = make();
+	Data committed = {0, 0};
+	Data current = committed;
+	if (!storage.init())
+	{
+		storage.add(current);
+	}
+
+	uint32_t flow_left = 0;
+	uint32_t flow_ppm = 0;
+	for (uint32_t minute = 0; minute < years * MINUTES_IN_YEAR; minute++)
+	{
+		if (!flow_left && uniform(1, 24 * 60 / FLOW_EVENTS_PER_DAY) == 1)
 		{
-			std::cout << "ERROR: i=" << i;
-			return 1;
+			flow_left = uniform(1, FLOW_MINUTES_MAX);
+			flow_ppm = uniform(1, PULSES_PER_MINUTE_MAX);
 		}
+		if (flow_left)
+		{
+			flow_left--;
+			current.value0 += uniform(0, flow_ppm);
+			current.value1 += uniform(0, flow_ppm);
+			if (!equal(current, committed))
+			{
+				add(make, storage, committed, current, loss_every, res);
+			}
+		}
+		if (minute % WAKEUP_PERIOD_MIN == 0)
+		{
+			add(make, storage, committed, current, loss_every, res);
+		}
+	}
 
+	Data last;
+	if (!reboot(make, storage, last, res) || !equal(last, committed))
+	{
+		printf("  ERROR final reboot: expected %u/%u\n", committed.value0, committed.value1);
+		res.errors++;
+	}
+	return res;
+}
+
+// Износ: максимум записей по ячейкам каждого блока
+void print_wear(uint16_t start, uint16_t block_size, uint16_t blocks, uint16_t marks, uint32_t years)
+{
+	uint32_t worst = 0;
+	for (uint16_t b = 0; b < blocks; b++)
+	{
+		uint32_t block_max = 0;
+		for (uint16_t i = 0; i < block_size; i++)
+		{
+			block_max = std::max(block_max, eeprom_cell_writes[start + b * block_size + i]);
+		}
+		uint32_t mark = marks ? eeprom_cell_writes[marks + b] : 0;
+		worst = std::max(worst, std::max(block_max, mark));
+		printf("  block %2u: data max %7u", b, block_max);
+		if (marks)
+		{
+			printf(", crc %7u", mark);
+		}
+		printf("\n");
 	}
-	std::cout << "OK";
-	return 0;
+	double per_year = (double)worst / years;
+	printf("  worst cell: %u writes, %.0f per year, endurance %lu reached in %.1f years\n",
+		   worst, per_year, EEPROM_ENDURANCE, per_year > 0 ? EEPROM_ENDURANCE / per_year : 0.0);
+}
+
+void print_result(const Result &res)
+{
+	printf("  adds %u, power losses %u, reboots %u, errors %u, skipped byte writes %u\n",
+		   res.adds, res.power_losses, res.reboots, res.errors, eeprom_skipped);
+	printf("  init(): reads avg %.1f max %u, host time avg %.2f us max %.2f us\n",
+		   res.reboots ? (double)res.init_reads_total / res.reboots : 0.0, res.init_reads_max,
+		   res.reboots ? res.init_ns_total / 1000.0 / res.reboots : 0.0, res.init_ns_max / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t years = argc > 1 ? atoi(argv[1]) : 5;
+	uint8_t blocks = argc > 2 ? atoi(argv[2]) : 20;
+	uint32_t loss_every = argc > 3 ? atoi(argv[3]) : 100;
+	uint32_t seed = argc > 4 ? atoi(argv[4]) : 1;
+
+	if (!years || !blocks || (uint32_t)blocks * (sizeof(Data) + 1) > E2END + 1 || !loss_every)
+	{
+		printf("usage: %s [years] [blocks <= %u] [loss_every] [seed]\n", argv[0],
+			   (unsigned)((E2END + 1) / (sizeof(Data) + 1)));
+		return 2;
+	}
+
+	uint32_t errors = 0;
+
+	rng.seed(seed);
+	printf("EEPROMStorage<Data>(%u), %u years, power loss every ~%u writes\n", blocks, years, loss_every);
+	std::function<EEPROMStorage<Data>()> make_ring = [blocks]() { return EEPROMStorage<Data>(blocks); };
+	Result ring = simulate(make_ring, years, loss_every);
+	print_result(ring);
+	print_wear(0, sizeof(Data), blocks, sizeof(Data) * blocks, years);
+	errors += ring.errors;
+
+	// Раскладка прошивки: журнал после EEPROMStorage<Data>(20) и EEPROMStorage<Config>(2)
+	uint16_t seq_start = EEPROMStorage<Data>(20).size() + EEPROMStorage<Config>(2).size();
+	uint16_t seq_block = sizeof(Data) + sizeof(uint32_t) + 1;
+	rng.seed(seed);
+	printf("\nSeqStorage<Data>(%u..%u), %u years, power loss every ~%u writes\n",
+		   seq_start, E2END + 1, years, loss_every);
+	std::function<SeqStorage<Data>()> make_seq = [seq_start]() { return SeqStorage<Data>(seq_start, E2END + 1); };
+	Result seq = simulate(make_seq, years, loss_every);
+	print_result(seq);
+	print_wear(seq_start, seq_block, (E2END + 1 - seq_start) / seq_block, 0, years);
+	errors += seq.errors;
+
+	printf(errors ? "\nFAILED\n" : "\nOK\n");
+	return errors ? 1 : 0;
 }
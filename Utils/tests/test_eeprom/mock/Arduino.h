@@ -0,0 +1,11 @@
+/*
+Заглушка Arduino.h для сборки Attiny85/src/Storage.cpp на ПК
+*/
+#ifndef _MOCK_ARDUINO_h
+#define _MOCK_ARDUINO_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#endif
@@ -0,0 +1 @@
+#include "../virtual_eeprom.h"
@@ -0,0 +1,6 @@
+#ifndef _MOCK_WDT_h
+#define _MOCK_WDT_h
+
+inline void wdt_reset() {}
+
+#endif
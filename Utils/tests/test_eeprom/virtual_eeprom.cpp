@@ -1,12 +1,27 @@
 #include "virtual_eeprom.h"
 
-uint8_t eeprom[512];
+uint8_t eeprom[E2END + 1];
+uint32_t eeprom_cell_writes[E2END + 1];
+uint32_t eeprom_reads = 0;
+int32_t eeprom_power_budget = -1;
+bool eeprom_torn_write = false;
 
 uint8_t eeprom_read_byte(uint8_t *idx) {
-	return eeprom[(uint8_t)(void*)idx];
+	eeprom_reads++;
+	return eeprom[(uintptr_t)idx & E2END];
 }
 void eeprom_write_byte(uint8_t *idx, uint8_t val) {
-	eeprom[(uint8_t)(void*)idx] = val;
+	uintptr_t i = (uintptr_t)idx & E2END;
+	if (eeprom_power_budget == 0) {
+		if (eeprom_torn_write) {
+			eeprom[i] = 0xFF;
+			eeprom_cell_writes[i]++;
+		}
+		throw PowerLoss();
+	}
+	if (eeprom_power_budget > 0) {
+		eeprom_power_budget--;
+	}
+	eeprom[i] = val;
+	eeprom_cell_writes[i]++;
 }
-
-
@@ -4,11 +4,26 @@
 #include "stdlib.h"
 #include "inttypes.h"
 
-#define E2END      0x7F
+#define E2END      0x1FF // attiny85: 512 байт
 
 uint8_t eeprom_read_byte(uint8_t *idx);
 void eeprom_write_byte(uint8_t *idx, uint8_t val);
 
+/*
+Модель EEPROM attiny85 для симуляции износа и отключения питания.
+eeprom_power_budget - сколько записей байт пройдет до отключения питания
+(-1 - не отключать). Запись, на которой пропало питание, не выполняется,
+а при eeprom_torn_write ячейка остается стертой (0xFF): AVR сначала стирает
+байт, потом пишет.
+*/
+struct PowerLoss {};
+
+extern uint8_t eeprom[E2END + 1];
+extern uint32_t eeprom_cell_writes[E2END + 1];
+extern uint32_t eeprom_reads;
+extern int32_t eeprom_power_budget;
+extern bool eeprom_torn_write;
+
 
 struct EERef {
 
@@ -16,12 +31,12 @@ struct EERef {
 		: index(index) {}
 
 	//Access/read members.
-	uint8_t operator*() const { return eeprom_read_byte((uint8_t*)index); }
+	uint8_t operator*() const { return eeprom_read_byte((uint8_t*)(uintptr_t)index); }
 	operator uint8_t() const { return **this; }
 
 	//Assignment/write members.
 	EERef &operator=(const EERef &ref) { return *this = *ref; }
-	EERef &operator=(uint8_t in) { return eeprom_write_byte((uint8_t*)index, in), *this; }
+	EERef &operator=(uint8_t in) { return eeprom_write_byte((uint8_t*)(uintptr_t)index, in), *this; }
 	EERef &operator +=(uint8_t in) { return *this = **this + in; }
 	EERef &operator -=(uint8_t in) { return *this = **this - in; }
 	EERef &operator *=(uint8_t in) { return *this = **this * in; }